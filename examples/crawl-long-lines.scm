@@ -0,0 +1,69 @@
+;
+; crawl-long-lines.scm -- crawling with grep, over very long lines.
+;
+; With a `grep` option, the `crawl` command of the FileSysStream gives
+; each line holding the grep string. Lines longer than 4096 bytes are
+; cut short, and their full length is given after the line number.
+; This builds a file with a 100MB line, and a file with 80MB of short
+; matching lines, and checks that both are reported, and that the
+; crawl does not fail; neither would fit in one message from a worker.
+;
+(use-modules (opencog) (opencog exec) (opencog sensory))
+(use-modules (srfi srfi-1))
+
+; -----------------------------------------------------------
+; Build the tree.
+(define test-dir "/tmp/sensory-crawl-long")
+(system (string-append "rm -rf " test-dir))
+(system (string-append "mkdir -p " test-dir "/a " test-dir "/b"))
+
+(define long-line
+	(string-append (make-string 4000 #\x) "NEEDLE"
+		(make-string (* 100 1024 1024) #\y)))
+(call-with-output-file (string-append test-dir "/a/long.txt")
+	(lambda (port)
+		(display "a short NEEDLE line\n" port)
+		(display long-line port)
+		(newline port)))
+
+(define short-line (string-append "NEEDLE" (make-string 3994 #\z)))
+(call-with-output-file (string-append test-dir "/b/many.txt")
+	(lambda (port)
+		(for-each (lambda (i) (display short-line port) (newline port))
+			(iota 20000))))
+
+(cog-execute!
+	(SetValue
+		(Anchor "long") (Predicate "fsys")
+		(Open (Type 'FileSysStream)
+			(Sensory (string-append "file://" test-dir)))))
+
+(define (fsys-cmd CMD)
+	(cog-execute! (Write (ValueOf (Anchor "long") (Predicate "fsys")) CMD)))
+
+; Everything on a stream, read until it is closed.
+(define (drain stream)
+	(define items (cog-value->list stream))
+	(if (null? items) '() (append items (drain stream))))
+
+; -----------------------------------------------------------
+; Each item is (URL, (FloatValue lineno [length]), line).
+(define found (drain (fsys-cmd
+	(List (Item "crawl") (Item "workers") (Number 2)
+		(Item "grep") (Item "NEEDLE")))))
+
+(define (where item) (cog-value->list (cog-value-ref item 1)))
+(define (text item) (cog-value-ref (cog-value-ref item 2) 0))
+
+(define cut (filter (lambda (item) (< 1 (length (where item)))) found))
+
+(format #t "~A matching lines; expect 20002\n" (length found))
+(format #t "~A cut short; expect 1\n" (length cut))
+(when (= 1 (length cut))
+	(format #t "line ~A was ~A bytes, ~A given; expect 2, ~A, 4096\n"
+		(first (where (car cut))) (second (where (car cut)))
+		(string-length (text (car cut))) (string-length long-line)))
+
+(system (string-append "rm -rf " test-dir))
+
+; The End! That's all folks!
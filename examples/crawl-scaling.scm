@@ -0,0 +1,72 @@
+;
+; crawl-scaling.scm -- how the crawl command scales with its workers.
+;
+; The `crawl` command of the FileSysStream reads every file in a tree,
+; with a pool of worker processes. This builds a tree of 16384 files,
+; of 8KB each, in 256 directories, and times a crawl of it with 1, 2,
+; 4 and 8 workers. Each run should report every file exactly once.
+;
+; Before the workers start, the tree is split into shares; the time
+; this takes is in the log, as "split in N ms". Run this on a machine
+; with at least 8 cores; the first run warms up the page cache, so
+; that the later ones measure CPU, and not the disk.
+;
+(use-modules (opencog) (opencog exec) (opencog sensory))
+(use-modules (srfi srfi-1))
+
+; -----------------------------------------------------------
+; Build the tree.
+(define bench-dir "/tmp/sensory-crawl-bench")
+(define page (make-string 8191 #\x))
+(system (string-append "rm -rf " bench-dir))
+(for-each
+	(lambda (d)
+		(define dir (format #f "~A/d~A/e~A" bench-dir (quotient d 16) (modulo d 16)))
+		(system (string-append "mkdir -p " dir))
+		(for-each
+			(lambda (f)
+				(call-with-output-file (format #f "~A/f~A.txt" dir f)
+					(lambda (port) (display page port) (newline port))))
+			(iota 64)))
+	(iota 256))
+
+(cog-execute!
+	(SetValue
+		(Anchor "bench") (Predicate "fsys")
+		(Open (Type 'FileSysStream)
+			(Sensory (string-append "file://" bench-dir)))))
+
+(define (fsys-cmd CMD)
+	(cog-execute! (Write (ValueOf (Anchor "bench") (Predicate "fsys")) CMD)))
+
+; Everything on a stream, read until it is closed.
+(define (drain stream)
+	(define items (cog-value->list stream))
+	(if (null? items) '() (append items (drain stream))))
+
+; -----------------------------------------------------------
+; Crawl with N workers; return the wall-clock time, in seconds, and
+; the number of files, and of distinct files, reported.
+(define (crawl N)
+	(define start (get-internal-real-time))
+	(define items (drain (fsys-cmd
+		(List (Item "crawl") (Item "workers") (Number N)))))
+	(define secs (exact->inexact
+		(/ (- (get-internal-real-time) start) internal-time-units-per-second)))
+	(define urls (map (lambda (lv) (cog-value-ref (cog-value-ref lv 0) 0)) items))
+	(define seen (make-hash-table))
+	(for-each (lambda (url) (hash-set! seen url #t)) urls)
+	(list secs (length urls) (hash-count (const #t) seen)))
+
+; Warm up the page cache.
+(crawl 8)
+
+(define base (car (crawl 1)))
+(for-each
+	(lambda (N)
+		(define run (crawl N))
+		(format #t "~A workers: ~,3F s, ~,2Fx, ~A files, ~A distinct\n"
+			N (first run) (/ base (first run)) (second run) (third run)))
+	'(1 2 4 8))
+
+; The End! That's all folks!
@@ -29,6 +29,61 @@ txt-stream
 
 ; Eventually, this will return an empty stream. This denotes end-of-file.
 
+; --------------------------------------------------------
+; Demo: Read the end of a file. A query string on the URL selects the
+; read mode. `?tail=N` returns the last N lines, in order, while
+; `?reverse` returns all of the lines, starting with the last one.
+; Both read backwards from the end of the file, so getting the tail
+; of a huge log file only reads the tail.
+(define tail-stream
+	(cog-execute!
+		(Open
+			(Type 'TextFileStream)
+			(SensoryNode "file:///tmp/demo.txt?tail=3"))))
+
+tail-stream
+tail-stream
+tail-stream
+tail-stream
+
+(define rev-stream
+	(cog-execute!
+		(Open
+			(Type 'TextFileStream)
+			(SensoryNode "file:///tmp/demo.txt?reverse"))))
+
+rev-stream
+rev-stream
+rev-stream
+
+; Records other than lines. The delimiter is percent-encoded, and may
+; be several bytes long. Here, records are blank-line separated
+; paragraphs. Use `?delim=%00` for the output of `find -print0`.
+; Records are returned whole, however long they are, each with its
+; delimiter, just as lines keep their newline.
+(define para-stream
+	(cog-execute!
+		(Open
+			(Type 'TextFileStream)
+			(SensoryNode "file:///tmp/demo.txt?delim=%0A%0A"))))
+
+para-stream
+para-stream
+
+; A random sample of lines. Only the pages holding the sampled lines
+; are read, so this is cheap even for huge files. The lines arrive in
+; file order. For an exactly uniform sample, build a line index first,
+; with the `lineindex` command of the FileSysStream (see filesys.scm).
+(define sample-stream
+	(cog-execute!
+		(Open
+			(Type 'TextFileStream)
+			(SensoryNode "file:///tmp/demo.txt?sample=3"))))
+
+sample-stream
+sample-stream
+sample-stream
+
 ; --------------------------------------------------------
 ; Demo: Perform indirect streaming. The file-stream will be placed
 ; as a Value on some Atom, where it can be accessed and processed.
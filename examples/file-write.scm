@@ -186,5 +186,25 @@
 ; The writer just invokes this second form in an infinite loop,
 ; until the end-of-file is reached, and then it halts.
 
+; --------------------------------------------------------
+; Demo: A log file that does not grow forever. The RotatingFileStream
+; is written to just like the TextFileStream, but it starts a new file
+; whenever the current one gets bigger than `size` or older than `age`
+; (in seconds). The old segments are compressed in the background.
+; The `index` keeps a list of the time range of each segment, in
+; `/tmp/transcript.log.segments`.
+(cog-execute!
+	(SetValue (Concept "log anchor") (Predicate "log place")
+		(Open (Type 'RotatingFileStream)
+			(Sensory "file:///tmp/transcript.log?size=4K&age=3600&index"))))
+
+(define log-writer
+	(WriteLink
+		(ValueOf (Concept "log anchor") (Predicate "log place"))
+		(Concept "Some chatter that goes on and on and on\n")))
+
+; Write it a few hundred times, and then look at `ls /tmp/transcript*`
+(for-each (lambda (i) (cog-execute! log-writer)) (iota 300))
+
 ; --------------------------------------------------------
 ; The End! That's All, Folks!
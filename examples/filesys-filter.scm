@@ -0,0 +1,84 @@
+;
+; filesys-filter.scm -- filtered directory listings, and a benchmark.
+;
+; The `ls` and `walk` commands of the FileSysStream accept name and
+; type filters. These are applied in C++, to the raw directory
+; entries, before any Values are created for them. This demo builds a
+; directory with 10000 files, of which 1% match the filter, and times
+; a filtered listing against the traditional approach of listing
+; everything and filtering in Atomese.
+;
+(use-modules (opencog) (opencog exec) (opencog sensory))
+(use-modules (srfi srfi-1))
+
+; -----------------------------------------------------------
+; Build a test directory. 9900 files named "data-N.dat" and 100 named
+; "code-N.scm".
+(define bench-dir "/tmp/sensory-filter-bench")
+(system (string-append "rm -rf " bench-dir "; mkdir -p " bench-dir "/sub"))
+(for-each
+	(lambda (n)
+		(close-port (open-output-file
+			(format #f "~A/~A-~A.~A" bench-dir
+				(if (< n 100) "code" "data") n (if (< n 100) "scm" "dat")))))
+	(iota 10000))
+(close-port (open-output-file (string-append bench-dir "/sub/nested.scm")))
+
+(cog-execute!
+	(SetValue
+		(Anchor "bench") (Predicate "fsys")
+		(Open (Type 'FileSysStream)
+			(Sensory (string-append "file://" bench-dir)))))
+
+(define (fsys-cmd CMD)
+	(cog-execute! (Write (ValueOf (Anchor "bench") (Predicate "fsys")) CMD)))
+
+; -----------------------------------------------------------
+; Some filters. Glob patterns follow the shell rules; a leading dot
+; must be matched explicitly.
+(fsys-cmd (List (Item "ls") (Item "glob") (Item "*.scm")))
+
+; POSIX extended regular expressions.
+(fsys-cmd (List (Item "ls") (Item "regex") (Item "^code-[0-9]+\\.scm$")))
+
+; Only subdirectories.
+(fsys-cmd (List (Item "ls") (Item "type") (Item "dir")))
+
+; Filters combine with ranking and paging.
+(fsys-cmd (List (Item "ls") (Item "glob") (Item "*.scm")
+	(Item "by") (Item "name") (Item "limit") (Number 5)))
+
+; The walk command descends into subdirectories. Filters select what
+; is reported; all subdirectories are visited regardless.
+(fsys-cmd (List (Item "walk") (Item "glob") (Item "*.scm")
+	(Item "type") (Item "file")))
+
+; -----------------------------------------------------------
+; The benchmark. Run each variant a number of times, and report the
+; average wall-clock time, in milliseconds.
+(define (time-it THUNK NREP)
+	(define start (get-internal-real-time))
+	(for-each (lambda (i) (THUNK)) (iota NREP))
+	(exact->inexact
+		(/ (* 1000 (- (get-internal-real-time) start))
+			(* NREP internal-time-units-per-second))))
+
+; Filter pushed down into the directory scan.
+(define (pushdown)
+	(fsys-cmd (List (Item "ls") (Item "glob") (Item "*.scm"))))
+
+; List everything, then filter the StringValues.
+(define (after-the-fact)
+	(filter
+		(lambda (sv) (string-suffix? ".scm" (cog-value-ref sv 0)))
+		(cog-value->list (fsys-cmd (Item "ls")))))
+
+(format #t "Matching entries: ~A pushed down, ~A after the fact\n"
+	(length (cog-value->list (pushdown)))
+	(length (after-the-fact)))
+
+(format #t "Pushed-down filter: ~,2F ms per listing\n" (time-it pushdown 20))
+(format #t "After-the-fact filter: ~,2F ms per listing\n"
+	(time-it after-the-fact 20))
+
+; The End! That's all folks!
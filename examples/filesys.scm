@@ -54,12 +54,81 @@
 (cog-execute! (Write (ValueOf (Anchor "xplor") (Predicate "fsys"))
 	(Item "ls")))
 
+; The ten newest files. Ranking is done while reading the directory,
+; so this is cheap even for huge directories. Sort by "name", "mtime"
+; or "size"; add (Item "reverse") to flip the order, and
+; (Item "offset") (Number 10) to get the next ten.
+(cog-execute! (Write (ValueOf (Anchor "xplor") (Predicate "fsys"))
+	(List (Item "ls") (Item "by") (Item "mtime") (Item "limit") (Number 10))))
+
 (cog-execute! (Write (ValueOf (Anchor "xplor") (Predicate "fsys"))
 	(List (Item "cd") (Item "file:///home"))))
 
 (cog-execute! (Write (ValueOf (Anchor "xplor") (Predicate "fsys"))
 	(Item "ls")))
 
+; Build a catalog of the current directory tree. The catalog is a
+; file that is kept up to date as the tree changes, for as long as
+; the stream is open. Other processes can search it instantly, without
+; walking the tree themselves.
+(cog-execute! (Write (ValueOf (Anchor "xplor") (Predicate "fsys"))
+	(Item "catalog")))
+
+; Search the catalog for paths containing a string. Each result is a
+; LinkValue holding the URL, the file type, and the size and mtime.
+(cog-execute! (Write (ValueOf (Anchor "xplor") (Predicate "fsys"))
+	(List (Item "locate") (Item ".bashrc"))))
+
+; Where is the bulk of the data? The du command walks the tree in
+; parallel, and returns a stream. Each directory appears on the stream
+; as soon as its subtree has been totaled, together with a FloatValue
+; of (disk-bytes apparent-bytes num-files num-dirs). The stream ends
+; with the starting directory. Running it again is fast, as listings
+; of unchanged directories are cached.
+(define du-stream
+	(cog-execute! (Write (ValueOf (Anchor "xplor") (Predicate "fsys"))
+		(Item "du"))))
+du-stream
+du-stream
+
+; What's in these files? The classify command sniffs the first page
+; of each file, in parallel, and replies with a stream of (url kind
+; format) triples, e.g. ("file:///tmp/foo.gz" "compressed" "gzip").
+; It takes the same filters as ls, or else a list of file URLs.
+(define kinds-stream
+	(cog-execute! (Write (ValueOf (Anchor "xplor") (Predicate "fsys"))
+		(List (Item "classify") (Item "glob") (Item "*.*")))))
+kinds-stream
+
+; Index the line starts of a file, so that a TextFileStream opened on
+; it with "?sample=K" takes an exactly uniform sample of K lines. The
+; index is kept in the per-user cache directory, and is ignored once
+; the file changes. This uses the demo.txt of file-read.scm.
+(cog-execute! (Write (ValueOf (Anchor "xplor") (Predicate "fsys"))
+	(List (Item "lineindex") (Item "file:///tmp/demo.txt"))))
+
+; Changing things. The mkdir, rename, unlink and copy commands take a
+; list of paths, and the batch command takes a list of these. They run
+; in the background, and reply with a stream of results, one per path.
+; Consecutive operations of the same kind are submitted together; when
+; the kind changes, the earlier ones are finished first. Plain names
+; are relative to the current directory.
+(define ops-stream
+	(cog-execute! (Write (ValueOf (Anchor "xplor") (Predicate "fsys"))
+		(List (Item "batch")
+			(List (Item "mkdir")
+				(Item "file:///tmp/sensory-demo/a/b")
+				(Item "file:///tmp/sensory-demo/c"))
+			(List (Item "copy")
+				(Item "file:///etc/hostname")
+				(Item "file:///tmp/sensory-demo/a/b/hostname"))
+			(List (Item "rename")
+				(Item "file:///tmp/sensory-demo/a/b/hostname")
+				(Item "file:///tmp/sensory-demo/c/hostname"))
+			(List (Item "unlink")
+				(Item "file:///tmp/sensory-demo/c/hostname"))))))
+ops-stream
+
 ; --------------------------------------------------------
 ; Now lets look at how the API for the above is represented.
 ; This builds a crude stimulus-reponse pipeline in scheme.
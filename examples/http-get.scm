@@ -0,0 +1,54 @@
+;
+; http-get.scm -- making requests to a local web server
+;
+; Demo of the HttpStream. Start a web server first, for example,
+;    python3 -m http.server 8000
+; in some directory with a few files in it.
+;
+(use-modules (opencog) (opencog exec) (opencog sensory))
+
+; --------------------------------------------------------
+; Open a client. The path in the URL is a prefix for all requests.
+; Up to two connections are kept open, and reused.
+(cog-execute!
+	(SetValue (Anchor "demo") (Predicate "web")
+		(Open (Type 'HttpStream)
+			(SensoryNode "http://localhost:8000/?pool=2"))))
+
+; A lone path is a GET. Writing returns a stream that holds the
+; response: first the status, reason and headers, then the body, a
+; piece at a time.
+(define listing
+	(cog-execute!
+		(Write (ValueOf (Anchor "demo") (Predicate "web"))
+			(Item "/"))))
+
+; Reading blocks until something has arrived. An empty value means
+; that the whole response has been read.
+listing
+listing
+
+; --------------------------------------------------------
+; Other methods are given in a List: method, path, and optionally a
+; body and header lines. The python server does not do POST, so this
+; gets back a 501 status.
+(define posted
+	(cog-execute!
+		(Write (ValueOf (Anchor "demo") (Predicate "web"))
+			(List (Item "POST") (Item "/") (Item "hello")
+				(Item "Content-Type: text/plain")))))
+posted
+
+; --------------------------------------------------------
+; Requests written one after another go out without waiting for the
+; answers, up to eight per connection. Here, several at once:
+(define (fetch path)
+	(cog-execute!
+		(Write (ValueOf (Anchor "demo") (Predicate "web")) (Item path))))
+
+(define responses (map fetch (list "/" "/" "/" "/" "/" "/")))
+(map (lambda (r) (cog-value-ref r 0)) responses)
+
+; The stream itself reports connections opened, requests, responses,
+; and requests that had to be sent again.
+(cog-execute! (ValueOf (Anchor "demo") (Predicate "web")))
@@ -0,0 +1,84 @@
+;
+; http-pipeline.scm -- checking pipelining and resending in HttpStream
+;
+; A test of the HttpStream against the stand-in server in this
+; directory, which answers pipelined requests in order, echoing each
+; request line, and can close the connection after every N answers.
+; Start two of them, one that keeps connections open, and one that
+; closes after every fifth answer:
+;    python3 http-test-server.py 8931 &
+;    python3 http-test-server.py 8932 5 &
+; Then load this file. Each check prints #t when it passes.
+;
+(use-modules (opencog) (opencog exec) (opencog sensory))
+(use-modules (srfi srfi-1))
+
+; Everything in a response, read until the ItemStream is closed.
+(define (drain stream)
+	(define items (cog-value->list stream))
+	(if (null? items) '() (append items (drain stream))))
+
+; The status code, and the body as one string.
+(define (status resp)
+	(inexact->exact (cog-value-ref (cog-value-ref (car resp) 0) 0)))
+(define (body resp)
+	(apply string-append
+		(map (lambda (sv) (cog-value-ref sv 0)) (cdr resp))))
+
+(define (open-client url)
+	(cog-execute!
+		(SetValue (Anchor "test") (Predicate "web")
+			(Open (Type 'HttpStream) (SensoryNode url)))))
+
+(define (fetch path)
+	(cog-execute!
+		(Write (ValueOf (Anchor "test") (Predicate "web")) (Item path))))
+
+(define (send method path)
+	(cog-execute!
+		(Write (ValueOf (Anchor "test") (Predicate "web"))
+			(List (Item method) (Item path) (Item "payload")))))
+
+; Write N requests at once, and then check that answer K is for
+; request K. Returns the number of correct answers.
+(define (pipeline n)
+	(define paths (map (lambda (k) (format #f "/p~A" k)) (iota n)))
+	(define resps (map fetch paths))
+	(count (lambda (path resp)
+			(equal? (body (drain resp)) (format #f "GET /api~A " path)))
+		paths resps))
+
+; --------------------------------------------------------
+; A server that keeps connections open.
+(open-client "http://127.0.0.1:8931/api?pool=2&depth=8")
+
+(equal? (body (drain (fetch "/status"))) "GET /api/status ")
+(equal? (body (drain (send "POST" "/jobs"))) "POST /api/jobs payload")
+(equal? (status (drain (fetch "/missing"))) 404)
+(equal? (length (drain (fetch "/chunked"))) 6)
+(equal? (body (drain (fetch "/eof"))) "until the end\n")
+
+; Controls and spaces in the path are percent-encoded, so that they
+; cannot end the request line, or add headers to it.
+(equal? (body (drain (fetch "/a b\r\nX-Evil: 1")))
+	"GET /api/a%20b%0D%0AX-Evil:%201 ")
+
+; A method that is not a token is refused.
+(catch #t (lambda () (send "GET /x" "/") #f) (lambda (key . args) #t))
+
+(define start (current-time))
+(= 2000 (pipeline 2000))
+(format #t "2000 pipelined requests in ~A seconds\n"
+	(- (current-time) start))
+
+; The server says how many requests it saw at once, at most.
+(body (drain (fetch "/stats")))
+
+; --------------------------------------------------------
+; A server that closes after every fifth answer. The requests in
+; flight behind the fifth must be sent again, on a new connection.
+(open-client "http://127.0.0.1:8932/api?pool=2&depth=8")
+(= 1000 (pipeline 1000))
+
+; (FloatValue connects requests responses retries)
+(cog-execute! (ValueOf (Anchor "test") (Predicate "web")))
@@ -0,0 +1,116 @@
+#! /usr/bin/env python3
+#
+# http-test-server.py -- stand-in web server for testing the HttpStream
+#
+# A minimal HTTP/1.1 server that reads pipelined requests, and answers
+# them in order. Every answer echoes the request line and the body, so
+# that the client can check that each response went with its request.
+# It can be told to close the connection after every N responses, to
+# test the client's resending of requests that were in flight.
+#
+# Usage:
+#    python3 http-test-server.py PORT [CLOSE_EVERY]
+#
+# Paths:
+#    /chunked   a chunked body, in five pieces, sent 10 msecs apart
+#    /eof       an HTTP/1.0 body that runs to the close of the connection
+#    /slow      an answer after 0.2 seconds
+#    /missing   a 404
+#    /stats     (connections requests max-pipelined) so far
+#    otherwise  "METHOD TARGET BODY"
+#
+# See http-pipeline.scm for the matching client.
+
+import socket, sys, threading, time
+
+port = int(sys.argv[1])
+close_every = int(sys.argv[2]) if 2 < len(sys.argv) else 0
+stats = {"conns": 0, "reqs": 0, "maxpipe": 0}
+lock = threading.Lock()
+
+def parse(buf):
+	"""Split off the complete requests at the front of the buffer."""
+	reqs = []
+	while True:
+		i = buf.find(b"\r\n\r\n")
+		if i < 0: break
+		lines = buf[:i].decode("latin-1").split("\r\n")
+		method, target, _ = lines[0].split(" ")
+		hdrs = {}
+		for ln in lines[1:]:
+			name, val = ln.split(":", 1)
+			hdrs[name.strip().lower()] = val.strip()
+		n = int(hdrs.get("content-length", "0"))
+		if len(buf) < i + 4 + n: break
+		reqs.append((method, target, buf[i+4:i+4+n]))
+		buf = buf[i+4+n:]
+	return reqs, buf
+
+def answer(s, method, target, body, last):
+	conn = b"Connection: close\r\n" if last else b""
+	if target.endswith("/chunked"):
+		s.sendall(b"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n" +
+			conn + b"\r\n")
+		for k in range(5):
+			piece = ("piece %d of %s\n" % (k, target)).encode()
+			s.sendall(b"%x\r\n%s\r\n" % (len(piece), piece))
+			time.sleep(0.01)
+		s.sendall(b"0\r\n\r\n")
+		return True
+	if target.endswith("/eof"):
+		s.sendall(b"HTTP/1.0 200 OK\r\n\r\nuntil the end\n")
+		return False
+	if target.endswith("/slow"):
+		time.sleep(0.2)
+	if target.endswith("/stats"):
+		with lock:
+			out = ("%d %d %d" % (stats["conns"], stats["reqs"],
+				stats["maxpipe"])).encode()
+	else:
+		out = (method + " " + target + " ").encode() + body
+	status = b"404 Not Found" if target.endswith("/missing") else b"200 OK"
+	if "HEAD" == method: out = b""
+	s.sendall(b"HTTP/1.1 " + status + b"\r\nContent-Length: " +
+		str(len(out)).encode() + b"\r\n" + conn + b"\r\n" + out)
+	return True
+
+def close(s):
+	"""Close gracefully, as servers should: closing at once, with more
+	requests unread, would reset the connection, and that can throw
+	away the answers that were sent just before."""
+	try:
+		s.shutdown(socket.SHUT_WR)
+		s.settimeout(1.0)
+		while s.recv(65536): pass
+	except OSError:
+		pass
+	s.close()
+
+def serve(s):
+	with lock: stats["conns"] += 1
+	buf = b""
+	served = 0
+	while True:
+		reqs, buf = parse(buf)
+		with lock:
+			stats["maxpipe"] = max(stats["maxpipe"], len(reqs))
+		for method, target, body in reqs:
+			served += 1
+			with lock: stats["reqs"] += 1
+			last = 0 < close_every and 0 == served % close_every
+			if not answer(s, method, target, body, last) or last:
+				close(s)
+				return
+		data = s.recv(65536)
+		if not data:
+			s.close()
+			return
+		buf += data
+
+ls = socket.socket()
+ls.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+ls.bind(("127.0.0.1", port))
+ls.listen(64)
+while True:
+	c, _ = ls.accept()
+	threading.Thread(target=serve, args=(c,), daemon=True).start()
@@ -95,6 +95,26 @@ irc-stream
 ; Low-level command: nicks of users in a channel
 (cog-execute! (Write bot (List (Concept "NAMES #opencog"))))
 
+; The queries above (LIST, NAMES, and also WHOIS and MODE) return a
+; stream, instead of mixing the server's replies into the bot stream.
+; Each reply is a StringValue holding the numeric reply code and its
+; arguments. Reading the stream blocks until replies arrive; it ends
+; when the server says it's done, or after 30 seconds, with a TIMEOUT.
+; Several queries can be in flight at once.
+(define whois (cog-execute! (Write bot (List (Concept "WHOIS") (Concept "linas")))))
+(define names (cog-execute! (Write bot (List (Concept "NAMES") (Concept "#opencog")))))
+whois
+names
+
+; The channel list is structured, as (channel users topic) triples,
+; and can be filtered. Here, channels with at least 100 users, and
+; "linux" in the name. The stream can be read while the list is still
+; arriving.
+(define chans (cog-execute! (Write bot
+	(List (Concept "LIST") (Concept "min") (Number 100)
+		(Concept "match") (Concept "*linux*")))))
+chans
+
 ; Low-level command: set channel topic.
 (cog-execute! (Write bot (List (Concept "TOPIC #opencog Who's an operator now"))))
 
@@ -102,5 +122,25 @@ irc-stream
 
 ; HELP is one of the IRC server commands.
 
+; Connection health: round-trip times of the PINGs sent to the server,
+; and how many went unanswered. This is answered locally, and is not
+; sent to the server. See opencog/atoms/irc/README.md for the fields.
+(cog-execute! (Write bot (List (Concept "PINGSTATS"))))
+
+; --------------------------------------------------------
+; A fleet of bots: three connections, each with its own nick, that
+; share out the channels that are joined. Messages from all of the
+; channels arrive on the one stream.
+(define fleet
+	(cog-execute!
+		(Open
+			(Type 'IRChatFleetStream)
+			(SensoryNode "irc://botty@irc.libera.chat:6667?pool=3"))))
+
+(cog-execute! (Write fleet (List (Concept "JOIN") (Concept "#opencog,#lojban"))))
+
+; Who is in which channel, and who is waiting for room.
+(cog-execute! (Write fleet (List (Concept "FLEET"))))
+
 ; --------------------------------------------------------
 ; The End! That's All, Folks!
@@ -0,0 +1,64 @@
+;
+; irc-fleet-test.scm -- channel placement and throughput of a fleet
+;
+; A test of the IRChatFleetStream against the stand-in server in this
+; directory. Start it first, allowing three channels per connection:
+;    python3 irc-test-server.py 16667 3
+; Then load this file. The server prints the channels that each nick
+; joins, and the channels that go with each dropped connection.
+;
+(use-modules (opencog) (opencog exec) (opencog sensory))
+
+(cog-execute!
+	(SetValue (Anchor "test") (Predicate "fleet")
+		(Open (Type 'IRChatFleetStream)
+			(SensoryNode "irc://b@127.0.0.1:16667?pool=3&rate=0&ping=0"))))
+
+(define fleet (ValueOf (Anchor "test") (Predicate "fleet")))
+(define (say . words)
+	(cog-execute! (Write fleet (List (map Concept words)))))
+
+(define (seconds-since start)
+	(exact->inexact (/ (- (get-internal-real-time) start)
+		internal-time-units-per-second)))
+
+; --------------------------------------------------------
+; Seven channels over three connections, at most three on each: they
+; should be placed 3, 2, 2.
+(sleep 1)
+(say "JOIN" "#a,#b,#c,#d,#e,#f,#g")
+(sleep 1)
+(say "FLEET")
+
+; When a connection is lost, its channels go to the others, as far
+; as they fit; the rest wait until it is back. Afterwards, there
+; should again be seven channels placed, and none waiting.
+(say "DROP b1")
+(sleep 3)
+(say "FLEET")
+
+; --------------------------------------------------------
+; Outbound: with rate=0 there is no flood limit, so this measures the
+; cost of the queues. The server's count comes back as a message.
+(define start (get-internal-real-time))
+(for-each
+	(lambda (i)
+		(say "PRIVMSG" (if (odd? i) "#a" "#c") (format #f "hello ~A" i)))
+	(iota 30000))
+(format #t "Queued 30000 messages in ~A seconds\n" (seconds-since start))
+
+; The messages go out over two connections, and STATS over any one of
+; them, so the count may be a little short of all of them, if asked
+; too soon.
+(define (read-msg) (cog-value->list (cog-execute! fleet)))
+(sleep 1)
+(say "STATS")
+(read-msg)
+
+; --------------------------------------------------------
+; Inbound: the server sends 30000 messages over all of the joined
+; channels, and they are read off the one stream.
+(set! start (get-internal-real-time))
+(say "BLAST 30000")
+(for-each (lambda (i) (read-msg)) (iota 30000))
+(format #t "Read 30000 messages in ~A seconds\n" (seconds-since start))
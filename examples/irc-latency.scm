@@ -0,0 +1,47 @@
+;
+; irc-latency.scm -- receive latency of the IRChatStream, with and
+; without busy-polling
+;
+; A loopback driver, for the stand-in server in this directory. Start
+; it first:
+;    python3 irc-test-server.py 16667
+; Then load this file. Two streams are opened, one in the default
+; mode, and one with `busypoll`. Each sends messages to the server's
+; "echo" nick, one at a time, and reads each one back before sending
+; the next. Then the time from the arrival of each message to its
+; being read is printed: the median, and the 99th percentile.
+;
+; Busy-polling only helps when there are cores to spare: the I/O
+; thread and the reader each spin on a core of their own. On a
+; machine with one core, it makes things worse.
+;
+(use-modules (opencog) (opencog exec) (opencog sensory))
+
+(define (measure name url n)
+	(cog-execute!
+		(SetValue (Anchor "test") (Predicate name)
+			(Open (Type 'IRChatStream) (SensoryNode url))))
+	(define bot (ValueOf (Anchor "test") (Predicate name)))
+
+	; Give it time to log in.
+	(sleep 1)
+
+	; Send a numbered message, and read until it comes back. Other
+	; things may arrive first, such as the server's welcome.
+	(define (ping-pong i)
+		(define tag (format #f "ping ~A" i))
+		(cog-execute! (Write bot
+			(List (Concept "PRIVMSG") (Concept "echo") (Concept tag))))
+		(let loop ()
+			(define msg (cog-value->list (cog-execute! bot)))
+			(if (not (equal? tag (cog-value-ref (list-ref msg 2) 0)))
+				(loop))))
+	(for-each ping-pong (iota n))
+
+	; (samples p50 p90 p99 max), in microseconds
+	(define lat (cog-execute! (Write bot (List (Concept "LATENCY")))))
+	(format #t "~A: p50 ~A usec, p99 ~A usec, over ~A messages\n" name
+		(cog-value-ref lat 1) (cog-value-ref lat 3) (cog-value-ref lat 0)))
+
+(measure "default" "irc://lat1@127.0.0.1:16667?rate=0&ping=0" 3000)
+(measure "busypoll" "irc://lat2@127.0.0.1:16667?rate=0&ping=0&busypoll" 3000)
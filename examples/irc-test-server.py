@@ -0,0 +1,114 @@
+#! /usr/bin/env python3
+#
+# irc-test-server.py -- stand-in IRC server for testing the IRC streams
+#
+# Just enough of an IRC server to log in, join channels and pass
+# messages, with a few extra commands for driving tests. It is not
+# an IRC server; there is no routing between clients.
+#
+# Usage:
+#    python3 irc-test-server.py PORT [CHANLIMIT]
+#
+# Each client is told, in the 005 reply, that it may join CHANLIMIT
+# channels (default 3). Besides NICK, USER, JOIN, PART, PING, QUIT and
+# PRIVMSG, it understands:
+#    BLAST n    send n PRIVMSGs, spread over all of the joined channels
+#    DROP nick  close the connection of that nick
+#    STATS      answer with a PRIVMSG of "privmsgs N clients M"
+# A PRIVMSG to the nick "echo" is sent straight back to the sender.
+#
+# See irc-fleet-test.scm and irc-latency.scm for the matching clients.
+
+import selectors, socket, sys, time
+
+port = int(sys.argv[1])
+chanlimit = int(sys.argv[2]) if 2 < len(sys.argv) else 3
+
+sel = selectors.DefaultSelector()
+clients = {}
+privmsgs = 0
+
+def send(c, line):
+	c.setblocking(True)
+	c.sendall((line + "\r\n").encode())
+	c.setblocking(False)
+
+def drop(c):
+	sel.unregister(c)
+	del clients[c]
+	c.close()
+
+def command(c, st, line):
+	global privmsgs
+	w = line.split(" ")
+	cmd = w[0].upper()
+	nick = st["nick"]
+	if "NICK" == cmd:
+		st["nick"] = w[1]
+		send(c, ":srv 001 %s :Welcome" % w[1])
+		send(c, ":srv 005 %s CHANLIMIT=#:%d :are supported" %
+			(w[1], chanlimit))
+		send(c, ":srv 376 %s :End of MOTD" % w[1])
+	elif "JOIN" == cmd:
+		for ch in w[1].split(","):
+			st["chans"].add(ch)
+			send(c, ":%s!bot@localhost JOIN %s" % (nick, ch))
+		print("JOIN", nick, w[1], flush=True)
+	elif "PART" == cmd:
+		for ch in w[1].split(","):
+			st["chans"].discard(ch)
+	elif "PING" == cmd:
+		send(c, ":srv PONG srv " + " ".join(w[1:]))
+	elif "QUIT" == cmd:
+		drop(c)
+	elif "PRIVMSG" == cmd:
+		privmsgs += 1
+		if "echo" == w[1]:
+			send(c, ":echo!e@localhost PRIVMSG %s %s" %
+				(nick, " ".join(w[2:])))
+	elif "BLAST" == cmd:
+		chans = [(cc, ch) for cc, s in clients.items()
+			for ch in sorted(s["chans"])]
+		for i in range(int(w[1])):
+			cc, ch = chans[i % len(chans)]
+			send(cc, ":u!u@localhost PRIVMSG %s :msg %d" % (ch, i))
+	elif "DROP" == cmd:
+		for cc, s in list(clients.items()):
+			if s["nick"] == w[1]:
+				print("DROP", w[1], sorted(s["chans"]), flush=True)
+				drop(cc)
+	elif "STATS" == cmd:
+		send(c, ":srv!s@localhost PRIVMSG %s :privmsgs %d clients %d" %
+			(nick, privmsgs, len(clients)))
+
+ls = socket.socket()
+ls.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+ls.bind(("127.0.0.1", port))
+ls.listen(64)
+ls.setblocking(False)
+sel.register(ls, selectors.EVENT_READ)
+
+while True:
+	for key, _ in sel.select():
+		if key.fileobj is ls:
+			c, _ = ls.accept()
+			c.setblocking(False)
+			c.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+			sel.register(c, selectors.EVENT_READ)
+			clients[c] = {"buf": b"", "nick": "*", "chans": set()}
+			continue
+		c = key.fileobj
+		st = clients[c]
+		try:
+			data = c.recv(65536)
+		except BlockingIOError:
+			continue
+		except ConnectionError:
+			data = b""
+		if not data:
+			drop(c)
+			continue
+		st["buf"] += data
+		while b"\r\n" in st["buf"] and c in clients:
+			line, st["buf"] = st["buf"].split(b"\r\n", 1)
+			command(c, st, line.decode(errors="replace"))
@@ -0,0 +1,58 @@
+;
+; remote-stream.scm -- sharing a stream with other processes
+;
+; Demo of publishing a stream with a StreamServer, and reading it from
+; another process with a RemoteStream. The stream is read only once,
+; by the server; every subscriber gets a copy of what is read.
+;
+(use-modules (opencog) (opencog exec) (opencog sensory))
+
+; --------------------------------------------------------
+; In the first guile session: start a server, listening on a Unix
+; socket. `tcp://127.0.0.1:7722` works too.
+(define server
+	(cog-execute!
+		(Open
+			(Type 'StreamServer)
+			(SensoryNode "unix:///tmp/cog-streams.sock"))))
+
+; Put the server where Atomese can find it.
+(cog-set-value! (Anchor "demo") (Predicate "server") server)
+
+; Open the stream to be shared. Here, an xterm: whatever is typed
+; into it will be shared. An IRC channel would be more interesting.
+(cog-execute!
+	(SetValue (Anchor "demo") (Predicate "text")
+		(Open (Type 'TerminalStream))))
+
+; Publish it, under the name "demo". From here on, the server reads
+; the stream; nothing else should.
+(cog-execute!
+	(Write (ValueOf (Anchor "demo") (Predicate "server"))
+		(List (Item "publish") (Item "demo")
+			(ValueOf (Anchor "demo") (Predicate "text")))))
+
+; Reading the server reports on what it publishes: the name, and
+; the number of subscribers, items, frames and bytes sent so far.
+server
+
+; --------------------------------------------------------
+; In a second guile session (or a third, or a fourth...): subscribe.
+(define remote
+	(cog-execute!
+		(Open
+			(Type 'RemoteStream)
+			(SensoryNode "unix:///tmp/cog-streams.sock?stream=demo"))))
+
+; Lines arrive as they are read by the server. Reading blocks until
+; something arrives, and then gives everything that has arrived.
+; Type some lines into the xterm, and then read.
+remote
+remote
+
+; --------------------------------------------------------
+; Back in the first session: stop publishing. The subscribers read
+; whatever is left, and then get an empty value.
+(cog-execute!
+	(Write (ValueOf (Anchor "demo") (Predicate "server"))
+		(List (Item "unpublish") (Item "demo"))))
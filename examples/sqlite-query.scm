@@ -0,0 +1,76 @@
+;
+; sqlite-query.scm -- querying an SQLite database
+;
+; Demo of the SqliteStream. A small database is created in /tmp, and
+; then read back, a batch of rows at a time.
+;
+(use-modules (opencog) (opencog exec) (opencog sensory))
+
+; --------------------------------------------------------
+; Open the database, creating the file if it is not there. Each read
+; will give at most three rows, to make the batching visible.
+(cog-execute!
+	(SetValue (Anchor "demo") (Predicate "db")
+		(Open (Type 'SqliteStream)
+			(SensoryNode "sqlite:///tmp/demo.db?create&batch=3"))))
+
+(define (sql stmt)
+	(cog-execute! (Write (ValueOf (Anchor "demo") (Predicate "db")) stmt)))
+
+; Statements that give no rows are run at once. They return a row of
+; the number of rows changed, and the last rowid inserted.
+(sql (Item "CREATE TABLE IF NOT EXISTS pets (name TEXT, kind TEXT, age)"))
+
+; Values for the `?` parameters follow the SQL. Since the SQL is the
+; same each time, it is prepared only once, and the prepared statement
+; is reused.
+(define (add-pet name kind age)
+	(sql (List (Item "INSERT INTO pets VALUES (?, ?, ?)")
+		(Concept name) (Concept kind) (Number age))))
+
+(add-pet "Tom" "cat" 3)
+(add-pet "Rex" "dog" 7)
+(add-pet "Polly" "parrot" 41)
+(add-pet "Felix" "cat" 12)
+(add-pet "Nemo" "fish" 1)
+
+; --------------------------------------------------------
+; Queries give nothing when written; the rows are read from the stream.
+(sql (Item "SELECT name, kind, age FROM pets ORDER BY age"))
+
+; Each read steps the cursor, and gives the next batch: here, three
+; rows, and then two. Each row is a LinkValue, one Value per column.
+; An empty value means that all rows have been read.
+(cog-execute! (ValueOf (Anchor "demo") (Predicate "db")))
+(cog-execute! (ValueOf (Anchor "demo") (Predicate "db")))
+(cog-execute! (ValueOf (Anchor "demo") (Predicate "db")))
+
+; --------------------------------------------------------
+; Parameters work for queries, too.
+(sql (List (Item "SELECT name FROM pets WHERE kind = ?") (Concept "cat")))
+(cog-execute! (ValueOf (Anchor "demo") (Predicate "db")))
+
+; --------------------------------------------------------
+; Integers bigger than 2^53 can't be held exactly in a FloatValue, so
+; they are given as StringValues of their digits. Passed back in as
+; text, they are compared as integers with an INTEGER column.
+(sql (Item "CREATE TABLE IF NOT EXISTS ids (id INTEGER PRIMARY KEY)"))
+(sql (Item "INSERT INTO ids VALUES (9007199254740993)"))
+(sql (Item "SELECT id FROM ids"))
+(cog-execute! (ValueOf (Anchor "demo") (Predicate "db")))
+(sql (List (Item "SELECT id + 1 FROM ids WHERE id = ?")
+	(Item "9007199254740993")))
+(cog-execute! (ValueOf (Anchor "demo") (Predicate "db")))
+(sql (Item "DROP TABLE ids"))
+
+; --------------------------------------------------------
+; A query that is not read to the end keeps its read transaction open,
+; and, until then, blocks writers to the file. Writing the next
+; statement lets go of it.
+(sql (Item "SELECT name FROM pets"))
+(cog-execute! (ValueOf (Anchor "demo") (Predicate "db")))
+(sql (Item "SELECT 1"))
+(cog-execute! (ValueOf (Anchor "demo") (Predicate "db")))
+
+; Clean up.
+(sql (Item "DROP TABLE pets"))
@@ -0,0 +1,63 @@
+;
+; topic-bus.scm -- publishing to, and subscribing to, named topics
+;
+; Demo of the in-process topic bus. Sources publish into named topics;
+; readers subscribe to a topic, or to a pattern of topics, without
+; having to know where the items come from.
+;
+(use-modules (opencog) (opencog exec) (opencog sensory))
+
+; --------------------------------------------------------
+; Subscribe first; subscribers only get what is published later.
+; This one gets everything under "percept/", with the topic name
+; attached to each item.
+(define all-percepts
+	(cog-execute!
+		(Open
+			(Type 'TopicStream)
+			(SensoryNode "topic://percept/*?tag"))))
+
+; This one gets only direct messages, and keeps at most 100 of them.
+; Giving a queue size asks to read; so would `?read`.
+(define dms
+	(cog-execute!
+		(Open
+			(Type 'TopicStream)
+			(SensoryNode "topic://percept/dm?queue=100"))))
+
+; --------------------------------------------------------
+; Publishers. Without `?read`, a TopicStream only publishes, and keeps
+; no queue of its own.
+(cog-execute!
+	(SetValue (Anchor "demo") (Predicate "dm")
+		(Open (Type 'TopicStream)
+			(SensoryNode "topic://percept/dm"))))
+
+(cog-execute!
+	(SetValue (Anchor "demo") (Predicate "file")
+		(Open (Type 'TopicStream)
+			(SensoryNode "topic://percept/file-changed"))))
+
+; Each thing written is one item.
+(cog-execute!
+	(Write (ValueOf (Anchor "demo") (Predicate "dm"))
+		(Item "hello there")))
+
+(cog-execute!
+	(Write (ValueOf (Anchor "demo") (Predicate "file"))
+		(Item "/tmp/foo.txt")))
+
+; Reading gives everything published since the last read.
+dms
+all-percepts
+
+; --------------------------------------------------------
+; A whole stream can be published: here, what is typed into an
+; xterm. From here on, the bus reads the xterm; nothing else should.
+(cog-execute!
+	(Write (ValueOf (Anchor "demo") (Predicate "dm"))
+		(Open (Type 'TerminalStream))))
+
+; Type some lines into the xterm, and then read. This blocks until
+; something arrives.
+dms
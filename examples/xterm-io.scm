@@ -93,5 +93,23 @@ term-stream
 
 (cog-execute! (Lookat (Type 'TerminalStream)))
 
+; --------------------------------------------------------
+; Screen mode: a status display. The ScreenStream keeps a copy of
+; the screen, and sends only what changed, at most 20 times a second.
+(cog-set-value! (Concept "xterm anchor") (Predicate "screen")
+	(cog-execute! (Open (Type 'ScreenStream) (Sensory "screen://?fps=20"))))
+
+(define (status cpu mem)
+	(cog-execute!
+		(Write (ValueOf (Concept "xterm anchor") (Predicate "screen"))
+			(List (Item "region") (Number 1) (Number 2) (Number 2) (Number 30)
+				(Item (format #f "cpu: ~a%\nmem: ~a%" cpu mem))))))
+
+; Each of these rewrites the whole region; only the digits that
+; changed are sent to the xterm.
+(status 12 40)
+(status 13 40)
+(status 13 41)
+
 ; --------------------------------------------------------
 ; The End! That's All, Folks!
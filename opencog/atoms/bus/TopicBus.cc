@@ -0,0 +1,254 @@
+/*
+ * opencog/atoms/bus/TopicBus.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <map>
+
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include "TopicBus.h"
+
+using namespace opencog;
+
+TopicBus::Subscriber::Subscriber(const std::string& pat, bool tag,
+                                 size_t maxq) :
+	pattern(pat), is_pattern(TopicBus::is_pattern(pat)), tagged(tag),
+	max_queue(maxq), nwaiting(0), closed(false), overflowing(false),
+	dropped(0)
+{
+}
+
+void TopicBus::Subscriber::put(const ValuePtr* vals, size_t n)
+{
+	bool warn = false;
+	uint64_t ndropped;
+	size_t nwake;
+	{
+		std::lock_guard<std::mutex> lck(mtx);
+		if (closed) return;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (max_queue <= queue.size())
+			{
+				queue.pop_front();
+				dropped ++;
+				warn = not overflowing;
+				overflowing = true;
+			}
+			queue.push_back(vals[i]);
+		}
+		ndropped = dropped;
+
+		// Once woken, readers no longer count as waiting, so that
+		// further items don't signal them again before they run.
+		nwake = nwaiting;
+		nwaiting = 0;
+	}
+	if (nwake) cv.notify_all();
+
+	if (warn)
+		SENSORY_WARN("TopicBus: subscriber to \"%s\" is falling behind; "
+			"dropped %" PRIu64 " so far", pattern.c_str(), ndropped);
+}
+
+/// Wait until there is something, then take all of it. Returns false
+/// if the subscription was closed, and nothing is left.
+bool TopicBus::Subscriber::take_all(std::deque<ValuePtr>& out)
+{
+	std::unique_lock<std::mutex> lck(mtx);
+	while (queue.empty() and not closed)
+	{
+		nwaiting ++;
+		cv.wait(lck);
+	}
+	if (queue.empty()) return false;
+	out.swap(queue);
+	overflowing = false;
+	return true;
+}
+
+void TopicBus::Subscriber::close(void)
+{
+	std::lock_guard<std::mutex> lck(mtx);
+	closed = true;
+	cv.notify_all();
+}
+
+// ==============================================================
+
+namespace {
+
+struct Bus
+{
+	std::mutex mtx;
+	std::map<std::string, TopicBus::TopicPtr> topics;
+	std::vector<TopicBus::SubscriberPtr> patterns;
+};
+
+Bus& bus(void)
+{
+	static Bus b;
+	return b;
+}
+
+bool matches(const TopicBus::SubscriberPtr& sub, const std::string& name)
+{
+	if (sub->is_pattern)
+		return 0 == fnmatch(sub->pattern.c_str(), name.c_str(), 0);
+	return sub->pattern == name;
+}
+
+/// Replace the topic's subscriber list with a copy, with `add` added
+/// (if not null) and `rem` removed (if not null). Bus lock is held.
+void change_subs(const TopicBus::TopicPtr& topic,
+                 const TopicBus::SubscriberPtr& add,
+                 const TopicBus::SubscriberPtr& rem)
+{
+	TopicBus::SubscriberListPtr old = topic->get_subs();
+	auto fresh = std::make_shared<TopicBus::SubscriberList>();
+	fresh->any_tagged = false;
+	for (const TopicBus::SubscriberPtr& sub : old->subs)
+	{
+		if (sub == rem) continue;
+		fresh->subs.push_back(sub);
+		fresh->any_tagged |= sub->tagged;
+	}
+	if (add)
+	{
+		fresh->subs.push_back(add);
+		fresh->any_tagged |= add->tagged;
+	}
+	std::lock_guard<std::mutex> lck(topic->mtx);
+	topic->subs = std::move(fresh);
+}
+
+/// Find or make the topic. Bus lock is held.
+TopicBus::TopicPtr get_topic(Bus& b, const std::string& name)
+{
+	auto it = b.topics.find(name);
+	if (b.topics.end() != it) return it->second;
+
+	TopicBus::TopicPtr topic(std::make_shared<TopicBus::Topic>());
+	topic->name = name;
+	topic->tag = createStringValue(name);
+
+	auto subs = std::make_shared<TopicBus::SubscriberList>();
+	subs->any_tagged = false;
+	for (const TopicBus::SubscriberPtr& sub : b.patterns)
+	{
+		if (not matches(sub, name)) continue;
+		subs->subs.push_back(sub);
+		subs->any_tagged |= sub->tagged;
+	}
+	topic->subs = std::move(subs);
+
+	b.topics.emplace(name, topic);
+	return topic;
+}
+
+} // namespace
+
+// ==============================================================
+
+bool TopicBus::is_pattern(const std::string& name)
+{
+	return std::string::npos != name.find_first_of("*?[");
+}
+
+TopicBus::TopicPtr TopicBus::topic(const std::string& name)
+{
+	Bus& b = bus();
+	std::lock_guard<std::mutex> lck(b.mtx);
+	return get_topic(b, name);
+}
+
+void TopicBus::subscribe(const SubscriberPtr& sub)
+{
+	Bus& b = bus();
+	std::lock_guard<std::mutex> lck(b.mtx);
+	if (not sub->is_pattern)
+	{
+		change_subs(get_topic(b, sub->pattern), sub, nullptr);
+		return;
+	}
+
+	// Topics made later pick up the pattern in get_topic().
+	b.patterns.push_back(sub);
+	for (const auto& pr : b.topics)
+		if (matches(sub, pr.first))
+			change_subs(pr.second, sub, nullptr);
+}
+
+void TopicBus::unsubscribe(const SubscriberPtr& sub)
+{
+	Bus& b = bus();
+	{
+		std::lock_guard<std::mutex> lck(b.mtx);
+		if (sub->is_pattern)
+		{
+			b.patterns.erase(
+				std::remove(b.patterns.begin(), b.patterns.end(), sub),
+				b.patterns.end());
+			for (const auto& pr : b.topics)
+				if (matches(sub, pr.first))
+					change_subs(pr.second, nullptr, sub);
+		}
+		else
+		{
+			auto it = b.topics.find(sub->pattern);
+			if (b.topics.end() != it)
+				change_subs(it->second, nullptr, sub);
+		}
+	}
+
+	// Publishers that loaded the old list may still deliver to it;
+	// closing makes that a no-op, and wakes any reader.
+	sub->close();
+}
+
+void TopicBus::publish(const TopicPtr& topic, const ValuePtr* vals,
+                       size_t n)
+{
+	if (0 == n) return;
+
+	SubscriberListPtr subs = topic->get_subs();
+	if (subs->subs.empty()) return;
+
+	// Tagged subscribers all share one copy of the pairs.
+	ValueSeq tagged;
+	if (subs->any_tagged)
+	{
+		tagged.reserve(n);
+		for (size_t i = 0; i < n; i++)
+			tagged.emplace_back(
+				createLinkValue(ValueSeq({topic->tag, vals[i]})));
+	}
+
+	for (const SubscriberPtr& sub : subs->subs)
+	{
+		if (sub->tagged) sub->put(tagged.data(), n);
+		else sub->put(vals, n);
+	}
+}
@@ -0,0 +1,127 @@
+/*
+ * opencog/atoms/bus/TopicBus.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_TOPIC_BUS_H
+#define _OPENCOG_TOPIC_BUS_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencog/atoms/value/Value.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * The process-wide topic bus. Publishers put Values into named topics;
+ * subscribers get them from a topic, or from all topics matching a
+ * glob pattern. Nothing is copied: every subscriber gets the same
+ * ValuePtr. Each subscriber has its own bounded queue; when it is
+ * full, the oldest item is dropped, so that a slow reader never holds
+ * up the publishers, or the other readers.
+ *
+ * Publishing does not take the bus lock. Each topic holds its list of
+ * subscribers as an immutable vector, which is replaced, not changed,
+ * when someone subscribes or leaves; publishers only copy the pointer.
+ *
+ * TopicStream is the Atomese interface to this.
+ */
+class TopicBus
+{
+public:
+	struct Subscriber
+	{
+		std::string pattern;    // Topic name, or glob pattern.
+		bool is_pattern;
+		bool tagged;            // Deliver (topic, item) pairs.
+		size_t max_queue;
+
+		std::mutex mtx;
+		std::condition_variable cv;
+		std::deque<ValuePtr> queue;
+		size_t nwaiting;
+		bool closed;
+		bool overflowing;
+		uint64_t dropped;
+
+		Subscriber(const std::string&, bool tagged, size_t max_queue);
+		void put(const ValuePtr*, size_t);
+		bool take_all(std::deque<ValuePtr>&);
+		void close(void);
+	};
+	typedef std::shared_ptr<Subscriber> SubscriberPtr;
+
+	struct SubscriberList
+	{
+		std::vector<SubscriberPtr> subs;
+		bool any_tagged;
+	};
+	typedef std::shared_ptr<const SubscriberList> SubscriberListPtr;
+
+	struct Topic
+	{
+		std::string name;
+		ValuePtr tag;           // The name, as a StringValue.
+
+		// Replaced under the bus lock and `mtx`; publishers take a
+		// copy of the pointer under `mtx` only. A plain mutex is
+		// cheaper here than std::atomic_load() on the shared_ptr.
+		std::mutex mtx;
+		SubscriberListPtr subs;
+
+		SubscriberListPtr get_subs(void)
+		{
+			std::lock_guard<std::mutex> lck(mtx);
+			return subs;
+		}
+	};
+	typedef std::shared_ptr<Topic> TopicPtr;
+
+	/// Glob characters make a pattern; anything else names one topic.
+	static bool is_pattern(const std::string&);
+
+	/// Get the topic, creating it if need be. Topics are never removed.
+	static TopicPtr topic(const std::string&);
+
+	static void subscribe(const SubscriberPtr&);
+	static void unsubscribe(const SubscriberPtr&);
+
+	/// Deliver to everyone subscribed to the topic right now.
+	static void publish(const TopicPtr&, const ValuePtr*, size_t);
+	static void publish(const TopicPtr& t, const ValueSeq& vals)
+		{ publish(t, vals.data(), vals.size()); }
+	static void publish(const TopicPtr& t, const ValuePtr& v)
+		{ publish(t, &v, 1); }
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_TOPIC_BUS_H
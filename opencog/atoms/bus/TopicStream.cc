@@ -0,0 +1,222 @@
+/*
+ * opencog/atoms/bus/TopicStream.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <thread>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/ValueFactory.h>
+
+#include <opencog/atoms/sensory-types/sensory_types.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include <opencog/atoms/sensory/SensoryNode.h>
+#include "TopicStream.h"
+
+using namespace opencog;
+
+TopicStream::TopicStream(const std::string& str)
+	: OutputStream(TOPIC_STREAM)
+{
+	init(str);
+}
+
+TopicStream::TopicStream(const Handle& senso)
+	: OutputStream(TOPIC_STREAM)
+{
+	if (SENSORY_NODE != senso->get_type())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting SensoryNode, got %s\n", senso->to_string().c_str());
+
+	init(senso->get_name());
+}
+
+TopicStream::~TopicStream()
+{
+	if (_sub) TopicBus::unsubscribe(_sub);
+}
+
+/// The URL is the topic name, or a glob pattern:
+///    topic://percept/file/changed
+///    topic://percept/file/changed?read&queue=1000
+///    topic://percept/*?tag
+/// Topic names are only published to, unless asked to read; patterns
+/// are always read.
+void TopicStream::init(const std::string& urlq)
+{
+	if (0 != urlq.compare(0, 8, "topic://"))
+		throw RuntimeException(TRACE_INFO,
+			"Unsupported URL \"%s\"\n", urlq.c_str());
+	_uri = urlq;
+
+	size_t max_queue = 10000;
+	bool read = false;
+	bool tagged = false;
+	std::map<std::string, std::string> params;
+	std::string url = SensoryNode::split_query(urlq, params);
+	for (const auto& pr : params)
+	{
+		if (0 == pr.first.compare("queue"))
+		{
+			char* end;
+			max_queue = strtoul(pr.second.c_str(), &end, 10);
+			if (pr.second.empty() or *end)
+				throw RuntimeException(TRACE_INFO,
+					"Expecting a number of items: \"%s\"\n", urlq.c_str());
+			read = (0 < max_queue);
+		}
+		else if (0 == pr.first.compare("read") and pr.second.empty())
+			read = true;
+		else if (0 == pr.first.compare("tag") and pr.second.empty())
+			tagged = true;
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown URL parameter \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+	}
+
+	std::string name = url.substr(8);
+	if (name.empty())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting a topic name: \"%s\"\n", urlq.c_str());
+
+	// A pattern is only ever subscribed to; with no queue, it would
+	// be of no use at all.
+	bool pattern = TopicBus::is_pattern(name);
+	if (pattern and 0 == max_queue)
+		throw RuntimeException(TRACE_INFO,
+			"A pattern subscribes, and can't have ?queue=0: \"%s\"\n",
+			urlq.c_str());
+	if (0 == max_queue and read)
+		throw RuntimeException(TRACE_INFO,
+			"Can't read with no queue: \"%s\"\n", urlq.c_str());
+
+	if (not pattern)
+		_topic = TopicBus::topic(name);
+	if (pattern or read)
+	{
+		_sub = std::make_shared<TopicBus::Subscriber>(name, tagged, max_queue);
+		TopicBus::subscribe(_sub);
+	}
+}
+
+// ==============================================================
+
+/// Block until something has been published, then return all of it.
+/// A stream that only publishes has nothing to read; it was opened
+/// without `?read`.
+void TopicStream::update() const
+{
+	std::deque<ValuePtr> vals;
+	if (_sub and _sub->take_all(vals))
+	{
+		_value.assign(std::make_move_iterator(vals.begin()),
+		              std::make_move_iterator(vals.end()));
+		return;
+	}
+	_value.clear();
+}
+
+ValuePtr TopicStream::describe(AtomSpace* as, bool silent)
+{
+	throw RuntimeException(TRACE_INFO, "Not implemeneted");
+	return Handle::UNDEFINED;
+}
+
+// ==============================================================
+
+/// Publish everything read from the stream, until it ends.
+static void pump(TopicBus::TopicPtr topic, ValuePtr src)
+{
+	LinkValuePtr lvp(LinkValueCast(src));
+	while (true)
+	{
+		ValueSeq vals;
+		try
+		{
+			vals = lvp->value();
+		}
+		catch (const std::exception& ex)
+		{
+			SENSORY_ERROR("TopicStream: reading for \"%s\": %s",
+				topic->name.c_str(), ex.what());
+			return;
+		}
+
+		// Same rules as OutputStream::write_content(): an empty
+		// list, or a list of empty lists, means the stream is done.
+		ValueSeq items;
+		items.reserve(vals.size());
+		for (ValuePtr& v : vals)
+		{
+			if (v->is_type(LINK_VALUE) and 0 == v->size()) continue;
+			items.emplace_back(std::move(v));
+		}
+		if (0 == items.size()) break;
+		TopicBus::publish(topic, items);
+	}
+	SENSORY_INFO("TopicStream: stream for \"%s\" ended", topic->name.c_str());
+}
+
+void TopicStream::publish(const ValuePtr& content)
+{
+	if (nullptr == _topic)
+		throw RuntimeException(TRACE_INFO,
+			"Can't publish to a pattern: \"%s\"\n", _uri.c_str());
+
+	if (content->is_type(LINK_STREAM_VALUE))
+	{
+		std::thread(pump, _topic, content).detach();
+		return;
+	}
+	TopicBus::publish(_topic, content);
+}
+
+ValuePtr TopicStream::write_out(AtomSpace* as, bool silent,
+                                const Handle& cref)
+{
+	ValuePtr content = cref;
+	if (cref->is_executable())
+	{
+		content = cref->execute(as, silent);
+		if (nullptr == content)
+			throw RuntimeException(TRACE_INFO,
+				"Expecting something to publish from %s\n",
+				cref->to_string().c_str());
+	}
+	publish(content);
+	return content;
+}
+
+// ==============================================================
+
+// Adds factory when library is loaded.
+DEFINE_VALUE_FACTORY(TOPIC_STREAM, createTopicStream, std::string)
+DEFINE_VALUE_FACTORY(TOPIC_STREAM, createTopicStream, Handle)
+
+// ====================================================================
+
+void opencog_sensory_bus_init(void)
+{
+	// Force shared lib ctors to run
+};
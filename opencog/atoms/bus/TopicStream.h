@@ -0,0 +1,95 @@
+/*
+ * opencog/atoms/bus/TopicStream.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_TOPIC_STREAM_H
+#define _OPENCOG_TOPIC_STREAM_H
+
+#include <opencog/atoms/sensory/OutputStream.h>
+#include "TopicBus.h"
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * TopicStreams connect to a named topic on the in-process TopicBus:
+ *    topic://percept/file-changed
+ *    topic://percept/file-*         (glob pattern; read-only)
+ * Writing publishes; whatever is written is one item. Writing a stream
+ * publishes every item read from it, in a thread of its own, until the
+ * stream ends. A topic name is only published to, unless it is opened
+ * with `?read`; a pattern is always read. Reading blocks until
+ * something has been published, and then gives everything published
+ * since the last read. A stream that reads gets what it writes itself,
+ * too.
+ *
+ * URL parameters:
+ *    ?read       Subscribe to the topic, so that it can be read.
+ *    ?queue=N    Keep at most N unread items; older ones are dropped.
+ *                Default 10000. Implies `?read`, if N is not zero.
+ *    ?tag        Give each item as (LinkValue (StringValue topic) item).
+ */
+class TopicStream
+	: public OutputStream
+{
+private:
+	std::string _uri;
+	TopicBus::TopicPtr _topic;
+	TopicBus::SubscriberPtr _sub;
+
+	void init(const std::string&);
+
+protected:
+	virtual void update() const;
+
+public:
+	TopicStream(const Handle&);
+	TopicStream(const std::string&);
+	virtual ~TopicStream();
+
+	virtual ValuePtr describe(AtomSpace*, bool);
+	virtual ValuePtr write_out(AtomSpace*, bool, const Handle&);
+
+	/// C++ API, same as writing.
+	void publish(const ValuePtr&);
+};
+
+typedef std::shared_ptr<TopicStream> TopicStreamPtr;
+static inline TopicStreamPtr TopicStreamCast(ValuePtr& a)
+	{ return std::dynamic_pointer_cast<TopicStream>(a); }
+
+template<typename ... Type>
+static inline std::shared_ptr<TopicStream> createTopicStream(Type&&... args) {
+   return std::make_shared<TopicStream>(std::forward<Type>(args)...);
+}
+
+/** @}*/
+} // namespace opencog
+
+extern "C" {
+void opencog_sensory_bus_init(void);
+};
+
+#endif // _OPENCOG_TOPIC_STREAM_H
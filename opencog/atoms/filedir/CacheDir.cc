@@ -0,0 +1,88 @@
+/*
+ * opencog/atoms/filedir/CacheDir.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <errno.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // for strerror()
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <functional>
+
+#include <opencog/util/exceptions.h>
+#include "CacheDir.h"
+
+using namespace opencog;
+
+static std::string home_dir(void)
+{
+	const char* home = getenv("HOME");
+	if (home and '/' == home[0]) return home;
+
+	struct passwd* pw = getpwuid(getuid());
+	if (pw and pw->pw_dir and '/' == pw->pw_dir[0]) return pw->pw_dir;
+
+	throw RuntimeException(TRACE_INFO,
+		"Cannot find a home directory for the cache\n");
+}
+
+std::string opencog::user_cache_dir(void)
+{
+	std::string base;
+	const char* xdg = getenv("XDG_CACHE_HOME");
+	if (xdg and '/' == xdg[0])
+		base = xdg;
+	else
+		base = home_dir() + "/.cache";
+	mkdir(base.c_str(), 0700);
+
+	std::string dir = base + "/opencog-sensory";
+	if (mkdir(dir.c_str(), 0700) and EEXIST != errno)
+		throw RuntimeException(TRACE_INFO,
+			"Cannot create \"%s\": %s\n", dir.c_str(), strerror(errno));
+
+	// Someone else's directory, or a symlink to one, would let them
+	// see, or swap out, what is written there.
+	struct stat st;
+	if (lstat(dir.c_str(), &st))
+		throw RuntimeException(TRACE_INFO,
+			"Cannot use \"%s\": %s\n", dir.c_str(), strerror(errno));
+	if (not S_ISDIR(st.st_mode) or st.st_uid != getuid() or
+	    (st.st_mode & (S_IWGRP | S_IWOTH)))
+		throw RuntimeException(TRACE_INFO,
+			"Cannot use \"%s\": not a private directory owned by this user\n",
+			dir.c_str());
+
+	return dir;
+}
+
+std::string opencog::user_cache_file(const std::string& path,
+                                     const char* suffix)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%016zx", std::hash<std::string>{}(path));
+	return user_cache_dir() + "/" + buf + suffix;
+}
@@ -0,0 +1,49 @@
+/*
+ * opencog/atoms/filedir/CacheDir.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef _OPENCOG_CACHE_DIR_H
+#define _OPENCOG_CACHE_DIR_H
+
+#include <string>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/// Per-user directory for catalogs, line indexes and the like:
+/// `$XDG_CACHE_HOME/opencog-sensory`, or `~/.cache/opencog-sensory`.
+/// It is created, mode 0700, if it does not exist. Throws if it is
+/// not a directory owned by the current user.
+std::string user_cache_dir(void);
+
+/// Name for a cache file holding data about `path`, in the per-user
+/// cache directory. The name is made from a hash of the path.
+std::string user_cache_file(const std::string& path, const char* suffix);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_CACHE_DIR_H
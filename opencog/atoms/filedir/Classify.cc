@@ -0,0 +1,266 @@
+/*
+ * opencog/atoms/filedir/Classify.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h> // for strerror()
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+
+#include "Classify.h"
+#include "LruCache.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Magic numbers. The table is small enough that a linear scan of it
+// costs less than the pread() that precedes it.
+
+struct Magic
+{
+	size_t offset;
+	const char* bytes;
+	size_t len;
+	const char* kind;
+	const char* format;
+	bool riff;         // The file must also start with "RIFF".
+};
+
+#define MAGIC(OFF, STR, KIND, FMT) {OFF, STR, sizeof(STR)-1, KIND, FMT, false}
+
+// RIFF containers: "RIFF", a length, and then the form type.
+#define RIFF(STR, KIND, FMT) {8, STR, sizeof(STR)-1, KIND, FMT, true}
+
+static const Magic _magic[] =
+{
+	MAGIC(0, "\x1f\x8b", "compressed", "gzip"),
+	MAGIC(0, "BZh", "compressed", "bzip2"),
+	MAGIC(0, "\xfd" "7zXZ\0", "compressed", "xz"),
+	MAGIC(0, "\x28\xb5\x2f\xfd", "compressed", "zstd"),
+	MAGIC(0, "\x04\x22\x4d\x18", "compressed", "lz4"),
+	MAGIC(0, "PK\x03\x04", "archive", "zip"),
+	MAGIC(0, "7z\xbc\xaf\x27\x1c", "archive", "7z"),
+	MAGIC(257, "ustar", "archive", "tar"),
+	MAGIC(0, "\x89PNG\r\n\x1a\n", "image", "png"),
+	MAGIC(0, "\xff\xd8\xff", "image", "jpeg"),
+	MAGIC(0, "GIF87a", "image", "gif"),
+	MAGIC(0, "GIF89a", "image", "gif"),
+	MAGIC(0, "II*\0", "image", "tiff"),
+	MAGIC(0, "MM\0*", "image", "tiff"),
+	RIFF("WEBP", "image", "webp"),
+	RIFF("WAVE", "audio", "wav"),
+	MAGIC(0, "OggS", "audio", "ogg"),
+	MAGIC(0, "fLaC", "audio", "flac"),
+	MAGIC(0, "ID3", "audio", "mp3"),
+	MAGIC(4, "ftyp", "video", "mp4"),
+	MAGIC(0, "\x1a\x45\xdf\xa3", "video", "matroska"),
+	MAGIC(0, "%PDF-", "document", "pdf"),
+	MAGIC(0, "\x7f" "ELF", "executable", "elf"),
+	MAGIC(0, "SQLite format 3\0", "database", "sqlite"),
+};
+
+#undef MAGIC
+#undef RIFF
+
+struct Kind
+{
+	const char* kind;
+	const char* format;
+};
+
+/// Validate UTF-8. A multi-byte sequence cut off by the end of the
+/// buffer is accepted, since the buffer is just the first page.
+static bool is_utf8(const unsigned char* p, size_t len)
+{
+	size_t i = 0;
+	while (i < len)
+	{
+		unsigned char c = p[i];
+		size_t n;
+		if (c < 0x80) { i++; continue; }
+		else if (0xc2 <= c and c <= 0xdf) n = 1;
+		else if (0xe0 <= c and c <= 0xef) n = 2;
+		else if (0xf0 <= c and c <= 0xf4) n = 3;
+		else return false;
+
+		for (size_t k = 1; k <= n; k++)
+		{
+			if (i + k >= len) return true;
+			if (0x80 != (p[i+k] & 0xc0)) return false;
+		}
+		i += n + 1;
+	}
+	return true;
+}
+
+static Kind sniff(const unsigned char* buf, size_t len)
+{
+	if (0 == len) return {"empty", ""};
+
+	for (const Magic& m : _magic)
+		if (m.offset + m.len <= len and
+		    0 == memcmp(buf + m.offset, m.bytes, m.len) and
+		    (not m.riff or 0 == memcmp(buf, "RIFF", 4)))
+			return {m.kind, m.format};
+
+	if (2 <= len and ((0xff == buf[0] and 0xfe == buf[1]) or
+	                  (0xfe == buf[0] and 0xff == buf[1])))
+		return {"text", "utf-16"};
+
+	// Text has no NULs, and few control characters other than
+	// whitespace, backspace and escape.
+	size_t ctrl = 0;
+	bool high = false;
+	for (size_t i = 0; i < len; i++)
+	{
+		unsigned char c = buf[i];
+		if (0 == c) return {"binary", "data"};
+		if (c < 0x20 and '\t' != c and '\n' != c and '\r' != c and
+		    '\f' != c and '\b' != c and '\x1b' != c)
+			ctrl++;
+		if (0x80 <= c) high = true;
+	}
+	if (ctrl * 100 > len) return {"binary", "data"};
+	if (not high) return {"text", "ascii"};
+	if (is_utf8(buf, len)) return {"text", "utf-8"};
+	return {"text", "latin-1"};
+}
+
+// ==============================================================
+// Cache of results, keyed by device and inode, and valid for as
+// long as the mtime and size are unchanged. At most CLASSIFY_CACHE_FILES
+// are kept; the least recently used are dropped.
+
+struct CachedKind
+{
+	int64_t mtime_ns;
+	off_t size;
+	Kind kind;
+};
+
+typedef std::pair<dev_t, ino_t> FileKey;
+
+#define CLASSIFY_CACHE_FILES 65536
+
+static std::mutex _cache_mtx;
+static LruCache<FileKey, CachedKind> _cache(CLASSIFY_CACHE_FILES);
+
+static Kind classify(const std::string& path, std::string& errtxt)
+{
+	// O_NOATIME keeps the sniffing from looking like a read to
+	// tools that care; it's only allowed on files we own.
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+	if (0 > fd and EPERM == errno)
+		fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (0 > fd)
+	{
+		errtxt = strerror(errno);
+		return {"error", nullptr};
+	}
+
+	struct stat st;
+	if (fstat(fd, &st))
+	{
+		errtxt = strerror(errno);
+		close(fd);
+		return {"error", nullptr};
+	}
+	if (S_ISDIR(st.st_mode)) { close(fd); return {"directory", ""}; }
+	if (not S_ISREG(st.st_mode)) { close(fd); return {"other", ""}; }
+
+	FileKey key(st.st_dev, st.st_ino);
+	int64_t mtime = (int64_t) st.st_mtim.tv_sec * 1000000000LL +
+		st.st_mtim.tv_nsec;
+	{
+		std::lock_guard<std::mutex> lck(_cache_mtx);
+		CachedKind* have = _cache.find(key);
+		if (have and mtime == have->mtime_ns and st.st_size == have->size)
+		{
+			close(fd);
+			return have->kind;
+		}
+	}
+
+	unsigned char buf[4096];
+	ssize_t len = pread(fd, buf, sizeof(buf), 0);
+	int err = errno;
+	close(fd);
+	if (0 > len)
+	{
+		errtxt = strerror(err);
+		return {"error", nullptr};
+	}
+
+	Kind kind = sniff(buf, len);
+	std::lock_guard<std::mutex> lck(_cache_mtx);
+	_cache.put(key, {mtime, st.st_size, kind});
+	return kind;
+}
+
+// ==============================================================
+
+void opencog::classify_files(std::vector<std::string>&& paths,
+                             const std::string& pfx,
+                             const ItemStreamPtr& out)
+{
+	std::thread([paths = std::move(paths), pfx, out]()
+	{
+		// Mostly waiting on the disk, so use more threads than cores.
+		size_t nthr = 2 * std::thread::hardware_concurrency();
+		if (0 == nthr) nthr = 8;
+		nthr = std::min(nthr, paths.size());
+
+		std::atomic<size_t> next(0);
+		auto worker = [&]()
+		{
+			while (true)
+			{
+				size_t i = next++;
+				if (paths.size() <= i) return;
+
+				std::string errtxt;
+				Kind k = classify(paths[i], errtxt);
+				out->add(createLinkValue(ValueSeq({
+					createStringValue(pfx + paths[i]),
+					createStringValue(k.kind),
+					createStringValue(k.format ? k.format : errtxt)})));
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for (size_t i = 0; i < nthr; i++)
+			pool.emplace_back(worker);
+		for (std::thread& t : pool)
+			t.join();
+
+		out->close();
+	}).detach();
+}
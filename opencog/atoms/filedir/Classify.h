@@ -0,0 +1,61 @@
+/*
+ * opencog/atoms/filedir/Classify.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_CLASSIFY_H
+#define _OPENCOG_CLASSIFY_H
+
+#include <string>
+#include <vector>
+#include <opencog/atoms/sensory/ItemStream.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * Guess the content type of each of the given files, from the magic
+ * bytes and a text/binary heuristic applied to the first page. The
+ * files are read in parallel, with pread(), by a pool of threads, and
+ * each result is reported to `out` as soon as it is known. The stream
+ * is closed after the last file.
+ *
+ * Each result is a LinkValue of three StringValues: the URL (the path
+ * prefixed by `pfx`), the kind, and the format. The kind is one of
+ * "text", "binary", "compressed", "archive", "image", "audio",
+ * "video", "document", "executable", "database", "empty", "directory",
+ * "other" or "error". The format is more specific, e.g. "utf-8",
+ * "gzip", "png" or "elf"; for errors, it is the error text.
+ *
+ * Results are cached, keyed by device and inode, and are reused for
+ * as long as the mtime and size of the file are unchanged; the most
+ * recently used 65536 are kept.
+ */
+void classify_files(std::vector<std::string>&& paths,
+                    const std::string& pfx, const ItemStreamPtr& out);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_CLASSIFY_H
@@ -0,0 +1,684 @@
+/*
+ * opencog/atoms/filedir/Crawl.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h> // for strerror()
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include <opencog/atoms/sensory/Spawn.h>
+
+#include "Crawl.h"
+#include "CrawlProto.h"
+
+using namespace opencog;
+
+CrawlOptions::CrawlOptions(void)
+{
+	workers = std::thread::hardware_concurrency();
+	if (0 == workers) workers = 4;
+}
+
+void CrawlOptions::parse(const Handle& cmd, size_t start)
+{
+	if (not cmd->is_link()) return;
+
+	const HandleSeq& oset = cmd->getOutgoingSet();
+	for (size_t i = start; i < oset.size(); i++)
+	{
+		const std::string& opt = oset[i]->is_node() ?
+			oset[i]->get_name() : "";
+		if (oset.size() <= i+1 or not oset[i+1]->is_node())
+			throw RuntimeException(TRACE_INFO,
+				"Expecting an option and a value: %s",
+				oset[i]->to_string().c_str());
+		const std::string& val = oset[++i]->get_name();
+
+		if (0 == opt.compare("workers"))
+		{
+			workers = atoi(val.c_str());
+			if (0 == workers or 1024 < workers)
+				throw RuntimeException(TRACE_INFO,
+					"Bad number of workers: %s", val.c_str());
+		}
+		else if (0 == opt.compare("glob"))
+			glob = val;
+		else if (0 == opt.compare("grep"))
+			grep = val;
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown option \"%s\"", opt.c_str());
+	}
+}
+
+// ==============================================================
+// Splitting the tree.
+
+typedef std::pair<char, std::string> Entry;
+
+/// Some part of the tree, handed out to one worker at a time.
+struct Share
+{
+	std::vector<Entry> paths;
+	double est;
+};
+
+// Reading a file costs about as much as reading this many more bytes.
+#define FILE_COST 4096.0
+
+/// List a directory; return the cost of reading the files in it.
+static double list_cost(const std::string& dir, const std::string& glob,
+                        std::vector<std::string>* subdirs)
+{
+	int dfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (0 > dfd) return 0.0;
+	DIR* dp = fdopendir(dfd);
+	if (nullptr == dp) { close(dfd); return 0.0; }
+
+	std::string base = ('/' == dir.back()) ? dir : dir + "/";
+	double cost = FILE_COST;
+	struct dirent* dent;
+	while ((dent = readdir(dp)))
+	{
+		const char* nm = dent->d_name;
+		if ('.' == nm[0] and (0 == nm[1] or ('.' == nm[1] and 0 == nm[2])))
+			continue;
+		if (DT_DIR == dent->d_type)
+		{
+			subdirs->emplace_back(base + nm);
+			continue;
+		}
+		if (DT_REG != dent->d_type and DT_UNKNOWN != dent->d_type)
+			continue;
+		if (not glob.empty() and fnmatch(glob.c_str(), nm, 0))
+			continue;
+
+		struct stat st;
+		if (fstatat(dfd, nm, &st, AT_SYMLINK_NOFOLLOW)) continue;
+		if (S_ISDIR(st.st_mode)) subdirs->emplace_back(base + nm);
+		else if (S_ISREG(st.st_mode)) cost += st.st_size + FILE_COST;
+	}
+	closedir(dp);
+	return cost;
+}
+
+/// Estimate the cost of a subtree, by looking at the first `budget`
+/// directories, breadth-first, and assuming that the rest are like
+/// those. Adds the number of directories listed to `listed`.
+static double estimate(const std::string& dir, const std::string& glob,
+                       size_t budget, std::atomic<size_t>& listed)
+{
+	std::deque<std::string> todo({dir});
+	std::vector<std::string> subdirs;
+	double seen = 0.0;
+	size_t ndirs = 0;
+	while (not todo.empty() and ndirs < budget)
+	{
+		subdirs.clear();
+		seen += list_cost(todo.front(), glob, &subdirs);
+		todo.pop_front();
+		ndirs ++;
+		todo.insert(todo.end(), subdirs.begin(), subdirs.end());
+	}
+	listed += ndirs;
+	return seen + todo.size() * (seen / ndirs);
+}
+
+/// Estimate each of the subtrees, with up to `nthreads` threads, as
+/// this is done before any worker can start.
+static std::vector<double> estimate_all(const std::vector<std::string>& dirs,
+                                        const std::string& glob,
+                                        size_t budget, size_t nthreads,
+                                        std::atomic<size_t>& listed)
+{
+	std::vector<double> ests(dirs.size());
+	std::atomic<size_t> next(0);
+	auto work = [&]()
+	{
+		size_t i;
+		while ((i = next++) < dirs.size())
+			ests[i] = estimate(dirs[i], glob, budget, listed);
+	};
+
+	nthreads = std::min(nthreads, dirs.size());
+	std::vector<std::thread> thrs;
+	for (size_t i = 1; i < nthreads; i++)
+		thrs.emplace_back(work);
+	work();
+	for (std::thread& thr : thrs)
+		thr.join();
+	return ests;
+}
+
+// At most this many directories are listed to split the tree. This
+// bounds the time before the workers start.
+#define PARTITION_DIRS 8192
+
+/// Split the tree into shares of roughly equal estimated cost, by
+/// opening up the largest subtree, until there are enough shares, or
+/// PARTITION_DIRS have been listed. The files directly in an opened
+/// directory are a share of their own. Returned largest first.
+static std::vector<Share> partition(const std::string& root,
+                                    const CrawlOptions& opts)
+{
+	typedef std::pair<double, std::string> Tree;
+	std::priority_queue<Tree> trees;
+	std::vector<Share> shares;
+	double total = 0.0;
+	std::atomic<size_t> listed(0);
+
+	auto open_up = [&](const std::string& dir)
+	{
+		std::vector<std::string> subdirs;
+		double cost = list_cost(dir, opts.glob, &subdirs);
+		shares.push_back({{{'f', dir}}, cost});
+		total += cost;
+		listed ++;
+
+		size_t budget = std::max((size_t) 1, 1024 / (1 + subdirs.size()));
+		std::vector<double> ests = estimate_all(subdirs, opts.glob,
+			budget, opts.workers, listed);
+		for (size_t i = 0; i < subdirs.size(); i++)
+		{
+			trees.push({ests[i], subdirs[i]});
+			total += ests[i];
+		}
+	};
+
+	open_up(root);
+	size_t want = 4 * opts.workers;
+	while (listed < PARTITION_DIRS and not trees.empty())
+	{
+		if (want <= trees.size() + shares.size() and
+		    trees.top().first < 2.0 * total / want)
+			break;
+		Tree big = trees.top();
+		trees.pop();
+		total -= big.first;
+		open_up(big.second);
+	}
+	while (not trees.empty())
+	{
+		shares.push_back({{{'r', trees.top().second}}, trees.top().first});
+		trees.pop();
+	}
+
+	// Many tiny shares are packed together, largest first, each into
+	// the lightest bin, so as not to send a message per directory.
+	std::sort(shares.begin(), shares.end(),
+		[](const Share& a, const Share& b) { return a.est > b.est; });
+	size_t maxshares = 16 * opts.workers;
+	if (shares.size() <= maxshares) return shares;
+
+	std::vector<Share> bins(maxshares, Share{{}, 0.0});
+	for (Share& sh : shares)
+	{
+		Share& bin = *std::min_element(bins.begin(), bins.end(),
+			[](const Share& a, const Share& b) { return a.est < b.est; });
+		bin.paths.insert(bin.paths.end(), sh.paths.begin(), sh.paths.end());
+		bin.est += sh.est;
+	}
+	std::sort(bins.begin(), bins.end(),
+		[](const Share& a, const Share& b) { return a.est > b.est; });
+	return bins;
+}
+
+// ==============================================================
+// Handing out the work.
+
+struct WorkerProc
+{
+	pid_t pid;
+	int fd;
+	std::string inbuf;
+	bool busy;
+	bool stealing;      // A STEAL has not been answered yet.
+	bool dead;
+
+	// What the worker has not finished, kept up to date from the 'd'
+	// records and GIVEs, and the files already reported from the
+	// directory it is in. If it dies, only these are done again.
+	std::unordered_map<std::string, char> left;
+	std::vector<std::string> partial;
+	double est;
+};
+
+class Coordinator
+{
+	std::string _pfx;
+	CrawlOptions _opts;
+
+	// Only a weak reference: once the reader drops the stream, no one
+	// wants the results, and the workers are stopped.
+	std::weak_ptr<ItemStream> _out;
+
+	std::vector<WorkerProc> _procs;
+	std::deque<Share> _queue;
+	uint64_t _next_id;
+
+	// Files reported by a worker that died half-way through their
+	// directory; they are not reported again.
+	std::unordered_set<std::string> _skip;
+
+	void send(WorkerProc&, const std::string&);
+	void assign(WorkerProc&);
+	void steal(void);
+	void died(WorkerProc&);
+	void results(WorkerProc&, const std::string&);
+	void got_frame(WorkerProc&, CrawlProto::Kind, const std::string&);
+	void stop(void);
+
+public:
+	Coordinator(const std::string& pfx, const CrawlOptions& opts,
+	            const std::weak_ptr<ItemStream>& out) :
+		_pfx(pfx), _opts(opts), _out(out), _next_id(1) {}
+	void start_workers(void);
+	void run(const std::string& root);
+};
+
+#ifndef CRAWL_WORKER
+#define CRAWL_WORKER "/usr/local/bin/opencog-crawl-worker"
+#endif
+
+/// The worker program. In the build tree, it is next to this library;
+/// once installed, it is in the bin directory beside the lib directory
+/// that holds this library, or else where CMake said it would be. The
+/// search path is never used.
+static std::string worker_path(void)
+{
+	Dl_info info;
+	if (dladdr((void*) &worker_path, &info) and info.dli_fname)
+	{
+		std::string dir(info.dli_fname);
+		size_t slash = dir.rfind('/');
+		dir = (std::string::npos == slash) ? "." : dir.substr(0, slash);
+		for (const char* rel : {"/", "/../../bin/"})
+		{
+			std::string prog = dir + rel + "opencog-crawl-worker";
+			if (0 == access(prog.c_str(), X_OK)) return prog;
+		}
+	}
+	return CRAWL_WORKER;
+}
+
+/// Start the worker processes. Throws if they can't be started.
+void Coordinator::start_workers(void)
+{
+	std::string prog = worker_path();
+
+	std::string init;
+	size_t start = CrawlProto::begin_frame(init, CrawlProto::INIT);
+	CrawlProto::put_string(init, _opts.glob);
+	CrawlProto::put_string(init, _opts.grep);
+	CrawlProto::end_frame(init, start);
+
+	for (size_t i = 0; i < _opts.workers; i++)
+	{
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv))
+		{
+			stop();
+			throw RuntimeException(TRACE_INFO,
+				"Can't create socket: %s", strerror(errno));
+		}
+
+		WorkerProc wp;
+		try
+		{
+			wp.pid = spawn_process({prog}, {{sv[1], 3}});
+		}
+		catch (...)
+		{
+			close(sv[0]);
+			close(sv[1]);
+			stop();
+			throw;
+		}
+		close(sv[1]);
+		wp.fd = sv[0];
+		wp.busy = false;
+		wp.stealing = false;
+		wp.dead = false;
+		_procs.emplace_back(wp);
+		send(_procs.back(), init);
+	}
+}
+
+void Coordinator::send(WorkerProc& wp, const std::string& msg)
+{
+	if (not wp.dead and not CrawlProto::write_all(wp.fd, msg))
+		died(wp);
+}
+
+/// Give the worker the next share, if there is one.
+void Coordinator::assign(WorkerProc& wp)
+{
+	if (wp.dead or wp.busy or _queue.empty()) return;
+
+	Share sh(std::move(_queue.front()));
+	_queue.pop_front();
+	wp.busy = true;
+	wp.est = sh.est;
+	wp.left.clear();
+	wp.partial.clear();
+
+	std::string msg;
+	size_t start = CrawlProto::begin_frame(msg, CrawlProto::TASK);
+	CrawlProto::put_varint(msg, _next_id++);
+	CrawlProto::put_varint(msg, sh.paths.size());
+	for (const Entry& ent : sh.paths)
+	{
+		msg.push_back(ent.first);
+		CrawlProto::put_string(msg, ent.second);
+		wp.left.emplace(ent.second, ent.first);
+	}
+	CrawlProto::end_frame(msg, start);
+	send(wp, msg);
+}
+
+/// For each idle worker, ask some busy worker to give up part of
+/// what it has not started yet.
+void Coordinator::steal(void)
+{
+	size_t idle = 0;
+	size_t asked = 0;
+	for (const WorkerProc& wp : _procs)
+	{
+		if (wp.dead) continue;
+		if (not wp.busy) idle++;
+		if (wp.stealing) asked++;
+	}
+
+	std::string msg;
+	size_t start = CrawlProto::begin_frame(msg, CrawlProto::STEAL);
+	CrawlProto::end_frame(msg, start);
+	for (WorkerProc& wp : _procs)
+	{
+		if (idle <= asked) break;
+		if (wp.dead or not wp.busy or wp.stealing) continue;
+		wp.stealing = true;
+		asked++;
+		send(wp, msg);
+	}
+}
+
+void Coordinator::died(WorkerProc& wp)
+{
+	if (wp.dead) return;
+	SENSORY_WARN("Crawl: worker pid=%d is gone", wp.pid);
+	wp.dead = true;
+	wp.stealing = false;
+	close(wp.fd);
+	if (not wp.busy) return;
+	wp.busy = false;
+
+	Share sh{{}, wp.est};
+	for (const auto& pr : wp.left)
+		sh.paths.emplace_back(pr.second, pr.first);
+	wp.left.clear();
+	if (not sh.paths.empty())
+		_queue.push_front(std::move(sh));
+	_skip.insert(wp.partial.begin(), wp.partial.end());
+	wp.partial.clear();
+}
+
+void Coordinator::results(WorkerProc& wp, const std::string& body)
+{
+	ItemStreamPtr out(_out.lock());
+	if (nullptr == out) return;
+
+	CrawlProto::Reader rd(body.data(), body.size());
+	size_t n = rd.varint();
+	for (size_t i = 0; i < n and not rd.bad; i++)
+	{
+		char tag = rd.byte();
+		std::string path = rd.string();
+		if ('s' == tag)
+		{
+			auto it = wp.left.find(path);
+			if (wp.left.end() != it) it->second = 'f';
+			size_t nsub = rd.varint();
+			for (size_t j = 0; j < nsub and not rd.bad; j++)
+				wp.left.emplace(rd.string(), 'r');
+			continue;
+		}
+		if ('d' == tag)
+		{
+			wp.left.erase(path);
+			wp.partial.clear();
+			size_t nsub = rd.varint();
+			for (size_t j = 0; j < nsub and not rd.bad; j++)
+				wp.left.emplace(rd.string(), 'r');
+			continue;
+		}
+
+		double num = rd.varint();
+		bool again = not _skip.empty() and 0 < _skip.count(path);
+		if (not again) wp.partial.push_back(path);
+		if ('m' == tag)
+		{
+			double len = rd.varint();
+			std::string line = rd.string();
+			if (again) continue;
+			std::vector<double> where({num});
+			if (line.size() < len) where.push_back(len);
+			out->add(createLinkValue(ValueSeq({
+				createStringValue(_pfx + path),
+				createFloatValue(std::move(where)),
+				createStringValue(std::move(line))})));
+		}
+		else
+		{
+			double bytes = rd.varint();
+			if (again) continue;
+			out->add(createLinkValue(ValueSeq({
+				createStringValue(_pfx + path),
+				createFloatValue(std::vector<double>({num, bytes}))})));
+		}
+	}
+}
+
+void Coordinator::got_frame(WorkerProc& wp, CrawlProto::Kind kind,
+                            const std::string& body)
+{
+	if (CrawlProto::RESULTS == kind)
+	{
+		results(wp, body);
+		return;
+	}
+	if (CrawlProto::DONE == kind)
+	{
+		wp.busy = false;
+		wp.left.clear();
+		wp.partial.clear();
+		assign(wp);
+		return;
+	}
+	if (CrawlProto::GIVE != kind) return;
+
+	wp.stealing = false;
+	CrawlProto::Reader rd(body.data(), body.size());
+	size_t n = rd.varint();
+	if (0 == n) return;
+
+	Share sh{{}, 0.0};
+	for (size_t i = 0; i < n and not rd.bad; i++)
+	{
+		char flag = rd.byte();
+		sh.paths.emplace_back(flag, rd.string());
+		wp.left.erase(sh.paths.back().second);
+	}
+
+	_queue.push_front(std::move(sh));
+	for (WorkerProc& other : _procs)
+		assign(other);
+}
+
+void Coordinator::run(const std::string& root)
+{
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<Share> shares = partition(root, _opts);
+	_queue.assign(shares.begin(), shares.end());
+	SENSORY_INFO("Crawl: %s in %zu shares, %zu workers, split in %d ms",
+		root.c_str(), shares.size(), _procs.size(),
+		(int) std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - begin).count());
+	for (WorkerProc& wp : _procs)
+		assign(wp);
+
+	std::vector<struct pollfd> pfds;
+	std::vector<WorkerProc*> who;
+	std::chrono::steady_clock::time_point last_steal;
+	char buf[65536];
+	while (true)
+	{
+		pfds.clear();
+		who.clear();
+		bool idle = false;
+		bool working = false;
+		for (WorkerProc& wp : _procs)
+		{
+			if (wp.dead) continue;
+			pfds.push_back({wp.fd, POLLIN, 0});
+			who.push_back(&wp);
+			if (wp.busy or wp.stealing) working = true;
+			else idle = true;
+		}
+		if (pfds.empty())
+		{
+			SENSORY_ERROR("Crawl: all workers are gone");
+			break;
+		}
+		if (not working and _queue.empty()) break;
+		if (_out.expired())
+		{
+			SENSORY_INFO("Crawl: the results are not wanted; stopping");
+			break;
+		}
+
+		// Idle workers keep asking, as a busy worker may have had
+		// nothing to give when last asked, but may have more now.
+		// Not too often, though; each ask interrupts the victim.
+		auto now = std::chrono::steady_clock::now();
+		if (idle and last_steal + std::chrono::milliseconds(5) <= now)
+		{
+			steal();
+			last_steal = now;
+		}
+		// A worker may be a long time in a big file; wake up now and
+		// then anyway, to see if the results are still wanted.
+		int rc = poll(pfds.data(), pfds.size(), idle ? 5 : 1000);
+		if (0 > rc and EINTR != errno)
+		{
+			SENSORY_ERROR("Crawl: poll(): %s", strerror(errno));
+			break;
+		}
+
+		for (size_t i = 0; 0 < rc and i < pfds.size(); i++)
+		{
+			if (0 == pfds[i].revents) continue;
+			WorkerProc& wp = *who[i];
+			ssize_t len = read(wp.fd, buf, sizeof(buf));
+			if (0 > len and EINTR == errno) continue;
+			if (0 >= len) { died(wp); continue; }
+			wp.inbuf.append(buf, len);
+
+			size_t off = 0;
+			while (not wp.dead)
+			{
+				CrawlProto::Kind kind;
+				size_t flen = CrawlProto::get_frame(wp.inbuf.data() + off,
+					wp.inbuf.size() - off, kind);
+				if ((size_t) -1 == flen) { died(wp); break; }
+				if (0 == flen) break;
+				got_frame(wp, kind, wp.inbuf.substr(off + CrawlProto::HEADER,
+					flen - CrawlProto::HEADER));
+				off += flen;
+			}
+			wp.inbuf.erase(0, off);
+		}
+
+		// Work handed back by a dead worker.
+		for (WorkerProc& wp : _procs)
+			assign(wp);
+	}
+
+	stop();
+	ItemStreamPtr out(_out.lock());
+	if (out) out->close();
+}
+
+/// Tell the workers to quit, and wait a while for them; a worker that
+/// is stuck, e.g. in a read from a hung file system, is killed.
+void Coordinator::stop(void)
+{
+	std::string msg;
+	size_t start = CrawlProto::begin_frame(msg, CrawlProto::QUIT);
+	CrawlProto::end_frame(msg, start);
+	for (WorkerProc& wp : _procs)
+	{
+		if (wp.dead) continue;
+		CrawlProto::write_all(wp.fd, msg);
+		close(wp.fd);
+		wp.dead = true;
+	}
+
+	for (WorkerProc& wp : _procs)
+		reap_process(wp.pid, 1000);
+}
+
+// ==============================================================
+
+void opencog::crawl(const std::string& root, const std::string& pfx,
+                    const CrawlOptions& opts, const ItemStreamPtr& out)
+{
+	std::shared_ptr<Coordinator> co(
+		std::make_shared<Coordinator>(pfx, opts, out));
+	co->start_workers();
+
+	// Return at once; results arrive on the stream as they are found.
+	// The coordinator does not keep the stream alive: if the reader
+	// drops it, the workers are told to quit.
+	std::thread([co, root]() { co->run(root); }).detach();
+}
@@ -0,0 +1,83 @@
+/*
+ * opencog/atoms/filedir/Crawl.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_CRAWL_H
+#define _OPENCOG_CRAWL_H
+
+#include <string>
+#include <opencog/atoms/base/Handle.h>
+#include <opencog/atoms/sensory/ItemStream.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * Options for the crawl command, given as keyword-value pairs:
+ *
+ *    (List (Item "crawl") (Item "workers") (Number 8)
+ *          (Item "glob") (Item "*.log") (Item "grep") (Item "ERROR"))
+ */
+struct CrawlOptions
+{
+	size_t workers;       // Number of worker processes.
+	std::string glob;     // Only read files whose name matches.
+	std::string grep;     // Report lines holding this string.
+
+	CrawlOptions(void);
+	void parse(const Handle& cmd, size_t start);
+};
+
+/**
+ * Walk the tree at `root`, and read every file in it, using a number
+ * of worker processes, so as to use more than one process' worth of
+ * CPU and I/O. The tree is first split into subtrees of roughly equal
+ * estimated size; these are handed out, largest first, over Unix
+ * sockets. A worker that runs out of work takes half of what some
+ * busy worker has not yet started. Workers are started with
+ * spawn_process(), and so the AtomSpace process is not forked.
+ *
+ * The results of all the workers are merged onto `out`, in no
+ * particular order, and the stream is closed when all are done. For
+ * each file, the result is a LinkValue holding the URL (the path,
+ * prefixed by `pfx`) and (FloatValue lines bytes). With a grep string,
+ * it is instead, for each matching line, the URL, (FloatValue lineno)
+ * and (StringValue line). Lines longer than 4096 bytes are cut short;
+ * for these, it is (FloatValue lineno length), with the full length.
+ *
+ * Only a weak reference to `out` is kept; once no one else holds it,
+ * the workers are stopped, within about a second.
+ *
+ * Throws if the workers could not be started. If a worker dies, what
+ * it had not finished is handed to another, and files it had already
+ * reported are not reported again.
+ */
+void crawl(const std::string& root, const std::string& pfx,
+           const CrawlOptions&, const ItemStreamPtr& out);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_CRAWL_H
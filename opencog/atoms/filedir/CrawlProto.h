@@ -0,0 +1,193 @@
+/*
+ * opencog/atoms/filedir/CrawlProto.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_CRAWL_PROTO_H
+#define _OPENCOG_CRAWL_PROTO_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <string>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * Messages between the crawl coordinator and its worker processes.
+ * Both ends are on the same machine, so lengths are in host order.
+ * Each frame is a four-byte length, a one-byte kind, and the body;
+ * the length counts the kind and the body. Numbers in the body are
+ * LEB128 varints; strings are a length and the bytes.
+ *
+ * Coordinator to worker:
+ *    INIT   glob, grep         once, before any TASK
+ *    TASK   id, n, n * (flag, path)
+ *    STEAL                     ask for some of the pending directories
+ *    QUIT
+ * Worker to coordinator:
+ *    RESULTS  n, n * record
+ *    GIVE     n, n * (flag, path)    answer to STEAL; may be empty
+ *    DONE     id, dirs, files, bytes
+ *
+ * A path flag is 'r' for a whole subtree, or 'f' for just the files
+ * in that directory. A record is 'f' path lines bytes, for a file,
+ * 'm' path lineno length line, for a line matching the grep string, or
+ * 'd' path n n*subdir, once all the files in a directory have been
+ * reported; the subdirs are those that were added to the pending
+ * list. From these, the coordinator knows what a worker has left.
+ * A line longer than MAX_LINE is cut short; `length` is how long it
+ * really was. A directory with so many subdirs that they would not
+ * fit in a frame has some of them sent first, in 's' path n n*subdir
+ * records; these mean that the files are all that is left of `path`.
+ * No frame is ever longer than MAX_FRAME.
+ *
+ * This header does not depend on the AtomSpace, as the worker does
+ * not use it.
+ */
+struct CrawlProto
+{
+	enum Kind : uint8_t
+	{
+		INIT = 1,
+		TASK = 2,
+		STEAL = 3,
+		QUIT = 4,
+		RESULTS = 5,
+		GIVE = 6,
+		DONE = 7,
+	};
+
+	static constexpr size_t HEADER = 5;
+	static constexpr size_t MAX_FRAME = 64 * 1024 * 1024;
+	static constexpr size_t MAX_LINE = 4096;
+
+	static void put_varint(std::string& out, uint64_t n)
+	{
+		while (0x80 <= n)
+		{
+			out.push_back((char) (0x80 | (n & 0x7f)));
+			n >>= 7;
+		}
+		out.push_back((char) n);
+	}
+
+	static void put_string(std::string& out, const std::string& str)
+	{
+		put_varint(out, str.size());
+		out.append(str);
+	}
+
+	/// Start a frame; returns where it starts, for end_frame().
+	static size_t begin_frame(std::string& out, Kind kind)
+	{
+		size_t start = out.size();
+		out.append(4, '\0');
+		out.push_back((char) kind);
+		return start;
+	}
+
+	static void end_frame(std::string& out, size_t start)
+	{
+		uint32_t len = out.size() - start - 4;
+		memcpy(&out[start], &len, sizeof(len));
+	}
+
+	/// If `buf` starts with a complete frame, return its size, and set
+	/// `kind`. Zero if more is needed; -1 (as size_t) on garbage.
+	static size_t get_frame(const char* buf, size_t len, Kind& kind)
+	{
+		if (len < HEADER) return 0;
+		uint32_t flen;
+		memcpy(&flen, buf, sizeof(flen));
+		if (0 == flen or MAX_FRAME < flen) return (size_t) -1;
+		if (len < flen + 4) return 0;
+		kind = (Kind) buf[4];
+		return flen + 4;
+	}
+
+	/// Write all of it. False if the other end is gone. Uses
+	/// MSG_NOSIGNAL, so that a dead worker does not SIGPIPE the
+	/// coordinator.
+	static bool write_all(int fd, const std::string& buf)
+	{
+		size_t off = 0;
+		while (off < buf.size())
+		{
+			ssize_t rc = send(fd, buf.data() + off, buf.size() - off,
+			                  MSG_NOSIGNAL);
+			if (0 > rc and EINTR == errno) continue;
+			if (0 >= rc) return false;
+			off += rc;
+		}
+		return true;
+	}
+
+	/// Reads a frame body. Reading past the end sets `bad`, and
+	/// returns zeros and empty strings.
+	struct Reader
+	{
+		const char* p;
+		const char* end;
+		bool bad;
+
+		Reader(const char* b, size_t n) : p(b), end(b + n), bad(false) {}
+
+		uint8_t byte(void)
+		{
+			if (p >= end) { bad = true; return 0; }
+			return *p++;
+		}
+
+		uint64_t varint(void)
+		{
+			uint64_t n = 0;
+			for (int shift = 0; shift < 64; shift += 7)
+			{
+				uint8_t c = byte();
+				n |= ((uint64_t) (c & 0x7f)) << shift;
+				if (0 == (c & 0x80)) return n;
+			}
+			bad = true;
+			return 0;
+		}
+
+		std::string string(void)
+		{
+			uint64_t n = varint();
+			if ((uint64_t) (end - p) < n) { bad = true; return ""; }
+			std::string s(p, n);
+			p += n;
+			return s;
+		}
+	};
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_CRAWL_PROTO_H
@@ -0,0 +1,370 @@
+/*
+ * opencog/atoms/filedir/CrawlWorker.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// The worker process for the `crawl` command; see Crawl.h. It is
+// started by the coordinator, with a Unix socket on fd 3, and walks
+// and reads the subtrees that it is handed, until told to quit.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <deque>
+#include <utility>
+
+#include "CrawlProto.h"
+#include "LineReader.h"
+
+using namespace opencog;
+
+typedef std::pair<char, std::string> Entry;
+
+class CrawlWorker
+{
+private:
+	int _fd;
+	std::string _inbuf;
+
+	std::string _glob;
+	std::string _grep;
+
+	// Directories still to be done for the current task. Subdirs are
+	// pushed on the back, and taken from the back, depth-first; the
+	// front holds the shallowest, and so likely the largest, which
+	// are the ones given away when asked.
+	std::deque<Entry> _pending;
+
+	std::string _results;
+	size_t _nresults;
+	std::string _rec;
+	uint64_t _dirs;
+	uint64_t _files;
+	uint64_t _bytes;
+
+	bool read_frame(bool wait, CrawlProto::Kind&, std::string&);
+	bool handle(CrawlProto::Kind, const std::string&);
+	void give(void);
+	void flush(void);
+	void add(void);
+	void scan(const Entry&);
+	void done(const std::string& dir, size_t before);
+	void read_file(int dfd, const std::string& path, const char* name);
+
+public:
+	CrawlWorker(int fd) : _fd(fd), _nresults(0) {}
+	int run(void);
+};
+
+// ==============================================================
+
+/// Get the next frame; without `wait`, only if one is already there.
+/// Returns false if there is none; exits if the coordinator is gone.
+bool CrawlWorker::read_frame(bool wait, CrawlProto::Kind& kind,
+                             std::string& body)
+{
+	while (true)
+	{
+		size_t flen = CrawlProto::get_frame(_inbuf.data(), _inbuf.size(), kind);
+		if ((size_t) -1 == flen) _exit(1);
+		if (0 < flen)
+		{
+			body = _inbuf.substr(CrawlProto::HEADER, flen - CrawlProto::HEADER);
+			_inbuf.erase(0, flen);
+			return true;
+		}
+
+		if (not wait)
+		{
+			struct pollfd pfd = {_fd, POLLIN, 0};
+			if (0 >= poll(&pfd, 1, 0)) return false;
+		}
+
+		char buf[4096];
+		ssize_t rc = read(_fd, buf, sizeof(buf));
+		if (0 > rc and EINTR == errno) continue;
+		if (0 >= rc) _exit(0);
+		_inbuf.append(buf, rc);
+	}
+}
+
+/// Handle a message. Returns true for a TASK, which fills _pending.
+bool CrawlWorker::handle(CrawlProto::Kind kind, const std::string& body)
+{
+	CrawlProto::Reader rd(body.data(), body.size());
+	if (CrawlProto::QUIT == kind) _exit(0);
+	if (CrawlProto::STEAL == kind) { give(); return false; }
+	if (CrawlProto::INIT == kind)
+	{
+		_glob = rd.string();
+		_grep = rd.string();
+		return false;
+	}
+	if (CrawlProto::TASK != kind) return false;
+
+	rd.varint();
+	size_t n = rd.varint();
+	for (size_t i = 0; i < n and not rd.bad; i++)
+	{
+		char flag = rd.byte();
+		_pending.emplace_back(flag, rd.string());
+	}
+	return true;
+}
+
+/// Hand back half of what is pending, from the shallow end, or as
+/// much of that as fits in a frame.
+void CrawlWorker::give(void)
+{
+	size_t n = _pending.size() / 2;
+	std::string paths;
+	size_t i = 0;
+	for (; i < n and paths.size() < CrawlProto::MAX_FRAME / 2; i++)
+	{
+		paths.push_back(_pending.front().first);
+		CrawlProto::put_string(paths, _pending.front().second);
+		_pending.pop_front();
+	}
+	std::string out;
+	size_t start = CrawlProto::begin_frame(out, CrawlProto::GIVE);
+	CrawlProto::put_varint(out, i);
+	out.append(paths);
+	CrawlProto::end_frame(out, start);
+
+	// Results go first, so that the coordinator sees them in order.
+	flush();
+	if (not CrawlProto::write_all(_fd, out)) _exit(1);
+}
+
+void CrawlWorker::flush(void)
+{
+	if (0 == _nresults) return;
+	std::string out;
+	size_t start = CrawlProto::begin_frame(out, CrawlProto::RESULTS);
+	CrawlProto::put_varint(out, _nresults);
+	out.append(_results);
+	CrawlProto::end_frame(out, start);
+	if (not CrawlProto::write_all(_fd, out)) _exit(1);
+	_results.clear();
+	_nresults = 0;
+}
+
+/// Append the record in _rec to the results, sending what is there
+/// first, if the frame would otherwise be too long.
+void CrawlWorker::add(void)
+{
+	// The kind, and the count of records, which is at most ten bytes.
+	if (CrawlProto::MAX_FRAME < 1 + 10 + _results.size() + _rec.size())
+		flush();
+	_results.append(_rec);
+	_nresults ++;
+}
+
+// ==============================================================
+
+void CrawlWorker::read_file(int dfd, const std::string& path, const char* name)
+{
+	int fd = openat(dfd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (0 > fd) return;
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	uint64_t lines = 0;
+	uint64_t bytes = 0;
+	if (_grep.empty())
+	{
+		static char buf[256 * 1024];
+		ssize_t rc;
+		while (0 < (rc = read(fd, buf, sizeof(buf))))
+		{
+			bytes += rc;
+			for (const char* p = buf;
+			     (p = (const char*) memchr(p, '\n', buf + rc - p)); p++)
+				lines ++;
+		}
+		_rec.assign(1, 'f');
+		CrawlProto::put_string(_rec, path);
+		CrawlProto::put_varint(_rec, lines);
+		CrawlProto::put_varint(_rec, bytes);
+		add();
+	}
+	else
+	{
+		// Read errors end the file, as if it were shorter. Lines are
+		// read with their newline, so that a last line without one
+		// is counted right.
+		try
+		{
+			LineReader rdr(fd, "\n", true);
+			std::string line;
+			while (rdr.next(line))
+			{
+				lines ++;
+				bytes += line.size();
+				if (not line.empty() and '\n' == line.back())
+					line.pop_back();
+				if (nullptr == memmem(line.data(), line.size(),
+				                      _grep.data(), _grep.size()))
+					continue;
+
+				// Long lines are cut short, but not in the middle of
+				// a UTF-8 character.
+				size_t len = line.size();
+				if (CrawlProto::MAX_LINE < len)
+				{
+					size_t cut = CrawlProto::MAX_LINE;
+					while (0 < cut and 0x80 == (line[cut] & 0xc0)) cut--;
+					line.resize(cut);
+				}
+				_rec.assign(1, 'm');
+				CrawlProto::put_string(_rec, path);
+				CrawlProto::put_varint(_rec, lines);
+				CrawlProto::put_varint(_rec, len);
+				CrawlProto::put_string(_rec, line);
+				add();
+			}
+		}
+		catch (const std::exception& ex) {}
+	}
+	close(fd);
+
+	_files ++;
+	_bytes += bytes;
+	if (65536 < _results.size()) flush();
+}
+
+void CrawlWorker::scan(const Entry& ent)
+{
+	const std::string& dir = ent.second;
+	int dfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (0 > dfd) return;
+	DIR* dp = fdopendir(dfd);
+	if (nullptr == dp) { close(dfd); return; }
+	_dirs ++;
+
+	std::string base = ('/' == dir.back()) ? dir : dir + "/";
+	struct dirent* dent;
+	while ((dent = readdir(dp)))
+	{
+		const char* nm = dent->d_name;
+		if ('.' == nm[0] and (0 == nm[1] or ('.' == nm[1] and 0 == nm[2])))
+			continue;
+
+		unsigned char type = dent->d_type;
+		if (DT_UNKNOWN == type)
+		{
+			struct stat st;
+			if (fstatat(dfd, nm, &st, AT_SYMLINK_NOFOLLOW)) continue;
+			if (S_ISDIR(st.st_mode)) type = DT_DIR;
+			else if (S_ISREG(st.st_mode)) type = DT_REG;
+			else continue;
+		}
+
+		if (DT_DIR == type)
+		{
+			if ('r' == ent.first)
+				_pending.emplace_back('r', base + nm);
+			continue;
+		}
+		if (DT_REG != type) continue;
+		if (not _glob.empty() and fnmatch(_glob.c_str(), nm, 0))
+			continue;
+		read_file(dfd, base + nm, nm);
+	}
+	closedir(dp);
+}
+
+/// Report that a directory is done, with the subdirectories it added
+/// to _pending, so that the coordinator knows what is left, should
+/// this worker die. If there are too many for one frame, the first
+/// of them go in 's' records.
+void CrawlWorker::done(const std::string& dir, size_t before)
+{
+	std::string subs;
+	size_t i = before;
+	while (true)
+	{
+		subs.clear();
+		size_t start = i;
+		for (; i < _pending.size() and subs.size() < CrawlProto::MAX_FRAME / 2; i++)
+			CrawlProto::put_string(subs, _pending[i].second);
+
+		_rec.assign(1, (i < _pending.size()) ? 's' : 'd');
+		CrawlProto::put_string(_rec, dir);
+		CrawlProto::put_varint(_rec, i - start);
+		_rec.append(subs);
+		add();
+		if (_pending.size() <= i) break;
+	}
+	if (65536 < _results.size()) flush();
+}
+
+// ==============================================================
+
+int CrawlWorker::run(void)
+{
+	CrawlProto::Kind kind;
+	std::string body;
+	while (true)
+	{
+		read_frame(true, kind, body);
+		if (not handle(kind, body)) continue;
+
+		CrawlProto::Reader rd(body.data(), body.size());
+		uint64_t id = rd.varint();
+		_dirs = _files = _bytes = 0;
+
+		while (not _pending.empty())
+		{
+			// Answer STEALs between directories.
+			while (read_frame(false, kind, body))
+				handle(kind, body);
+			if (_pending.empty()) break;
+
+			Entry ent(std::move(_pending.back()));
+			_pending.pop_back();
+			size_t before = _pending.size();
+			scan(ent);
+			done(ent.second, before);
+		}
+		flush();
+
+		std::string out;
+		size_t start = CrawlProto::begin_frame(out, CrawlProto::DONE);
+		CrawlProto::put_varint(out, id);
+		CrawlProto::put_varint(out, _dirs);
+		CrawlProto::put_varint(out, _files);
+		CrawlProto::put_varint(out, _bytes);
+		CrawlProto::end_frame(out, start);
+		if (not CrawlProto::write_all(_fd, out)) return 1;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	signal(SIGPIPE, SIG_IGN);
+	int fd = (1 < argc) ? atoi(argv[1]) : 3;
+	CrawlWorker wrk(fd);
+	return wrk.run();
+}
@@ -0,0 +1,421 @@
+/*
+ * opencog/atoms/filedir/DirScan.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h> // for strerror()
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/value/StringValue.h>
+
+#include "DirScan.h"
+
+using namespace opencog;
+
+ScanOptions::ScanOptions(void) :
+	by(NONE), reverse(false), limit(0), offset(0),
+	types(0), recursive(false)
+{
+}
+
+static size_t get_count(const Handle& h)
+{
+	if (not h->is_node())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting a number: %s", h->to_string().c_str());
+
+	// Works for NumberNodes as well as ItemNodes holding digits.
+	const char* str = h->get_name().c_str();
+	char* end;
+	double d = strtod(str, &end);
+	if (end == str or d < 0.0)
+		throw RuntimeException(TRACE_INFO,
+			"Expecting a non-negative number: %s", h->to_string().c_str());
+	return (size_t) d;
+}
+
+static void free_regex(regex_t* re)
+{
+	regfree(re);
+	delete re;
+}
+
+void ScanOptions::parse(const Handle& cmd, size_t start)
+{
+	if (not cmd->is_link()) return;
+
+	const HandleSeq& oset = cmd->getOutgoingSet();
+	for (size_t i = start; i < oset.size(); i++)
+	{
+		if (not oset[i]->is_node())
+			throw RuntimeException(TRACE_INFO,
+				"Expecting an option: %s", oset[i]->to_string().c_str());
+
+		const std::string& opt = oset[i]->get_name();
+
+		// Options without a value.
+		if (0 == opt.compare("reverse"))
+		{
+			reverse = true;
+			continue;
+		}
+
+		if (oset.size() <= i+1)
+			throw RuntimeException(TRACE_INFO,
+				"Option \"%s\" expects a value", opt.c_str());
+		const Handle& val = oset[++i];
+		if (not val->is_node())
+			throw RuntimeException(TRACE_INFO,
+				"Option \"%s\" expects a Node: %s",
+				opt.c_str(), val->to_string().c_str());
+
+		if (0 == opt.compare("limit"))
+			limit = get_count(val);
+		else if (0 == opt.compare("offset"))
+			offset = get_count(val);
+		else if (0 == opt.compare("by"))
+		{
+			const std::string& key = val->get_name();
+			if (0 == key.compare("name")) by = NAME;
+			else if (0 == key.compare("mtime")) by = MTIME;
+			else if (0 == key.compare("size")) by = SIZE;
+			else
+				throw RuntimeException(TRACE_INFO,
+					"Unknown sort key \"%s\"", key.c_str());
+		}
+		else if (0 == opt.compare("glob"))
+			glob = val->get_name();
+		else if (0 == opt.compare("regex"))
+		{
+			regex_t* re = new regex_t;
+			int rc = regcomp(re, val->get_name().c_str(),
+			                 REG_EXTENDED | REG_NOSUB);
+			if (rc)
+			{
+				char buf[256];
+				regerror(rc, re, buf, sizeof(buf));
+				delete re;
+				throw RuntimeException(TRACE_INFO,
+					"Bad regex \"%s\": %s", val->get_name().c_str(), buf);
+			}
+			regex = std::shared_ptr<regex_t>(re, free_regex);
+		}
+		else if (0 == opt.compare("type"))
+		{
+			const std::string& ty = val->get_name();
+			if (0 == ty.compare("file")) types |= T_FILE;
+			else if (0 == ty.compare("dir")) types |= T_DIR;
+			else if (0 == ty.compare("symlink")) types |= T_SYMLINK;
+			else if (0 == ty.compare("other")) types |= T_OTHER;
+			else
+				throw RuntimeException(TRACE_INFO,
+					"Unknown file type \"%s\"", ty.c_str());
+		}
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown option \"%s\"", opt.c_str());
+	}
+}
+
+bool ScanOptions::match_name(const char* nm) const
+{
+	if (not glob.empty() and fnmatch(glob.c_str(), nm, FNM_PERIOD))
+		return false;
+	if (regex and regexec(regex.get(), nm, 0, nullptr, 0))
+		return false;
+	return true;
+}
+
+// ==============================================================
+
+struct Ranked
+{
+	int64_t key;       // mtime or size; unused when sorting by name.
+	std::string name;
+};
+
+static inline unsigned dtype_bits(unsigned char dt)
+{
+	switch (dt)
+	{
+		case DT_REG: return ScanOptions::T_FILE;
+		case DT_DIR: return ScanOptions::T_DIR;
+		case DT_LNK: return ScanOptions::T_SYMLINK;
+		case DT_UNKNOWN: return 0;
+		default: return ScanOptions::T_OTHER;
+	}
+}
+
+static inline unsigned mode_bits(mode_t m)
+{
+	if (S_ISREG(m)) return ScanOptions::T_FILE;
+	if (S_ISDIR(m)) return ScanOptions::T_DIR;
+	if (S_ISLNK(m)) return ScanOptions::T_SYMLINK;
+	return ScanOptions::T_OTHER;
+}
+
+/// Comparison used for ranking. `operator()(a,b)` is true if `a`
+/// should be listed before `b`. Default order is newest first,
+/// largest first, and names ascending.
+struct RankOrder
+{
+	ScanOptions::SortKey by;
+	bool desc;
+	bool operator()(const Ranked& a, const Ranked& b) const
+	{
+		if (ScanOptions::NAME == by or ScanOptions::NONE == by)
+			return desc ? b.name < a.name : a.name < b.name;
+		if (a.key != b.key)
+			return desc ? b.key < a.key : a.key < b.key;
+		return a.name < b.name;
+	}
+};
+
+class DirScanner
+{
+	const ScanOptions& _opts;
+	std::string _root;
+	int _err;          // errno, if the walk had to stop.
+	RankOrder _order;
+	bool _ranked;
+	bool _need_stat;
+	size_t _keep;
+
+	// Max-heap on "worse", so that the top is the worst entry kept.
+	std::priority_queue<Ranked, std::vector<Ranked>, RankOrder> _heap;
+	std::vector<std::string> _plain;
+
+	bool beats_top(const char*, const std::string&, int64_t) const;
+	void accept(const char*, const std::string&, int64_t);
+
+public:
+	DirScanner(const ScanOptions&, const std::string& root);
+	void scan(int dfd, const std::string& rel);
+	int error(void) const { return _err; }
+	std::vector<std::string> results(void);
+};
+
+DirScanner::DirScanner(const ScanOptions& opts, const std::string& root) :
+	_opts(opts),
+	_root(root),
+	_err(0),
+	_order({opts.by, (ScanOptions::MTIME == opts.by or
+	        ScanOptions::SIZE == opts.by) != opts.reverse}),
+	_ranked(ScanOptions::NONE != opts.by or 0 < opts.limit or
+	        0 < opts.offset),
+	_need_stat(ScanOptions::MTIME == opts.by or ScanOptions::SIZE == opts.by),
+	_keep(opts.limit ? opts.limit + opts.offset : SIZE_MAX),
+	_heap(_order)
+{
+}
+
+/// Compare `rel + nm` to `name`, as std::string::compare() would,
+/// without joining them.
+static int compare_joined(const std::string& rel, const char* nm,
+                          const std::string& name)
+{
+	int rc = name.compare(0, rel.size(), rel);
+	if (rc) return -rc;
+	return -name.compare(rel.size(), std::string::npos, nm);
+}
+
+/// True if the entry would be listed before the worst one kept; the
+/// same as _order(entry, _heap.top()), but with nothing copied.
+bool DirScanner::beats_top(const char* nm, const std::string& rel,
+                           int64_t key) const
+{
+	const Ranked& top = _heap.top();
+	if (ScanOptions::NAME == _opts.by or ScanOptions::NONE == _opts.by)
+	{
+		int rc = compare_joined(rel, nm, top.name);
+		return _order.desc ? 0 < rc : rc < 0;
+	}
+	if (key != top.key)
+		return _order.desc ? top.key < key : key < top.key;
+	return compare_joined(rel, nm, top.name) < 0;
+}
+
+void DirScanner::accept(const char* nm, const std::string& rel, int64_t key)
+{
+	if (not _ranked)
+	{
+		_plain.emplace_back(rel + nm);
+		return;
+	}
+
+	// Once the heap is full, most entries lose to the worst one kept;
+	// they are compared in place, and only those that make it into
+	// the heap get a string.
+	if (_heap.size() >= _keep)
+	{
+		if (not beats_top(nm, rel, key)) return;
+		_heap.pop();
+	}
+	_heap.push({key, rel + nm});
+}
+
+void DirScanner::scan(int dfd, const std::string& rel)
+{
+	DIR* dir = fdopendir(dfd);
+	if (nullptr == dir) { close(dfd); return; }
+
+	std::vector<std::string> subdirs;
+	struct dirent* dent;
+	while ((dent = readdir(dir)))
+	{
+		const char* nm = dent->d_name;
+		if ('.' == nm[0] and (0 == nm[1] or ('.' == nm[1] and 0 == nm[2])))
+			continue;
+
+		unsigned tbits = dtype_bits(dent->d_type);
+		struct stat st;
+		bool have_stat = false;
+		if (0 == tbits)
+		{
+			if (fstatat(dfd, nm, &st, AT_SYMLINK_NOFOLLOW)) continue;
+			have_stat = true;
+			tbits = mode_bits(st.st_mode);
+		}
+
+		if (_opts.recursive and ScanOptions::T_DIR == tbits)
+			subdirs.emplace_back(nm);
+
+		// Filters on the raw dirent; nothing allocated yet.
+		if (_opts.types and 0 == (_opts.types & tbits)) continue;
+		if (not _opts.match_name(nm)) continue;
+
+		int64_t key = 0;
+		if (_need_stat)
+		{
+			if (not have_stat and fstatat(dfd, nm, &st, AT_SYMLINK_NOFOLLOW))
+				continue;
+			key = (ScanOptions::MTIME == _opts.by) ?
+				(int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec :
+				(int64_t) st.st_size;
+		}
+		accept(nm, rel, key);
+	}
+
+	// Each level of the walk holds its directory open. Should that
+	// run out of file descriptors, this one is closed, and its
+	// subdirectories are opened by path instead. If even that fails,
+	// the walk stops, and scan_dir() throws, rather than return a
+	// listing with subtrees silently missing.
+	const int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+	for (const std::string& sd : subdirs)
+	{
+		int sfd = -1;
+		if (dir)
+		{
+			sfd = openat(dfd, sd.c_str(), flags);
+			if (0 > sfd and (EMFILE == errno or ENFILE == errno))
+			{
+				closedir(dir);
+				dir = nullptr;
+			}
+		}
+		if (nullptr == dir)
+			sfd = open((_root + "/" + rel + sd).c_str(), flags);
+		if (0 > sfd)
+		{
+			if (EMFILE != errno and ENFILE != errno) continue;
+			_err = errno;
+			break;
+		}
+		scan(sfd, rel + sd + "/");
+		if (_err) break;
+	}
+	if (dir) closedir(dir);
+}
+
+std::vector<std::string> DirScanner::results(void)
+{
+	if (not _ranked) return std::move(_plain);
+
+	// Drain the heap; it comes out worst-first.
+	std::vector<std::string> kept;
+	kept.reserve(_heap.size());
+	while (not _heap.empty())
+	{
+		kept.emplace_back(std::move(const_cast<Ranked&>(_heap.top()).name));
+		_heap.pop();
+	}
+	std::reverse(kept.begin(), kept.end());
+	if (_opts.offset >= kept.size()) return {};
+	kept.erase(kept.begin(), kept.begin() + _opts.offset);
+	return kept;
+}
+
+// ==============================================================
+
+ValueSeq opencog::list_dir(const std::string& path, const std::string& url,
+                           const ScanOptions& opts)
+{
+	ValueSeq vents;
+	std::string base = url + "/";
+
+	// Plain listing, in directory order, as it always was.
+	if (opts.is_plain())
+	{
+		DIR* dir = opendir(path.c_str());
+		if (nullptr == dir)
+			throw RuntimeException(TRACE_INFO,
+				"Cannot list \"%s\": %s\n", path.c_str(), strerror(errno));
+
+		struct dirent* dent;
+		while ((dent = readdir(dir)))
+			vents.emplace_back(createStringValue(base + dent->d_name));
+		closedir(dir);
+		return vents;
+	}
+
+	for (const std::string& name : scan_dir(path, opts))
+		vents.emplace_back(createStringValue(base + name));
+	return vents;
+}
+
+std::vector<std::string> opencog::scan_dir(const std::string& path,
+                                           const ScanOptions& opts)
+{
+	int dfd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (0 > dfd)
+		throw RuntimeException(TRACE_INFO,
+			"Cannot list \"%s\": %s\n", path.c_str(), strerror(errno));
+
+	DirScanner scanner(opts, path);
+	scanner.scan(dfd, "");
+	if (scanner.error())
+		throw RuntimeException(TRACE_INFO,
+			"Cannot list \"%s\": %s\n", path.c_str(),
+			strerror(scanner.error()));
+	return scanner.results();
+}
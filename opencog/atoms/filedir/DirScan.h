@@ -0,0 +1,103 @@
+/*
+ * opencog/atoms/filedir/DirScan.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_DIR_SCAN_H
+#define _OPENCOG_DIR_SCAN_H
+
+#include <regex.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencog/atoms/base/Handle.h>
+#include <opencog/atoms/value/Value.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * Options for directory listings. These are given as keyword-value
+ * pairs following the command, e.g.
+ *
+ *    (List (Item "ls") (Item "by") (Item "mtime") (Item "limit") (Number 10))
+ *
+ * to get the ten newest entries. Ranking is done during the scan,
+ * with a bounded heap, so memory use is proportional to the limit
+ * (plus offset), and not to the size of the directory.
+ *
+ * Filters select entries by name, with a shell glob or a POSIX
+ * extended regex, and by type (file, dir, symlink, other). They are
+ * applied to the raw directory entries, before anything is allocated
+ * for them, so that a filter that matches few entries is cheap, even
+ * on huge directories. For recursive walks, filters select what is
+ * reported; all subdirectories are still descended into.
+ */
+struct ScanOptions
+{
+	enum SortKey { NONE, NAME, MTIME, SIZE };
+	enum TypeBits { T_FILE = 1, T_DIR = 2, T_SYMLINK = 4, T_OTHER = 8 };
+
+	SortKey by;
+	bool reverse;      // Flip the default order for the key.
+	size_t limit;      // Zero means no limit.
+	size_t offset;
+
+	unsigned types;    // Bitmask of TypeBits; zero means any.
+	std::string glob;
+	std::shared_ptr<regex_t> regex;
+	bool recursive;    // Set by the walk command, not by an option.
+
+	ScanOptions(void);
+
+	/// Parse keyword-value pairs, starting at the given position
+	/// in the outgoing set of the command.
+	void parse(const Handle& cmd, size_t start);
+
+	bool is_plain(void) const
+	{
+		return NONE == by and 0 == limit and 0 == offset and
+			0 == types and glob.empty() and nullptr == regex and
+			not recursive;
+	}
+
+	/// True if the name passes the glob and regex filters.
+	bool match_name(const char*) const;
+};
+
+/// List the directory at `path`, or, if the options ask for it, the
+/// whole tree under it. Returned values are StringValues holding
+/// `url + "/" + relative-path`.
+ValueSeq list_dir(const std::string& path, const std::string& url,
+                  const ScanOptions&);
+
+/// The relative paths of the entries that list_dir() would return,
+/// without the URL, and without the "." and ".." entries.
+std::vector<std::string> scan_dir(const std::string& path,
+                                  const ScanOptions&);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_DIR_SCAN_H
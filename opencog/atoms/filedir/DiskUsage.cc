@@ -0,0 +1,343 @@
+/*
+ * opencog/atoms/filedir/DiskUsage.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+
+#include "DiskUsage.h"
+#include "LruCache.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Cache of directory listings, keyed by device and inode. The cached
+// data is valid for as long as the directory mtime is unchanged. At
+// most DU_CACHE_DIRS directories are kept; the least recently used
+// are dropped.
+
+typedef std::pair<dev_t, ino_t> DirKey;
+
+/// A file with more than one link; it is counted only once per walk,
+/// however many directories it is in.
+struct Linked
+{
+	DirKey key;
+	uint64_t disk;
+	uint64_t apparent;
+};
+
+struct DirSummary
+{
+	int64_t mtime_ns;
+	uint64_t disk;      // Bytes in files with one link, not subdirs.
+	uint64_t apparent;
+	uint64_t nfiles;
+	std::vector<Linked> linked;
+	std::vector<std::string> subdirs;
+};
+
+#define DU_CACHE_DIRS 65536
+
+static std::mutex _cache_mtx;
+static LruCache<DirKey, DirSummary> _cache(DU_CACHE_DIRS);
+
+// ==============================================================
+
+struct DuNode
+{
+	std::string path;
+	DuNode* parent;
+	std::atomic<size_t> pending;   // Unfinished subdirs, plus one for self.
+	std::atomic<uint64_t> disk;
+	std::atomic<uint64_t> apparent;
+	std::atomic<uint64_t> nfiles;
+	std::atomic<uint64_t> ndirs;
+
+	DuNode(const std::string& p, DuNode* par) :
+		path(p), parent(par), pending(1),
+		disk(0), apparent(0), nfiles(0), ndirs(1) {}
+};
+
+class DuWalker
+{
+	std::string _pfx;
+
+	// Only a weak reference: once the reader drops the stream, no one
+	// wants the results, and the walk stops.
+	std::weak_ptr<ItemStream> _out;
+	std::atomic<bool> _cancel;
+
+	std::mutex _mtx;
+	std::condition_variable _cv;
+	std::deque<DuNode*> _work;
+	size_t _busy;
+	bool _done;
+
+	// Files with more than one link, seen so far on this walk.
+	std::mutex _seen_mtx;
+	std::set<DirKey> _seen;
+
+	void worker(void);
+	void scan(DuNode*);
+	void finish(DuNode*);
+
+public:
+	DuWalker(const std::string& pfx, const std::weak_ptr<ItemStream>& out) :
+		_pfx(pfx), _out(out), _cancel(false), _busy(0), _done(false) {}
+	void run(const std::string&);
+};
+
+static inline int64_t stx_mtime(const struct statx& stx)
+{
+	return (int64_t) stx.stx_mtime.tv_sec * 1000000000LL +
+		stx.stx_mtime.tv_nsec;
+}
+
+/// Post-order completion. When the last subdir of a directory is
+/// done, the directory itself is done; report it, and pass the totals
+/// up to the parent.
+void DuWalker::finish(DuNode* node)
+{
+	while (node and 0 == --node->pending)
+	{
+		ItemStreamPtr out(_out.lock());
+		if (nullptr == out)
+			_cancel = true;
+		else if (not _cancel)
+			out->add(createLinkValue(ValueSeq({
+				createStringValue(_pfx + node->path),
+				createFloatValue(std::vector<double>({
+					(double) node->disk, (double) node->apparent,
+					(double) node->nfiles, (double) node->ndirs}))})));
+
+		DuNode* par = node->parent;
+		if (par)
+		{
+			par->disk += node->disk;
+			par->apparent += node->apparent;
+			par->nfiles += node->nfiles;
+			par->ndirs += node->ndirs;
+		}
+		delete node;
+		node = par;
+	}
+}
+
+void DuWalker::scan(DuNode* node)
+{
+	int dfd = open(node->path.c_str(),
+		O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (0 > dfd) { finish(node); return; }
+
+	struct statx stx;
+	if (statx(dfd, "", AT_EMPTY_PATH, STATX_MTIME | STATX_INO, &stx))
+	{
+		close(dfd);
+		finish(node);
+		return;
+	}
+
+	DirKey key(makedev(stx.stx_dev_major, stx.stx_dev_minor), stx.stx_ino);
+	int64_t mtime = stx_mtime(stx);
+
+	DirSummary sum;
+	bool hit = false;
+	{
+		std::lock_guard<std::mutex> lck(_cache_mtx);
+		DirSummary* have = _cache.find(key);
+		if (have and have->mtime_ns == mtime)
+		{
+			sum = *have;
+			hit = true;
+		}
+	}
+
+	if (not hit)
+	{
+		sum.mtime_ns = mtime;
+		sum.disk = 0;
+		sum.apparent = 0;
+		sum.nfiles = 0;
+
+		DIR* dp = fdopendir(dfd);
+		if (nullptr == dp) { close(dfd); finish(node); return; }
+
+		struct dirent* dent;
+		while ((dent = readdir(dp)))
+		{
+			const char* nm = dent->d_name;
+			if ('.' == nm[0] and (0 == nm[1] or ('.' == nm[1] and 0 == nm[2])))
+				continue;
+
+			// Directories are stat'ed when they are scanned.
+			if (DT_DIR == dent->d_type)
+			{
+				sum.subdirs.emplace_back(nm);
+				continue;
+			}
+
+			if (statx(dfd, nm, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+			          STATX_TYPE | STATX_SIZE | STATX_BLOCKS |
+			          STATX_NLINK | STATX_INO, &stx))
+				continue;
+
+			if (S_ISDIR(stx.stx_mode))
+			{
+				sum.subdirs.emplace_back(nm);
+				continue;
+			}
+			if (1 < stx.stx_nlink)
+			{
+				sum.linked.push_back({
+					DirKey(makedev(stx.stx_dev_major, stx.stx_dev_minor),
+					       stx.stx_ino),
+					stx.stx_blocks * 512, stx.stx_size});
+				continue;
+			}
+			sum.disk += stx.stx_blocks * 512;
+			sum.apparent += stx.stx_size;
+			sum.nfiles ++;
+		}
+		closedir(dp);
+
+		std::lock_guard<std::mutex> lck(_cache_mtx);
+		_cache.put(key, sum);
+	}
+	else
+		close(dfd);
+
+	node->disk += sum.disk;
+	node->apparent += sum.apparent;
+	node->nfiles += sum.nfiles;
+
+	// As `du` does, a file with many links is counted where it is
+	// first found.
+	if (0 < sum.linked.size())
+	{
+		std::lock_guard<std::mutex> lck(_seen_mtx);
+		for (const Linked& lnk : sum.linked)
+		{
+			if (not _seen.insert(lnk.key).second) continue;
+			node->disk += lnk.disk;
+			node->apparent += lnk.apparent;
+			node->nfiles ++;
+		}
+	}
+
+	if (0 < sum.subdirs.size())
+	{
+		node->pending += sum.subdirs.size();
+		std::string base = (1 == node->path.size()) ?
+			node->path : node->path + "/";
+
+		std::lock_guard<std::mutex> lck(_mtx);
+		for (const std::string& sd : sum.subdirs)
+			_work.push_back(new DuNode(base + sd, node));
+		_cv.notify_all();
+	}
+
+	// Drop the self-count; this completes leaf directories at once.
+	finish(node);
+}
+
+void DuWalker::worker(void)
+{
+	std::unique_lock<std::mutex> lck(_mtx);
+	while (true)
+	{
+		while (_work.empty() and not _done)
+			_cv.wait(lck);
+		if (_work.empty()) return;
+
+		// Depth-first, so that subtrees complete, and get reported,
+		// early, and the work queue stays short.
+		DuNode* node = _work.back();
+		_work.pop_back();
+		_busy++;
+		lck.unlock();
+
+		// Once cancelled, what is left is finished without being
+		// read, so that the nodes are all freed.
+		if (_out.expired()) _cancel = true;
+		if (_cancel)
+			finish(node);
+		else
+			scan(node);
+
+		lck.lock();
+		_busy--;
+		if (0 == _busy and _work.empty())
+		{
+			_done = true;
+			_cv.notify_all();
+		}
+	}
+}
+
+void DuWalker::run(const std::string& root)
+{
+	_work.push_back(new DuNode(root, nullptr));
+
+	size_t nthr = std::thread::hardware_concurrency();
+	if (0 == nthr) nthr = 4;
+
+	std::vector<std::thread> pool;
+	for (size_t i = 0; i < nthr; i++)
+		pool.emplace_back(&DuWalker::worker, this);
+	for (std::thread& t : pool)
+		t.join();
+
+	ItemStreamPtr out(_out.lock());
+	if (out) out->close();
+}
+
+// ==============================================================
+
+void opencog::disk_usage(const std::string& root, const std::string& pfx,
+                         const ItemStreamPtr& out)
+{
+	// Return at once; results arrive on the stream as they are found.
+	// The walker does not keep the stream alive: if the reader drops
+	// it, the walk stops at the next directory.
+	std::weak_ptr<ItemStream> wout(out);
+	std::thread([root, pfx, wout]()
+	{
+		DuWalker walker(pfx, wout);
+		walker.run(root);
+	}).detach();
+}
@@ -0,0 +1,67 @@
+/*
+ * opencog/atoms/filedir/DiskUsage.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_DISK_USAGE_H
+#define _OPENCOG_DISK_USAGE_H
+
+#include <string>
+#include <opencog/atoms/sensory/ItemStream.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * Compute per-directory size totals for the tree at `root`, in the
+ * manner of `du`. The tree is walked by a pool of threads; each
+ * directory is reported to `out` as soon as its subtree is complete,
+ * so the stream delivers results in post-order. The stream is closed
+ * after the root is reported.
+ *
+ * Each result is a LinkValue holding the directory URL (the path,
+ * prefixed by `pfx`) and a FloatValue of
+ *    (disk-bytes apparent-bytes num-files num-dirs)
+ * for the entire subtree.
+ *
+ * A file with more than one link is counted once, in whichever
+ * directory it is found in first, as `du` does.
+ *
+ * Directory listings are cached, keyed by the directory mtime, so
+ * repeated runs only re-read directories that changed; the cache
+ * holds the most recently used 65536 directories. Note that writing
+ * to a file does not change the mtime of the directory holding it,
+ * so totals for growing files may lag until some entry in that
+ * directory is created, deleted or renamed.
+ *
+ * The walk holds only a weak reference to `out`; once no one else
+ * holds the stream, the walk stops.
+ */
+void disk_usage(const std::string& root, const std::string& pfx,
+                const ItemStreamPtr& out);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_DISK_USAGE_H
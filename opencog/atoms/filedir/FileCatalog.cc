@@ -0,0 +1,522 @@
+/*
+ * opencog/atoms/filedir/FileCatalog.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // for strerror()
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include <opencog/util/exceptions.h>
+#include "CacheDir.h"
+#include "FileCatalog.h"
+
+using namespace opencog;
+
+static const char CAT_MAGIC[8] = {'O','C','F','S','C','A','T','1'};
+static const uint32_t CAT_VERSION = 1;
+
+static_assert(sizeof(CatalogHeader) == 48, "Catalog header not packed");
+static_assert(sizeof(CatalogEntry) == 32, "Catalog entry not packed");
+
+// ==============================================================
+// Reader
+
+CatalogReader::CatalogReader(void) :
+	_fd(-1), _len(0), _map(nullptr),
+	_hdr(nullptr), _ents(nullptr), _strtab(nullptr)
+{
+}
+
+CatalogReader::~CatalogReader()
+{
+	close();
+}
+
+void CatalogReader::close(void)
+{
+	if (_map) munmap((void*) _map, _len);
+	if (0 <= _fd) ::close(_fd);
+	_fd = -1;
+	_len = 0;
+	_map = nullptr;
+	_hdr = nullptr;
+	_ents = nullptr;
+	_strtab = nullptr;
+}
+
+/// Map the catalog file. Returns false if there is no such file,
+/// or if it is not a valid catalog.
+bool CatalogReader::open(const std::string& catfile)
+{
+	close();
+	_fd = ::open(catfile.c_str(), O_RDONLY | O_CLOEXEC);
+	if (0 > _fd) return false;
+
+	struct stat st;
+	if (fstat(_fd, &st) or st.st_size < (off_t) sizeof(CatalogHeader))
+	{
+		close();
+		return false;
+	}
+	_len = st.st_size;
+	void* map = mmap(nullptr, _len, PROT_READ, MAP_SHARED, _fd, 0);
+	if (MAP_FAILED == map)
+	{
+		_len = 0;
+		close();
+		return false;
+	}
+	_map = (const char*) map;
+	_hdr = (const CatalogHeader*) _map;
+
+	// The file may be damaged, or may have been written by someone
+	// else; nothing in it can be trusted until it has been checked.
+	// Sums are arranged so that they cannot overflow.
+	if (memcmp(_hdr->magic, CAT_MAGIC, 8) or
+	    CAT_VERSION != _hdr->version or
+	    _hdr->strtab_off > _len or
+	    _hdr->strtab_len > _len - _hdr->strtab_off or
+	    _hdr->rootlen >= _hdr->strtab_len or
+	    _hdr->nentries > (_len - sizeof(CatalogHeader)) / sizeof(CatalogEntry) or
+	    sizeof(CatalogHeader) + _hdr->nentries * sizeof(CatalogEntry)
+	        > _hdr->strtab_off)
+	{
+		close();
+		return false;
+	}
+	_ents = (const CatalogEntry*) (_map + sizeof(CatalogHeader));
+	_strtab = _map + _hdr->strtab_off;
+
+	// Each path must be NUL-terminated and inside the string table,
+	// and the paths must be in order, for the searches to stay in it.
+	uint64_t slen = _hdr->strtab_len;
+	uint64_t prev = _hdr->rootlen;
+	bool ok = 0 == _strtab[_hdr->rootlen];
+	for (uint64_t i = 0; ok and i < _hdr->nentries; i++)
+	{
+		const CatalogEntry& e = _ents[i];
+		ok = prev < e.path_off and e.path_off < slen and
+			e.path_len < slen - e.path_off and
+			0 == _strtab[e.path_off + e.path_len];
+		prev = e.path_off + e.path_len;
+	}
+	if (not ok)
+	{
+		close();
+		return false;
+	}
+
+	// Entries are read in-place; only advise, don't prefault.
+	madvise(map, _len, MADV_WILLNEED);
+	return true;
+}
+
+std::string CatalogReader::root(void) const
+{
+	if (nullptr == _hdr) return "";
+	return std::string(_strtab, _hdr->rootlen);
+}
+
+void CatalogReader::prefix_range(const std::string& pfx,
+                                 size_t& lo, size_t& hi) const
+{
+	size_t n = size();
+	const CatalogEntry* first = std::lower_bound(_ents, _ents + n, pfx,
+		[this](const CatalogEntry& e, const std::string& p)
+			{ return strcmp(_strtab + e.path_off, p.c_str()) < 0; });
+
+	// Everything with the prefix is contiguous; bisect for the end.
+	const CatalogEntry* last = std::partition_point(first, _ents + n,
+		[this, &pfx](const CatalogEntry& e)
+			{ return 0 == strncmp(_strtab + e.path_off,
+			                      pfx.c_str(), pfx.size()); });
+
+	lo = first - _ents;
+	hi = last - _ents;
+}
+
+// ==============================================================
+// Writer
+
+FileCatalog::FileCatalog(const std::string& root,
+                         const std::string& catfile) :
+	_root(root), _catfile(catfile), _ifd(-1), _watcher(nullptr),
+	_stop(false), _rescan(false)
+{
+	// Trailing slashes confuse the prefix logic.
+	while (1 < _root.size() and '/' == _root.back())
+		_root.pop_back();
+}
+
+FileCatalog::~FileCatalog()
+{
+	_stop = true;
+	if (_watcher)
+	{
+		_watcher->join();
+		delete _watcher;
+	}
+	if (0 <= _ifd) close(_ifd);
+}
+
+/// The default location of the catalog for a given root directory.
+/// Kept out of the tree itself, so that writing it does not modify
+/// the thing being cataloged, and in a per-user directory, so that
+/// other users can neither read it nor plant one.
+std::string FileCatalog::default_path(const std::string& root)
+{
+	return user_cache_file(root, ".cat");
+}
+
+const char* FileCatalog::type_name(uint8_t t)
+{
+	switch (t)
+	{
+		case CAT_FILE: return "file";
+		case CAT_DIR: return "dir";
+		case CAT_SYMLINK: return "symlink";
+		default: return "other";
+	}
+}
+
+namespace opencog {
+struct CatRec
+{
+	std::string path;
+	uint64_t size;
+	int64_t mtime_ns;
+	uint8_t type;
+};
+}
+
+static inline int64_t mtime_ns(const struct stat& st)
+{
+	return (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+static inline uint8_t cat_type(mode_t m)
+{
+	if (S_ISREG(m)) return CAT_FILE;
+	if (S_ISDIR(m)) return CAT_DIR;
+	if (S_ISLNK(m)) return CAT_SYMLINK;
+	return CAT_OTHER;
+}
+
+/// Rebuild the catalog. Directories that have not changed since the
+/// last catalog are not read; their entries are copied over. Changed
+/// directories are re-read, and their entries re-stat'ed. The result
+/// is written to a temp file and renamed into place, so that readers
+/// that already have the old catalog mapped keep a consistent view.
+size_t FileCatalog::refresh(void)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+
+	// Index the old catalog by parent directory.
+	CatalogReader old;
+	bool have_old = old.open(_catfile) and old.root() == _root;
+
+	std::unordered_map<std::string, std::vector<size_t>> kids;
+	std::unordered_map<std::string, int64_t> dir_mtime;
+	if (have_old)
+	{
+		for (size_t i = 0; i < old.size(); i++)
+		{
+			const CatalogEntry& e = old.entry(i);
+			const char* p = old.path(i);
+			const char* sl = strrchr(p, '/');
+			if (sl and i)
+				kids[sl == p ? "/" : std::string(p, sl - p)].push_back(i);
+			if (CAT_DIR == e.type)
+				dir_mtime[std::string(p, e.path_len)] = e.mtime_ns;
+		}
+	}
+
+	std::set<std::string> dirty;
+	bool rescan;
+	{
+		std::lock_guard<std::mutex> dlck(_dirty_mtx);
+		dirty.swap(_dirty);
+		rescan = _rescan;
+		_rescan = false;
+	}
+
+	std::vector<CatRec> recs;
+	struct stat st;
+	if (lstat(_root.c_str(), &st) or not S_ISDIR(st.st_mode))
+		throw RuntimeException(TRACE_INFO,
+			"Cannot catalog \"%s\": %s\n", _root.c_str(), strerror(errno));
+
+	recs.push_back({_root, (uint64_t) st.st_size, mtime_ns(st), CAT_DIR});
+
+	// Explicit stack; the tree may be deep.
+	std::vector<std::pair<std::string, int64_t>> stack;
+	stack.push_back({_root, mtime_ns(st)});
+	while (not stack.empty())
+	{
+		std::string dir = std::move(stack.back().first);
+		int64_t dmt = stack.back().second;
+		stack.pop_back();
+
+		if (0 <= _ifd) add_watch(dir);
+
+		auto dm = dir_mtime.find(dir);
+		bool reuse = have_old and not rescan and dm != dir_mtime.end() and
+			dm->second == dmt and 0 == dirty.count(dir);
+
+		if (reuse)
+		{
+			auto kl = kids.find(dir);
+			if (kl == kids.end()) continue;
+			for (size_t i : kl->second)
+			{
+				const CatalogEntry& e = old.entry(i);
+				CatRec rec{std::string(old.path(i), e.path_len),
+					e.size, e.mtime_ns, e.type};
+
+				// A directory's mtime changes when its own contents
+				// change, and not the parent's. So subdirs must be
+				// looked at again, even when the parent is unchanged.
+				if (CAT_DIR == e.type)
+				{
+					if (lstat(rec.path.c_str(), &st)) continue;
+					rec.mtime_ns = mtime_ns(st);
+					rec.size = st.st_size;
+					rec.type = cat_type(st.st_mode);
+					if (CAT_DIR == rec.type)
+						stack.push_back({rec.path, rec.mtime_ns});
+				}
+				recs.emplace_back(std::move(rec));
+			}
+			continue;
+		}
+
+		int dfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW |
+		                            O_CLOEXEC);
+		if (0 > dfd) continue;
+		DIR* dp = fdopendir(dfd);
+		if (nullptr == dp) { close(dfd); continue; }
+
+		struct dirent* dent;
+		while ((dent = readdir(dp)))
+		{
+			const char* nm = dent->d_name;
+			if ('.' == nm[0] and (0 == nm[1] or ('.' == nm[1] and 0 == nm[2])))
+				continue;
+			if (fstatat(dfd, nm, &st, AT_SYMLINK_NOFOLLOW)) continue;
+
+			std::string path = (1 == dir.size()) ? dir + nm : dir + "/" + nm;
+			// The catalog itself, and its temp files.
+			if (0 == path.compare(0, _catfile.size(), _catfile)) continue;
+
+			uint8_t ty = cat_type(st.st_mode);
+			if (CAT_DIR == ty)
+				stack.push_back({path, mtime_ns(st)});
+			recs.push_back({std::move(path), (uint64_t) st.st_size,
+				mtime_ns(st), ty});
+		}
+		closedir(dp);
+	}
+
+	old.close();
+
+	std::sort(recs.begin(), recs.end(),
+		[](const CatRec& a, const CatRec& b) { return a.path < b.path; });
+
+	write_catalog(recs);
+	return recs.size();
+}
+
+void FileCatalog::write_catalog(const std::vector<CatRec>& recs)
+{
+	const std::string& catfile = _catfile;
+
+	CatalogHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CAT_MAGIC, 8);
+	hdr.version = CAT_VERSION;
+	hdr.rootlen = _root.size();
+	hdr.nentries = recs.size();
+	hdr.strtab_off = sizeof(CatalogHeader) + recs.size() * sizeof(CatalogEntry);
+	hdr.built = time(nullptr);
+
+	std::vector<CatalogEntry> ents(recs.size());
+	std::string strtab;
+	strtab.reserve(_root.size() + 1 + recs.size() * 48);
+	strtab.append(_root);
+	strtab.push_back(0);
+	for (size_t i = 0; i < recs.size(); i++)
+	{
+		CatalogEntry& e = ents[i];
+		memset(&e, 0, sizeof(e));
+		e.path_off = strtab.size();
+		e.path_len = recs[i].path.size();
+		e.size = recs[i].size;
+		e.mtime_ns = recs[i].mtime_ns;
+		e.type = recs[i].type;
+		strtab.append(recs[i].path);
+		strtab.push_back(0);
+	}
+	hdr.strtab_len = strtab.size();
+
+	// A fresh, exclusively created temp file; a fixed name could be
+	// a symlink planted by someone else.
+	std::string tmpfile = catfile + ".XXXXXX";
+	int fd = mkostemp(&tmpfile[0], O_CLOEXEC);
+	FILE* fh = (0 > fd) ? nullptr : fdopen(fd, "w");
+	if (nullptr == fh)
+	{
+		int norr = errno;
+		if (0 <= fd) { close(fd); unlink(tmpfile.c_str()); }
+		throw RuntimeException(TRACE_INFO,
+			"Cannot write catalog \"%s\": %s\n",
+			tmpfile.c_str(), strerror(norr));
+	}
+
+	bool ok = 1 == fwrite(&hdr, sizeof(hdr), 1, fh);
+	if (ok and 0 < ents.size())
+		ok = ents.size() == fwrite(ents.data(), sizeof(CatalogEntry),
+		                           ents.size(), fh);
+	if (ok)
+		ok = 1 == fwrite(strtab.data(), strtab.size(), 1, fh);
+	if (fclose(fh)) ok = false;
+
+	if (not ok or rename(tmpfile.c_str(), catfile.c_str()))
+	{
+		int norr = errno;
+		unlink(tmpfile.c_str());
+		throw RuntimeException(TRACE_INFO,
+			"Cannot write catalog \"%s\": %s\n",
+			catfile.c_str(), strerror(norr));
+	}
+}
+
+// ==============================================================
+// inotify watcher
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                    IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF)
+
+void FileCatalog::add_watch(const std::string& dir)
+{
+	int wd = inotify_add_watch(_ifd, dir.c_str(), WATCH_MASK | IN_ONLYDIR);
+	if (0 > wd) return;  // Out of watches, probably. Fall back to mtime.
+
+	std::lock_guard<std::mutex> dlck(_dirty_mtx);
+	_wdpath[wd] = dir;
+}
+
+void FileCatalog::watch(void)
+{
+	if (_watcher) return;
+
+	_ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (0 > _ifd)
+		throw RuntimeException(TRACE_INFO,
+			"Cannot watch \"%s\": %s\n", _root.c_str(), strerror(errno));
+
+	// The refresh adds watches as it walks.
+	refresh();
+	_watcher = new std::thread(&FileCatalog::watch_loop, this);
+}
+
+/// Collect dirty directories from inotify, and refresh the catalog
+/// once things have been quiet for a little while. Bursts of changes
+/// (e.g. untarring something) result in one refresh, not thousands.
+/// A steady trickle of changes, that is never quiet, still gets a
+/// refresh every MAX_DELAY_MSECS.
+void FileCatalog::watch_loop(void)
+{
+	static const int QUIET_MSECS = 1000;
+	static const int MAX_DELAY_MSECS = 10000;
+	alignas(struct inotify_event) char buf[16384];
+	bool pending = false;
+	std::chrono::steady_clock::time_point first;
+
+	auto waited = [&first](void) -> int
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - first).count();
+	};
+
+	while (not _stop)
+	{
+		int wait = 500;
+		if (pending)
+			wait = std::min(QUIET_MSECS,
+			                std::max(0, MAX_DELAY_MSECS - waited()));
+
+		struct pollfd pfd = {_ifd, POLLIN, 0};
+		int rc = poll(&pfd, 1, wait);
+		if (0 > rc and EINTR != errno) return;
+
+		ssize_t len = (0 < rc) ? read(_ifd, buf, sizeof(buf)) : 0;
+		if (0 < len)
+		{
+			std::lock_guard<std::mutex> dlck(_dirty_mtx);
+			for (char* p = buf; p < buf + len; )
+			{
+				struct inotify_event* ev = (struct inotify_event*) p;
+				p += sizeof(struct inotify_event) + ev->len;
+
+				// The kernel queue filled up, and events were lost;
+				// there's no telling which directories changed.
+				if (ev->mask & IN_Q_OVERFLOW)
+				{
+					_rescan = true;
+					if (not pending) first = std::chrono::steady_clock::now();
+					pending = true;
+					continue;
+				}
+
+				auto wp = _wdpath.find(ev->wd);
+				if (wp == _wdpath.end()) continue;
+				_dirty.insert(wp->second);
+				if (not pending) first = std::chrono::steady_clock::now();
+				pending = true;
+
+				if (ev->mask & IN_IGNORED)
+					_wdpath.erase(wp);
+			}
+		}
+
+		if (not pending) continue;
+		if (0 != rc and waited() < MAX_DELAY_MSECS) continue;
+
+		pending = false;
+		try { refresh(); }
+		catch (const StandardException&) {}
+	}
+}
@@ -0,0 +1,204 @@
+/*
+ * opencog/atoms/filedir/FileCatalog.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_FILE_CATALOG_H
+#define _OPENCOG_FILE_CATALOG_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * On-disk layout of a file catalog. The file is meant to be mmap'ed
+ * and searched in place, without parsing, so that a freshly started
+ * process can perceive a large directory tree without walking it.
+ *
+ * The file is a header, followed by a table of fixed-size entries,
+ * followed by a string table holding the NUL-terminated paths. The
+ * entries are sorted by path, and the strings are laid out in that
+ * same order, so that a prefix is a contiguous range of entries, and
+ * a substring search is a single memmem() over the string table.
+ */
+struct CatalogHeader
+{
+	char magic[8];         // "OCFSCAT1"
+	uint32_t version;
+	uint32_t rootlen;      // Root path is the first string in strtab.
+	uint64_t nentries;
+	uint64_t strtab_off;
+	uint64_t strtab_len;
+	int64_t built;         // Seconds since the epoch.
+};
+
+struct CatalogEntry
+{
+	uint64_t path_off;     // Offset into the string table.
+	uint64_t size;
+	int64_t mtime_ns;
+	uint32_t path_len;
+	uint8_t type;          // One of the CatalogType values.
+	uint8_t pad[3];
+};
+
+enum CatalogType : uint8_t
+{
+	CAT_FILE = 1,
+	CAT_DIR = 2,
+	CAT_SYMLINK = 3,
+	CAT_OTHER = 4,
+};
+
+struct CatRec;
+
+/**
+ * Read-only, mmap'ed view of a catalog file. Opening and querying
+ * touches only the catalog pages, and never the cataloged tree.
+ */
+class CatalogReader
+{
+private:
+	int _fd;
+	size_t _len;
+	const char* _map;
+	const CatalogHeader* _hdr;
+	const CatalogEntry* _ents;
+	const char* _strtab;
+
+public:
+	CatalogReader(void);
+	~CatalogReader();
+
+	bool open(const std::string&);
+	void close(void);
+	bool is_open(void) const { return nullptr != _map; }
+
+	std::string root(void) const;
+	size_t size(void) const { return _hdr ? _hdr->nentries : 0; }
+	const CatalogEntry& entry(size_t i) const { return _ents[i]; }
+	const char* path(size_t i) const { return _strtab + _ents[i].path_off; }
+
+	/// Range of entries whose path starts with the given prefix.
+	void prefix_range(const std::string&, size_t& lo, size_t& hi) const;
+
+	/// Call `fn(index)` for every entry in [lo,hi) whose path
+	/// contains the given substring.
+	template<typename F>
+	void locate(const std::string& pat, size_t lo, size_t hi, F fn) const;
+};
+
+/**
+ * Maintains a catalog of a directory tree. The catalog is rebuilt
+ * incrementally: directories whose mtime is unchanged, and that have
+ * not been flagged by inotify, have their listing copied from the
+ * previous catalog, instead of being read again.
+ */
+class FileCatalog
+{
+private:
+	std::string _root;
+	std::string _catfile;
+	std::mutex _mtx;
+
+	// inotify watcher
+	int _ifd;
+	std::thread* _watcher;
+	std::atomic<bool> _stop;
+	std::mutex _dirty_mtx;
+	std::set<std::string> _dirty;
+	bool _rescan;    // inotify lost events; read everything again.
+	std::unordered_map<int, std::string> _wdpath;
+
+	void add_watch(const std::string&);
+	void watch_loop(void);
+	void write_catalog(const std::vector<CatRec>&);
+
+public:
+	FileCatalog(const std::string& root, const std::string& catfile);
+	~FileCatalog();
+
+	const std::string& root(void) const { return _root; }
+	const std::string& catfile(void) const { return _catfile; }
+
+	/// Bring the catalog file up to date. Returns number of entries.
+	size_t refresh(void);
+
+	/// Start a background thread that watches the tree with inotify,
+	/// and refreshes the catalog shortly after changes settle down,
+	/// or at most ten seconds after the first of them.
+	void watch(void);
+
+	static std::string default_path(const std::string& root);
+	static const char* type_name(uint8_t);
+};
+
+// ==============================================================
+
+template<typename F>
+void CatalogReader::locate(const std::string& pat, size_t lo, size_t hi,
+                           F fn) const
+{
+	if (lo >= hi) return;
+	const char* start = _strtab + _ents[lo].path_off;
+	const char* end = _strtab + _ents[hi-1].path_off + _ents[hi-1].path_len;
+	const char* cur = start;
+	size_t idx = lo;
+	while (cur < end)
+	{
+		const char* hit = (const char*)
+			memmem(cur, end - cur, pat.c_str(), pat.size());
+		if (nullptr == hit) return;
+
+		// Paths are stored in sorted order, and so are the offsets.
+		// Binary search for the entry holding the hit.
+		uint64_t off = hit - _strtab;
+		const CatalogEntry* ent = std::upper_bound(_ents + idx, _ents + hi,
+			off, [](uint64_t o, const CatalogEntry& e)
+				{ return o < e.path_off; });
+		idx = (ent - _ents) - 1;
+
+		fn(idx);
+
+		// Resume the search at the next path.
+		idx++;
+		if (idx >= hi) return;
+		cur = _strtab + _ents[idx].path_off;
+	}
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_FILE_CATALOG_H
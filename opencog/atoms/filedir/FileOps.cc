@@ -0,0 +1,453 @@
+/*
+ * opencog/atoms/filedir/FileOps.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h> // for strerror()
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+
+#include "FileOps.h"
+
+using namespace opencog;
+
+const char* FileOp::kind_name(Kind k)
+{
+	switch (k)
+	{
+		case MKDIR: return "mkdir";
+		case RENAME: return "rename";
+		case UNLINK: return "unlink";
+		case COPY: return "copy";
+	}
+	return "unknown";
+}
+
+// ==============================================================
+
+/// Copy the data, keeping it in the kernel if possible.
+static int copy_data(int in, int out, off_t left)
+{
+	int err = 0;
+	while (0 < left)
+	{
+		ssize_t n = copy_file_range(in, nullptr, out, nullptr, left, 0);
+		if (0 < n) { left -= n; continue; }
+		if (0 == n) break;
+		if (EINTR == errno) continue;
+
+		// Old kernels, or cross-filesystem copies on kernels before
+		// 5.3. Fall back to copying through user space.
+		if (EXDEV != errno and ENOSYS != errno and
+		    EINVAL != errno and EOPNOTSUPP != errno)
+			return errno;
+
+		char buf[128*1024];
+		while (0 < left)
+		{
+			ssize_t nr = read(in, buf, sizeof(buf));
+			if (0 > nr and EINTR == errno) continue;
+			if (0 >= nr) { err = nr ? errno : 0; break; }
+			ssize_t done = 0;
+			while (done < nr)
+			{
+				ssize_t nw = write(out, buf + done, nr - done);
+				if (0 > nw and EINTR == errno) continue;
+				if (0 > nw) { err = errno; break; }
+				done += nw;
+			}
+			if (err) break;
+			left -= nr;
+		}
+		break;
+	}
+	return err;
+}
+
+/// Copy a regular file. The copy is written to a temp file next to
+/// dst, and renamed into place when complete, so that a failed copy
+/// leaves dst as it was. Copying a file onto itself (or onto a hard
+/// link or symlink to itself) is refused.
+static int copy_file(const char* src, const char* dst)
+{
+	int in = open(src, O_RDONLY | O_CLOEXEC);
+	if (0 > in) return errno;
+
+	struct stat st;
+	if (fstat(in, &st)) { int err = errno; close(in); return err; }
+	if (not S_ISREG(st.st_mode)) { close(in); return EINVAL; }
+
+	// Write through a symlink, as cp does, and not over it.
+	std::string target(dst);
+	char* real = realpath(dst, nullptr);
+	if (real) { target = real; free(real); }
+
+	// Opened without O_TRUNC, only to see if it is the same file.
+	int old = open(target.c_str(), O_RDONLY | O_CLOEXEC);
+	if (0 <= old)
+	{
+		struct stat dst_st;
+		int rc = fstat(old, &dst_st);
+		int err = errno;
+		close(old);
+		if (rc) { close(in); return err; }
+		if (dst_st.st_dev == st.st_dev and dst_st.st_ino == st.st_ino)
+		{
+			close(in);
+			return EINVAL;
+		}
+	}
+
+	size_t slash = target.rfind('/');
+	std::string tmp = (std::string::npos == slash) ?
+		"." + target + ".XXXXXX" :
+		target.substr(0, slash+1) + "." + target.substr(slash+1) + ".XXXXXX";
+	int out = mkostemp(&tmp[0], O_CLOEXEC);
+	if (0 > out) { int err = errno; close(in); return err; }
+
+	int err = 0;
+	if (fchmod(out, st.st_mode & 07777)) err = errno;
+	if (0 == err) err = copy_data(in, out, st.st_size);
+	if (close(out) and 0 == err) err = errno;
+	close(in);
+
+	if (0 == err and rename(tmp.c_str(), target.c_str())) err = errno;
+	if (err) unlink(tmp.c_str());
+	return err;
+}
+
+// ==============================================================
+
+namespace {
+
+/// One system call. Intermediate directories of a mkdir -p have
+/// no FileOp, and are not reported.
+struct Job
+{
+	FileOp::Kind kind;
+	const char* a;
+	const char* b;
+	const FileOp* op;
+	int err;
+};
+
+class OpRunner
+{
+	ItemStreamPtr _out;
+
+#ifdef HAVE_LIBURING
+	static const unsigned RING_DEPTH = 256;
+	struct io_uring _ring;
+	bool _have_ring;
+	void ring_exec(std::vector<Job>&);
+#endif
+
+	void exec(std::vector<Job>&);
+	void finish(Job&);
+	int sync_exec(const Job&);
+	void report(const FileOp&, int);
+
+	void run_mkdirs(const FileOp*, size_t);
+	void run_group(const FileOp*, size_t);
+
+public:
+	OpRunner(const ItemStreamPtr&);
+	~OpRunner();
+	void run(const std::vector<FileOp>&);
+};
+
+OpRunner::OpRunner(const ItemStreamPtr& out) : _out(out)
+{
+#ifdef HAVE_LIBURING
+	// Fails on kernels without io_uring, or where seccomp forbids it.
+	_have_ring = (0 == io_uring_queue_init(RING_DEPTH, &_ring, 0));
+#endif
+}
+
+OpRunner::~OpRunner()
+{
+#ifdef HAVE_LIBURING
+	if (_have_ring) io_uring_queue_exit(&_ring);
+#endif
+}
+
+void OpRunner::report(const FileOp& op, int err)
+{
+	ValueSeq vs;
+	vs.emplace_back(createStringValue(FileOp::kind_name(op.kind)));
+	vs.emplace_back(createStringValue(op.src_url));
+	if (FileOp::RENAME == op.kind or FileOp::COPY == op.kind)
+		vs.emplace_back(createStringValue(op.dst_url));
+	vs.emplace_back(createStringValue(err ? strerror(err) : "ok"));
+	_out->add(createLinkValue(vs));
+}
+
+int OpRunner::sync_exec(const Job& j)
+{
+	int rc = 0;
+	switch (j.kind)
+	{
+		case FileOp::MKDIR: rc = mkdir(j.a, 0777); break;
+		case FileOp::RENAME: rc = rename(j.a, j.b); break;
+		case FileOp::UNLINK: rc = unlink(j.a); break;
+		case FileOp::COPY: return copy_file(j.a, j.b);
+	}
+	return rc ? errno : 0;
+}
+
+/// Post-process a completed job, and report it.
+void OpRunner::finish(Job& j)
+{
+	// As with mkdir -p, an existing directory is not an error.
+	if (FileOp::MKDIR == j.kind and EEXIST == j.err)
+	{
+		struct stat st;
+		if (0 == stat(j.a, &st) and S_ISDIR(st.st_mode))
+			j.err = 0;
+	}
+	if (j.op) report(*j.op, j.err);
+}
+
+#ifdef HAVE_LIBURING
+/// Run the jobs through the ring, RING_DEPTH at a time. If the ring
+/// misbehaves, it is set up anew, and what it did not take is done
+/// with plain system calls; every job is finished exactly once.
+void OpRunner::ring_exec(std::vector<Job>& jobs)
+{
+	size_t next = 0;
+	std::vector<bool> done;
+	while (next < jobs.size() and _have_ring)
+	{
+		size_t n = 0;
+		while (next + n < jobs.size() and n < RING_DEPTH)
+		{
+			struct io_uring_sqe* sqe = io_uring_get_sqe(&_ring);
+			if (nullptr == sqe) break;
+			Job& j = jobs[next + n];
+			switch (j.kind)
+			{
+				case FileOp::MKDIR:
+					io_uring_prep_mkdirat(sqe, AT_FDCWD, j.a, 0777);
+					break;
+				case FileOp::RENAME:
+					io_uring_prep_renameat(sqe, AT_FDCWD, j.a, AT_FDCWD, j.b, 0);
+					break;
+				case FileOp::UNLINK:
+					io_uring_prep_unlinkat(sqe, AT_FDCWD, j.a, 0);
+					break;
+				default:
+					// Copies never get here.
+					break;
+			}
+			io_uring_sqe_set_data(sqe, &j);
+			n++;
+		}
+
+		// The kernel takes the SQEs in order, so the first `got` of
+		// them are in flight, and the rest are still in the ring.
+		int rc = io_uring_submit(&_ring);
+		size_t got = (0 > rc) ? 0 : std::min((size_t) rc, n);
+		done.assign(n, false);
+		int lost = 0;
+		for (size_t i = 0; i < got; i++)
+		{
+			struct io_uring_cqe* cqe;
+			int wrc;
+			do { wrc = io_uring_wait_cqe(&_ring, &cqe); }
+			while (-EINTR == wrc);
+			if (wrc) { lost = -wrc; break; }
+
+			Job* j = (Job*) io_uring_cqe_get_data(cqe);
+			j->err = (0 > cqe->res) ? -cqe->res : 0;
+			io_uring_cqe_seen(&_ring, cqe);
+
+			// Kernels older than 5.11 (5.15 for mkdirat) reject the
+			// opcode itself. Do those the old-fashioned way.
+			if (EINVAL == j->err or EOPNOTSUPP == j->err)
+				j->err = sync_exec(*j);
+			finish(*j);
+			done[j - &jobs[next]] = true;
+		}
+
+		// SQEs left in the ring would go out with the next submit,
+		// and completions not waited for would be seen later; both
+		// point at jobs that are finished by then. Start over with a
+		// fresh ring, or none at all.
+		if (got < n or lost)
+		{
+			io_uring_queue_exit(&_ring);
+			_have_ring = (0 == io_uring_queue_init(RING_DEPTH, &_ring, 0));
+		}
+
+		for (size_t i = 0; i < n; i++)
+		{
+			if (done[i]) continue;
+			Job& j = jobs[next + i];
+
+			// In flight, but there is no telling if it was done; doing
+			// it again would fail if it was. So the error is given.
+			if (i < got)
+				j.err = lost;
+			else
+				j.err = sync_exec(j);
+			finish(j);
+		}
+		next += n;
+	}
+
+	// Without a ring, the rest are done one at a time.
+	for (; next < jobs.size(); next++)
+	{
+		jobs[next].err = sync_exec(jobs[next]);
+		finish(jobs[next]);
+	}
+}
+#endif
+
+void OpRunner::exec(std::vector<Job>& jobs)
+{
+#ifdef HAVE_LIBURING
+	if (_have_ring and FileOp::COPY != jobs[0].kind)
+	{
+		ring_exec(jobs);
+		return;
+	}
+#endif
+	for (Job& j : jobs)
+	{
+		j.err = sync_exec(j);
+		finish(j);
+	}
+}
+
+/// mkdir -p for a group of directories. Missing ancestors are
+/// collected and de-duplicated, and created one level at a time.
+void OpRunner::run_mkdirs(const FileOp* ops, size_t n)
+{
+	std::map<size_t, std::map<std::string, const FileOp*>> levels;
+	std::vector<const FileOp*> dups;
+	for (size_t i = 0; i < n; i++)
+	{
+		const std::string& path = ops[i].src;
+		size_t depth = 0;
+		size_t pos = path.find('/', 1);
+		while (std::string::npos != pos)
+		{
+			if ('/' != path[pos-1])
+				levels[depth++].emplace(path.substr(0, pos), nullptr);
+			pos = path.find('/', pos+1);
+		}
+		const FileOp*& slot = levels[depth][path];
+		if (slot) dups.push_back(&ops[i]);
+		else slot = &ops[i];
+	}
+
+	for (auto& lvl : levels)
+	{
+		std::vector<Job> jobs;
+		jobs.reserve(lvl.second.size());
+		for (auto& pr : lvl.second)
+			jobs.push_back({FileOp::MKDIR, pr.first.c_str(), nullptr,
+			                pr.second, 0});
+		exec(jobs);
+	}
+
+	for (const FileOp* op : dups)
+	{
+		Job j({FileOp::MKDIR, op->src.c_str(), nullptr, op, 0});
+		j.err = sync_exec(j);
+		finish(j);
+	}
+}
+
+void OpRunner::run_group(const FileOp* ops, size_t n)
+{
+	if (FileOp::MKDIR == ops[0].kind)
+	{
+		run_mkdirs(ops, n);
+		return;
+	}
+
+	// Jobs in one submission run in no particular order. So a job that
+	// touches a path already touched in this submission waits for the
+	// next one, as in (rename a b) (rename b c).
+	std::vector<Job> jobs;
+	std::set<std::string> busy;
+	for (size_t i = 0; i < n; i++)
+	{
+		const FileOp& op = ops[i];
+		bool has_dst = FileOp::UNLINK != op.kind;
+		if (busy.count(op.src) or (has_dst and busy.count(op.dst)))
+		{
+			exec(jobs);
+			jobs.clear();
+			busy.clear();
+		}
+		busy.insert(op.src);
+		if (has_dst) busy.insert(op.dst);
+		jobs.push_back({op.kind, op.src.c_str(), op.dst.c_str(), &op, 0});
+	}
+	exec(jobs);
+}
+
+void OpRunner::run(const std::vector<FileOp>& ops)
+{
+	size_t i = 0;
+	while (i < ops.size())
+	{
+		size_t j = i + 1;
+		while (j < ops.size() and ops[j].kind == ops[i].kind) j++;
+		run_group(&ops[i], j - i);
+		i = j;
+	}
+}
+
+} // anonymous namespace
+
+// ==============================================================
+
+void opencog::run_file_ops(std::vector<FileOp>&& ops,
+                           const ItemStreamPtr& out)
+{
+	std::thread([ops = std::move(ops), out]()
+	{
+		OpRunner runner(out);
+		runner.run(ops);
+		out->close();
+	}).detach();
+}
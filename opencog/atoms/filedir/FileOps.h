@@ -0,0 +1,78 @@
+/*
+ * opencog/atoms/filedir/FileOps.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_FILE_OPS_H
+#define _OPENCOG_FILE_OPS_H
+
+#include <string>
+#include <vector>
+#include <opencog/atoms/sensory/ItemStream.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/// A single mutating filesystem operation. Paths are plain paths;
+/// the URLs are what gets reported back.
+struct FileOp
+{
+	enum Kind { MKDIR, RENAME, UNLINK, COPY };
+	Kind kind;
+	std::string src;
+	std::string dst;       // Only for RENAME and COPY.
+	std::string src_url;
+	std::string dst_url;
+
+	static const char* kind_name(Kind);
+};
+
+/**
+ * Perform a batch of filesystem operations on a background thread,
+ * and report each result to `out`, in order of completion. The
+ * stream is closed after the last result.
+ *
+ * Consecutive operations of the same kind are submitted together,
+ * and may complete in any order; a change of kind acts as a barrier.
+ * Thus, a batch of mkdirs, followed by renames into the new dirs,
+ * works as expected. A mkdir creates missing parents, as `mkdir -p`
+ * does; parents are created level by level, each level in a single
+ * submission.
+ *
+ * When built with liburing, and when the kernel supports it, mkdir,
+ * rename and unlink are submitted through io_uring, so that a batch
+ * of thousands costs a handful of system calls. Otherwise, and for
+ * any opcode that the kernel rejects, plain system calls are used.
+ * Copies use copy_file_range(), so that the data stays in the kernel
+ * (and may be reflinked, on filesystems that support this).
+ *
+ * Each result is a LinkValue holding StringValues: the operation
+ * name, the URL(s) operated on, and either "ok" or the error text.
+ */
+void run_file_ops(std::vector<FileOp>&& ops, const ItemStreamPtr& out);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_FILE_OPS_H
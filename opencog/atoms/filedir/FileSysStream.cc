@@ -31,12 +31,20 @@
 #include <opencog/atomspace/AtomSpace.h>
 #include <opencog/atoms/base/Link.h>
 #include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/FloatValue.h>
 #include <opencog/atoms/value/LinkValue.h>
 #include <opencog/atoms/value/StringValue.h>
 #include <opencog/atoms/value/ValueFactory.h>
 
 #include <opencog/atoms/sensory-types/sensory_types.h>
+#include "Classify.h"
+#include "Crawl.h"
+#include "DirScan.h"
+#include "DiskUsage.h"
+#include "FileCatalog.h"
+#include "FileOps.h"
 #include "FileSysStream.h"
+#include "LineReader.h"
 
 using namespace opencog;
 
@@ -139,6 +147,95 @@ void FileSysStream::do_describe(void)
 						createNode(TYPE_NODE, "StringValue")))));
 	cmds.emplace_back(ls_cmd);
 
+	// List files, ranked by name, mtime or size, in C++.
+	Handle ranked_ls_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the ranked ls command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "ls")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "by")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createLink(CHOICE_LINK,
+						createNode(ITEM_NODE, "name"),
+						createNode(ITEM_NODE, "mtime"),
+						createNode(ITEM_NODE, "size"))),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "limit")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "NumberNode")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "LinkValue"),
+						createNode(TYPE_NODE, "StringValue")))));
+	cmds.emplace_back(ranked_ls_cmd);
+
+	// List files matching a shell glob, a regex, or a file type. The
+	// filters work for the walk command, too.
+	Handle filtered_ls_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the filtered ls command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "ls")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createLink(CHOICE_LINK,
+						createNode(ITEM_NODE, "glob"),
+						createNode(ITEM_NODE, "regex"))),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "ItemNode")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "type")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createLink(CHOICE_LINK,
+						createNode(ITEM_NODE, "file"),
+						createNode(ITEM_NODE, "dir"),
+						createNode(ITEM_NODE, "symlink"),
+						createNode(ITEM_NODE, "other"))),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "LinkValue"),
+						createNode(TYPE_NODE, "StringValue")))));
+	cmds.emplace_back(filtered_ls_cmd);
+
+	// Recursive listing of the tree under the current directory.
+	// Takes the same options as the ls command.
+	Handle walk_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the walk command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "walk")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "LinkValue"),
+						createNode(TYPE_NODE, "StringValue")))));
+	cmds.emplace_back(walk_cmd);
+
 	Handle pwd_cmd =
 		createLink(SECTION,
 			createNode(ITEM_NODE, "the pwd command"),
@@ -176,12 +273,263 @@ void FileSysStream::do_describe(void)
 						createNode(TYPE_NODE, "StringValue")))));
 	cmds.emplace_back(cd_cmd);
 
-#ifdef LATER
+	// Build (or refresh) a persistent catalog of the current directory
+	// tree, and keep it up to date for as long as the stream is open.
+	Handle catalog_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the catalog command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "catalog")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createNode(TYPE_NODE, "StringValue"))));
+	cmds.emplace_back(catalog_cmd);
+
+	// Search the catalog for paths containing a substring.
+	Handle locate_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the locate command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "locate")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "ItemNode")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "LinkValue"),
+						createLink(LINK_SIGNATURE_LINK,
+							createNode(TYPE_NODE, "LinkValue"),
+							createNode(TYPE_NODE, "StringValue"),
+							createNode(TYPE_NODE, "StringValue"),
+							createNode(TYPE_NODE, "FloatValue"))))));
+	cmds.emplace_back(locate_cmd);
+
+	// Build an index of line starts, so that a TextFileStream opened
+	// with ?sample=K can take an exactly uniform sample.
+	Handle lineindex_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the lineindex command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "lineindex")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "ItemNode")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createNode(TYPE_NODE, "StringValue"))));
+	cmds.emplace_back(lineindex_cmd);
+
+	// Per-directory size totals, delivered as the walk progresses.
+	Handle du_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the du command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "du")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "ItemStream"),
+						createLink(LINK_SIGNATURE_LINK,
+							createNode(TYPE_NODE, "LinkValue"),
+							createNode(TYPE_NODE, "StringValue"),
+							createNode(TYPE_NODE, "FloatValue"))))));
+	cmds.emplace_back(du_cmd);
+
+	// Read every file in the tree, with worker processes. Replies with
+	// the lines and bytes of each file or, with a grep option, with
+	// the line number and text of each matching line.
+	Handle crawl_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the crawl command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "crawl")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "ItemStream"),
+						createLink(CHOICE_LINK,
+							createLink(LINK_SIGNATURE_LINK,
+								createNode(TYPE_NODE, "LinkValue"),
+								createNode(TYPE_NODE, "StringValue"),
+								createNode(TYPE_NODE, "FloatValue")),
+							createLink(LINK_SIGNATURE_LINK,
+								createNode(TYPE_NODE, "LinkValue"),
+								createNode(TYPE_NODE, "StringValue"),
+								createNode(TYPE_NODE, "FloatValue"),
+								createNode(TYPE_NODE, "StringValue")))))));
+	cmds.emplace_back(crawl_cmd);
+
+	// Guess what is in files, without reading them through. Takes either
+	// a list of file URLs, or the same filters as the ls command.
+	Handle classify_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the classify command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "classify")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "ItemStream"),
+						createLink(LINK_SIGNATURE_LINK,
+							createNode(TYPE_NODE, "LinkValue"),
+							createNode(TYPE_NODE, "StringValue"),
+							createNode(TYPE_NODE, "StringValue"),
+							createNode(TYPE_NODE, "StringValue"))))));
+	cmds.emplace_back(classify_cmd);
+
+	// Create directories, and any missing parents. Takes any number
+	// of paths; so do the other mutating commands. All of these reply
+	// with a stream of per-operation results.
 	Handle mkdir_cmd =
 		createLink(SECTION,
-			createNode(ITEM_NODE, "the mkdir command"));
+			createNode(ITEM_NODE, "the mkdir command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "mkdir")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "ItemNode")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "ItemStream"),
+						createLink(LINK_SIGNATURE_LINK,
+							createNode(TYPE_NODE, "LinkValue"),
+							createNode(TYPE_NODE, "StringValue"))))));
 	cmds.emplace_back(mkdir_cmd);
-#endif
+
+	// Rename; takes pairs of from, to paths.
+	Handle rename_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the rename command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "rename")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "ItemNode")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "ItemNode")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "ItemStream"),
+						createLink(LINK_SIGNATURE_LINK,
+							createNode(TYPE_NODE, "LinkValue"),
+							createNode(TYPE_NODE, "StringValue"))))));
+	cmds.emplace_back(rename_cmd);
+
+	// Remove files.
+	Handle unlink_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the unlink command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "unlink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "ItemNode")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "ItemStream"),
+						createLink(LINK_SIGNATURE_LINK,
+							createNode(TYPE_NODE, "LinkValue"),
+							createNode(TYPE_NODE, "StringValue"))))));
+	cmds.emplace_back(unlink_cmd);
+
+	// Copy files; takes pairs of from, to paths.
+	Handle copy_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the copy command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "copy")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "ItemNode")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "ItemNode")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "ItemStream"),
+						createLink(LINK_SIGNATURE_LINK,
+							createNode(TYPE_NODE, "LinkValue"),
+							createNode(TYPE_NODE, "StringValue"))))));
+	cmds.emplace_back(copy_cmd);
+
+	// Any mix of the above, submitted together.
+	Handle batch_cmd =
+		createLink(SECTION,
+			createNode(ITEM_NODE, "the batch command"),
+			createLink(CONNECTOR_SEQ,
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "WriteLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(ITEM_NODE, "batch")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "command"),
+					createNode(TYPE_NODE, "ListLink")),
+				createLink(CONNECTOR,
+					createNode(SEX_NODE, "reply"),
+					createLink(LINK_SIGNATURE_LINK,
+						createNode(TYPE_NODE, "ItemStream"),
+						createLink(LINK_SIGNATURE_LINK,
+							createNode(TYPE_NODE, "LinkValue"),
+							createNode(TYPE_NODE, "StringValue"))))));
+	cmds.emplace_back(batch_cmd);
 
 	_global_desc = createLink(cmds, CHOICE_LINK);
 }
@@ -225,25 +573,73 @@ ValuePtr FileSysStream::write_out(AtomSpace* as, bool silent,
 	const std::string& cmd = cref->get_name();
 	if (0 == cmd.compare("ls"))
 	{
-		const std::string& path = _cwd.substr(_pfxlen);
-		DIR* dir = opendir(path.c_str());
+		// Optional ranking and paging, e.g. the ten newest entries:
+		// (List (Item "ls") (Item "by") (Item "mtime") (Item "limit") (Number 10))
+		ScanOptions opts;
+		opts.parse(cmdref, 1);
+		return createLinkValue(list_dir(_cwd.substr(_pfxlen), _cwd, opts));
+	}
+
+	// Recursive listing; same options as ls, e.g.
+	// (List (Item "walk") (Item "glob") (Item "*.scm") (Item "type") (Item "file"))
+	if (0 == cmd.compare("walk"))
+	{
+		ScanOptions opts;
+		opts.recursive = true;
+		opts.parse(cmdref, 1);
+		return createLinkValue(list_dir(_cwd.substr(_pfxlen), _cwd, opts));
+	}
+
+	if (0 == cmd.compare("pwd"))
+	{
+		return createStringValue(_cwd);
+	}
+
+	// Takes an optional argument.
+	if (0 == cmd.compare("catalog"))
+		return do_catalog(cmdref);
 
-		ValueSeq vents;
-		struct dirent* dent = readdir(dir);
-		while (dent)
+	if (0 == cmd.compare("du"))
+	{
+		std::string root = _cwd.substr(_pfxlen);
+		if (cmdref->is_link() and 2 <= cmdref->size())
 		{
-			vents.emplace_back(createStringValue(_cwd + "/" + + dent->d_name));
-			dent = readdir(dir);
+			const Handle& arg1 = cmdref->getOutgoingAtom(1);
+			if (not arg1->is_node() or
+			    arg1->get_name().compare(0, _pfxlen, _prefix))
+				throw RuntimeException(TRACE_INFO,
+					"Expecting filepath: %s", arg1->to_string().c_str());
+			root = arg1->get_name().substr(_pfxlen);
 		}
-		closedir(dir);
-		return createLinkValue(vents);
+		while (1 < root.size() and '/' == root.back()) root.pop_back();
+
+		ItemStreamPtr results(createItemStream());
+		disk_usage(root, _prefix, results);
+		return results;
 	}
 
-	if (0 == cmd.compare("pwd"))
+	// Walk and read the tree, with a pool of worker processes, e.g.
+	// (List (Item "crawl") (Item "glob") (Item "*.log") (Item "grep") (Item "ERROR"))
+	if (0 == cmd.compare("crawl"))
 	{
-		return createStringValue(_cwd);
+		CrawlOptions opts;
+		opts.parse(cmdref, 1);
+		std::string root = _cwd.substr(_pfxlen);
+		while (1 < root.size() and '/' == root.back()) root.pop_back();
+
+		ItemStreamPtr results(createItemStream());
+		crawl(root, _prefix, opts, results);
+		return results;
 	}
 
+	if (0 == cmd.compare("classify"))
+		return do_classify(cmdref);
+
+	if (0 == cmd.compare("mkdir") or 0 == cmd.compare("rename") or
+	    0 == cmd.compare("unlink") or 0 == cmd.compare("copy") or
+	    0 == cmd.compare("batch"))
+		return do_mutate(cmdref);
+
 	// Commands taking arguments
 	cref = cmdref;
 	if (not cref->is_link() or cref->size() < 2)
@@ -266,12 +662,230 @@ ValuePtr FileSysStream::write_out(AtomSpace* as, bool silent,
 		return createStringValue(_cwd);
 	}
 
+	if (0 == cmd.compare("locate"))
+		return do_locate(arg1);
+
+	// Index the line starts of a file, for sampling with TextFileStream.
+	if (0 == cmd.compare("lineindex"))
+	{
+		std::string path = get_path(arg1);
+		LineIndex::build(path);
+		return createStringValue(_prefix + LineIndex::index_path(path));
+	}
+
 	throw RuntimeException(TRACE_INFO,
 		"Unknown command \"%s\"\n", cmd.c_str());
 }
 
 // ==============================================================
 
+/// Create a catalog of the tree rooted at the current directory,
+/// and watch it for changes. An optional second argument gives the
+/// location of the catalog file, as a file:// URL.
+ValuePtr FileSysStream::do_catalog(const Handle& cmdref)
+{
+	std::string root = _cwd.substr(_pfxlen);
+	while (1 < root.size() and '/' == root.back()) root.pop_back();
+	std::string catfile = FileCatalog::default_path(root);
+	if (cmdref->is_link() and 2 <= cmdref->size())
+	{
+		const Handle& arg1 = cmdref->getOutgoingAtom(1);
+		if (not arg1->is_node() or
+		    arg1->get_name().compare(0, _pfxlen, _prefix))
+			throw RuntimeException(TRACE_INFO,
+				"Expecting filepath: %s", arg1->to_string().c_str());
+		catfile = arg1->get_name().substr(_pfxlen);
+	}
+
+	if (nullptr == _catalog or _catalog->root() != root or
+	    _catalog->catfile() != catfile)
+	{
+		_catalog = std::make_shared<FileCatalog>(root, catfile);
+		_catalog->watch();
+	}
+	else
+		_catalog->refresh();
+
+	return createStringValue(_prefix + catfile);
+}
+
+/// Search the catalog for paths containing the given substring,
+/// restricted to paths under the current directory. If this stream
+/// has not built a catalog, look for one that some other process
+/// built, for the current directory or any directory above it.
+ValuePtr FileSysStream::do_locate(const Handle& arg)
+{
+	if (not arg->is_node())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting search string: %s", arg->to_string().c_str());
+
+	std::string cwd = _cwd.substr(_pfxlen);
+	while (1 < cwd.size() and '/' == cwd.back()) cwd.pop_back();
+
+	// Under the root means equal to it, or followed by a slash;
+	// `/home/ab` is not under `/home/a`.
+	auto under = [&cwd](const std::string& root)
+	{
+		if (0 != cwd.compare(0, root.size(), root)) return false;
+		return cwd.size() == root.size() or '/' == root.back() or
+			'/' == cwd[root.size()];
+	};
+
+	CatalogReader rdr;
+	if (_catalog and under(_catalog->root()))
+		rdr.open(_catalog->catfile());
+
+	std::string dir = cwd;
+	while (not rdr.is_open())
+	{
+		// Names are hashes; check that it really is for this dir.
+		rdr.open(FileCatalog::default_path(dir));
+		if (rdr.is_open() and rdr.root() != dir) rdr.close();
+		if (rdr.is_open() or 1 >= dir.size()) break;
+		size_t sl = dir.rfind('/');
+		dir = (0 == sl) ? "/" : dir.substr(0, sl);
+	}
+	if (not rdr.is_open())
+		throw RuntimeException(TRACE_INFO,
+			"No catalog for %s; use the catalog command first\n",
+			_cwd.c_str());
+
+	size_t lo, hi;
+	rdr.prefix_range(1 == cwd.size() ? cwd : cwd + "/", lo, hi);
+
+	ValueSeq vents;
+	rdr.locate(arg->get_name(), lo, hi, [&](size_t i)
+	{
+		const CatalogEntry& e = rdr.entry(i);
+		vents.emplace_back(createLinkValue(ValueSeq({
+			createStringValue(_prefix + std::string(rdr.path(i), e.path_len)),
+			createStringValue(FileCatalog::type_name(e.type)),
+			createFloatValue(std::vector<double>({(double) e.size,
+				e.mtime_ns * 1.0e-9}))})));
+	});
+	return createLinkValue(vents);
+}
+
+// ==============================================================
+
+/// Convert a file:// URL to a path. Plain names are taken to be
+/// relative to the current directory.
+std::string FileSysStream::get_path(const Handle& h)
+{
+	if (not h->is_node())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting filepath: %s", h->to_string().c_str());
+
+	const std::string& name = h->get_name();
+	if (0 == name.compare(0, _pfxlen, _prefix))
+		return name.substr(_pfxlen);
+
+	if (name.empty() or '/' == name[0] or std::string::npos != name.find(':'))
+		throw RuntimeException(TRACE_INFO,
+			"Expecting filepath: %s", h->to_string().c_str());
+
+	std::string cwd = _cwd.substr(_pfxlen);
+	if ('/' != cwd.back()) cwd += '/';
+	return cwd + name;
+}
+
+/// Append the operations of one mutating command to `ops`.
+void FileSysStream::get_ops(const Handle& cmd, std::vector<FileOp>& ops)
+{
+	if (not cmd->is_link() or cmd->size() < 2 or
+	    not cmd->getOutgoingAtom(0)->is_node())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting command with arguments: %s", cmd->to_string().c_str());
+
+	const std::string& name = cmd->getOutgoingAtom(0)->get_name();
+	FileOp::Kind kind;
+	bool pairs = false;
+	if (0 == name.compare("mkdir")) kind = FileOp::MKDIR;
+	else if (0 == name.compare("unlink")) kind = FileOp::UNLINK;
+	else if (0 == name.compare("rename")) { kind = FileOp::RENAME; pairs = true; }
+	else if (0 == name.compare("copy")) { kind = FileOp::COPY; pairs = true; }
+	else
+		throw RuntimeException(TRACE_INFO,
+			"Unknown command \"%s\"\n", name.c_str());
+
+	const HandleSeq& oset = cmd->getOutgoingSet();
+	if (pairs and 0 == oset.size() % 2)
+		throw RuntimeException(TRACE_INFO,
+			"Expecting pairs of paths: %s", cmd->to_string().c_str());
+
+	size_t step = pairs ? 2 : 1;
+	for (size_t i = 1; i < oset.size(); i += step)
+	{
+		FileOp op;
+		op.kind = kind;
+		op.src = get_path(oset[i]);
+		while (1 < op.src.size() and '/' == op.src.back()) op.src.pop_back();
+		op.src_url = _prefix + op.src;
+		if (pairs)
+		{
+			op.dst = get_path(oset[i+1]);
+			op.dst_url = _prefix + op.dst;
+		}
+		ops.emplace_back(std::move(op));
+	}
+}
+
+/// The mutating commands: mkdir, rename, unlink and copy, each of
+/// which takes a list of paths, and batch, which takes a list of
+/// these commands. The operations are run in the background; the
+/// results are delivered on the returned stream.
+ValuePtr FileSysStream::do_mutate(const Handle& cmdref)
+{
+	std::vector<FileOp> ops;
+	if (cmdref->is_link() and
+	    0 == cmdref->getOutgoingAtom(0)->get_name().compare("batch"))
+	{
+		for (size_t i = 1; i < cmdref->size(); i++)
+			get_ops(cmdref->getOutgoingAtom(i), ops);
+	}
+	else
+		get_ops(cmdref, ops);
+
+	ItemStreamPtr results(createItemStream());
+	run_file_ops(std::move(ops), results);
+	return results;
+}
+
+// ==============================================================
+
+/// Sniff the content type of files. The arguments are either file
+/// URLs, or else options for listing the current directory, as for
+/// the ls command; by default, all the files in it.
+ValuePtr FileSysStream::do_classify(const Handle& cmdref)
+{
+	std::vector<std::string> paths;
+	if (cmdref->is_link() and 2 <= cmdref->size() and
+	    cmdref->getOutgoingAtom(1)->is_node() and
+	    0 == cmdref->getOutgoingAtom(1)->get_name().compare(0, _pfxlen, _prefix))
+	{
+		for (size_t i = 1; i < cmdref->size(); i++)
+			paths.emplace_back(get_path(cmdref->getOutgoingAtom(i)));
+	}
+	else
+	{
+		ScanOptions opts;
+		opts.parse(cmdref, 1);
+		if (0 == opts.types) opts.types = ScanOptions::T_FILE;
+
+		std::string cwd = _cwd.substr(_pfxlen);
+		paths = scan_dir(cwd, opts);
+		if ('/' != cwd.back()) cwd += '/';
+		for (std::string& p : paths)
+			p.insert(0, cwd);
+	}
+
+	ItemStreamPtr results(createItemStream());
+	classify_files(std::move(paths), _prefix, results);
+	return results;
+}
+
+// ==============================================================
+
 // Adds factory when library is loaded.
 DEFINE_VALUE_FACTORY(FILE_SYS_STREAM, createFileSysStream)
 DEFINE_VALUE_FACTORY(FILE_SYS_STREAM, createFileSysStream, Handle)
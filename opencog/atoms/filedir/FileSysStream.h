@@ -24,11 +24,16 @@
 #define _OPENCOG_FILE_SYS_STREAM_H
 
 #include <stdio.h>
+#include <memory>
+#include <vector>
 #include <opencog/atoms/sensory/OutputStream.h>
 
 namespace opencog
 {
 
+class FileCatalog;
+struct FileOp;
+
 /** \addtogroup grp_atomspace
  *  @{
  */
@@ -43,12 +48,20 @@ class FileSysStream
 private:
 	void do_describe(void);
 
+	ValuePtr do_catalog(const Handle&);
+	ValuePtr do_locate(const Handle&);
+	ValuePtr do_classify(const Handle&);
+	ValuePtr do_mutate(const Handle&);
+	void get_ops(const Handle&, std::vector<FileOp>&);
+	std::string get_path(const Handle&);
+
 protected:
 	void init(const std::string&);
 	virtual void update() const;
 
 	Handle _description;
 	mutable std::string _cwd;
+	std::shared_ptr<FileCatalog> _catalog;
 
 public:
 	FileSysStream(void);
@@ -0,0 +1,482 @@
+/*
+ * opencog/atoms/filedir/LineReader.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <set>
+
+#include <opencog/util/exceptions.h>
+
+#include "CacheDir.h"
+#include "LineReader.h"
+
+using namespace opencog;
+
+// Start small; most lines are short, and most requests are for a few
+// lines. Double the size whenever a block holds no line break.
+#define MIN_BLOCK 16384
+#define MAX_BLOCK (16*1024*1024)
+
+// Forward reads are sequential, so read big blocks.
+#define FWD_BLOCK (1024*1024)
+
+LineReader::LineReader(int fd, const std::string& delim, bool keep) :
+	_fd(fd), _delim(delim), _keep(keep),
+	_start(-1), _blksz(MIN_BLOCK),
+	_fend(0), _fhead(0), _fscan(0)
+{
+	if (_delim.empty())
+		throw RuntimeException(TRACE_INFO, "Empty record delimiter");
+}
+
+const char* LineReader::find_delim(const char* p, size_t len) const
+{
+	if (1 == _delim.size())
+		return (const char*) memchr(p, _delim[0], len);
+	return (const char*) memmem(p, len, _delim.data(), _delim.size());
+}
+
+/// Find the last delimiter lying entirely within [p, p+len).
+const char* LineReader::rfind_delim(const char* p, size_t len) const
+{
+	size_t dlen = _delim.size();
+	if (1 == dlen)
+		return (const char*) memrchr(p, _delim[0], len);
+
+	// Look for the last byte of the delimiter, then check the rest.
+	char last = _delim.back();
+	while (dlen <= len)
+	{
+		const char* hit = (const char*) memrchr(p + dlen - 1, last, len - dlen + 1);
+		if (nullptr == hit) return nullptr;
+		const char* beg = hit - dlen + 1;
+		if (0 == memcmp(beg, _delim.data(), dlen)) return beg;
+		len = hit - p;
+	}
+	return nullptr;
+}
+
+// ==============================================================
+
+void LineReader::seek_end(void)
+{
+	struct stat st;
+	if (fstat(_fd, &st))
+		throw RuntimeException(TRACE_INFO,
+			"Unable to stat file: %s", strerror(errno));
+	_start = st.st_size;
+	_buf.clear();
+	_blksz = MIN_BLOCK;
+}
+
+/// Read the block just before `_start`, and prepend it to the buffer.
+/// Returns false at the start of the file.
+bool LineReader::fill_back(void)
+{
+	if (0 >= _start) return false;
+
+	size_t len = std::min((off_t) _blksz, _start);
+	off_t off = _start - len;
+	std::string blk(len, '\0');
+	size_t got = 0;
+	while (got < len)
+	{
+		ssize_t n = pread(_fd, &blk[got], len - got, off + got);
+		if (0 > n and EINTR == errno) continue;
+		if (0 > n)
+			throw RuntimeException(TRACE_INFO,
+				"Unable to read file: %s", strerror(errno));
+		if (0 == n) break;  // Truncated under our feet.
+		got += n;
+	}
+	blk.resize(got);
+
+	_buf.insert(0, blk);
+	_start = off;
+	if (_blksz < MAX_BLOCK) _blksz *= 2;
+	return true;
+}
+
+bool LineReader::prev(std::string& rec)
+{
+	if (0 > _start) seek_end();
+
+	size_t dlen = _delim.size();
+	while (true)
+	{
+		// Make sure a trailing delimiter is not split across blocks.
+		if (_buf.size() < dlen and fill_back()) continue;
+
+		// The record we want is terminated by the delimiter at the
+		// end of the buffer (except for the last record in a file
+		// that lacks a final delimiter). Find the one before that.
+		size_t term = (_buf.size() >= dlen and
+			0 == _buf.compare(_buf.size() - dlen, dlen, _delim)) ? dlen : 0;
+		size_t end = _buf.size() - term;
+		size_t keep = _keep ? _buf.size() : end;
+
+		const char* base = _buf.data();
+		const char* hit = rfind_delim(base, end);
+		if (hit)
+		{
+			size_t cut = hit - base + dlen;
+			rec.assign(base + cut, keep - cut);
+			_buf.resize(cut);
+			return true;
+		}
+
+		if (not fill_back())
+		{
+			if (_buf.empty()) return false;
+			_buf.resize(keep);
+			rec.swap(_buf);
+			_buf.clear();
+			return true;
+		}
+	}
+}
+
+// ==============================================================
+
+/// Append the next block to the forward buffer, first discarding the
+/// records already returned. Returns false at the end of the file.
+bool LineReader::fill_fwd(void)
+{
+	if (0 < _fhead)
+	{
+		_fbuf.erase(0, _fhead);
+		_fscan -= _fhead;
+		_fhead = 0;
+	}
+
+	size_t have = _fbuf.size();
+	_fbuf.resize(have + FWD_BLOCK);
+	ssize_t n;
+	do { n = pread(_fd, &_fbuf[have], FWD_BLOCK, _fend); }
+	while (0 > n and EINTR == errno);
+	if (0 > n)
+	{
+		_fbuf.resize(have);
+		throw RuntimeException(TRACE_INFO,
+			"Unable to read file: %s", strerror(errno));
+	}
+	_fbuf.resize(have + n);
+	_fend += n;
+	return 0 < n;
+}
+
+bool LineReader::next(std::string& rec)
+{
+	size_t dlen = _delim.size();
+	while (true)
+	{
+		const char* base = _fbuf.data();
+		const char* hit = find_delim(base + _fscan, _fbuf.size() - _fscan);
+		if (hit)
+		{
+			size_t end = hit - base;
+			rec.assign(base + _fhead, end + (_keep ? dlen : 0) - _fhead);
+			_fhead = _fscan = end + dlen;
+			return true;
+		}
+
+		// A delimiter might straddle the end of the buffer; back up
+		// just enough to find it, after the next read.
+		if (_fbuf.size() - _fhead >= dlen)
+			_fscan = _fbuf.size() - dlen + 1;
+		else
+			_fscan = _fhead;
+
+		if (not fill_fwd())
+		{
+			if (_fhead >= _fbuf.size()) return false;
+			rec.assign(_fbuf, _fhead, std::string::npos);
+			_fhead = _fscan = _fbuf.size();
+			return true;
+		}
+	}
+}
+
+// ==============================================================
+
+bool LineReader::record_at(off_t start, std::string& rec)
+{
+	rec.clear();
+	size_t dlen = _delim.size();
+	off_t pos = start;
+	size_t scan = 0;
+	char blk[MIN_BLOCK];
+	while (true)
+	{
+		ssize_t n = pread(_fd, blk, sizeof(blk), pos);
+		if (0 > n and EINTR == errno) continue;
+		if (0 >= n) return 0 < rec.size();
+		rec.append(blk, n);
+		pos += n;
+
+		const char* hit = find_delim(rec.data() + scan, rec.size() - scan);
+		if (hit)
+		{
+			rec.resize(hit - rec.data() + (_keep ? dlen : 0));
+			return true;
+		}
+		scan = (rec.size() >= dlen) ? rec.size() - dlen + 1 : 0;
+	}
+}
+
+off_t LineReader::start_after(off_t off)
+{
+	if (0 >= off) return 0;
+
+	// Back up, in case `off` is in the middle of a delimiter.
+	size_t dlen = _delim.size();
+	off_t pos = std::max((off_t) 0, off - (off_t) dlen);
+	char blk[MIN_BLOCK];
+	while (true)
+	{
+		ssize_t n = pread(_fd, blk, sizeof(blk), pos);
+		if (0 > n and EINTR == errno) continue;
+		if (0 >= n) return -1;
+
+		const char* hit = find_delim(blk, n);
+		if (hit) return pos + (hit - blk) + dlen;
+
+		if ((size_t) n < dlen) return -1;
+		pos += n - dlen + 1;
+	}
+}
+
+void LineReader::sample(size_t k, std::vector<std::string>& recs,
+                        const LineIndex* idx)
+{
+	std::random_device rd;
+	std::mt19937_64 gen(rd());
+
+	std::set<off_t> starts;
+	if (idx and 0 < idx->size())
+	{
+		// Floyd's algorithm: k distinct record numbers, uniformly.
+		size_t n = idx->size();
+		k = std::min(k, n);
+		std::set<size_t> picks;
+		for (size_t j = n - k; j < n; j++)
+		{
+			size_t t = std::uniform_int_distribution<size_t>(0, j)(gen);
+			if (not picks.insert(t).second) picks.insert(j);
+		}
+		for (size_t i : picks)
+			starts.insert((*idx)[i]);
+	}
+	else
+	{
+		struct stat st;
+		if (fstat(_fd, &st))
+			throw RuntimeException(TRACE_INFO,
+				"Unable to stat file: %s", strerror(errno));
+		if (0 == st.st_size) return;
+
+		// Files with fewer than k records will produce repeats;
+		// give up after a while.
+		std::uniform_int_distribution<off_t> dist(0, st.st_size - 1);
+		for (size_t tries = 0; starts.size() < k and tries < 4*k + 16; tries++)
+		{
+			off_t start = start_after(dist(gen));
+			if (0 > start or start >= st.st_size) start = 0;
+			starts.insert(start);
+		}
+	}
+
+	std::string rec;
+	for (off_t start : starts)
+		if (record_at(start, rec))
+			recs.emplace_back(std::move(rec));
+}
+
+// ==============================================================
+
+struct LineIndexHeader
+{
+	char magic[8];         // "OCLNIDX2"
+	uint64_t file_size;
+	int64_t mtime_ns;
+	uint64_t delim_hash;
+	uint64_t nlines;
+};
+
+static const char IDX_MAGIC[8] = {'O','C','L','N','I','D','X','2'};
+
+static uint64_t delim_hash(const std::string& delim)
+{
+	return std::hash<std::string>{}(delim);
+}
+
+LineIndex::LineIndex(void) :
+	_len(0), _map(nullptr), _offs(nullptr), _nlines(0)
+{
+}
+
+LineIndex::~LineIndex()
+{
+	if (_map) munmap(_map, _len);
+}
+
+/// The index is named for the real path of the file, so that all
+/// the ways of naming it find the same index, and for the delimiter.
+std::string LineIndex::index_path(const std::string& path,
+                                  const std::string& delim)
+{
+	char* real = realpath(path.c_str(), nullptr);
+	std::string key(real ? real : path.c_str());
+	free(real);
+	if (0 != delim.compare("\n"))
+		key.append(1, '\0').append(delim);
+	return user_cache_file(key, ".lineidx");
+}
+
+bool LineIndex::open(const std::string& path, const std::string& delim)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st)) return false;
+
+	// No cache directory means no index; sampling does without.
+	std::string ipath;
+	try { ipath = index_path(path, delim); }
+	catch (const RuntimeException&) { return false; }
+
+	int fd = ::open(ipath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (0 > fd) return false;
+
+	struct stat ist;
+	if (fstat(fd, &ist) or (size_t) ist.st_size < sizeof(LineIndexHeader))
+	{
+		close(fd);
+		return false;
+	}
+
+	void* map = mmap(nullptr, ist.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map) return false;
+
+	const LineIndexHeader* hdr = (const LineIndexHeader*) map;
+	int64_t mtime = (int64_t) st.st_mtim.tv_sec * 1000000000LL +
+		st.st_mtim.tv_nsec;
+	if (memcmp(hdr->magic, IDX_MAGIC, sizeof(IDX_MAGIC)) or
+	    hdr->file_size != (uint64_t) st.st_size or
+	    hdr->mtime_ns != mtime or
+	    hdr->delim_hash != delim_hash(delim) or
+	    ((size_t) ist.st_size - sizeof(LineIndexHeader)) / sizeof(uint64_t) <
+	        hdr->nlines)
+	{
+		munmap(map, ist.st_size);
+		return false;
+	}
+
+	_map = map;
+	_len = ist.st_size;
+	_offs = (const uint64_t*) ((const char*) map + sizeof(LineIndexHeader));
+	_nlines = hdr->nlines;
+	return true;
+}
+
+size_t LineIndex::build(const std::string& path, const std::string& delim)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (0 > fd)
+		throw RuntimeException(TRACE_INFO,
+			"Unable to open \"%s\": %s", path.c_str(), strerror(errno));
+
+	struct stat st;
+	if (fstat(fd, &st))
+	{
+		int norr = errno;
+		close(fd);
+		throw RuntimeException(TRACE_INFO,
+			"Unable to stat \"%s\": %s", path.c_str(), strerror(norr));
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	// The records are found just as LineReader::next() finds them, so
+	// that the index agrees with the reader for any delimiter. Only
+	// what was there when the file was stat'ed is indexed.
+	std::vector<uint64_t> offs;
+	try
+	{
+		LineReader rdr(fd, delim, true);
+		std::string rec;
+		uint64_t pos = 0;
+		while (pos < (uint64_t) st.st_size and rdr.next(rec))
+		{
+			offs.push_back(pos);
+			pos += rec.size();
+		}
+	}
+	catch (...)
+	{
+		close(fd);
+		throw;
+	}
+	close(fd);
+
+	LineIndexHeader hdr;
+	memcpy(hdr.magic, IDX_MAGIC, sizeof(IDX_MAGIC));
+	hdr.file_size = st.st_size;
+	hdr.mtime_ns = (int64_t) st.st_mtim.tv_sec * 1000000000LL +
+		st.st_mtim.tv_nsec;
+	hdr.delim_hash = delim_hash(delim);
+	hdr.nlines = offs.size();
+
+	// Write to a fresh temp file, and rename, so that readers never
+	// see a partial index.
+	std::string idxfile = index_path(path, delim);
+	std::string tmpfile = idxfile + ".XXXXXX";
+	int tfd = mkostemp(&tmpfile[0], O_CLOEXEC);
+	FILE* fh = (0 > tfd) ? nullptr : fdopen(tfd, "w");
+	if (nullptr == fh)
+	{
+		int norr = errno;
+		if (0 <= tfd) { close(tfd); unlink(tmpfile.c_str()); }
+		throw RuntimeException(TRACE_INFO,
+			"Unable to write \"%s\": %s", tmpfile.c_str(), strerror(norr));
+	}
+
+	bool ok = (1 == fwrite(&hdr, sizeof(hdr), 1, fh)) and
+		(offs.size() == fwrite(offs.data(), sizeof(uint64_t), offs.size(), fh));
+	ok = (0 == fclose(fh)) and ok;
+	if (not ok or rename(tmpfile.c_str(), idxfile.c_str()))
+	{
+		int norr = errno;
+		unlink(tmpfile.c_str());
+		throw RuntimeException(TRACE_INFO,
+			"Unable to write \"%s\": %s", idxfile.c_str(), strerror(norr));
+	}
+	return offs.size();
+}
@@ -0,0 +1,149 @@
+/*
+ * opencog/atoms/filedir/LineReader.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_LINE_READER_H
+#define _OPENCOG_LINE_READER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+namespace opencog
+{
+
+class LineIndex;
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * Split a file into lines, or, more generally, into records separated
+ * by an arbitrary delimiter, such as a NUL byte, or a blank line.
+ *
+ * Reading forwards, large blocks are read with pread(), and scanned
+ * with memchr() (or memmem(), for multi-byte delimiters). Records may
+ * be of any size; the buffer grows as needed.
+ *
+ * Reading backwards, blocks are read with pread(), starting at EOF,
+ * and records are split off with memrchr(), so that the cost is
+ * proportional to the amount of text returned, and not to the size
+ * of the file.
+ *
+ * By default, records are returned with their trailing delimiter, if
+ * they have one, just as fgets() returns lines.
+ */
+class LineReader
+{
+private:
+	int _fd;
+	std::string _delim;
+	bool _keep;            // Keep the delimiter on returned records.
+
+	// Reading backwards.
+	off_t _start;          // File offset of _buf[0]
+	std::string _buf;      // Bytes not yet returned.
+	size_t _blksz;
+
+	// Reading forwards.
+	off_t _fend;           // File offset just past the end of _fbuf
+	std::string _fbuf;
+	size_t _fhead;         // Start of the next record in _fbuf
+	size_t _fscan;         // Where to resume searching for a delimiter.
+
+	bool fill_back(void);
+	bool fill_fwd(void);
+	const char* find_delim(const char*, size_t) const;
+	const char* rfind_delim(const char*, size_t) const;
+
+public:
+	/// The file descriptor is not owned; the caller closes it.
+	LineReader(int fd, const std::string& delim = "\n", bool keep = true);
+
+	/// Start at the current end of file.
+	void seek_end(void);
+
+	/// Get the next record, starting from the beginning of the file.
+	/// Returns false at the end of the file.
+	bool next(std::string&);
+
+	/// Get the record before the last one returned. Returns false
+	/// when the start of the file is reached.
+	bool prev(std::string&);
+
+	/// Get the record that starts at offset `start`.
+	bool record_at(off_t start, std::string&);
+
+	/// Offset of the first record that starts after offset `off`,
+	/// or -1 if there is none. Offset zero gives the first record.
+	off_t start_after(off_t off);
+
+	/// Pick `k` distinct records at random, and return them in file
+	/// order. Reads only the pages the samples are on, and so the
+	/// cost does not depend on the file size. Without an index,
+	/// records are chosen by picking random offsets, and so a record
+	/// that follows a long one is more likely to be chosen. With an
+	/// index, the choice is exactly uniform.
+	void sample(size_t k, std::vector<std::string>&,
+	            const LineIndex* = nullptr);
+};
+
+/**
+ * Offsets of the starts of the lines (or records, for some other
+ * delimiter) of a file. The index is kept in the per-user cache
+ * directory (see CacheDir.h), under a name made from the path and
+ * the delimiter, and is only used while the size and mtime of the
+ * file match those it was built for.
+ */
+class LineIndex
+{
+private:
+	size_t _len;
+	void* _map;
+	const uint64_t* _offs;
+	size_t _nlines;
+
+public:
+	LineIndex(void);
+	~LineIndex();
+
+	/// Map the index for the file, if there is a current one. Returns
+	/// false, and does not throw, if there is none, or if the cache
+	/// directory can't be used.
+	bool open(const std::string& path, const std::string& delim = "\n");
+	bool is_open(void) const { return nullptr != _map; }
+
+	size_t size(void) const { return _nlines; }
+	uint64_t operator[](size_t i) const { return _offs[i]; }
+
+	/// (Re-)build the index for the file. Returns the number of lines.
+	static size_t build(const std::string& path,
+	                    const std::string& delim = "\n");
+	static std::string index_path(const std::string& path,
+	                              const std::string& delim = "\n");
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_LINE_READER_H
@@ -0,0 +1,86 @@
+/*
+ * opencog/atoms/filedir/LruCache.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_LRU_CACHE_H
+#define _OPENCOG_LRU_CACHE_H
+
+#include <list>
+#include <map>
+#include <utility>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * A map that holds at most a given number of entries; adding one
+ * more drops the one that was used longest ago. Used for the caches
+ * of per-file and per-directory results, which would otherwise grow
+ * with every file ever looked at. Not thread-safe; callers hold a
+ * lock.
+ */
+template<typename Key, typename Val>
+class LruCache
+{
+private:
+	typedef std::list<std::pair<Key, Val>> Order;
+
+	size_t _max;
+	Order _order;      // Most recently used first.
+	std::map<Key, typename Order::iterator> _index;
+
+public:
+	LruCache(size_t max) : _max(max) {}
+
+	/// The entry for the key, or nullptr. Finding it counts as a use.
+	Val* find(const Key& key)
+	{
+		auto it = _index.find(key);
+		if (_index.end() == it) return nullptr;
+		_order.splice(_order.begin(), _order, it->second);
+		return &it->second->second;
+	}
+
+	void put(const Key& key, Val val)
+	{
+		Val* have = find(key);
+		if (have) { *have = std::move(val); return; }
+
+		_order.emplace_front(key, std::move(val));
+		_index.emplace(key, _order.begin());
+		if (_max < _order.size())
+		{
+			_index.erase(_order.back().first);
+			_order.pop_back();
+		}
+	}
+
+	size_t size(void) const { return _order.size(); }
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_LRU_CACHE_H
@@ -0,0 +1,320 @@
+/*
+ * opencog/atoms/filedir/RotatingFileStream.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // for strerror()
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/value/ValueFactory.h>
+
+#include <opencog/atoms/sensory-types/sensory_types.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include <opencog/atoms/sensory/SensoryNode.h>
+#include "RotatingFileStream.h"
+
+using namespace opencog;
+
+// The TextFileStream gets the URL without our parameters.
+static std::string base_url(const std::string& url)
+{
+	std::map<std::string, std::string> params;
+	return SensoryNode::split_query(url, params);
+}
+
+RotatingFileStream::RotatingFileStream(const std::string& str)
+	: TextFileStream(ROTATING_FILE_STREAM, base_url(str))
+{
+	init_rotation(str);
+}
+
+RotatingFileStream::RotatingFileStream(const Handle& senso)
+	: TextFileStream(ROTATING_FILE_STREAM, base_url(senso->get_name()))
+{
+	if (SENSORY_NODE != senso->get_type())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting SensoryNode, got %s\n", senso->to_string().c_str());
+
+	init_rotation(senso->get_name());
+}
+
+RotatingFileStream::~RotatingFileStream()
+{
+	// The last segment is finished like all the others.
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		std::string seg = segment_name();
+		close_file();
+		if (0 < _seg_bytes)
+		{
+			if (0 == rename(_path.c_str(), seg.c_str()))
+				retire(seg);
+			else
+				SENSORY_WARN("RotatingFileStream: can't rename \"%s\": %s",
+					_path.c_str(), strerror(errno));
+		}
+	}
+
+	// Finish compressing what was already rotated out.
+	{
+		std::lock_guard<std::mutex> lck(_qmtx);
+		_stop = true;
+	}
+	_qcv.notify_all();
+	if (_worker.joinable()) _worker.join();
+}
+
+static size_t get_size(const std::string& str, const std::string& url)
+{
+	char* end;
+	double val = strtod(str.c_str(), &end);
+	if (end == str.c_str() or val < 0.0)
+		throw RuntimeException(TRACE_INFO,
+			"Bad size in \"%s\"\n", url.c_str());
+	switch (*end)
+	{
+		case 0: break;
+		case 'k': case 'K': val *= 1024.0; break;
+		case 'm': case 'M': val *= 1024.0 * 1024.0; break;
+		case 'g': case 'G': val *= 1024.0 * 1024.0 * 1024.0; break;
+		default:
+			throw RuntimeException(TRACE_INFO,
+				"Bad size in \"%s\"\n", url.c_str());
+	}
+	return (size_t) val;
+}
+
+void RotatingFileStream::init_rotation(const std::string& url)
+{
+	_uri = url;
+	_max_bytes = 0;
+	_max_age = 0;
+#ifdef HAVE_ZLIB
+	_compress = true;
+#else
+	_compress = false;
+#endif
+	_index = false;
+	_stop = false;
+
+	std::map<std::string, std::string> params;
+	SensoryNode::split_query(url, params);
+	for (const auto& pr : params)
+	{
+		if (0 == pr.first.compare("size"))
+			_max_bytes = get_size(pr.second, url);
+		else if (0 == pr.first.compare("age"))
+			_max_age = get_size(pr.second, url);
+		else if (0 == pr.first.compare("compress"))
+			_compress = pr.second.compare("0") and pr.second.compare("no");
+		else if (0 == pr.first.compare("index"))
+			_index = true;
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown URL parameter \"%s\" in \"%s\"\n",
+				pr.first.c_str(), url.c_str());
+	}
+
+#ifndef HAVE_ZLIB
+	if (_compress)
+		throw RuntimeException(TRACE_INFO,
+			"Built without zlib; cannot compress: \"%s\"\n", url.c_str());
+#endif
+
+	// Carry on with an existing file.
+	struct stat st;
+	_seg_bytes = (0 == fstat(fileno(_fh), &st)) ? st.st_size : 0;
+	_seg_first = (0 < _seg_bytes) ? st.st_mtime : 0;
+	_seg_last = _seg_first;
+	_try_bytes = _seg_bytes;
+	_try_first = _seg_first;
+
+	_worker = std::thread(&RotatingFileStream::worker_loop, this);
+}
+
+// ==============================================================
+
+void RotatingFileStream::do_write(const std::string& str)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+
+	time_t now = time(nullptr);
+	if (0 < _try_bytes and
+	    ((_max_bytes and _max_bytes < _try_bytes + str.size()) or
+	     (_max_age and _try_first + _max_age <= now)))
+		rotate();
+
+	if (0 == _seg_bytes) _seg_first = now;
+	if (0 == _try_bytes) _try_first = now;
+	fwrite(str.data(), 1, str.size(), _fh);
+	_seg_bytes += str.size();
+	_try_bytes += str.size();
+	_seg_last = now;
+}
+
+/// Readers share the file handle, which rotate() swaps.
+void RotatingFileStream::update() const
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	TextFileStream::update();
+}
+
+/// A name for the current segment, not yet taken by another.
+std::string RotatingFileStream::segment_name(void) const
+{
+	char stamp[32];
+	struct tm tmv;
+	localtime_r(&_seg_first, &tmv);
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tmv);
+
+	std::string seg = _path + "." + stamp;
+	struct stat st;
+	for (int n = 1; 0 == stat(seg.c_str(), &st) or
+	     (_compress and 0 == stat((seg + ".gz").c_str(), &st)); n++)
+		seg = _path + "." + stamp + "." + std::to_string(n);
+	return seg;
+}
+
+/// Move the current file out of the way, and start a new one. The
+/// old one is handed to the worker thread. Called with `_mtx` held.
+///
+/// If the file can't be moved, or the new one can't be opened, keep
+/// appending to the old one; that's better than losing data. The next
+/// try is a whole period (of size or age) later, so that a stuck file
+/// doesn't cost a rename on every write.
+void RotatingFileStream::rotate(void)
+{
+	_try_bytes = 0;
+
+	std::string seg = segment_name();
+	if (rename(_path.c_str(), seg.c_str()))
+	{
+		SENSORY_WARN("RotatingFileStream: can't rename \"%s\": %s",
+			_path.c_str(), strerror(errno));
+		return;
+	}
+
+	// Open the new file before closing the old, so that there is
+	// always a file to write to.
+	FILE* fh = fopen(_path.c_str(), "a+");
+	if (nullptr == fh)
+	{
+		SENSORY_WARN("RotatingFileStream: can't open \"%s\": %s",
+			_path.c_str(), strerror(errno));
+		rename(seg.c_str(), _path.c_str());
+		return;
+	}
+	close_file();
+	_fh = fh;
+	retire(seg);
+}
+
+/// Hand a segment that was moved out to the worker thread.
+void RotatingFileStream::retire(const std::string& seg)
+{
+	{
+		std::lock_guard<std::mutex> lck(_qmtx);
+		_queue.push_back({seg, _seg_first, _seg_last});
+	}
+	_qcv.notify_one();
+	_seg_bytes = 0;
+}
+
+// ==============================================================
+
+void RotatingFileStream::worker_loop(void)
+{
+	std::unique_lock<std::mutex> lck(_qmtx);
+	while (true)
+	{
+		_qcv.wait(lck, [this] { return _stop or not _queue.empty(); });
+		if (_queue.empty()) return;
+
+		Segment seg = _queue.front();
+		_queue.pop_front();
+		lck.unlock();
+		finish_segment(seg);
+		lck.lock();
+	}
+}
+
+#ifdef HAVE_ZLIB
+/// Compress `path` to `path.gz`, and remove the original. Returns the
+/// name of the file that holds the data when done.
+static std::string gzip_file(const std::string& path)
+{
+	FILE* in = fopen(path.c_str(), "r");
+	if (nullptr == in) return path;
+
+	std::string gz = path + ".gz";
+	std::string tmp = gz + ".tmp";
+	gzFile out = gzopen(tmp.c_str(), "wb6");
+	if (nullptr == out) { fclose(in); return path; }
+
+	bool ok = true;
+	char buf[256*1024];
+	size_t n;
+	while (ok and 0 < (n = fread(buf, 1, sizeof(buf), in)))
+		ok = ((int) n == gzwrite(out, buf, n));
+	ok = (not ferror(in)) and ok;
+	fclose(in);
+	ok = (Z_OK == gzclose(out)) and ok;
+
+	if (not ok or rename(tmp.c_str(), gz.c_str()))
+	{
+		unlink(tmp.c_str());
+		return path;
+	}
+	unlink(path.c_str());
+	return gz;
+}
+#endif
+
+void RotatingFileStream::finish_segment(const Segment& seg)
+{
+	std::string final_path = seg.path;
+#ifdef HAVE_ZLIB
+	if (_compress) final_path = gzip_file(seg.path);
+#endif
+
+	if (not _index) return;
+
+	std::string base = final_path.substr(final_path.rfind('/') + 1);
+	FILE* idx = fopen((_path + ".segments").c_str(), "a");
+	if (nullptr == idx) return;
+	fprintf(idx, "%lld\t%lld\t%s\n",
+		(long long) seg.first, (long long) seg.last, base.c_str());
+	fclose(idx);
+}
+
+// ==============================================================
+
+// Adds factory when library is loaded.
+DEFINE_VALUE_FACTORY(ROTATING_FILE_STREAM, createRotatingFileStream, std::string)
+DEFINE_VALUE_FACTORY(ROTATING_FILE_STREAM, createRotatingFileStream, Handle)
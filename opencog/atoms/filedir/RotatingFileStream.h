@@ -0,0 +1,124 @@
+/*
+ * opencog/atoms/filedir/RotatingFileStream.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_ROTATING_FILE_STREAM_H
+#define _OPENCOG_ROTATING_FILE_STREAM_H
+
+#include <time.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <opencog/atoms/filedir/TextFileStream.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * RotatingFileStreams are TextFileStreams that roll over to a new
+ * file when the current one gets too big, or too old. The closed
+ * segments are compressed on a background thread; the writer only
+ * pays for a rename and an open. The URL parameters are
+ *    size=10M      ; roll over after this many bytes (K, M, G allowed)
+ *    age=3600      ; roll over after this many seconds
+ *    compress=0    ; keep the segments uncompressed
+ *    index         ; keep an index of segment time ranges
+ * as in `file:///var/log/bot.log?size=100M&age=86400&index`.
+ *
+ * Segments are named after the time of their first write, e.g.
+ * `bot.log.20240601-120000.gz`. The index, `bot.log.segments`, has
+ * one line per segment, with the times of the first and last writes
+ * (in seconds since the epoch), and the segment file name, separated
+ * by tabs; so replay can go straight to the segment it wants.
+ *
+ * The age is checked when writing, so a segment is closed on the
+ * first write after it becomes too old. If the file can't be rolled
+ * over, writes carry on into it, and the next try is a period later.
+ * Closing the stream finishes the last segment like the others.
+ */
+class RotatingFileStream
+	: public TextFileStream
+{
+private:
+	struct Segment
+	{
+		std::string path;
+		time_t first;
+		time_t last;
+	};
+
+	size_t _max_bytes;
+	time_t _max_age;
+	bool _compress;
+	bool _index;
+
+	// Guards the file handle, which is swapped on rotation.
+	mutable std::mutex _mtx;
+	size_t _seg_bytes;
+	time_t _seg_first;
+	time_t _seg_last;
+
+	// Bytes and start time since the last rollover, or failed try.
+	size_t _try_bytes;
+	time_t _try_first;
+
+	// Background compression.
+	std::mutex _qmtx;
+	std::condition_variable _qcv;
+	std::deque<Segment> _queue;
+	bool _stop;
+	std::thread _worker;
+
+	void init_rotation(const std::string&);
+	std::string segment_name(void) const;
+	void rotate(void);
+	void retire(const std::string&);
+	void worker_loop(void);
+	void finish_segment(const Segment&);
+
+protected:
+	virtual void do_write(const std::string&);
+	virtual void update() const;
+
+public:
+	RotatingFileStream(const Handle&);
+	RotatingFileStream(const std::string&);
+	virtual ~RotatingFileStream();
+};
+
+typedef std::shared_ptr<RotatingFileStream> RotatingFileStreamPtr;
+static inline RotatingFileStreamPtr RotatingFileStreamCast(ValuePtr& a)
+	{ return std::dynamic_pointer_cast<RotatingFileStream>(a); }
+
+template<typename ... Type>
+static inline std::shared_ptr<RotatingFileStream> createRotatingFileStream(Type&&... args) {
+   return std::make_shared<RotatingFileStream>(std::forward<Type>(args)...);
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_ROTATING_FILE_STREAM_H
@@ -21,6 +21,7 @@
  */
 
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h> // for strerror()
 
 #include <opencog/util/exceptions.h>
@@ -30,6 +31,9 @@
 #include <opencog/atoms/value/ValueFactory.h>
 
 #include <opencog/atoms/sensory-types/sensory_types.h>
+#include <opencog/atoms/sensory/DirectCopy.h>
+#include <opencog/atoms/sensory/SensoryNode.h>
+#include "LineReader.h"
 #include "TextFileStream.h"
 
 using namespace opencog;
@@ -60,8 +64,16 @@ TextFileStream::TextFileStream(const Handle& senso)
 
 TextFileStream::~TextFileStream()
 {
+	close_file();
+}
+
+void TextFileStream::close_file(void) const
+{
+	_reader.reset();
+	_pending.clear();
 	if (_fh)
 		fclose (_fh);
+	_fh = nullptr;
 }
 
 /// Attempt to open the URL for reading and writing.
@@ -78,11 +90,15 @@ TextFileStream::~TextFileStream()
 /// Possible extensions:
 /// file:mode//...
 /// where mode is one of the modes described in `man 3 fopen`
+///
+/// Read modes are given as a query string; see the header file.
 
 void TextFileStream::init(const std::string& url)
 {
 	_fresh = true;
 	_fh = nullptr;
+	_mode = READ_FORWARD;
+	_count = 0;
 	if (0 != url.compare(0, 8, "file:///"))
 		throw RuntimeException(TRACE_INFO,
 			"Unsupported URL \"%s\"\n", url.c_str());
@@ -90,9 +106,38 @@ void TextFileStream::init(const std::string& url)
 	// Make a copy, for debuggingg purposes.
 	_uri = url;
 
+	std::map<std::string, std::string> params;
+	std::string base = SensoryNode::split_query(url, params);
+	for (const auto& pr : params)
+	{
+		if (0 == pr.first.compare("reverse"))
+			_mode = READ_REVERSE;
+		else if (0 == pr.first.compare("tail") or
+		         0 == pr.first.compare("sample"))
+		{
+			char* end;
+			_count = strtoul(pr.second.c_str(), &end, 10);
+			if (pr.second.empty() or *end)
+				throw RuntimeException(TRACE_INFO,
+					"Expecting a line count: \"%s\"\n", url.c_str());
+			_mode = ('t' == pr.first[0]) ? READ_TAIL : READ_SAMPLE;
+		}
+		else if (0 == pr.first.compare("delim"))
+		{
+			if (pr.second.empty())
+				throw RuntimeException(TRACE_INFO,
+					"Expecting a delimiter: \"%s\"\n", url.c_str());
+			_delim = pr.second;
+		}
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown URL parameter \"%s\" in \"%s\"\n",
+				pr.first.c_str(), url.c_str());
+	}
+
 	// Ignore the first 7 chars "file://"
-	const char* fpath = url.substr(7).c_str();
-	_fh = fopen(fpath, "a+");
+	_path = base.substr(7);
+	_fh = fopen(_path.c_str(), "a+");
 
 	if (nullptr == _fh)
 	{
@@ -122,7 +167,22 @@ ValuePtr TextFileStream::describe(AtomSpace* as, bool silent)
 // So, a line-oriented, buffered interface. For now.
 void TextFileStream::update() const
 {
-	if (nullptr == _fh) { _value.clear(); return; }
+	std::string item;
+	if (not next_item(item))
+	{
+		_value.clear();
+		return;
+	}
+	_value.resize(1);
+	_value[0] = createNode(ITEM_NODE, std::move(item));
+}
+
+/// Get the next thing to hand out: a line, or a record, depending on
+/// the read mode. Closes the file, and returns false, at the end.
+#define BUFSZ 4080
+bool TextFileStream::next_item(std::string& item) const
+{
+	if (nullptr == _fh) return false;
 
 	// The very first call after opening a file will typically
 	// be a bogus update, so as to give the caller something,
@@ -131,24 +191,75 @@ void TextFileStream::update() const
 	if (_fresh)
 	{
 		_fresh = false;
-		_value.resize(1);
-		_value[0] = createNode(ITEM_NODE, _uri);
-		return;
+		item = _uri;
+		return true;
 	}
 
-#define BUFSZ 4080
-	char buff[BUFSZ];
-	char* rd = fgets(buff, BUFSZ, _fh);
-	if (nullptr == rd)
+	if (READ_FORWARD != _mode or not _delim.empty())
 	{
-		fclose(_fh);
-		_fh = nullptr;
-		_value.clear();
-		return;
+		if (read_record(item)) return true;
 	}
+	else
+	{
+		char buff[BUFSZ];
+		if (fgets(buff, BUFSZ, _fh))
+		{
+			item.assign(buff);
+			return true;
+		}
+	}
+	close_file();
+	return false;
+}
 
-	_value.resize(1);
-	_value[0] = createNode(ITEM_NODE, buff);
+/// Get the next record in the record, reverse, tail and sample modes.
+/// The reverse and tail modes start at the end of the file at the time
+/// of the first read; the sample is taken at the time of the first read.
+bool TextFileStream::read_record(std::string& line) const
+{
+	if (nullptr == _reader)
+	{
+		// Records keep their delimiter, just as lines keep their
+		// newline.
+		const std::string delim(_delim.empty() ? "\n" : _delim);
+		_reader.reset(new LineReader(fileno(_fh), delim));
+
+		if (READ_FORWARD == _mode)
+			return _reader->next(line);
+
+		// Sampling reads only what it returns. An index of record
+		// starts, if someone built one, makes it exactly uniform.
+		if (READ_SAMPLE == _mode)
+		{
+			LineIndex idx;
+			bool have = idx.open(_path, delim);
+
+			std::vector<std::string> recs;
+			_reader->sample(_count, recs, have ? &idx : nullptr);
+			for (std::string& r : recs)
+				_pending.emplace_back(std::move(r));
+		}
+		else
+			_reader->seek_end();
+
+		// Collect the tail, so as to hand it out in forward order.
+		if (READ_TAIL == _mode)
+		{
+			std::string tl;
+			for (size_t i = 0; i < _count and _reader->prev(tl); i++)
+				_pending.emplace_front(std::move(tl));
+		}
+	}
+
+	if (READ_FORWARD == _mode)
+		return _reader->next(line);
+	if (READ_REVERSE == _mode)
+		return _reader->prev(line);
+
+	if (_pending.empty()) return false;
+	line = std::move(_pending.front());
+	_pending.pop_front();
+	return true;
 }
 
 // ==============================================================
@@ -156,7 +267,24 @@ void TextFileStream::update() const
 
 void TextFileStream::do_write(const std::string& str)
 {
-	fprintf(_fh, "%s", str.c_str());
+	fwrite(str.data(), 1, str.size(), _fh);
+}
+
+/// Copy one text file into another. Same as what update() and
+/// prt_value() would do, item by item, but without making an ItemNode
+/// for each line.
+namespace opencog {
+template<>
+void DirectCopy<TextFileStream>::loop(TextFileStream* sink,
+                                      const TextFileStream* src)
+{
+	// The string is reused, so that its buffer is, too. Same as
+	// do_write(); lines may hold NUL bytes, so it is not fputs().
+	std::string item;
+	while (src->next_item(item))
+		fwrite(item.data(), 1, item.size(), sink->_fh);
+	src->_value.clear();
+}
 }
 
 // Write stuff to a file.
@@ -167,7 +295,10 @@ ValuePtr TextFileStream::write_out(AtomSpace* as, bool silent,
 		throw RuntimeException(TRACE_INFO,
 			"Text stream not open: URI \"%s\"\n", _uri.c_str());
 
-	return do_write_out(as, silent, cref);
+	ValuePtr content = get_content(as, silent, cref);
+	if (DirectCopy<TextFileStream>::copy(this, content, TEXT_FILE_STREAM))
+		return content;
+	return write_content(content);
 }
 
 // ==============================================================
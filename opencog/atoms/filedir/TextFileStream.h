@@ -24,11 +24,15 @@
 #define _OPENCOG_TEXT_FILE_STREAM_H
 
 #include <stdio.h>
+#include <deque>
+#include <memory>
 #include <opencog/atoms/sensory/OutputStream.h>
 
 namespace opencog
 {
 
+class LineReader;
+
 /** \addtogroup grp_atomspace
  *  @{
  */
@@ -36,18 +40,55 @@ namespace opencog
 /**
  * TextFileStreams provide a stream of ItemNodes read from a text file,
  * and, more generally, from unix socket sources. This is experimental.
+ *
+ * By default, lines are read from the start of the file. A query
+ * string on the URL selects another mode:
+ *    file:///var/log/syslog?tail=100   ; the last 100 lines, in order
+ *    file:///var/log/syslog?reverse    ; all lines, last one first
+ * Both of these read backwards from the end of the file, and so cost
+ * is proportional to what is read, not to the size of the file.
+ *
+ * Records other than lines are read by giving a delimiter, which may
+ * be several bytes long, and is percent-encoded:
+ *    file:///tmp/files.txt?delim=%00      ; NUL-separated, as find -print0
+ *    file:///tmp/book.txt?delim=%0A%0A    ; paragraphs
+ * Records are returned whole, no matter how long they are, and keep
+ * their delimiter, as lines keep their newline. This combines with
+ * the tail and reverse modes.
+ *
+ * A random sample of lines (or records) is read with
+ *    file:///var/log/syslog?sample=20
+ * which reads only the pages the sampled lines are on, so that the
+ * cost depends on the size of the sample, and not of the file. Lines
+ * are found from random byte offsets, so lines following long lines
+ * are favored; if there is a current line index for the file (see
+ * LineIndex), the sample is exactly uniform. The index is never built
+ * here. The sampled lines are delivered in file order.
  */
 class TextFileStream
 	: public OutputStream
 {
+	friend class DirectCopy<TextFileStream>;
+
 protected:
 	TextFileStream(Type t, const std::string&);
 	void init(const std::string&);
 	virtual void update() const;
 
 	std::string _uri;
+	std::string _path;
 	mutable FILE* _fh;
 	mutable bool _fresh;
+
+	enum ReadMode { READ_FORWARD, READ_REVERSE, READ_TAIL, READ_SAMPLE };
+	ReadMode _mode;
+	size_t _count;         // Number of lines, for tail and sample.
+	std::string _delim;    // Empty, for plain lines.
+	mutable std::unique_ptr<LineReader> _reader;
+	mutable std::deque<std::string> _pending;
+	bool read_record(std::string&) const;
+	bool next_item(std::string&) const;
+	void close_file(void) const;
 	virtual void do_write(const std::string&);
 
 public:
@@ -0,0 +1,718 @@
+/*
+ * opencog/atoms/http/HttpStream.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h> // for strerror()
+#include <strings.h> // for strncasecmp()
+#include <unistd.h>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+#include <opencog/atoms/value/ValueFactory.h>
+
+#include <opencog/atoms/sensory-types/sensory_types.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include <opencog/atoms/sensory/SensoryNode.h>
+#include "HttpStream.h"
+
+using namespace opencog;
+
+struct HttpStream::Request
+{
+	std::string wire;       // The whole request, ready to send.
+	bool idempotent;        // May be pipelined, and sent again.
+	bool head;              // The response has no body.
+	int retries;
+	ItemStreamPtr out;
+};
+
+// When a connection breaks, the request whose answer was being read
+// is sent once more, if it is idempotent. Those behind it are always
+// sent again; each one gets to be at the front at some point.
+#define MAX_RETRIES 1
+
+HttpStream::HttpStream(const std::string& str)
+	: OutputStream(HTTP_STREAM)
+{
+	init(str);
+}
+
+HttpStream::HttpStream(const Handle& senso)
+	: OutputStream(HTTP_STREAM)
+{
+	if (SENSORY_NODE != senso->get_type())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting SensoryNode, got %s\n", senso->to_string().c_str());
+
+	init(senso->get_name());
+}
+
+static void fail(const HttpStream::RequestPtr& req, const std::string& why)
+{
+	req->out->add(createLinkValue(ValueSeq({
+		createFloatValue(0.0), createStringValue(why)})));
+	req->out->close();
+}
+
+HttpStream::~HttpStream()
+{
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		_stop = true;
+
+		// Wakes up threads waiting for a response.
+		for (int fd : _fds)
+			if (0 <= fd) shutdown(fd, SHUT_RDWR);
+	}
+	_cv.notify_all();
+	for (std::thread& th : _threads)
+		th.join();
+
+	for (const RequestPtr& req : _pending)
+		fail(req, "Stream closed");
+}
+
+/// The URL is the server, and a path prefix for all requests:
+///    http://localhost:8080/api?pool=4&depth=8&timeout=30
+void HttpStream::init(const std::string& urlq)
+{
+	_stop = false;
+	_pool = 2;
+	_depth = 8;
+	_timeout = 30;
+	_nconnects = 0;
+	_nrequests = 0;
+	_nresponses = 0;
+	_nretries = 0;
+
+	if (0 != urlq.compare(0, 7, "http://"))
+		throw RuntimeException(TRACE_INFO,
+			"Unsupported URL \"%s\"\n", urlq.c_str());
+	_uri = urlq;
+
+	std::map<std::string, std::string> params;
+	std::string url = SensoryNode::split_query(urlq, params);
+	for (const auto& pr : params)
+	{
+		char* end;
+		unsigned long num = strtoul(pr.second.c_str(), &end, 10);
+		if (pr.second.empty() or *end or 0 == num)
+			throw RuntimeException(TRACE_INFO,
+				"Expecting a number for \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+
+		if (0 == pr.first.compare("pool"))
+			_pool = num;
+		else if (0 == pr.first.compare("depth"))
+			_depth = num;
+		else if (0 == pr.first.compare("timeout"))
+			_timeout = num;
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown URL parameter \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+	}
+
+	size_t sls = url.find('/', 7);
+	_authority = url.substr(7, sls - 7);
+	_base = (std::string::npos == sls) ? "" : url.substr(sls);
+	while (not _base.empty() and '/' == _base.back()) _base.pop_back();
+
+	// Split host:port, allowing for [::1]:port
+	_host = _authority;
+	_port = "80";
+	size_t col = _authority.rfind(':');
+	size_t brk = _authority.rfind(']');
+	if (std::string::npos != col and
+	    (std::string::npos == brk or brk < col))
+	{
+		_host = _authority.substr(0, col);
+		_port = _authority.substr(col + 1);
+	}
+	if (2 <= _host.size() and '[' == _host.front() and ']' == _host.back())
+		_host = _host.substr(1, _host.size() - 2);
+	bool ctl = false;
+	for (unsigned char c : _authority)
+		if (c <= 0x20 or 0x7f <= c) ctl = true;
+	if (_host.empty() or _port.empty() or ctl)
+		throw RuntimeException(TRACE_INFO,
+			"Expecting http://host:port/path, got \"%s\"\n", urlq.c_str());
+
+	_fds.resize(_pool, -1);
+	for (size_t i = 0; i < _pool; i++)
+		_threads.emplace_back(&HttpStream::conn_loop, this, i);
+}
+
+// ==============================================================
+// Making requests.
+
+/// RFC 9110 token characters, allowed in a method name.
+static bool is_tchar(unsigned char c)
+{
+	return isalnum(c) or (c and strchr("!#$%&'*+-.^_`|~", c));
+}
+
+/// Percent-encode what may not appear in a request target: controls
+/// (CR and LF above all), space, DEL and non-ASCII bytes. A `%` is
+/// passed on as-is, so paths that are already encoded still work.
+static void append_target(std::string& w, const std::string& path)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	for (unsigned char c : path)
+	{
+		if (0x20 < c and c < 0x7f)
+		{
+			w += (char) c;
+			continue;
+		}
+		w += '%';
+		w += hex[c >> 4];
+		w += hex[c & 0xf];
+	}
+}
+
+ItemStreamPtr HttpStream::request(const std::string& method,
+                                  const std::string& path,
+                                  const std::string& body,
+                                  const std::vector<std::string>& headers)
+{
+	bool tok = not method.empty();
+	for (unsigned char c : method)
+		if (not is_tchar(c)) tok = false;
+	if (not tok)
+		throw RuntimeException(TRACE_INFO,
+			"Bad method \"%s\"\n", method.c_str());
+
+	RequestPtr req(std::make_shared<Request>());
+	req->head = (0 == method.compare("HEAD"));
+	req->idempotent = (0 != method.compare("POST") and
+	                   0 != method.compare("PATCH"));
+	req->retries = 0;
+	req->out = createItemStream();
+
+	std::string& w = req->wire;
+	w = method + " ";
+	append_target(w, _base);
+	if (path.empty() or '/' != path[0]) w += '/';
+	append_target(w, path);
+	w += " HTTP/1.1\r\n";
+	w += "Host: " + _authority + "\r\n";
+	w += "User-Agent: opencog-sensory\r\n";
+	for (const std::string& hdr : headers)
+	{
+		if (std::string::npos != hdr.find_first_of("\r\n") or
+		    std::string::npos == hdr.find(':'))
+			throw RuntimeException(TRACE_INFO,
+				"Bad header \"%s\"\n", hdr.c_str());
+		w += hdr + "\r\n";
+	}
+	if (not body.empty() or not req->idempotent)
+		w += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+	w += "\r\n";
+	w += body;
+
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		_pending.push_back(req);
+		_nrequests ++;
+	}
+	_cv.notify_one();
+	return req->out;
+}
+
+static std::string get_word(const ValuePtr& vp)
+{
+	if (vp->is_node()) return HandleCast(vp)->get_name();
+	if (vp->is_type(STRING_VALUE))
+	{
+		const std::vector<std::string>& strs = StringValueCast(vp)->value();
+		if (1 == strs.size()) return strs[0];
+	}
+	throw RuntimeException(TRACE_INFO,
+		"Expecting a string, got %s\n", vp->to_string().c_str());
+}
+
+/// A path is a GET; otherwise (method path [body [header...]]).
+/// The members of a List are executed first.
+ValuePtr HttpStream::write_out(AtomSpace* as, bool silent,
+                               const Handle& cref)
+{
+	ValueSeq args;
+	if (LIST_LINK == cref->get_type())
+	{
+		for (const Handle& h : cref->getOutgoingSet())
+		{
+			if (not h->is_executable())
+			{
+				args.emplace_back(h);
+				continue;
+			}
+			ValuePtr vp = h->execute(as, silent);
+			if (nullptr == vp)
+				throw RuntimeException(TRACE_INFO,
+					"Expecting something from %s\n", h->to_string().c_str());
+			args.emplace_back(vp);
+		}
+	}
+	else
+	{
+		ValuePtr content = cref;
+		if (cref->is_executable())
+			content = cref->execute(as, silent);
+		if (content and content->is_type(LINK_VALUE) and
+		    not content->is_type(LINK_STREAM_VALUE))
+			args = LinkValueCast(content)->value();
+		else if (content)
+			args.emplace_back(content);
+	}
+
+	if (1 == args.size())
+		return request("GET", get_word(args[0]), "", {});
+
+	if (2 <= args.size())
+	{
+		std::string body = (2 < args.size()) ? get_word(args[2]) : "";
+		std::vector<std::string> headers;
+		for (size_t i = 3; i < args.size(); i++)
+			headers.emplace_back(get_word(args[i]));
+		return request(get_word(args[0]), get_word(args[1]), body, headers);
+	}
+
+	throw RuntimeException(TRACE_INFO,
+		"Expecting a path, or (method path [body [headers]]), got %s\n",
+		cref->to_string().c_str());
+}
+
+// ==============================================================
+// Reading responses.
+
+/// One connection, as seen by the thread that runs it.
+struct Conn
+{
+	int fd;
+	std::string inbuf;
+	size_t off;             // Start of what has not been parsed yet.
+	std::string err;
+};
+
+/// Read more. False on EOF, error or timeout.
+static bool fill(Conn& c)
+{
+	if (0 < c.off)
+	{
+		c.inbuf.erase(0, c.off);
+		c.off = 0;
+	}
+	char buf[65536];
+	while (true)
+	{
+		ssize_t rc = recv(c.fd, buf, sizeof(buf), 0);
+		if (0 > rc and EINTR == errno) continue;
+		if (0 == rc) c.err = "Connection closed by server";
+		if (0 > rc)
+			c.err = (EAGAIN == errno) ? "Timed out" : strerror(errno);
+		if (0 >= rc) return false;
+		c.inbuf.append(buf, rc);
+		return true;
+	}
+}
+
+static bool get_line(Conn& c, std::string& line)
+{
+	while (true)
+	{
+		size_t nl = c.inbuf.find('\n', c.off);
+		if (std::string::npos != nl)
+		{
+			line.assign(c.inbuf, c.off, nl - c.off);
+			if (not line.empty() and '\r' == line.back()) line.pop_back();
+			c.off = nl + 1;
+			return true;
+		}
+		if (65536 < c.inbuf.size() - c.off)
+		{
+			c.err = "Header line too long";
+			return false;
+		}
+		if (not fill(c)) return false;
+	}
+}
+
+/// Pass on `n` bytes of the body, a piece at a time, as they arrive.
+static bool get_body(Conn& c, uint64_t n, const ItemStreamPtr& out)
+{
+	while (0 < n)
+	{
+		if (c.off == c.inbuf.size() and not fill(c)) return false;
+		size_t len = std::min((uint64_t) (c.inbuf.size() - c.off), n);
+		out->add(createStringValue(c.inbuf.substr(c.off, len)));
+		c.off += len;
+		n -= len;
+	}
+	return true;
+}
+
+enum Outcome
+{
+	KEEP,       // Done; the connection can be reused.
+	CLOSE,      // Done; the connection must be closed.
+	RETRY,      // Closed before anything came back.
+	FAILED,     // Broken in the middle.
+};
+
+static Outcome read_response(Conn& c, HttpStream::Request& req)
+{
+	std::string line;
+	int status = 0;
+	std::string reason;
+	std::vector<std::string> hdrs;
+	bool chunked = false;
+	bool has_length = false;
+	uint64_t length = 0;
+	bool close = false;
+
+	// Interim 1xx responses are skipped.
+	while (status < 200)
+	{
+		bool fresh = (c.off == c.inbuf.size());
+		if (not get_line(c, line))
+			return (fresh and c.off == c.inbuf.size()) ? RETRY : FAILED;
+		if (line.empty() and 0 == status) continue;
+
+		if (0 != line.compare(0, 7, "HTTP/1.") or line.size() < 12)
+		{
+			c.err = "Bad status line: " + line.substr(0, 80);
+			return FAILED;
+		}
+		bool http10 = ('0' == line[7]);
+		status = atoi(line.c_str() + 9);
+		reason = (13 <= line.size()) ? line.substr(13) : "";
+		close = http10;
+
+		hdrs.clear();
+		chunked = false;
+		has_length = false;
+		while (true)
+		{
+			if (not get_line(c, line)) return FAILED;
+			if (line.empty()) break;
+			size_t col = line.find(':');
+			if (std::string::npos == col) continue;
+
+			std::string name = line.substr(0, col);
+			for (char& ch : name) ch = tolower(ch);
+			size_t vst = line.find_first_not_of(" \t", col + 1);
+			std::string value = (std::string::npos == vst) ? "" :
+				line.substr(vst, line.find_last_not_of(" \t") + 1 - vst);
+
+			if (0 == name.compare("content-length"))
+			{
+				has_length = true;
+				length = strtoull(value.c_str(), nullptr, 10);
+			}
+			else if (0 == name.compare("transfer-encoding"))
+				chunked = (std::string::npos != value.find("chunked"));
+			else if (0 == name.compare("connection"))
+			{
+				if (0 == strncasecmp(value.c_str(), "close", 5))
+					close = true;
+				else if (0 == strncasecmp(value.c_str(), "keep-alive", 10))
+					close = false;
+			}
+			hdrs.emplace_back(std::move(name));
+			hdrs.emplace_back(std::move(value));
+		}
+		if (status < 100)
+		{
+			c.err = "Bad status: " + std::to_string(status);
+			return FAILED;
+		}
+	}
+
+	req.out->add(createLinkValue(ValueSeq({
+		createFloatValue((double) status),
+		createStringValue(reason),
+		createStringValue(std::move(hdrs))})));
+
+	if (req.head or 204 == status or 304 == status)
+		return close ? CLOSE : KEEP;
+
+	if (chunked)
+	{
+		while (true)
+		{
+			if (not get_line(c, line)) return FAILED;
+			char* end;
+			uint64_t sz = strtoull(line.c_str(), &end, 16);
+			if (end == line.c_str())
+			{
+				c.err = "Bad chunk size: " + line.substr(0, 80);
+				return FAILED;
+			}
+			if (0 == sz) break;
+			if (not get_body(c, sz, req.out)) return FAILED;
+			if (not get_line(c, line)) return FAILED;
+		}
+
+		// Trailers, which are dropped.
+		do { if (not get_line(c, line)) return FAILED; }
+		while (not line.empty());
+		return close ? CLOSE : KEEP;
+	}
+
+	if (has_length)
+		return get_body(c, length, req.out) ?
+			(close ? CLOSE : KEEP) : FAILED;
+
+	// No length: the body runs to the end of the connection.
+	while (true)
+	{
+		if (c.off < c.inbuf.size())
+		{
+			req.out->add(createStringValue(c.inbuf.substr(c.off)));
+			c.off = c.inbuf.size();
+		}
+		if (not fill(c)) break;
+	}
+	return (0 == c.err.compare("Connection closed by server")) ?
+		CLOSE : FAILED;
+}
+
+// ==============================================================
+// Running the connections.
+
+/// Connect to the server. Returns -1, and says why, on failure.
+int HttpStream::open_conn(std::string& err)
+{
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo* res = nullptr;
+	int rc = getaddrinfo(_host.c_str(), _port.c_str(), &hints, &res);
+	if (0 != rc)
+	{
+		err = std::string("Can't resolve ") + _host + ": " + gai_strerror(rc);
+		return -1;
+	}
+
+	int fd = -1;
+	for (struct addrinfo* ai = res; ai; ai = ai->ai_next)
+	{
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+		            ai->ai_protocol);
+		if (0 > fd) { err = strerror(errno); continue; }
+
+		// The send timeout also bounds connect().
+		struct timeval tv = {(time_t) _timeout, 0};
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		if (0 == connect(fd, ai->ai_addr, ai->ai_addrlen)) break;
+		err = std::string("Can't connect to ") + _authority + ": " +
+			strerror(errno);
+		::close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+/// Wait for requests, and take as many as may be pipelined behind
+/// those already in flight. Returns false when the stream is closed.
+bool HttpStream::take(std::deque<RequestPtr>& inflight, std::string& out)
+{
+	std::unique_lock<std::mutex> lck(_mtx);
+	while (not _stop and _pending.empty() and inflight.empty())
+		_cv.wait(lck);
+	if (_stop) return false;
+
+	while (not _pending.empty() and inflight.size() < _depth)
+	{
+		// Nothing goes out with, or behind, a request that isn't
+		// idempotent: if the connection breaks, it can't be resent,
+		// and neither can anything sent after it.
+		const RequestPtr& req = _pending.front();
+		if (not inflight.empty() and
+		    (not req->idempotent or not inflight.back()->idempotent))
+			break;
+		out += req->wire;
+		inflight.push_back(req);
+		_pending.pop_front();
+	}
+	return true;
+}
+
+/// Put back what was in flight, so that another
+/// connection sends it; or fail it, if it can't be sent again.
+void HttpStream::requeue(std::deque<RequestPtr>& inflight)
+{
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		while (not inflight.empty())
+		{
+			RequestPtr req(inflight.back());
+			inflight.pop_back();
+			if (_stop or not req->idempotent or MAX_RETRIES < req->retries)
+			{
+				fail(req, "Connection closed by server");
+				continue;
+			}
+			_pending.push_front(req);
+			_nretries ++;
+		}
+	}
+	_cv.notify_all();
+}
+
+void HttpStream::conn_loop(size_t idx)
+{
+	Conn c;
+	c.fd = -1;
+	std::deque<RequestPtr> inflight;
+
+	auto drop_conn = [&]()
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		::close(c.fd);
+		c.fd = -1;
+		_fds[idx] = -1;
+		c.inbuf.clear();
+		c.off = 0;
+	};
+
+	std::string wire;
+	while (true)
+	{
+		wire.clear();
+		if (not take(inflight, wire)) break;
+
+		if (0 > c.fd)
+		{
+			std::string err;
+			int fd = open_conn(err);
+			if (0 > fd)
+			{
+				// Not worth retrying; the server isn't there.
+				for (const RequestPtr& req : inflight) fail(req, err);
+				inflight.clear();
+				continue;
+			}
+			std::lock_guard<std::mutex> lck(_mtx);
+			c.fd = fd;
+			c.inbuf.clear();
+			c.off = 0;
+			_fds[idx] = fd;
+			_nconnects ++;
+			if (_stop) break;
+		}
+
+		// Send everything that was taken, in one go.
+		size_t off = 0;
+		while (off < wire.size())
+		{
+			ssize_t rc = send(c.fd, wire.data() + off, wire.size() - off,
+			                  MSG_NOSIGNAL);
+			if (0 > rc and EINTR == errno) continue;
+			if (0 >= rc) break;
+			off += rc;
+		}
+		if (off < wire.size())
+		{
+			// Most likely, the server closed an idle connection.
+			drop_conn();
+			inflight.front()->retries ++;
+			requeue(inflight);
+			continue;
+		}
+
+		// Read one response; then loop around, to top up the pipeline.
+		RequestPtr req(inflight.front());
+		Outcome oc = read_response(c, *req);
+		if (KEEP == oc or CLOSE == oc)
+		{
+			inflight.pop_front();
+			req->out->close();
+			std::lock_guard<std::mutex> lck(_mtx);
+			_nresponses ++;
+		}
+		if (KEEP == oc) continue;
+
+		drop_conn();
+		if (RETRY == oc) req->retries ++;
+		if (FAILED == oc)
+		{
+			SENSORY_WARN("HttpStream: %s: %s", _uri.c_str(), c.err.c_str());
+			inflight.pop_front();
+			fail(req, c.err);
+		}
+		requeue(inflight);
+	}
+
+	if (0 <= c.fd) drop_conn();
+	for (const RequestPtr& req : inflight)
+		fail(req, "Stream closed");
+}
+
+// ==============================================================
+
+/// Report on the connections. This does not block.
+void HttpStream::update() const
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	_value.clear();
+	_value.emplace_back(createFloatValue(std::vector<double>({
+		(double) _nconnects, (double) _nrequests,
+		(double) _nresponses, (double) _nretries})));
+}
+
+ValuePtr HttpStream::describe(AtomSpace* as, bool silent)
+{
+	throw RuntimeException(TRACE_INFO, "Not implemeneted");
+	return Handle::UNDEFINED;
+}
+
+// ==============================================================
+
+// Adds factory when library is loaded.
+DEFINE_VALUE_FACTORY(HTTP_STREAM, createHttpStream, std::string)
+DEFINE_VALUE_FACTORY(HTTP_STREAM, createHttpStream, Handle)
+
+// ====================================================================
+
+void opencog_sensory_http_init(void)
+{
+	// Force shared lib ctors to run
+};
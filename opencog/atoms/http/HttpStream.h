@@ -0,0 +1,132 @@
+/*
+ * opencog/atoms/http/HttpStream.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_HTTP_STREAM_H
+#define _OPENCOG_HTTP_STREAM_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <opencog/atoms/sensory/ItemStream.h>
+#include <opencog/atoms/sensory/OutputStream.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * HttpStreams are HTTP/1.1 clients for one server:
+ *    http://localhost:8080/api?pool=4&depth=8
+ * Requests are made by writing; each write returns an ItemStream that
+ * delivers the response:
+ *    (Item "/status")                           GET base/status
+ *    (List (Item "POST") (Item "/x") (Item "body") (Item "Name: value"))
+ * The first item is (LinkValue (FloatValue status) (StringValue reason)
+ * (StringValue name value name value ...)), with the header names in
+ * lower case. Then comes the body, as StringValues, a piece at a time,
+ * as it arrives, chunked or not. The ItemStream is closed at the end.
+ * If the request fails, the last item is (LinkValue (FloatValue 0)
+ * (StringValue why)).
+ *
+ * Connections are kept open and reused. Each of the `pool` connections
+ * has up to `depth` requests in flight, pipelined. Requests that are
+ * not idempotent (POST, PATCH) are never pipelined. Idempotent requests
+ * that were in flight when the server closed the connection are sent
+ * again, once, on a new connection.
+ *
+ * Reading the stream gives (FloatValue connects requests responses
+ * retries). This does not block.
+ */
+class HttpStream
+	: public OutputStream
+{
+public:
+	struct Request;
+	typedef std::shared_ptr<Request> RequestPtr;
+
+private:
+	std::string _uri;
+	std::string _authority;  // For the Host: header.
+	std::string _host;
+	std::string _port;
+	std::string _base;       // Path prefix, without a trailing slash.
+	size_t _pool;
+	size_t _depth;
+	unsigned _timeout;
+
+	mutable std::mutex _mtx;
+	std::condition_variable _cv;
+	std::deque<RequestPtr> _pending;
+	std::vector<std::thread> _threads;
+	std::vector<int> _fds;
+	bool _stop;
+
+	size_t _nconnects;
+	size_t _nrequests;
+	size_t _nresponses;
+	size_t _nretries;
+
+	void init(const std::string&);
+	int open_conn(std::string&);
+	void conn_loop(size_t);
+	bool take(std::deque<RequestPtr>&, std::string&);
+	void requeue(std::deque<RequestPtr>&);
+
+protected:
+	virtual void update() const;
+
+public:
+	HttpStream(const Handle&);
+	HttpStream(const std::string&);
+	virtual ~HttpStream();
+
+	virtual ValuePtr describe(AtomSpace*, bool);
+	virtual ValuePtr write_out(AtomSpace*, bool, const Handle&);
+
+	/// C++ API, same as writing.
+	ItemStreamPtr request(const std::string& method,
+	                      const std::string& path,
+	                      const std::string& body,
+	                      const std::vector<std::string>& headers);
+};
+
+typedef std::shared_ptr<HttpStream> HttpStreamPtr;
+static inline HttpStreamPtr HttpStreamCast(ValuePtr& a)
+	{ return std::dynamic_pointer_cast<HttpStream>(a); }
+
+template<typename ... Type>
+static inline std::shared_ptr<HttpStream> createHttpStream(Type&&... args) {
+   return std::make_shared<HttpStream>(std::forward<Type>(args)...);
+}
+
+/** @}*/
+} // namespace opencog
+
+extern "C" {
+void opencog_sensory_http_init(void);
+};
+
+#endif // _OPENCOG_HTTP_STREAM_H
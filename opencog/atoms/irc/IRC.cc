@@ -23,6 +23,9 @@
 	IRC:	#magpie @ irc.quakenet.org
 */
 
+#include <algorithm>
+#include <vector>
+#include <opencog/atoms/sensory/SensoryLog.h>
 #include "IRC.h"
 #ifdef WIN32_NOT_UNIX
 #include <windows.h>
@@ -34,10 +37,19 @@
 #include <netdb.h>
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <fcntl.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <poll.h>
+#include <sched.h>
+#include <math.h>
 #include <time.h>
 
+/* Lines waiting to be sent, at most. At the default rate of one line
+ * a second, this is over an hour's worth; past it, lines are dropped,
+ * and the drop is logged. */
+#define OUTQ_MAX 4096
+
 #define closesocket(s) close(s)
 #define SOCKET_ERROR -1
 #define INVALID_SOCKET -1
@@ -50,17 +62,68 @@ IRC::IRC() :
     dataout(nullptr),
     datain(nullptr),
     chan_users(nullptr),
-    hooks(nullptr)
+    hooks(nullptr),
+    send_rate(1.0),
+    send_burst(5),
+    send_tokens(5.0),
+    tokens_at(0.0),
+    busy_poll(false),
+    recv_at(0.0),
+    inlen(0),
+    timer_period(0),
+    timer_fn(nullptr),
+    next_timer(0.0),
+    ping_interval(0),
+    ping_timeout(0),
+    ping_max_missed(0),
+    ping_seq(0),
+    next_ping(0.0),
+    ping_sent_at(0.0),
+    rtt_m2(0.0)
+{
+	ping_token[0]='\0';
+	memset(&rtt, 0, sizeof(rtt));
+	if (pipe2(wake_pipe, O_NONBLOCK | O_CLOEXEC))
+	{
+		SENSORY_ERROR("pipe2(): %s", strerror(errno));
+		wake_pipe[0]=wake_pipe[1]=-1;
+	}
+}
+
+/* Monotonic clock, in milliseconds. */
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec * 1.0e-6;
+}
+
+double IRC::monotonic_ms(void)
+{
+	return now_ms();
+}
+
+/* Set one socket option; on failure, log it and return nonzero. */
+static int set_sockopt(int sock, int level, int opt, int val, const char* name)
 {
-	// Start logfile
-	logfile = fopen("/tmp/irc-dbg.log", "a");
-	if (nullptr == logfile) perror("Can't open logfile");
+	if (0 == setsockopt(sock, level, opt, &val, sizeof(val)))
+	{
+		SENSORY_DEBUG("%s set to %d", name, val);
+		return 0;
+	}
+	SENSORY_ERROR("setsockopt(%s): %s", name, strerror(errno));
+	return 1;
 }
 
 IRC::~IRC()
 {
 	if (hooks)
 		delete_irc_command_hook(hooks);
+	if (0 <= wake_pipe[0])
+	{
+		close(wake_pipe[0]);
+		close(wake_pipe[1]);
+	}
 }
 
 // Append to tail.
@@ -120,10 +183,6 @@ int IRC::start(const char* server, int port, const char* nick,
 	hostent* resolv;
 	#endif
 	sockaddr_in rem;
-	int optval;
-	socklen_t optlen = sizeof(optval);
-	int rc;
-
 	if (connected)
 		return 1;
 
@@ -133,56 +192,39 @@ int IRC::start(const char* server, int port, const char* nick,
 		return 1;
 	}
 
-	/* Turn on keepalive. */
-	optval = 1;
-	rc=setsockopt(irc_socket, SOL_SOCKET, SO_KEEPALIVE, &optval, optlen);
-	if (0 > rc)
-	{
-		perror("setsockopt()");
-		close(irc_socket);
-		return 1;
-	}
-	if (logfile) fprintf(logfile, "SO_KEEPALIVE turned ON\n");
-
-	/* Verify that it worked. */
-	rc=getsockopt(irc_socket, SOL_SOCKET, SO_KEEPALIVE, &optval, &optlen);
-	if (0 > rc)
+	/* Turn on keepalive. This is a backstop for the PING probes
+	 * in message_loop(): the first probe is sent after a minute of
+	 * silence, then every 10 seconds; after 6 unanswered probes,
+	 * the connection is declared dead. Data that is not acked
+	 * within the same two minutes also kills the connection. */
+	if (set_sockopt(irc_socket, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE") ||
+	    set_sockopt(irc_socket, IPPROTO_TCP, TCP_KEEPIDLE, 60, "TCP_KEEPIDLE") ||
+	    set_sockopt(irc_socket, IPPROTO_TCP, TCP_KEEPINTVL, 10, "TCP_KEEPINTVL") ||
+	    set_sockopt(irc_socket, IPPROTO_TCP, TCP_KEEPCNT, 6, "TCP_KEEPCNT"))
 	{
-		perror("getsockopt()");
-		close(irc_socket);
-		return 1;
-	}
-	if (logfile) fprintf(logfile,
-		"SO_KEEPALIVE is %s\n", (optval ? "ON" : "OFF"));
-
-	/* Ping every .. I dunno -- 5 minutes? */
-	optval = 300;
-	rc=setsockopt(irc_socket, IPPROTO_TCP, TCP_KEEPINTVL, &optval, optlen);
-	if (0 > rc)
-	{
-		perror("setsockopt()");
-		close(irc_socket);
+		closesocket(irc_socket);
 		return 1;
 	}
-	if (logfile) fprintf(logfile,
-		"tcp_keepalive_time set to %d seconds\n", optval);
+	#ifdef TCP_USER_TIMEOUT
+	set_sockopt(irc_socket, IPPROTO_TCP, TCP_USER_TIMEOUT, 120000,
+		"TCP_USER_TIMEOUT");
+	#endif
 
-	/* Ping every 10 seconds (for 9 tries == 90 seconds total) */
-	optval = 10;
-	rc=setsockopt(irc_socket, IPPROTO_TCP, TCP_KEEPINTVL, &optval, optlen);
-	if (0 > rc)
-	{
-		perror("setsockopt()");
-		close(irc_socket);
-		return 1;
-	}
-	if (logfile) fprintf(logfile,
-		"tcp_keepalive_intvl set to %d seconds\n", optval);
+	/* Let the kernel poll the device queue for incoming packets, for
+	 * up to 50 microseconds, on each recv(). Needs CAP_NET_ADMIN if
+	 * this is more than net.core.busy_read; the spinning in
+	 * message_loop() works either way. */
+	#ifdef SO_BUSY_POLL
+	if (busy_poll)
+		set_sockopt(irc_socket, SOL_SOCKET, SO_BUSY_POLL, 50, "SO_BUSY_POLL");
+	#endif
+	if (busy_poll)
+		set_sockopt(irc_socket, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
 
 	resolv=gethostbyname(server);
 	if (!resolv)
 	{
-		perror("gethostbyname()");
+		SENSORY_ERROR("gethostbyname(%s): %s", server, hstrerror(h_errno));
 		closesocket(irc_socket);
 		return 1;
 	}
@@ -194,6 +236,9 @@ int IRC::start(const char* server, int port, const char* nick,
 	{
 		#ifdef WIN32_NOT_UNIX
 		printf("Failed to connect: %d\n", WSAGetLastError());
+		#else
+		SENSORY_ERROR("Failed to connect to %s:%d: %s",
+			server, port, strerror(errno));
 		#endif
 		closesocket(irc_socket);
 		return 1;
@@ -204,13 +249,33 @@ int IRC::start(const char* server, int port, const char* nick,
 	
 	if (!dataout /*|| !datain*/)
 	{
-		printf("Failed to open streams!\n");
+		SENSORY_ERROR("Failed to open streams: %s", strerror(errno));
 		closesocket(irc_socket);
 		return 1;
 	}
 	
 	connected=true;
 	
+	// Start probing afresh on each new connection. Lines queued for
+	// an earlier connection are stale; drop them, as well as any
+	// unfinished line read from it.
+	ping_sent_at=0.0;
+	next_ping=now_ms() + ping_interval;
+	next_timer=now_ms() + timer_period;
+	inlen=0;
+	{
+		std::lock_guard<std::mutex> lck(outq_mtx);
+		outq.clear();
+		outbuf.clear();
+		send_tokens=send_burst;
+		tokens_at=now_ms();
+	}
+	{
+		std::lock_guard<std::mutex> lck(rtt_mtx);
+		rtt.missed_in_a_row=0;
+	}
+
+	if (cur_nick) delete [] cur_nick;
 	cur_nick=new char[strlen(nick)+1];
 	strcpy(cur_nick, nick);
 
@@ -227,13 +292,12 @@ void IRC::disconnect()
 	if (connected)
 	{
 		// quit("Leaving");
-		fclose(dataout);
-		printf("Disconnected from server.\n");
+		// The shutdown wakes up message_loop(), if it is waiting in
+		// another thread. The fclose() closes the socket as well.
 		connected=false;
-		#ifdef WIN32_NOT_UNIX
 		shutdown(irc_socket, 2);
-		#endif
-		closesocket(irc_socket);
+		fclose(dataout);
+		SENSORY_INFO("Disconnected from server");
 	}
 }
 
@@ -251,35 +315,464 @@ int IRC::quit(const char* quit_message)
 	return 0;
 }
 
-int IRC::message_loop()
+void IRC::set_liveness(int interval_ms, int timeout_ms, int max_missed)
 {
-	char buffer[1024];
-	int ret_len;
+	ping_interval=interval_ms;
+	ping_timeout=timeout_ms;
+	ping_max_missed=(0 < max_missed) ? max_missed : 1;
+}
 
-	if (not connected)
+void IRC::set_timer(int period_ms, void (*fn)(void*))
+{
+	timer_period=period_ms;
+	timer_fn=fn;
+}
+
+void IRC::set_send_rate(double lines_per_sec, int burst)
+{
+	std::lock_guard<std::mutex> lck(outq_mtx);
+	send_rate=lines_per_sec;
+	send_burst=(0 < burst) ? burst : 1;
+	send_tokens=send_burst;
+}
+
+void IRC::set_busy_poll(bool on)
+{
+	busy_poll=on;
+}
+
+/* Returns 1 if not connected, and 2 if the queue is full; the line is
+ * dropped in either case. */
+int IRC::enqueue(const char* line)
+{
+	if (!connected)
+		return 1;
+	{
+		std::lock_guard<std::mutex> lck(outq_mtx);
+		if (OUTQ_MAX <= outq.size())
+		{
+			SENSORY_WARN("Send queue full; dropped %s", line);
+			return 2;
+		}
+		outq.emplace_back(line);
+	}
+	wake();
+	return 0;
+}
+
+/* Wake up message_loop(). If the pipe is full, a wake-up is pending
+ * already. */
+void IRC::wake(void)
+{
+	char c=0;
+	if (1 == write(wake_pipe[1], &c, 1) || EAGAIN == errno)
+		return;
+	SENSORY_ERROR("Can't wake the message loop: %s", strerror(errno));
+}
+
+/* Split text into pieces of at most max bytes, at a blank if there is
+ * one in the second half of the piece, else at a UTF-8 character
+ * boundary. Newlines always split; carriage returns are dropped. */
+static void split_text(const char* text, size_t max, std::vector<std::string>& out)
+{
+	std::string line;
+	for (const char* p=text; ; p++)
 	{
-		printf("Not connected!\n");
+		if (*p && '\n' != *p)
+		{
+			if ('\r' != *p) line += *p;
+			continue;
+		}
+
+		size_t start=0;
+		while (line.size() - start > max)
+		{
+			size_t cut=line.rfind(' ', start + max);
+			if (std::string::npos == cut || cut < start + max/2)
+			{
+				cut=start + max;
+				while (cut > start && 0x80 == (line[cut] & 0xC0))
+					cut--;
+				if (cut == start) cut=start + max;
+				out.emplace_back(line.substr(start, cut - start));
+				start=cut;
+			}
+			else
+			{
+				out.emplace_back(line.substr(start, cut - start));
+				start=cut + 1;
+			}
+		}
+		if (start < line.size())
+			out.emplace_back(line.substr(start));
+		line.clear();
+		if (0 == *p) break;
+	}
+}
+
+/* Send a PRIVMSG or NOTICE to one or more comma-separated targets.
+ * Long text is split so that each line, as relayed by the server with
+ * our full nick!user@host prefix, fits in the 512-byte IRC limit. The
+ * host is not known, so room is left for the longest one (63 bytes).
+ * All of the lines are queued at once, and go out as fast as the
+ * send rate allows; if they don't all fit, none are queued. Returns
+ * as enqueue() does. */
+int IRC::send_message(const char* cmd, const char* targets, const char* text)
+{
+	if (!connected)
 		return 1;
+
+	std::vector<std::string> tgts;
+	for (const char* t=targets; *t; )
+	{
+		const char* e=strchr(t, ',');
+		if (!e) e=t + strlen(t);
+		if (e > t) tgts.emplace_back(t, e - t);
+		t=*e ? e+1 : e;
+	}
+
+	size_t nick_len=cur_nick ? strlen(cur_nick) : 30;
+	size_t prefix=1 + nick_len + 1 + 10 + 1 + 63 + 1;
+	std::vector<std::string> lines;
+	for (const std::string& tgt : tgts)
+	{
+		size_t head=strlen(cmd) + 1 + tgt.size() + 2;
+		if (510 <= prefix + head + 32)
+		{
+			SENSORY_WARN("Target too long; dropped %s to %s", cmd, tgt.c_str());
+			continue;
+		}
+		std::vector<std::string> pieces;
+		split_text(text, 510 - prefix - head, pieces);
+		for (const std::string& pc : pieces)
+			lines.emplace_back(std::string(cmd) + " " + tgt + " :" + pc);
 	}
+	if (lines.empty())
+		return 0;
 
+	{
+		std::lock_guard<std::mutex> lck(outq_mtx);
+		if (OUTQ_MAX < outq.size() + lines.size())
+		{
+			SENSORY_WARN("Send queue full; dropped %s to %s", cmd, targets);
+			return 2;
+		}
+		for (std::string& ln : lines)
+			outq.emplace_back(std::move(ln));
+	}
+	wake();
+	return 0;
+}
+
+/* Send as many queued lines as the rate allows, in one send(). What
+ * could not be sent yet is kept, and goes out first the next time.
+ * Returns the errno if the connection failed, else 0. */
+int IRC::drain_queue(double now)
+{
+	size_t n=0;
+	if (outbuf.empty())
+	{
+		std::lock_guard<std::mutex> lck(outq_mtx);
+		n=outq.size();
+		if (0 < n && 0 < send_rate)
+		{
+			send_tokens+=(now - tokens_at) * send_rate / 1000.0;
+			if (send_tokens > send_burst) send_tokens=send_burst;
+			tokens_at=now;
+			if ((double) n > send_tokens) n=(size_t) send_tokens;
+			send_tokens-=n;
+		}
+		for (size_t i=0; i<n; i++)
+		{
+			outbuf+=outq.front();
+			outbuf+="\r\n";
+			outq.pop_front();
+		}
+	}
+	if (outbuf.empty())
+		return 0;
+
+	// Anything written with fprintf() goes first.
+	fflush(dataout);
+	size_t done=0;
+	while (done < outbuf.size())
+	{
+		ssize_t rc=send(irc_socket, outbuf.data() + done,
+		                outbuf.size() - done, MSG_NOSIGNAL);
+		if (0 > rc)
+		{
+			int err=errno;
+			if (EINTR == err) continue;
+			outbuf.erase(0, done);
+			if (EAGAIN == err || EWOULDBLOCK == err)
+				return 0;
+
+			size_t unsent=std::count(outbuf.begin(), outbuf.end(), '\n');
+			{
+				std::lock_guard<std::mutex> lck(outq_mtx);
+				unsent+=outq.size();
+			}
+			SENSORY_ERROR("send(): %s; %zu queued lines not sent",
+				strerror(err), unsent);
+			return err;
+		}
+		done+=rc;
+	}
+	outbuf.clear();
+	SENSORY_TRACE("Sent %zu queued lines", n);
+	return 0;
+}
+
+/* Milliseconds until the next queued line may be sent, or -1 if
+ * there is nothing waiting. */
+int IRC::queue_wait(void)
+{
+	// A batch that was only partly sent is tried again soon.
+	if (!outbuf.empty())
+		return 10;
+
+	std::lock_guard<std::mutex> lck(outq_mtx);
+	if (outq.empty())
+		return -1;
+	if (send_rate <= 0 || 1.0 <= send_tokens)
+		return 0;
+	return (int) ceil((1.0 - send_tokens) * 1000.0 / send_rate);
+}
+
+void IRC::get_rtt_stats(irc_rtt_stats* stats)
+{
+	std::lock_guard<std::mutex> lck(rtt_mtx);
+	*stats=rtt;
+	stats->stddev=(1 < rtt.received) ? sqrt(rtt_m2 / (rtt.received-1)) : 0.0;
+}
+
+void IRC::send_ping(double now)
+{
+	ping_seq++;
+	snprintf(ping_token, sizeof(ping_token), "oc%lu", ping_seq);
+	fprintf(dataout, "PING :%s\r\n", ping_token);
+	fflush(dataout);
+	ping_sent_at=now;
+
+	std::lock_guard<std::mutex> lck(rtt_mtx);
+	rtt.sent++;
+}
+
+/* The reply looks like ":server PONG server :token"; servers that
+ * omit the prefix are accepted, too. Only the reply to the PING that
+ * is outstanding counts; late replies to earlier ones are ignored. */
+void IRC::got_pong(const char* params)
+{
+	if (0 == ping_sent_at || !params)
+		return;
+
+	const char* tok=strrchr(params, ' ');
+	tok=tok ? tok+1 : params;
+	if (':'==tok[0]) tok++;
+	if (strcmp(tok, ping_token))
+		return;
+
+	double ms=now_ms() - ping_sent_at;
+	ping_sent_at=0.0;
+
+	// Welford's running mean and variance.
+	std::lock_guard<std::mutex> lck(rtt_mtx);
+	rtt.received++;
+	rtt.missed_in_a_row=0;
+	rtt.last=ms;
+	if (1 == rtt.received || ms < rtt.min) rtt.min=ms;
+	if (ms > rtt.max) rtt.max=ms;
+	double delta=ms - rtt.mean;
+	rtt.mean+=delta / rtt.received;
+	rtt_m2+=delta * (ms - rtt.mean);
+	SENSORY_TRACE("PONG %s rtt=%g ms", tok, ms);
+}
+
+/* Look after the timer, the PINGs and the outbound queue. Sets wait_ms
+ * to the time until one of these next needs attention, or to -1 if
+ * none of them does. Returns IRC_NO_PONG if the server stopped
+ * answering PINGs, the errno if sending failed, else 0. This,
+ * together with read_input(), is one pass of
+ * message_loop(); callers with many connections can run these from
+ * a single poll() loop of their own. */
+int IRC::service(int* wait_ms)
+{
+	int wait=-1;
+	if (timer_fn)
+	{
+		double now=now_ms();
+		if (next_timer <= now)
+		{
+			(*timer_fn)(this);
+			next_timer=now + timer_period;
+		}
+		wait=(int) ceil(next_timer - now);
+		if (wait < 0) wait=0;
+	}
+	if (0 < ping_interval)
+	{
+		double now=now_ms();
+		if (0 < ping_sent_at && ping_sent_at + ping_timeout <= now)
+		{
+			int missed;
+			{
+				std::lock_guard<std::mutex> lck(rtt_mtx);
+				rtt.missed++;
+				missed=++rtt.missed_in_a_row;
+			}
+			ping_sent_at=0.0;
+			SENSORY_WARN("No PONG for %s within %d ms (%d in a row)",
+				ping_token, ping_timeout, missed);
+			if (missed >= ping_max_missed)
+			{
+				SENSORY_ERROR("Server not responding; dropping connection");
+				return IRC_NO_PONG;
+			}
+
+			// Probe again right away, instead of waiting a full
+			// interval, so that a dead server is found quickly.
+			next_ping=now;
+		}
+		if (0 == ping_sent_at && next_ping <= now)
+		{
+			send_ping(now);
+			next_ping=now + ping_interval;
+		}
+
+		double until=next_ping;
+		if (0 < ping_sent_at && ping_sent_at + ping_timeout < until)
+			until=ping_sent_at + ping_timeout;
+		int pwait=(int) ceil(until - now);
+		if (pwait < 0) pwait=0;
+		if (wait < 0 || pwait < wait) wait=pwait;
+	}
+
+	int err=drain_queue(now_ms());
+	if (err)
+		return err;
+
+	int qwait=queue_wait();
+	if (0 <= qwait && (wait < 0 || qwait < wait)) wait=qwait;
+	*wait_ms=wait;
+	return 0;
+}
+
+/* Read whatever has arrived, and run the hooks for each complete line.
+ * Returns 0 if something was read, -1 if there was nothing to read,
+ * IRC_CLOSED if the server closed the connection, and the errno if
+ * reading failed. */
+int IRC::read_input(bool nowait)
+{
+	int ret_len=recv(irc_socket, inbuf+inlen, sizeof(inbuf)-1-inlen,
+	                 nowait ? MSG_DONTWAIT : 0);
+	if (0 > ret_len && (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno))
+		return -1;
+	if (ret_len==SOCKET_ERROR || !ret_len)
+	{
+		int rc=ret_len ? errno : IRC_CLOSED;
+		SENSORY_INFO("Exit main loop: %s", why(rc));
+		return rc;
+	}
+	recv_at=now_ms();
+	inlen+=ret_len;
+	inbuf[inlen]='\0';
+
+	// Carry an incomplete last line over to the next read. A
+	// line that does not fit in the buffer is dropped.
+	char* rest=split_to_replies(inbuf);
+	inlen-=rest-inbuf;
+	if (inlen >= (int) sizeof(inbuf)-1) inlen=0;
+	memmove(inbuf, rest, inlen);
+	return 0;
+}
+
+/* Empty the wake-up pipe, once it has done its job. */
+void IRC::clear_wake(void)
+{
+	char junk[64];
+	while (0 < read(wake_pipe[0], junk, sizeof(junk))) {}
+}
+
+/* Say why the connection was given up on, for a value returned by
+ * message_loop(), service() or read_input(). */
+const char* IRC::why(int rc)
+{
+	if (IRC_CLOSED == rc)
+		return "connection closed";
+	if (IRC_NO_PONG == rc)
+		return "server stopped answering";
+	return strerror(rc);
+}
+
+/* Returns IRC_CLOSED if the server closed the connection, IRC_NO_PONG
+ * if it stopped answering PINGs, or else the errno of what failed. */
+int IRC::message_loop()
+{
+	if (not connected)
+	{
+		SENSORY_WARN("Not connected!");
+		return ENOTCONN;
+	}
+
+	unsigned long idle=0;
 	while (1)
 	{
-		ret_len=recv(irc_socket, buffer, 1023, 0);
-		if (ret_len==SOCKET_ERROR || !ret_len)
+		int wait;
+		int svc=service(&wait);
+		if (svc)
+			return svc;
+
+		// Busy-poll: try to read, and if there is nothing, go around
+		// again, so that the timers and the queue are looked after.
+		// Spin hard at first; after a while, yield the CPU on each
+		// pass, so that a pinned core can be shared in a pinch.
+		if (busy_poll)
 		{
-			#ifdef __IRC_DEBUG__
-			perror("Exit main loop");
-			#endif
-			return 1;
+			int rc=read_input(true);
+			if (0 > rc)
+			{
+				if (2000 < ++idle)
+				{
+					sched_yield();
+					if (0 == (idle & 0xff))
+						clear_wake();
+				}
+				continue;
+			}
+			idle=0;
+			if (rc)
+				return rc;
+			continue;
+		}
+
+		struct pollfd pfd[2];
+		pfd[0].fd=irc_socket;
+		pfd[0].events=POLLIN;
+		pfd[0].revents=0;
+		pfd[1].fd=wake_pipe[0];
+		pfd[1].events=POLLIN;
+		pfd[1].revents=0;
+		int rc=poll(pfd, 2, wait);
+		if (0 > rc)
+		{
+			int err=errno;
+			if (EINTR == err) continue;
+			SENSORY_ERROR("poll(): %s", strerror(err));
+			return err;
 		}
-		buffer[ret_len]='\0';
-		split_to_replies(buffer);
+		if (pfd[1].revents)
+			clear_wake();
+		if (0 == pfd[0].revents) continue;
+
+		rc=read_input(false);
+		if (0 < rc)
+			return rc;
 	}
 
 	return 0;
 }
 
-void IRC::split_to_replies(char* data)
+char* IRC::split_to_replies(char* data)
 {
 	char* p;
 
@@ -289,6 +782,7 @@ void IRC::split_to_replies(char* data)
 		parse_irc_reply(data);
 		data=p+2;
 	}
+	return data;
 }
 
 int IRC::is_op(const char* channel, const char* nick)
@@ -340,7 +834,7 @@ void IRC::parse_irc_reply(char* data)
 	hostd_tmp.host=0;
 	hostd_tmp.target=0;
 
-	if (logfile) { fprintf(logfile, "%s\n", data); fflush(logfile); }
+	SENSORY_TRACE("%s", data);
 
 	if (data[0]==':')
 	{
@@ -742,6 +1236,10 @@ void IRC::parse_irc_reply(char* data)
 				}
 			}
 		}
+		else if (!strcmp(cmd, "PONG"))
+		{
+			got_pong(params);
+		}
 		else if (!strcmp(cmd, "NICK"))
 		{
 			if (!strcmp(hostd_tmp.nick, cur_nick))
@@ -772,12 +1270,13 @@ void IRC::parse_irc_reply(char* data)
 			if (!params)
 				return;
 			fprintf(dataout, "PONG %s\r\n", &params[1]);
-			#ifdef __IRC_DEBUG__
-			const time_t now = time(0);
-			printf("Ping received, pong sent on %s.", ctime (&now));
-			#endif
+			SENSORY_DEBUG("Ping received, pong sent");
 			fflush(dataout);
 		}
+		else if (!strcmp(cmd, "PONG"))
+		{
+			got_pong(params);
+		}
 		else
 		{
 			hostd_tmp.host=0;
@@ -796,12 +1295,15 @@ void IRC::call_hook(const char* irc_command, const char* params, irc_reply_data*
 	if (!hooks)
 		return;
 
+	// A hook that returns nonzero declines the reply, and passes it
+	// on to the next hook for the same command, if there is one.
+	hostd->command=irc_command;
 	p=hooks;
 	while (p)
 	{
-		if (!strcmp(p->irc_command, irc_command))
+		if (!strcmp(p->irc_command, irc_command) &&
+		    0 == (*(p->function))(params, hostd, this))
 		{
-			(*(p->function))(params, hostd, this);
 			p=0;
 		}
 		else
@@ -25,10 +25,20 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
 
 #define __CPIRC_VERSION__	0.1
 // #define __IRC_DEBUG__ 1
 
+/* Why message_loop(), service() or read_input() gave up on the
+ * connection. Any other positive value is the errno of the system
+ * call that failed. See IRC::why(). */
+#define IRC_CLOSED	0x10000
+#define IRC_NO_PONG	0x10001
+
 #define IRC_USER_VOICE	1
 #define IRC_USER_HALFOP	2
 #define IRC_USER_OP		4
@@ -39,6 +49,7 @@ struct irc_reply_data
 	char* ident;
 	char* host;
 	char* target;
+	const char* command;
 };
 
 struct irc_command_hook
@@ -48,6 +59,20 @@ struct irc_command_hook
 	irc_command_hook* next;
 };
 
+// Round-trip times are in milliseconds.
+struct irc_rtt_stats
+{
+	double last;
+	double min;
+	double max;
+	double mean;
+	double stddev;
+	unsigned long sent;      // PINGs sent
+	unsigned long received;  // matching PONGs received
+	unsigned long missed;    // PINGs that timed out, in total
+	int missed_in_a_row;
+};
+
 struct channel_user
 {
 	char* nick;
@@ -78,9 +103,25 @@ public:
 	int raw(const char* data);
 	void hook_irc_command(const char* cmd_name, int (*function_ptr)(const char*, irc_reply_data*, void*));
 	int message_loop();
+	int service(int* wait_ms);
+	int read_input(bool nowait);
+	static const char* why(int rc);
+	void clear_wake(void);
+	int socket_fd(void) { return irc_socket; }
+	int wake_fd(void) { return wake_pipe[0]; }
+	void set_liveness(int interval_ms, int timeout_ms, int max_missed);
+	void get_rtt_stats(irc_rtt_stats*);
+	void set_timer(int period_ms, void (*fn)(void*));
+	void set_send_rate(double lines_per_sec, int burst);
+	int enqueue(const char* line);
+	int send_message(const char* cmd, const char* targets, const char* text);
+	void set_busy_poll(bool on);
+	double last_recv_at(void) { return recv_at; }
+	static double monotonic_ms(void);
 	int is_op(const char* channel, const char* nick);
 	int is_voice(const char* channel, const char* nick);
 	const char* current_nick(void);
+	bool is_connected(void) { return connected; }
 
 	// User data hook
 	void* context;
@@ -89,16 +130,65 @@ private:
 	void call_hook(const char* irc_command, const char*params, irc_reply_data* hostd);
 	/*void call_the_hook(irc_command_hook* hook, const char* irc_command, const char*params, irc_host_data* hostd);*/
 	void parse_irc_reply(char* data);
-	void split_to_replies(char* data);
+	char* split_to_replies(char* data);
 	void insert_irc_command_hook(irc_command_hook* hook, const char* cmd_name, int (*function_ptr)(const char*, irc_reply_data*, void*));
 	void delete_irc_command_hook(irc_command_hook* cmd_hook);
+	void send_ping(double now);
+	void got_pong(const char* params);
+	int drain_queue(double now);
+	void wake(void);
+	int queue_wait(void);
 
 	int irc_socket;
-	bool connected;
+	std::atomic<bool> connected; // Read by writers in other threads.
 	char* cur_nick;
 	FILE* dataout;
 	FILE* datain;
 	channel_user* chan_users;
 	irc_command_hook* hooks;
-	FILE* logfile;
+
+	// Outbound lines, sent from message_loop(), at no more than
+	// send_rate lines per second, after an initial burst. Lines are
+	// sent in batches, as many per send() as the rate allows. The
+	// pipe wakes up the loop when lines are queued. The queue is
+	// bounded; see OUTQ_MAX. outbuf holds the part of the last batch
+	// that send() has not taken yet; only message_loop() touches it.
+	std::deque<std::string> outq;
+	std::string outbuf;
+	std::mutex outq_mtx;
+	int wake_pipe[2];
+	double send_rate;
+	int send_burst;
+	double send_tokens;
+	double tokens_at;
+
+	// In busy-poll mode, message_loop() spins on a non-blocking
+	// recv(), instead of sleeping in poll(). recv_at is the time of
+	// the most recent recv() that returned data.
+	bool busy_poll;
+	double recv_at;
+
+	// Received data; an incomplete last line is carried over to the
+	// next read.
+	char inbuf[4096];
+	int inlen;
+
+	// Called from message_loop() every timer_period ms, or so.
+	int timer_period;
+	void (*timer_fn)(void*);
+	double next_timer;
+
+	// Liveness probing. A PING carrying a fresh token is sent every
+	// ping_interval ms; if ping_max_missed of them in a row go without
+	// a PONG for ping_timeout ms, message_loop() gives up.
+	int ping_interval;
+	int ping_timeout;
+	int ping_max_missed;
+	unsigned long ping_seq;
+	double next_ping;
+	double ping_sent_at;     // zero when no PING is outstanding
+	char ping_token[32];
+	irc_rtt_stats rtt;
+	double rtt_m2;           // running sum of squares, for stddev
+	std::mutex rtt_mtx;
 };
@@ -0,0 +1,1017 @@
+/*
+ * opencog/atoms/irc/IRChatFleetStream.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/oc_assert.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+#include <opencog/atoms/value/ValueFactory.h>
+
+#include <opencog/atoms/sensory-types/sensory_types.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include <opencog/atoms/sensory/SensoryNode.h>
+#include "IRChatFleetStream.h"
+#include "IRChatStream.h"
+
+#include "IRC.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace opencog;
+
+IRChatFleetStream::IRChatFleetStream(Type t, const std::string& str)
+	: OutputStream(t)
+{
+	OC_ASSERT(nameserver().isA(_type, I_R_CHAT_FLEET_STREAM),
+		"Bad IRChatFleetStream constructor!");
+	init(str);
+}
+
+IRChatFleetStream::IRChatFleetStream(const std::string& str)
+	: OutputStream(I_R_CHAT_FLEET_STREAM)
+{
+	init(str);
+}
+
+IRChatFleetStream::IRChatFleetStream(const Handle& senso)
+	: OutputStream(I_R_CHAT_FLEET_STREAM)
+{
+	if (SENSORY_NODE != senso->get_type())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting SensoryNode, got %s\n", senso->to_string().c_str());
+
+	init(senso->get_name());
+}
+
+IRChatFleetStream::~IRChatFleetStream()
+{
+	if (nullptr == _loop) return;
+
+	// The I/O thread says goodbye on each connection, on its way out.
+	// Readers blocked in update() are let go.
+	_cancel = true;
+	concurrent_queue<ValuePtr>::cancel();
+	char c = 0;
+	if (write(_wake[1], &c, 1)) {}
+	_loop->join();
+	delete _loop;
+	::close(_wake[0]);
+	::close(_wake[1]);
+
+	for (auto& mp : _members)
+	{
+		mp->queries.cancel_all("CLOSED");
+		delete mp->conn;
+	}
+}
+
+// ==================================================================
+/// The URL is that of the IRChatStream, but with a comma-separated
+/// list of nicks, one for each connection:
+///    irc://bot1,bot2,bot3@irc.example.org:6667
+/// or else a single nick and the number of connections:
+///    irc://bot@irc.example.org?pool=3
+/// which uses the nicks bot1, bot2 and bot3.
+///
+/// No connection joins more than `chans=50` channels, or fewer, if
+/// the server says so. The `ping`, `timeout`, `missed`, `reply`,
+/// `rate` and `burst` parameters are as for the IRChatStream, and
+/// apply to each connection. In particular, the flood limit is per
+/// connection, so a pool of N connections can send N times as fast.
+///
+void IRChatFleetStream::init(const std::string& urlq)
+{
+	_loop = nullptr;
+	_cancel = false;
+	_next = 0;
+	_chan_limit = 50;
+
+	if (0 != urlq.compare(0, 6, "irc://"))
+		throw RuntimeException(TRACE_INFO,
+			"Unsupported URL \"%s\"\n", urlq.c_str());
+
+	// Make a copy, for debugging purposes.
+	_uri = urlq;
+
+	int ping_interval = 30000;
+	int ping_timeout = 10000;
+	int ping_missed = 3;
+	int reply_timeout = -1;
+	double send_rate = 1.0;
+	int send_burst = 5;
+	size_t pool = 0;
+
+	std::map<std::string, std::string> params;
+	std::string url = SensoryNode::split_query(urlq, params);
+	for (const auto& pr : params)
+	{
+		char* end;
+		double secs = strtod(pr.second.c_str(), &end);
+		if (pr.second.empty() or *end or secs < 0.0)
+			throw RuntimeException(TRACE_INFO,
+				"Expecting a number for \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+
+		if (0 == pr.first.compare("ping"))
+			ping_interval = (int) (1000.0 * secs);
+		else if (0 == pr.first.compare("timeout"))
+			ping_timeout = (int) (1000.0 * secs);
+		else if (0 == pr.first.compare("missed"))
+			ping_missed = (int) secs;
+		else if (0 == pr.first.compare("reply"))
+			reply_timeout = (int) (1000.0 * secs);
+		else if (0 == pr.first.compare("rate"))
+			send_rate = secs;
+		else if (0 == pr.first.compare("burst"))
+			send_burst = (int) secs;
+		else if (0 == pr.first.compare("chans"))
+			_chan_limit = (size_t) secs;
+		else if (0 == pr.first.compare("pool"))
+			pool = (size_t) secs;
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown URL parameter \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+	}
+	if (0 < ping_interval and 0 == ping_timeout)
+		throw RuntimeException(TRACE_INFO,
+			"PING timeout must be positive: \"%s\"\n", urlq.c_str());
+	if (0 == _chan_limit)
+		throw RuntimeException(TRACE_INFO,
+			"Channel limit must be positive: \"%s\"\n", urlq.c_str());
+
+	// Ignore the first 6 chars "irc://"
+	size_t base = 6;
+	size_t nck = url.find('@', base);
+
+	if (std::string::npos == nck)
+		throw RuntimeException(TRACE_INFO,
+			"Invalid IRC URL \"%s\" expecting irc://nick,nick@host[:port]\n",
+			url.c_str());
+
+	std::vector<std::string> nicks;
+	for (size_t start = base; start < nck; )
+	{
+		size_t end = url.find(',', start);
+		if (std::string::npos == end or nck < end) end = nck;
+		if (end > start) nicks.emplace_back(url.substr(start, end-start));
+		start = end + 1;
+	}
+	if (0 < pool)
+	{
+		if (1 != nicks.size())
+			throw RuntimeException(TRACE_INFO,
+				"Expecting a single nick with \"pool\" in \"%s\"\n",
+				urlq.c_str());
+		std::string nick = nicks[0];
+		nicks.clear();
+		for (size_t i = 1; i <= pool; i++)
+			nicks.emplace_back(nick + std::to_string(i));
+	}
+	if (nicks.empty())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting at least one nick in \"%s\"\n", urlq.c_str());
+
+	// There may or may not be a port number.
+	size_t sls = url.find('/', nck);
+	size_t col = url.find(':', nck);
+
+	_port = 6667;
+	nck ++;
+	if (std::string::npos == col)
+	{
+		if (std::string::npos == sls)
+			_host = url.substr(nck);
+		else
+			_host = url.substr(nck, sls-nck);
+	}
+	else
+	{
+		_host = url.substr(nck, col-nck);
+		_port = atoi(url.substr(col+1, sls-col-1).c_str());
+	}
+
+	if (pipe2(_wake, O_NONBLOCK | O_CLOEXEC))
+		throw RuntimeException(TRACE_INFO,
+			"Unable to create pipe: %s\n", strerror(errno));
+
+	for (const std::string& nick : nicks)
+	{
+		Member* m = new Member;
+		_members.emplace_back(m);
+		m->fleet = this;
+		m->base_nick = nick;
+		m->nick = nick;
+		m->renames = 0;
+		m->drop = 0;
+		m->ready = false;
+		m->joined = 0;
+		m->limit = _chan_limit;
+		m->retry_at = 0.0;
+		m->backoff = 1;
+		m->up_since = 0;
+		m->reconnects = 0;
+		m->connector = nullptr;
+		m->connecting = false;
+		if (0 <= reply_timeout) m->queries.set_timeout(reply_timeout);
+
+		m->conn = new IRC;
+		m->conn->context = m;
+		m->conn->set_liveness(ping_interval, ping_timeout, ping_missed);
+		m->conn->set_timer(1000, &xtimer);
+		m->conn->set_send_rate(send_rate, send_burst);
+
+		// Everything goes to the same place, and is sorted out there.
+		m->conn->hook_irc_command("PRIVMSG", &xgot_reply);
+		for (const char** nu = QueryTracker::numerics(); *nu; nu++)
+			m->conn->hook_irc_command(*nu, &xgot_reply);
+
+		// 005 - server limits, including the number of channels
+		// 376 - end of MOTD; 422 - there is no MOTD
+		// 432 - nick refused; 433 - nick already in use
+		// 405 - joined too many channels
+		// 471, 473, 474, 475 - can't join: full, invite-only,
+		//       banned, wrong key
+		static const char* fleet_cmds[] = {
+			"005", "376", "422", "432", "433", "405", "471", "473", "474",
+			"475", "KICK", "JOIN", "NOTICE", nullptr};
+		for (const char** cmd = fleet_cmds; *cmd; cmd++)
+			m->conn->hook_irc_command(*cmd, &xgot_reply);
+	}
+
+	// Run all of the I/O in one thread.
+	_loop = new std::thread(&IRChatFleetStream::looper, this);
+}
+
+// ==================================================================
+
+ValuePtr IRChatFleetStream::describe(AtomSpace* as, bool silent)
+{
+	throw RuntimeException(TRACE_INFO, "Not implemeneted");
+	return Handle::UNDEFINED;
+}
+
+// ==================================================================
+
+/// Log in, in a thread of its own. Until it is done, the I/O thread
+/// leaves the connection alone; it is woken up when it is done.
+void IRChatFleetStream::start_connect(Member& m)
+{
+	finish_connect(m);
+	m.connecting = true;
+	m.connector = new std::thread([this, &m]()
+	{
+		connect(m);
+		m.connecting = false;
+		char c = 0;
+		if (write(_wake[1], &c, 1)) {}
+	});
+}
+
+void IRChatFleetStream::finish_connect(Member& m)
+{
+	if (nullptr == m.connector) return;
+	m.connector->join();
+	delete m.connector;
+	m.connector = nullptr;
+}
+
+/// Log in. This blocks until the server answers, or not, and so is
+/// run by start_connect(), and not by the I/O thread.
+void IRChatFleetStream::connect(Member& m)
+{
+	const char* user = "botski";
+	const char* name = "Atomese Sensory Stream";
+	const char* pass = "";
+
+	// Each login starts over with the nick that was asked for.
+	std::string nick;
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		m.ready = false;
+		m.limit = _chan_limit;
+		m.nick = m.base_nick;
+		m.renames = 0;
+		nick = m.nick;
+	}
+	m.drop = 0;
+
+	SENSORY_INFO("Joining network=%s port=%d nick=%s user=%s",
+		_host.c_str(), _port, nick.c_str(), user);
+
+	if (0 == m.conn->start(_host.c_str(), _port, nick.c_str(),
+	                       user, name, pass))
+	{
+		m.up_since = time(0);
+		return;
+	}
+
+	SENSORY_ERROR("IRChatFleetStream: unable to connect %s to \"%s\"",
+		nick.c_str(), _uri.c_str());
+	m.retry_at = IRC::monotonic_ms() + 1000.0 * m.backoff;
+	if (m.backoff < 60) m.backoff *= 2;
+	m.reconnects++;
+}
+
+/// The connection closed, or stopped answering. Move its channels to
+/// the other connections, and try again later, backing off as for
+/// the IRChatStream. `rc` is what IRC::service() or read_input() gave;
+/// zero if the reply handlers logged out, and have said why.
+void IRChatFleetStream::lost(Member& m, int rc)
+{
+	if (IRC_NO_PONG == rc)
+		SENSORY_WARN("IRChatFleetStream: %s stopped answering %s; reconnecting",
+			_host.c_str(), nick_of(m).c_str());
+	else if (IRC_CLOSED == rc)
+		SENSORY_WARN("IRChatFleetStream: %s closed the connection for %s; "
+			"reconnecting", _host.c_str(), nick_of(m).c_str());
+	else if (rc)
+		SENSORY_ERROR("IRChatFleetStream: socket error for %s: %s; reconnecting",
+			nick_of(m).c_str(), strerror(rc));
+
+	m.conn->disconnect();
+	m.queries.cancel_all("DISCONNECTED");
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		m.ready = false;
+		release(m);
+		rebalance();
+	}
+
+	if (60 < time(0) - m.up_since) m.backoff = 1;
+	m.retry_at = IRC::monotonic_ms() + 1000.0 * m.backoff;
+	if (m.backoff < 60) m.backoff *= 2;
+	m.reconnects++;
+}
+
+/// The server will not have the nick; log out, and leave it so. Its
+/// channels go to the other connections.
+void IRChatFleetStream::retire(Member& m)
+{
+	m.conn->quit("Adios");
+	m.conn->disconnect();
+	m.queries.cancel_all("DISCONNECTED");
+
+	std::lock_guard<std::mutex> lck(_mtx);
+	m.ready = false;
+	release(m);
+	rebalance();
+}
+
+/// The nick in use. It changes in the I/O thread, while logging in,
+/// and is read by the writer, so it is copied out under _mtx.
+std::string IRChatFleetStream::nick_of(Member& m)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	return m.nick;
+}
+
+/// Run all of the connections. Each pass looks after the timers and
+/// outbound queues of each connection, and then waits in a single
+/// poll() for any of them to have something to read, or to send.
+void IRChatFleetStream::looper(void)
+{
+	std::vector<struct pollfd> pfd;
+	std::vector<Member*> polled;
+	while (not _cancel)
+	{
+		int wait = -1;
+		pfd.clear();
+		polled.clear();
+		for (auto& mp : _members)
+		{
+			Member& m = *mp;
+			if (m.connecting or 2 == m.drop) continue;
+			if (not m.conn->is_connected())
+			{
+				if (m.retry_at <= IRC::monotonic_ms())
+				{
+					start_connect(m);
+					continue;
+				}
+				int rwait = (int) (m.retry_at - IRC::monotonic_ms());
+				if (rwait < 0) rwait = 0;
+				if (wait < 0 or rwait < wait) wait = rwait;
+				continue;
+			}
+
+			int mwait;
+			int rc = m.conn->service(&mwait);
+			if (rc)
+			{
+				lost(m, rc);
+				continue;
+			}
+			if (0 <= mwait and (wait < 0 or mwait < wait)) wait = mwait;
+
+			pfd.push_back({m.conn->socket_fd(), POLLIN, 0});
+			pfd.push_back({m.conn->wake_fd(), POLLIN, 0});
+			polled.push_back(&m);
+		}
+		pfd.push_back({_wake[0], POLLIN, 0});
+
+		int rc = poll(pfd.data(), pfd.size(), wait);
+		if (0 > rc)
+		{
+			if (EINTR == errno) continue;
+			SENSORY_ERROR("IRChatFleetStream: poll(): %s", strerror(errno));
+			usleep(100000);
+			continue;
+		}
+
+		for (size_t i = 0; i < polled.size(); i++)
+		{
+			Member& m = *polled[i];
+			if (pfd[2*i+1].revents) m.conn->clear_wake();
+			if (0 == pfd[2*i].revents) continue;
+			int rrc = m.conn->read_input(true);
+			if (2 == m.drop) retire(m);
+			else if (1 == m.drop) lost(m, 0);
+			else if (0 < rrc) lost(m, rrc);
+		}
+		if (pfd.back().revents)
+		{
+			char junk[64];
+			while (0 < read(_wake[0], junk, sizeof(junk))) {}
+		}
+	}
+
+	// We can send a quit, but then we never actually
+	// wait for the quit reply. So .. whatever. A login that is under
+	// way has to finish first; it takes at most the connect timeout.
+	for (auto& mp : _members)
+	{
+		finish_connect(*mp);
+		if (not mp->conn->is_connected()) continue;
+		mp->conn->quit("Adios");
+		mp->conn->disconnect();
+	}
+}
+
+// ==================================================================
+// Channel placement. All of these must be called with _mtx held.
+
+/// Give the channel to the connection with the fewest channels, if
+/// any has room for it. Otherwise, it waits for room to open up.
+void IRChatFleetStream::assign(Channel& ch)
+{
+	Member* best = nullptr;
+	for (auto& mp : _members)
+	{
+		if (not mp->ready or mp->limit <= mp->joined) continue;
+		if (nullptr == best or mp->joined < best->joined) best = mp.get();
+	}
+	if (nullptr == best)
+	{
+		SENSORY_DEBUG("IRChatFleetStream: no room for %s", ch.name.c_str());
+		return;
+	}
+
+	ch.owner = best;
+	best->joined++;
+	std::string line("JOIN " + ch.name);
+	if (not ch.key.empty()) line += " " + ch.key;
+	best->conn->enqueue(line.c_str());
+}
+
+/// Place all of the channels that are waiting for room.
+void IRChatFleetStream::rebalance(void)
+{
+	for (auto& pr : _channels)
+		if (nullptr == pr.second.owner) assign(pr.second);
+}
+
+/// The connection is gone; its channels are up for grabs.
+void IRChatFleetStream::release(Member& m)
+{
+	for (auto& pr : _channels)
+		if (&m == pr.second.owner) pr.second.owner = nullptr;
+	m.joined = 0;
+}
+
+/// Which connection to send to `target` from. A channel that we are
+/// in is sent to from the connection that is in it. Anything else is
+/// sent from a connection chosen by hashing the target, so that the
+/// messages to any one nick all come from the same nick, for as long
+/// as the pool is unchanged. An empty target gets the next connection,
+/// round-robin.
+IRChatFleetStream::Member* IRChatFleetStream::pick(const std::string& target)
+{
+	std::string key(QueryTracker::casefold(target));
+	auto it = _channels.find(key);
+	if (_channels.end() != it and it->second.owner)
+		return it->second.owner;
+
+	std::vector<Member*> up;
+	for (auto& mp : _members)
+		if (mp->ready) up.push_back(mp.get());
+	if (up.empty()) return nullptr;
+
+	if (target.empty())
+		return up[_next++ % up.size()];
+	return up[std::hash<std::string>()(key) % up.size()];
+}
+
+// ==================================================================
+// thunks
+
+int IRChatFleetStream::xgot_reply(const char* params, irc_reply_data* ird,
+                                  void* data)
+{
+	IRC* conn = static_cast<IRC*>(data);
+	Member* m = static_cast<Member*>(conn->context);
+	return m->fleet->got_reply(*m, params, ird);
+}
+
+void IRChatFleetStream::xtimer(void* data)
+{
+	IRC* conn = static_cast<IRC*>(data);
+	Member* m = static_cast<Member*>(conn->context);
+	m->queries.expire();
+}
+
+// ==================================================================
+
+/* printf can puke if these fields are NULL */
+static void fixup_reply(irc_reply_data* ird)
+{
+	ird->nick = (NULL == ird->nick) ? (char *) "" : ird->nick;
+	ird->ident = (NULL == ird->ident) ? (char *) "" : ird->ident;
+	ird->host = (NULL == ird->host) ? (char *) "" : ird->host;
+	ird->target = (NULL == ird->target) ? (char *) "" : ird->target;
+}
+
+/// Return the n'th blank-separated word of the params.
+static std::string param_word(const char* params, size_t n)
+{
+	std::string word;
+	for (const char* p = params; p and *p; )
+	{
+		const char* e = strchr(p, ' ');
+		if (nullptr == e) e = p + strlen(p);
+		if (0 == n--) return std::string(p, e-p);
+		p = *e ? e+1 : e;
+	}
+	return word;
+}
+
+int IRChatFleetStream::got_reply(Member& m, const char* params,
+                                 irc_reply_data* ird)
+{
+	fixup_reply(ird);
+	const char* cmd = ird->command;
+
+	if (0 == strcmp(cmd, "PRIVMSG"))
+		return got_privmsg(m, params, ird);
+
+	if (m.queries.deliver(cmd, params))
+		return 0;
+
+	if (0 == strcmp(cmd, "005"))
+		got_isupport(m, params);
+	else if (0 == strcmp(cmd, "376") or 0 == strcmp(cmd, "422"))
+		got_ready(m);
+	else if (0 == strcmp(cmd, "433") and not m.ready)
+	{
+		// Nick is taken. Try a few others, so that this connection
+		// still gets a share of the channels. If those are taken too,
+		// log out, and try the first one again later.
+		std::string nick;
+		{
+			std::lock_guard<std::mutex> lck(_mtx);
+			if (m.renames < 3)
+			{
+				m.renames++;
+				m.nick += "_";
+				nick = m.nick;
+			}
+		}
+		if (nick.empty())
+		{
+			SENSORY_WARN("IRChatFleetStream: nick %s and its variants "
+				"are in use; will retry", m.base_nick.c_str());
+			m.drop = 1;
+			return 0;
+		}
+		SENSORY_WARN("IRChatFleetStream: nick in use; trying %s",
+			nick.c_str());
+		m.conn->enqueue(("NICK " + nick).c_str());
+	}
+	else if (0 == strcmp(cmd, "432"))
+	{
+		// The server won't have the nick, ever. If that is one that
+		// got too long with the suffixes, start over, as for a 433.
+		std::string nick(nick_of(m));
+		if (0 < m.renames)
+		{
+			SENSORY_WARN("IRChatFleetStream: nick %s refused; will retry "
+				"with %s", nick.c_str(), m.base_nick.c_str());
+			m.drop = 1;
+			return 0;
+		}
+		SENSORY_ERROR("IRChatFleetStream: nick %s refused: %s; "
+			"not using it", nick.c_str(), params);
+		m.drop = 2;
+	}
+	else if (0 == strcmp(cmd, "405") or 0 == strcmp(cmd, "471") or
+	         0 == strcmp(cmd, "473") or 0 == strcmp(cmd, "474") or
+	         0 == strcmp(cmd, "475"))
+		got_join_failed(m, params, ird);
+	else if (0 == strcmp(cmd, "KICK"))
+		got_kick(m, params, ird);
+	else
+		SENSORY_DEBUG("Fleet %s reply: nick=%s cmd=%s params=%s",
+			nick_of(m).c_str(), ird->nick, cmd, params);
+	return 0;
+}
+
+int IRChatFleetStream::got_privmsg(Member& m, const char* params,
+                                   irc_reply_data* ird)
+{
+	SENSORY_TRACE("IRC msg from %s to %s =%s", ird->nick, ird->target, params);
+
+	// Skip over leading colon.
+	const char * start = params;
+	if (':' == *start) start++;
+
+	// As for the IRChatStream: who it's from, who it's to (a channel,
+	// or the nick of one of our connections), and the text.
+	ValueSeq msg;
+	msg.push_back(createStringValue(ird->nick));
+	msg.push_back(createStringValue(ird->target));
+
+	// Does the message start with the _nick? If so, special case it.
+	std::string nick(nick_of(m));
+	if (0 == strncmp(start, nick.c_str(), nick.size()))
+		msg.push_back(createStringValue(
+			std::vector<std::string>({nick, start + nick.size()})));
+	else
+		msg.push_back(createStringValue(start));
+
+	push(createLinkValue(msg));
+	return 0;
+}
+
+/// Pick the channel limit out of the server's ISUPPORT reply, e.g.
+/// `CHANLIMIT=#&:120` or the older `MAXCHANNELS=120`.
+void IRChatFleetStream::got_isupport(Member& m, const char* params)
+{
+	size_t lim = 0;
+	for (size_t n = 1; ; n++)
+	{
+		std::string tok(param_word(params, n));
+		if (tok.empty() or ':' == tok[0]) break;
+
+		if (0 == tok.compare(0, 10, "CHANLIMIT="))
+		{
+			for (size_t s = 10; s < tok.size(); )
+			{
+				size_t e = tok.find(',', s);
+				if (std::string::npos == e) e = tok.size();
+				size_t c = tok.find(':', s);
+				if (c < e and tok.find('#', s) < c and c+1 < e)
+					lim = atoi(tok.substr(c+1, e-c-1).c_str());
+				s = e + 1;
+			}
+		}
+		else if (0 == tok.compare(0, 12, "MAXCHANNELS="))
+			lim = atoi(tok.c_str() + 12);
+	}
+	if (0 == lim) return;
+
+	std::lock_guard<std::mutex> lck(_mtx);
+	if (lim < m.limit)
+	{
+		SENSORY_INFO("IRChatFleetStream: %s may join %zu channels",
+			m.nick.c_str(), lim);
+		m.limit = lim;
+	}
+}
+
+/// Do not join any channels until the MOTD has arrived; the server
+/// may refuse them until then.
+void IRChatFleetStream::got_ready(Member& m)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	if (m.ready) return;
+	m.ready = true;
+	SENSORY_INFO("IRChatFleetStream: %s is ready", m.nick.c_str());
+	rebalance();
+}
+
+void IRChatFleetStream::got_join_failed(Member& m, const char* params,
+                                        irc_reply_data* ird)
+{
+	std::string name(param_word(params, 1));
+	std::lock_guard<std::mutex> lck(_mtx);
+	auto it = _channels.find(QueryTracker::casefold(name));
+	if (_channels.end() == it or &m != it->second.owner) return;
+
+	m.joined--;
+	it->second.owner = nullptr;
+
+	// The server has a lower limit than it said. Believe it, and
+	// try somewhere else.
+	if (0 == strcmp(ird->command, "405"))
+	{
+		m.limit = m.joined;
+		assign(it->second);
+		return;
+	}
+
+	// Full, banned, invite-only or wrong key. Trying again from
+	// another nick would be evading the ban, so give up on it.
+	SENSORY_WARN("IRChatFleetStream: %s can't join: %s",
+		m.nick.c_str(), params);
+	_channels.erase(it);
+}
+
+/// Getting kicked is a hint; don't rejoin.
+void IRChatFleetStream::got_kick(Member& m, const char* params,
+                                 irc_reply_data* ird)
+{
+	std::string name(param_word(params, 0));
+	std::string victim(param_word(params, 1));
+	if (QueryTracker::casefold(victim) != QueryTracker::casefold(nick_of(m)))
+		return;
+
+	SENSORY_WARN("Got kicked -- input=%s nick=%s ident=%s host=%s",
+		params, ird->nick, ird->ident, ird->host);
+
+	std::lock_guard<std::mutex> lck(_mtx);
+	auto it = _channels.find(QueryTracker::casefold(name));
+	if (_channels.end() == it or &m != it->second.owner) return;
+	m.joined--;
+	_channels.erase(it);
+	rebalance();
+}
+
+// ==============================================================
+
+// Same as the IRChatStream: hang until a message arrives.
+void IRChatFleetStream::update() const
+{
+	if (nullptr == _loop) { _value.clear(); return; }
+
+	if (is_closed() and 0 == concurrent_queue<ValuePtr>::size()) return;
+
+	// This will hang, until there's something to read.
+	try
+	{
+		ValuePtr val;
+		IRChatFleetStream* that = const_cast<IRChatFleetStream*>(this);
+		that->pop(val);
+		_value.resize(1);
+		_value[0] = val;
+		return;
+	}
+	catch (typename concurrent_queue<ValuePtr>::Canceled& e)
+	{}
+
+	// The stream is being closed.
+	_value.clear();
+}
+
+// ==============================================================
+
+#define CHKNARG(NUM,MSG) \
+	if (cmdstrs.size() < NUM) \
+		throw RuntimeException(TRACE_INFO, MSG);
+
+/// Split a comma-separated list.
+static std::vector<std::string> split_list(const std::string& str)
+{
+	std::vector<std::string> items;
+	for (size_t start = 0; start < str.size(); )
+	{
+		size_t end = str.find(',', start);
+		if (std::string::npos == end) end = str.size();
+		if (end > start) items.emplace_back(str.substr(start, end-start));
+		start = end + 1;
+	}
+	return items;
+}
+
+/// The commands are those of the IRChatStream. JOIN and PART place
+/// and remove channels; messages go out from whichever connection
+/// pick() chooses; other raw commands go out round-robin.
+void IRChatFleetStream::run_cmd(const std::vector<std::string>& cmdstrs)
+{
+	if (0 == cmdstrs.size()) return;
+
+	const std::string& cmd = cmdstrs[0];
+	if (0 == cmd.compare("PRIVMSG") or 0 == cmd.compare("NOTICE"))
+	{
+		CHKNARG(3, "Expecting at least three arguments");
+
+		// Concatenate the rest into a single message.
+		std::string msg;
+		for (size_t i=2; i< cmdstrs.size(); i++)
+			msg += cmdstrs[i];
+
+		// Targets that go out from the same connection go together.
+		std::map<Member*, std::string> from;
+		std::lock_guard<std::mutex> lck(_mtx);
+		for (const std::string& tgt : split_list(cmdstrs[1]))
+		{
+			Member* m = pick(tgt);
+			if (nullptr == m)
+			{
+				SENSORY_WARN("IRChatFleetStream: not connected; dropped "
+					"message to %s", tgt.c_str());
+				continue;
+			}
+			std::string& tgts = from[m];
+			tgts += (tgts.empty() ? "" : ",") + tgt;
+		}
+		for (const auto& pr : from)
+			pr.first->conn->send_message(cmd.c_str(), pr.second.c_str(),
+			                             msg.c_str());
+		return;
+	}
+
+	if (0 == cmd.compare("JOIN"))
+	{
+		CHKNARG(2, "Expecting at least two arguments");
+		std::vector<std::string> chans(split_list(cmdstrs[1]));
+		std::vector<std::string> keys;
+		if (2 < cmdstrs.size()) keys = split_list(cmdstrs[2]);
+
+		std::lock_guard<std::mutex> lck(_mtx);
+		for (size_t i = 0; i < chans.size(); i++)
+		{
+			std::string key(QueryTracker::casefold(chans[i]));
+			if (_channels.end() != _channels.find(key)) continue;
+			Channel& ch = _channels[key];
+			ch.name = chans[i];
+			if (i < keys.size()) ch.key = keys[i];
+			ch.owner = nullptr;
+			assign(ch);
+		}
+		return;
+	}
+
+	if (0 == cmd.compare("PART"))
+	{
+		CHKNARG(2, "Expecting at least two arguments");
+		std::lock_guard<std::mutex> lck(_mtx);
+		for (const std::string& name : split_list(cmdstrs[1]))
+		{
+			auto it = _channels.find(QueryTracker::casefold(name));
+			if (_channels.end() == it) continue;
+			Member* m = it->second.owner;
+			if (m)
+			{
+				m->conn->enqueue(("PART " + it->second.name).c_str());
+				m->joined--;
+			}
+			_channels.erase(it);
+		}
+
+		// There may be room now, for channels that are waiting.
+		rebalance();
+		return;
+	}
+
+	// Anything goes. Raw commands. Server will bitch if we do
+	// something wrong.
+	std::string line(cmd);
+	for (size_t i=1; i< cmdstrs.size(); i++)
+		line += " " + cmdstrs[i];
+
+	std::lock_guard<std::mutex> lck(_mtx);
+	Member* m = pick("");
+	if (nullptr == m)
+	{
+		SENSORY_WARN("IRChatFleetStream: not connected; dropped %s",
+			line.c_str());
+		return;
+	}
+	m->conn->enqueue(line.c_str());
+}
+
+void IRChatFleetStream::prt_value(const ValuePtr& command_data)
+{
+	std::vector<std::string> cmd;
+	if (IRChatStream::get_cmd(command_data, cmd))
+		run_cmd(cmd);
+}
+
+/// Commands that are answered locally, with a Value, instead of
+/// being sent to the server. Returns nullptr for all other commands.
+ValuePtr IRChatFleetStream::run_query(const std::vector<std::string>& cmdstrs)
+{
+	if (0 == cmdstrs.size()) return nullptr;
+
+	// The state of the pool. One LinkValue per connection, holding
+	// its nick, and a FloatValue of (connected ready channels limit
+	// reconnects), followed by the channels that have found no room.
+	if (0 == cmdstrs[0].compare("FLEET"))
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		ValueSeq vs;
+		for (auto& mp : _members)
+		{
+			vs.push_back(createLinkValue(ValueSeq({
+				createStringValue(mp->nick),
+				createFloatValue(std::vector<double>({
+					(double) mp->conn->is_connected(), (double) mp->ready,
+					(double) mp->joined, (double) mp->limit,
+					(double) mp->reconnects}))})));
+		}
+		std::vector<std::string> waiting;
+		for (const auto& pr : _channels)
+			if (nullptr == pr.second.owner)
+				waiting.push_back(pr.second.name);
+		vs.push_back(createStringValue(waiting));
+		return createLinkValue(vs);
+	}
+
+	// Queries, as for the IRChatStream. A query about a channel goes
+	// out from the connection that is in it.
+	std::vector<std::string> words;
+	if (1 == cmdstrs.size())
+	{
+		size_t start = 0;
+		const std::string& str = cmdstrs[0];
+		while (start < str.size())
+		{
+			size_t end = str.find(' ', start);
+			if (std::string::npos == end) end = str.size();
+			if (end > start) words.emplace_back(str.substr(start, end-start));
+			start = end + 1;
+		}
+	}
+	else
+		words = cmdstrs;
+
+	Member* m;
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		m = pick(1 < words.size() ? words[1] : "");
+	}
+	if (nullptr == m) return nullptr;
+
+	ItemStreamPtr replies(m->queries.track(words));
+	if (nullptr == replies) return nullptr;
+
+	std::string line;
+	for (const std::string& w : words)
+		line += (line.empty() ? "" : " ") + w;
+
+	if (m->conn->enqueue(line.c_str()))
+		m->queries.cancel_all("DISCONNECTED");
+	return replies;
+}
+
+ValuePtr IRChatFleetStream::write_out(AtomSpace* as, bool silent,
+                                      const Handle& cref)
+{
+	ValuePtr content = get_content(as, silent, cref);
+
+	// Some commands are answered here, and are not sent on.
+	if (not content->is_type(LINK_STREAM_VALUE))
+	{
+		std::vector<std::string> cmd;
+		if (not IRChatStream::get_cmd(content, cmd)) return content;
+
+		ValuePtr reply = run_query(cmd);
+		if (reply) return reply;
+		run_cmd(cmd);
+		return content;
+	}
+	return write_content(content);
+}
+
+// ==============================================================
+
+// Adds factory when library is loaded.
+DEFINE_VALUE_FACTORY(I_R_CHAT_FLEET_STREAM, createIRChatFleetStream, std::string)
+DEFINE_VALUE_FACTORY(I_R_CHAT_FLEET_STREAM, createIRChatFleetStream, Handle)
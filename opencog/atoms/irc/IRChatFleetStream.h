@@ -0,0 +1,164 @@
+/*
+ * opencog/atoms/irc/IRChatFleetStream.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_I_R_CHAT_FLEET_STREAM_H
+#define _OPENCOG_I_R_CHAT_FLEET_STREAM_H
+
+#include <atomic>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencog/util/concurrent_queue.h>
+#include <opencog/atoms/sensory/OutputStream.h>
+#include "QueryTracker.h"
+
+class IRC;
+struct irc_reply_data;
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * A pool of IRC connections, one per nick, to a single server, that
+ * look like one IRChatStream to the agent.
+ *
+ * Channels that are joined are spread over the connections, the
+ * least-loaded first, with no more on any one connection than the
+ * server allows. When a connection is lost, its channels are moved
+ * to the others; those that don't fit wait until a connection has
+ * room. Messages from all of the channels arrive on the one stream.
+ *
+ * All of the connections are run from a single thread, with a single
+ * poll(), instead of a thread per connection.
+ */
+class IRChatFleetStream
+	: public OutputStream, protected concurrent_queue<ValuePtr>
+{
+private:
+	struct Member
+	{
+		IRChatFleetStream* fleet;
+		IRC* conn;
+		std::string base_nick;  // As given in the URL.
+		std::string nick;       // In use; guarded by _mtx.
+		unsigned renames;       // Suffixes added, while nick in use.
+		int drop;            // Set by the reply handlers, to log out:
+		                     // 1 to log in again later, 2 for good.
+		bool ready;          // Registered, and past the MOTD.
+		size_t joined;       // Number of channels assigned to it.
+		size_t limit;        // Most channels it may join.
+		double retry_at;     // When to reconnect, in IRC::monotonic_ms()
+		int backoff;         // Seconds to wait before the next retry.
+		time_t up_since;
+		unsigned long reconnects;
+		QueryTracker queries;
+
+		// Logging in blocks, in name lookup and connect(), so it is
+		// done in a thread of its own, so as not to stall the others.
+		std::thread* connector;
+		std::atomic<bool> connecting;
+	};
+
+	struct Channel
+	{
+		std::string name;
+		std::string key;
+		Member* owner;       // nullptr until some connection has room.
+	};
+
+	std::vector<std::unique_ptr<Member>> _members;
+
+	// Channels, by casefolded name, and who is in them. Guarded by
+	// _mtx, as these are changed by both the writer and the I/O thread.
+	std::mutex _mtx;
+	std::map<std::string, Channel> _channels;
+	size_t _next;
+
+	std::thread* _loop;
+	std::atomic<bool> _cancel;
+	int _wake[2];
+	void looper(void);
+	void start_connect(Member&);
+	void finish_connect(Member&);
+	void connect(Member&);
+	void lost(Member&, int);
+	void retire(Member&);
+	std::string nick_of(Member&);
+
+	void assign(Channel&);
+	void rebalance(void);
+	void release(Member&);
+	Member* pick(const std::string&);
+
+	static int xgot_reply(const char*, irc_reply_data*, void*);
+	static void xtimer(void*);
+	int got_reply(Member&, const char*, irc_reply_data*);
+	int got_privmsg(Member&, const char*, irc_reply_data*);
+	void got_isupport(Member&, const char*);
+	void got_ready(Member&);
+	void got_join_failed(Member&, const char*, irc_reply_data*);
+	void got_kick(Member&, const char*, irc_reply_data*);
+
+protected:
+	IRChatFleetStream(Type t, const std::string&);
+	void init(const std::string&);
+	virtual void update() const;
+
+	std::string _uri;
+	std::string _host;
+	int _port;
+	size_t _chan_limit;
+
+	virtual void prt_value(const ValuePtr&);
+	void run_cmd(const std::vector<std::string>&);
+	ValuePtr run_query(const std::vector<std::string>&);
+
+public:
+	IRChatFleetStream(const Handle&);
+	IRChatFleetStream(const std::string&);
+	virtual ~IRChatFleetStream();
+
+	virtual ValuePtr describe(AtomSpace*, bool);
+	virtual ValuePtr write_out(AtomSpace*, bool, const Handle&);
+};
+
+typedef std::shared_ptr<IRChatFleetStream> IRChatFleetStreamPtr;
+static inline IRChatFleetStreamPtr IRChatFleetStreamCast(ValuePtr& a)
+	{ return std::dynamic_pointer_cast<IRChatFleetStream>(a); }
+
+template<typename ... Type>
+static inline std::shared_ptr<IRChatFleetStream> createIRChatFleetStream(Type&&... args) {
+   return std::make_shared<IRChatFleetStream>(std::forward<Type>(args)...);
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_I_R_CHAT_FLEET_STREAM_H
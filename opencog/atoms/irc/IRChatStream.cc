@@ -24,17 +24,28 @@
 #include <opencog/util/exceptions.h>
 #include <opencog/util/oc_assert.h>
 #include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/FloatValue.h>
 #include <opencog/atoms/value/LinkValue.h>
 #include <opencog/atoms/value/StringValue.h>
 #include <opencog/atoms/value/ValueFactory.h>
 
 #include <opencog/atoms/sensory-types/sensory_types.h>
+#include <opencog/atoms/sensory/DirectCopy.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include <opencog/atoms/sensory/SensoryNode.h>
 #include "IRChatStream.h"
 
 #include "IRC.h"
 
+#include <algorithm>
+
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
 #include <string.h> // for strerror()
+#include <time.h>
+#include <unistd.h>
 
 using namespace opencog;
 
@@ -74,6 +85,7 @@ IRChatStream::~IRChatStream()
 
 	_loop->join();
 	delete _loop;
+	_queries.cancel_all("CLOSED");
 }
 
 // ==================================================================
@@ -90,17 +102,80 @@ IRChatStream::~IRChatStream()
 ///
 /// See also: https://ircv3.net/irc/index.html
 ///
-void IRChatStream::init(const std::string& url)
+/// The server is probed with PINGs, to notice when it stops answering.
+/// The probing is set with query parameters, in seconds:
+///   irc://nick@host?ping=30&timeout=10&missed=3
+/// sends a PING every 30 seconds, and reconnects if three in a row are
+/// not answered within 10 seconds. `ping=0` turns probing off.
+/// Replies to queries such as WHOIS are waited for `reply=30` seconds.
+/// Outgoing lines are limited to `rate=1` per second, after a `burst=5`;
+/// `rate=0` sends them as fast as possible.
+///
+/// For the lowest latency, `busypoll` makes the I/O thread spin on the
+/// socket, instead of sleeping, and `cpu=N` pins it to core N. Readers
+/// of the stream then also spin for a while, before going to sleep.
+///
+void IRChatStream::init(const std::string& urlq)
 {
 	_conn = nullptr;
 	_cancel = false;
-
-	if (0 != url.compare(0, 6, "irc://"))
+	_reconnects = 0;
+	_ping_interval = 30000;
+	_ping_timeout = 10000;
+	_ping_missed = 3;
+	_send_rate = 1.0;
+	_send_burst = 5;
+	_busy = false;
+	_cpu = -1;
+	_lat.resize(LAT_SAMPLES);
+	_lat_count = 0;
+
+	if (0 != urlq.compare(0, 6, "irc://"))
 		throw RuntimeException(TRACE_INFO,
-			"Unsupported URL \"%s\"\n", url.c_str());
+			"Unsupported URL \"%s\"\n", urlq.c_str());
 
 	// Make a copy, for debugging purposes.
-	_uri = url;
+	_uri = urlq;
+
+	std::map<std::string, std::string> params;
+	std::string url = SensoryNode::split_query(urlq, params);
+	for (const auto& pr : params)
+	{
+		if (0 == pr.first.compare("busypoll") and pr.second.empty())
+		{
+			_busy = true;
+			continue;
+		}
+
+		char* end;
+		double secs = strtod(pr.second.c_str(), &end);
+		if (pr.second.empty() or *end or secs < 0.0)
+			throw RuntimeException(TRACE_INFO,
+				"Expecting a number for \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+
+		if (0 == pr.first.compare("ping"))
+			_ping_interval = (int) (1000.0 * secs);
+		else if (0 == pr.first.compare("timeout"))
+			_ping_timeout = (int) (1000.0 * secs);
+		else if (0 == pr.first.compare("missed"))
+			_ping_missed = (int) secs;
+		else if (0 == pr.first.compare("reply"))
+			_queries.set_timeout((int) (1000.0 * secs));
+		else if (0 == pr.first.compare("rate"))
+			_send_rate = secs;
+		else if (0 == pr.first.compare("burst"))
+			_send_burst = (int) secs;
+		else if (0 == pr.first.compare("cpu"))
+			_cpu = (int) secs;
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown URL parameter \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+	}
+	if (0 < _ping_interval and 0 == _ping_timeout)
+		throw RuntimeException(TRACE_INFO,
+			"PING timeout must be positive: \"%s\"\n", urlq.c_str());
 
 	// Ignore the first 6 chars "irc://"
 	size_t base = 6;
@@ -133,10 +208,20 @@ void IRChatStream::init(const std::string& url)
 
 	_conn = new IRC;
 	_conn->context = this;
+	_conn->set_liveness(_ping_interval, _ping_timeout, _ping_missed);
+	_conn->set_timer(1000, &xtimer);
+	_conn->set_send_rate(_send_rate, _send_burst);
+	_conn->set_busy_poll(_busy);
 
 	// Hooks run in order. Privmsg will be most common.
 	_conn->hook_irc_command("PRIVMSG", &xgot_privmsg);
 
+	// Replies to queries. These must come before the other hooks for
+	// the same numerics; replies that are not claimed by a query are
+	// passed on to those.
+	for (const char** nu = QueryTracker::numerics(); *nu; nu++)
+		_conn->hook_irc_command(*nu, &xgot_numeric);
+
 	// 001 and 002 are server greetings.
 	_conn->hook_irc_command("001", &xgot_privmsg);
 	_conn->hook_irc_command("002", &xgot_privmsg);
@@ -192,6 +277,13 @@ ValuePtr IRChatStream::describe(AtomSpace* as, bool silent)
 
 // ==================================================================
 
+/// Sleep, but wake up promptly if the stream is closed.
+void IRChatStream::pause(int secs)
+{
+	for (int i = 0; i < 10*secs and not _cancel; i++)
+		usleep(100000);
+}
+
 // Infinite loop.
 // XXX Needs major redesign. Works for now.
 void IRChatStream::looper(void)
@@ -201,27 +293,59 @@ void IRChatStream::looper(void)
 	const char* name = "Atomese Sensory Stream";
 	const char* pass = "";
 
+	if (0 <= _cpu)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(_cpu, &cpus);
+		int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (rc)
+			SENSORY_WARN("IRChatStream: can't pin to cpu %d: %s",
+				_cpu, strerror(rc));
+	}
+
 	// Loop forever. When the IRC network burps and closes our
-	// connection, just log in again.
+	// connection, or stops answering PINGs, just log in again.
+	// Retries back off, from one second up to a minute, so that
+	// a server that is down is not hammered; a connection that
+	// stayed up for a while resets the backoff.
+	int backoff = 1;
 	while (true)
 	{
-		printf("Joining network=%s port=%d nick=%s user=%s\n",
+		SENSORY_INFO("Joining network=%s port=%d nick=%s user=%s",
 			_host.c_str(), _port, _nick.c_str(), user);
 
 		int rc = _conn->start(_host.c_str(), _port, _nick.c_str(),
 		                      user, name, pass);
 		if (rc)
-			throw RuntimeException(TRACE_INFO,
-				"Unable to connect (%d) to URL \"%s\"\n", rc, _uri.c_str());
-
-		rc = _conn->message_loop();
+			SENSORY_ERROR("IRChatStream: unable to connect to \"%s\"",
+				_uri.c_str());
+		else
+		{
+			time_t up = time(0);
+			rc = _conn->message_loop();
+			if (_cancel) return;
+
+			if (IRC_NO_PONG == rc)
+				SENSORY_WARN("IRChatStream: %s stopped answering; reconnecting",
+					_host.c_str());
+			else if (IRC_CLOSED == rc)
+				SENSORY_WARN("IRChatStream: %s closed the connection; reconnecting",
+					_host.c_str());
+			else if (rc)
+				SENSORY_ERROR("IRChatStream: socket error: %s; reconnecting",
+					strerror(rc));
+
+			_conn->disconnect();
+			_queries.cancel_all("DISCONNECTED");
+			if (60 < time(0) - up) backoff = 1;
+		}
 		if (_cancel) return;
 
-		if (rc) perror("IRChatStream Error: Socket error");
-
-		// For now, assume we got kicked and want to spawn again.
-		_conn->disconnect();
-		sleep(20);
+		pause(backoff);
+		if (_cancel) return;
+		if (backoff < 60) backoff *= 2;
+		_reconnects++;
 	}
 }
 
@@ -260,6 +384,21 @@ int IRChatStream::xgot_misc(const char* params, irc_reply_data* ird,
 	return that->got_misc(params, ird);
 }
 
+int IRChatStream::xgot_numeric(const char* params, irc_reply_data* ird,
+                               void* data)
+{
+	IRC* conn = static_cast<IRC*>(data);
+	IRChatStream* that = static_cast<IRChatStream*>(conn->context);
+	return that->got_numeric(params, ird);
+}
+
+void IRChatStream::xtimer(void* data)
+{
+	IRC* conn = static_cast<IRC*>(data);
+	IRChatStream* that = static_cast<IRChatStream*>(conn->context);
+	that->_queries.expire();
+}
+
 // ==================================================================
 
 /* printf can puke if these fields are NULL */
@@ -269,12 +408,6 @@ static void fixup_reply(irc_reply_data* ird)
 	ird->ident = (NULL == ird->ident) ? (char *) "" : ird->ident;
 	ird->host = (NULL == ird->host) ? (char *) "" : ird->host;
 	ird->target = (NULL == ird->target) ? (char *) "" : ird->target;
-
-#if DEBUG
-	printf(">>> IRC nick=%s ident=%s host=%s target=%s\n",
-		ird->nick, ird->ident, ird->host, ird->target);
-	printf(">>> IRC reply params=%s\n", params);
-#endif
 }
 
 /// Do not attempt to join any channels, until MOTD has arrived.
@@ -291,19 +424,31 @@ int IRChatStream::got_misc(const char* params, irc_reply_data* ird)
 	// ident is the "true identity" of the nick.
 	// host is the hostname that the nick is sending from,
 	// target is who the message is for.
-	printf("Misc reply: nick=%s nick-ident=%s nick-host=%s msg-target=%s\n",
-		ird->nick, ird->ident, ird->host, ird->target);
-	printf("Misc params=%s\n", params);
+	SENSORY_DEBUG("Misc reply: nick=%s nick-ident=%s nick-host=%s "
+		"msg-target=%s params=%s",
+		ird->nick, ird->ident, ird->host, ird->target, params);
 
 	return 0;
 }
 
+/// Hand the reply to the query waiting for it. If there is none,
+/// decline it, so that it goes to the next hook, as before.
+int IRChatStream::got_numeric(const char* params, irc_reply_data* ird)
+{
+	if (_queries.deliver(ird->command, params)) return 0;
+	if (0 == strcmp(ird->command, "403") or
+	    0 == strcmp(ird->command, "322") or
+	    0 == strcmp(ird->command, "353"))
+		return 1;
+	return got_misc(params, ird);
+}
+
 // ==================================================================
 
 int IRChatStream::got_privmsg(const char* params, irc_reply_data* ird)
 {
 	fixup_reply(ird);
-printf(">>> IRC msg from %s to %s =%s\n", ird->nick, ird->target, params);
+	SENSORY_TRACE("IRC msg from %s to %s =%s", ird->nick, ird->target, params);
 
 	// Skip over leading colon.
 	const char * start = params;
@@ -319,13 +464,17 @@ printf(">>> IRC msg from %s to %s =%s\n", ird->nick, ird->target, params);
 
 	// Does the message start with the _nick? If so, special case it.
 	// This is special handling to make message processing easier.
-	if (0 == _nick.compare(0, _nick.size(), start, _nick.size()))
+	if (0 == strncmp(start, _nick.c_str(), _nick.size()))
 		msg.push_back(createStringValue(
 			std::vector<std::string>({_nick, start + _nick.size()})));
 	else
 		msg.push_back(createStringValue(start));
 
 	ValuePtr svp(createLinkValue(msg));
+	{
+		std::lock_guard<std::mutex> lck(_lat_mtx);
+		_stamps[svp.get()] = _conn->last_recv_at();
+	}
 	push(svp); // concurrent_queue<ValutePtr>::push(svp);
 	return 0;
 }
@@ -333,9 +482,8 @@ printf(">>> IRC msg from %s to %s =%s\n", ird->nick, ird->target, params);
 int IRChatStream::got_kick(const char* params, irc_reply_data* ird)
 {
 	fixup_reply(ird);
-	printf("got kicked -- input=%s\n", params);
-	printf("nick=%s ident=%s host=%s target=%s\n",
-	       ird->nick, ird->ident, ird->host, ird->target);
+	SENSORY_WARN("Got kicked -- input=%s nick=%s ident=%s host=%s target=%s",
+	       params, ird->nick, ird->ident, ird->host, ird->target);
 	return 0;
 }
 
@@ -351,13 +499,27 @@ void IRChatStream::update() const
 	if (is_closed() and 0 == concurrent_queue<ValuePtr>::size()) return;
 
 	// Read one at a time. (???)
+	// In busy-poll mode, spin for up to SPIN_MS, so that the item is
+	// picked up as soon as it arrives, without waiting to be woken.
+	// The clock is looked at only every so often; it costs more than
+	// a try_get().
+	IRChatStream* that = const_cast<IRChatStream*>(this);
+	ValuePtr val;
+	bool got = false;
+	if (_busy)
+	{
+		double give_up = IRC::monotonic_ms() + SPIN_MS;
+		for (int i = 1; not (got = that->try_get(val)); i++)
+			if (0 == i % 64 and give_up < IRC::monotonic_ms()) break;
+	}
+
 	// This will hang, until there's something to read.
 	try
 	{
-		ValuePtr val;
-		const_cast<IRChatStream*>(this) -> pop(val);
+		if (not got) that->pop(val);
 		_value.resize(1);
 		_value[0] = val;
+		record_latency(val);
 		return;
 	}
 	catch (typename concurrent_queue<ValuePtr>::Canceled& e)
@@ -366,6 +528,20 @@ void IRChatStream::update() const
 	// If we are here, the queue closed up. Should never happen...
 }
 
+/// Note the time from the arrival of the message from the network,
+/// to its being handed to the reader. Items that were not stamped
+/// when queued are not counted.
+void IRChatStream::record_latency(const ValuePtr& val) const
+{
+	double now = IRC::monotonic_ms();
+	std::lock_guard<std::mutex> lck(_lat_mtx);
+	auto it = _stamps.find(val.get());
+	if (_stamps.end() == it) return;
+	_lat[_lat_count % LAT_SAMPLES] = (float) (1000.0 * (now - it->second));
+	_stamps.erase(it);
+	_lat_count++;
+}
+
 // ==============================================================
 
 #define CHKNARG(NUM,MSG) \
@@ -379,23 +555,27 @@ void IRChatStream::run_cmd(const std::vector<std::string>& cmdstrs)
 {
 	if (0 == cmdstrs.size()) return;
 
+	// Everything goes through the outbound queue, so that it goes
+	// out in order, and within the server's flood limits.
 	const std::string& cmd = cmdstrs[0];
-	if (0 == cmd.compare("PRIVMSG"))
+	if (0 == cmd.compare("PRIVMSG") or 0 == cmd.compare("NOTICE"))
 	{
 		CHKNARG(3, "Expecting at least three arguments");
-		const char* msg_target = cmdstrs[1].c_str();
 
+		// The target may be a comma-separated list of channels and
+		// nicks. Long messages are split into several lines.
+		const char* msg_target = cmdstrs[1].c_str();
 		if (cmdstrs.size() == 3)
 		{
-			_conn->privmsg(msg_target, cmdstrs[2].c_str());
+			_conn->send_message(cmd.c_str(), msg_target, cmdstrs[2].c_str());
 			return;
 		}
 
-		// Concatenate the rest into a single line.
+		// Concatenate the rest into a single message.
 		std::string msg;
 		for (size_t i=2; i< cmdstrs.size(); i++)
 			msg += cmdstrs[i];
-		_conn->privmsg(msg_target, msg.c_str());
+		_conn->send_message(cmd.c_str(), msg_target, msg.c_str());
 		return;
 	}
 
@@ -403,34 +583,38 @@ void IRChatStream::run_cmd(const std::vector<std::string>& cmdstrs)
 	{
 		CHKNARG(2, "Expecting at least two arguments");
 		// Channels must always start with hash mark.
-		const char* channel = cmdstrs[1].c_str();
 		// if ('#' != _channel[0]) _channel = "#" + _channel;
-		_conn->join(channel);
+		_conn->enqueue(("JOIN " + cmdstrs[1]).c_str());
 		return;
 	}
 
 	if (0 == cmd.compare("PART"))
 	{
 		CHKNARG(2, "Expecting at least two arguments");
-		const char* channel = cmdstrs[1].c_str();
-		_conn->part(channel);
+		_conn->enqueue(("PART " + cmdstrs[1]).c_str());
 		return;
 	}
 
 	// Anything goes. Raw commands. Server will bitch if we do
 	// something wrong.
-	_conn->raw(cmd.c_str());
+	std::string line(cmd);
+	for (size_t i=1; i< cmdstrs.size(); i++)
+		line += " " + cmdstrs[i];
+	_conn->enqueue(line.c_str());
 }
 
 // ==============================================================
 /// Deal with different kinds of stream formats.
-void IRChatStream::prt_value(const ValuePtr& command_data)
+/// Converts the command to a list of strings, or returns false if it
+/// is a no-op.
+bool IRChatStream::get_cmd(const ValuePtr& command_data,
+                           std::vector<std::string>& cmd)
 {
 	if (command_data->is_type(STRING_VALUE))
 	{
 		StringValuePtr svp(StringValueCast(command_data));
-		run_cmd(svp->value());
-		return;
+		cmd = svp->value();
+		return true;
 	}
 
 	if (command_data->is_type(LINK_VALUE))
@@ -447,7 +631,6 @@ void IRChatStream::prt_value(const ValuePtr& command_data)
 		if (lvp->size() == 1 and lvp->value()[0]->is_type(LINK_VALUE))
 			lvp = LinkValueCast(lvp->value()[0]);
 
-		std::vector<std::string> cmd;
 		for (const ValuePtr& vp : lvp->value())
 		{
 			if (vp->is_type(STRING_VALUE))
@@ -462,19 +645,17 @@ void IRChatStream::prt_value(const ValuePtr& command_data)
 
 			// FalseLink is the result of a no-op. So do nothing.
 			else if (FALSE_LINK == vp->get_type())
-				return;
+				return false;
 
 			else
 				throw RuntimeException(TRACE_INFO,
 					"Expecting node or string; got %s\n", vp->to_string().c_str());
 		}
-		run_cmd(cmd);
-		return;
+		return true;
 	}
 
 	if (LIST_LINK == command_data->get_type())
 	{
-		std::vector<std::string> cmd;
 		for (const Handle& ho : HandleCast(command_data)->getOutgoingSet())
 		{
 			if (not ho->is_node())
@@ -482,14 +663,90 @@ void IRChatStream::prt_value(const ValuePtr& command_data)
 					"Expecting node; got %s\n", ho->to_string().c_str());
 			cmd.push_back(ho->get_name());
 		}
-		run_cmd(cmd);
-		return;
+		return true;
 	}
 
 	throw RuntimeException(TRACE_INFO,
 		"Unsupported data %s\n", command_data->to_string().c_str());
 }
 
+void IRChatStream::prt_value(const ValuePtr& command_data)
+{
+	std::vector<std::string> cmd;
+	if (get_cmd(command_data, cmd))
+		run_cmd(cmd);
+}
+
+/// Commands that are answered locally, with a Value, instead of
+/// being sent to the server. Returns nullptr for all other commands.
+ValuePtr IRChatStream::run_query(const std::vector<std::string>& cmdstrs)
+{
+	if (0 == cmdstrs.size()) return nullptr;
+
+	// Connection health, for monitoring. Times are in milliseconds:
+	// (connected last-rtt min-rtt mean-rtt max-rtt stddev-rtt
+	//  pings-sent pongs-received pings-missed missed-in-a-row reconnects)
+	if (0 == cmdstrs[0].compare("PINGSTATS"))
+	{
+		irc_rtt_stats st;
+		_conn->get_rtt_stats(&st);
+		return createFloatValue(std::vector<double>({
+			(double) _conn->is_connected(),
+			st.last, st.min, st.mean, st.max, st.stddev,
+			(double) st.sent, (double) st.received, (double) st.missed,
+			(double) st.missed_in_a_row, (double) _reconnects}));
+	}
+
+	// Receive-to-read latency of the most recent messages, in
+	// microseconds: (samples p50 p90 p99 max)
+	if (0 == cmdstrs[0].compare("LATENCY"))
+	{
+		std::vector<float> lat;
+		{
+			std::lock_guard<std::mutex> lck(_lat_mtx);
+			size_t n = std::min(_lat_count, LAT_SAMPLES);
+			lat.assign(_lat.begin(), _lat.begin() + n);
+		}
+		if (lat.empty())
+			return createFloatValue(std::vector<double>({0, 0, 0, 0, 0}));
+		std::sort(lat.begin(), lat.end());
+		size_t n = lat.size();
+		return createFloatValue(std::vector<double>({(double) n,
+			lat[n/2], lat[(n*9)/10], lat[(n*99)/100], lat[n-1]}));
+	}
+
+	// Queries. The reply is a stream, which is filled in as the
+	// answers come in from the server.
+	std::vector<std::string> words;
+	if (1 == cmdstrs.size())
+	{
+		size_t start = 0;
+		const std::string& str = cmdstrs[0];
+		while (start < str.size())
+		{
+			size_t end = str.find(' ', start);
+			if (std::string::npos == end) end = str.size();
+			if (end > start) words.emplace_back(str.substr(start, end-start));
+			start = end + 1;
+		}
+	}
+	else
+		words = cmdstrs;
+
+	ItemStreamPtr replies(_queries.track(words));
+	if (nullptr == replies) return nullptr;
+
+	std::string line;
+	for (const std::string& w : words)
+		line += (line.empty() ? "" : " ") + w;
+
+	// If it can't be sent, we're not connected, and nothing that is
+	// pending will ever be answered.
+	if (_conn->enqueue(line.c_str()))
+		_queries.cancel_all("DISCONNECTED");
+	return replies;
+}
+
 // Write stuff to a file.
 ValuePtr IRChatStream::write_out(AtomSpace* as, bool silent,
                                  const Handle& cref)
@@ -498,7 +755,24 @@ ValuePtr IRChatStream::write_out(AtomSpace* as, bool silent,
 		throw RuntimeException(TRACE_INFO,
 			"IRC stream not open: URI \"%s\"\n", _uri.c_str());
 
-	return do_write_out(as, silent, cref);
+	ValuePtr content = get_content(as, silent, cref);
+
+	// Some commands are answered here, and are not sent on.
+	if (not content->is_type(LINK_STREAM_VALUE))
+	{
+		std::vector<std::string> cmd;
+		if (not get_cmd(content, cmd)) return content;
+
+		ValuePtr reply = run_query(cmd);
+		if (reply) return reply;
+		run_cmd(cmd);
+		return content;
+	}
+
+	// Relaying one chat into another.
+	if (DirectCopy<IRChatStream>::copy(this, content, I_R_CHAT_STREAM))
+		return content;
+	return write_content(content);
 }
 
 // ==============================================================
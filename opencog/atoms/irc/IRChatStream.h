@@ -23,9 +23,13 @@
 #ifndef _OPENCOG_I_R_CHAT_STREAM_H
 #define _OPENCOG_I_R_CHAT_STREAM_H
 
+#include <atomic>
+#include <mutex>
 #include <thread>
+#include <unordered_map>
 #include <opencog/util/concurrent_queue.h>
 #include <opencog/atoms/sensory/OutputStream.h>
+#include "QueryTracker.h"
 
 class IRC;
 struct irc_reply_data;
@@ -44,21 +48,31 @@ namespace opencog
 class IRChatStream
 	: public OutputStream, protected concurrent_queue<ValuePtr>
 {
+	friend class DirectCopy<IRChatStream>;
+
 private:
 	IRC* _conn;
 	std::thread* _loop;
-	bool _cancel;
+	std::atomic<bool> _cancel;
+	std::atomic<unsigned long> _reconnects;
 	void looper(void);
+	void pause(int);
 
 	static int xend_of_motd(const char*, irc_reply_data*, void*);
 	static int xgot_privmsg(const char*, irc_reply_data*, void*);
 	static int xgot_kick(const char*, irc_reply_data*, void*);
 	static int xgot_misc(const char*, irc_reply_data*, void*);
+	static int xgot_numeric(const char*, irc_reply_data*, void*);
+	static void xtimer(void*);
 
 	int end_of_motd(const char*, irc_reply_data*);
 	int got_privmsg(const char*, irc_reply_data*);
 	int got_kick(const char*, irc_reply_data*);
 	int got_misc(const char*, irc_reply_data*);
+	int got_numeric(const char*, irc_reply_data*);
+
+	// Replies to WHOIS, NAMES, LIST and MODE queries.
+	QueryTracker _queries;
 
 protected:
 	IRChatStream(Type t, const std::string&);
@@ -70,8 +84,34 @@ protected:
 	std::string _host;
 	int _port;
 
+	// Liveness probing, in milliseconds; see IRC::set_liveness()
+	int _ping_interval;
+	int _ping_timeout;
+	int _ping_missed;
+
+	// Flood control; see IRC::set_send_rate()
+	double _send_rate;
+	int _send_burst;
+
+	// Low-latency mode; see IRC::set_busy_poll(). Readers spin for
+	// at most SPIN_MS before going to sleep.
+	static constexpr double SPIN_MS = 1.0;
+	bool _busy;
+	int _cpu;
+
+	// Receive-to-read latency, in microseconds, of the most recent
+	// messages. _stamps holds the receive time of each queued message,
+	// keyed by the message itself.
+	static constexpr size_t LAT_SAMPLES = 4096;
+	mutable std::mutex _lat_mtx;
+	mutable std::unordered_map<const Value*, double> _stamps;
+	mutable std::vector<float> _lat;
+	mutable size_t _lat_count;
+	void record_latency(const ValuePtr&) const;
+
 	virtual void prt_value(const ValuePtr&);
 	void run_cmd(const std::vector<std::string>&);
+	ValuePtr run_query(const std::vector<std::string>&);
 
 public:
 	IRChatStream(const Handle&);
@@ -80,6 +120,9 @@ public:
 
 	virtual ValuePtr describe(AtomSpace*, bool);
 	virtual ValuePtr write_out(AtomSpace*, bool, const Handle&);
+
+	/// Convert a command to a list of strings; false if it is a no-op.
+	static bool get_cmd(const ValuePtr&, std::vector<std::string>&);
 };
 
 typedef std::shared_ptr<IRChatStream> IRChatStreamPtr;
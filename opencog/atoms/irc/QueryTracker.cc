@@ -0,0 +1,416 @@
+/*
+ * opencog/atoms/irc/QueryTracker.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+
+#include "QueryTracker.h"
+
+using namespace opencog;
+
+/// A numeric that answers a query. `keyarg` is the position of the
+/// nick or channel among the arguments, counting our own nick, which
+/// always comes first, as zero. It is -1 if the reply does not name
+/// one. `end` marks the last reply to the query.
+struct QueryTracker::ReplySpec
+{
+	int numeric;
+	int keyarg;
+	bool end;
+};
+
+// Lists end with a zero numeric.
+static const QueryTracker::ReplySpec whois_specs[] = {
+	{301, 1, false},   // away
+	{307, 1, false},   // registered nick
+	{311, 1, false},   // nick user host * :realname
+	{312, 1, false},   // nick server :info
+	{313, 1, false},   // is an operator
+	{317, 1, false},   // idle seconds, signon time
+	{319, 1, false},   // channels
+	{320, 1, false},   // special
+	{330, 1, false},   // logged in as
+	{338, 1, false},   // actual host
+	{378, 1, false},   // connecting from
+	{671, 1, false},   // secure connection
+	{276, 1, false},   // certificate fingerprint
+	{401, 1, false},   // no such nick; the 318 follows
+	{402, 1, false},   // no such server
+	{318, 1, true},    // end of WHOIS
+	{431, -1, true},   // no nick given
+	{0, 0, false}
+};
+
+static const QueryTracker::ReplySpec names_specs[] = {
+	{353, 2, false},   // symbol channel :nicks
+	{366, 1, true},    // end of NAMES
+	{0, 0, false}
+};
+
+static const QueryTracker::ReplySpec list_specs[] = {
+	{321, -1, false},  // start of LIST
+	{322, -1, false},  // channel users :topic
+	{323, -1, true},   // end of LIST
+	{416, -1, true},   // output too large
+	{0, 0, false}
+};
+
+static const QueryTracker::ReplySpec chan_mode_specs[] = {
+	{324, 1, true},    // channel modes
+	{403, 1, true},    // no such channel
+	{442, 1, true},    // not on channel
+	{0, 0, false}
+};
+
+static const QueryTracker::ReplySpec user_mode_specs[] = {
+	{221, -1, true},   // user modes
+	{401, 1, true},    // no such nick
+	{502, -1, true},   // can't view modes of other users
+	{0, 0, false}
+};
+
+const char** QueryTracker::numerics(void)
+{
+	static const char* nums[] = {
+		"221", "276", "301", "307", "311", "312", "313", "317", "318",
+		"319", "320", "321", "322", "323", "324", "330", "338", "353",
+		"366", "378", "401", "402", "403", "416", "431", "442", "502",
+		"671", nullptr};
+	return nums;
+}
+
+/// IRC nicks and channel names are case-insensitive, and, per RFC 1459,
+/// so are {}|^ and []\~
+std::string QueryTracker::casefold(const std::string& s)
+{
+	std::string f(s);
+	for (char& c : f)
+	{
+		if ('A' <= c and c <= 'Z') c += 'a' - 'A';
+		else if ('[' == c) c = '{';
+		else if (']' == c) c = '}';
+		else if ('\\' == c) c = '|';
+		else if ('~' == c) c = '^';
+	}
+	return f;
+}
+
+static void split(const std::string& s, char sep, std::vector<std::string>& out)
+{
+	size_t start = 0;
+	while (start <= s.size())
+	{
+		size_t end = s.find(sep, start);
+		if (std::string::npos == end) end = s.size();
+		if (end > start) out.emplace_back(s.substr(start, end-start));
+		start = end + 1;
+	}
+}
+
+// ==============================================================
+
+QueryTracker::QueryTracker(void) :
+	_timeout(30000)
+{
+}
+
+void QueryTracker::set_timeout(int ms)
+{
+	_timeout = std::chrono::milliseconds(ms);
+}
+
+/// Pull the filter options out of a LIST command.
+QueryTracker::ListFilter* QueryTracker::list_filter(std::vector<std::string>& words)
+{
+	ListFilter* filt = new ListFilter({0, SIZE_MAX, "", "", 0, 0});
+	std::unique_ptr<ListFilter> guard(filt);
+
+	std::vector<std::string> rest;
+	rest.emplace_back(words[0]);
+	for (size_t i = 1; i < words.size(); i++)
+	{
+		const std::string& opt = words[i];
+		bool is_num = (0 == opt.compare("min") or 0 == opt.compare("max") or
+		               0 == opt.compare("limit"));
+		if (not is_num and opt.compare("match") and opt.compare("topic"))
+		{
+			// Not ours; pass it on to the server.
+			rest.emplace_back(opt);
+			continue;
+		}
+		if (words.size() <= i+1)
+			throw RuntimeException(TRACE_INFO,
+				"LIST option \"%s\" expects a value", opt.c_str());
+
+		const std::string& val = words[++i];
+		if (is_num)
+		{
+			char* end;
+			double d = strtod(val.c_str(), &end);
+			if (end == val.c_str() or *end or d < 0.0)
+				throw RuntimeException(TRACE_INFO,
+					"LIST option \"%s\" expects a number, got \"%s\"",
+					opt.c_str(), val.c_str());
+			if ('m' == opt[0] and 'i' == opt[1]) filt->min_users = (size_t) d;
+			else if ('m' == opt[0]) filt->max_users = (size_t) d;
+			else filt->limit = (size_t) d;
+		}
+		else if ('m' == opt[0]) filt->match = val;
+		else filt->topic = val;
+	}
+	words.swap(rest);
+	return guard.release();
+}
+
+ItemStreamPtr QueryTracker::track(std::vector<std::string>& words)
+{
+	if (0 == words.size()) return nullptr;
+
+	std::string cmd(words[0]);
+	for (char& c : cmd) c = toupper(c);
+
+	const ReplySpec* specs = nullptr;
+	std::vector<std::string> keys;
+	ListFilter* filt = nullptr;
+	if (0 == cmd.compare("WHOIS"))
+	{
+		// WHOIS [server] nick[,nick...]
+		if (2 > words.size()) return nullptr;
+		specs = whois_specs;
+		split(words.back(), ',', keys);
+	}
+	else if (0 == cmd.compare("NAMES"))
+	{
+		// NAMES with no channel lists them all, and ends with
+		// a single 366 for "*".
+		specs = names_specs;
+		if (2 > words.size()) keys.emplace_back("");
+		else split(words[1], ',', keys);
+	}
+	else if (0 == cmd.compare("LIST"))
+	{
+		specs = list_specs;
+		keys.emplace_back("");
+		filt = list_filter(words);
+	}
+	else if (0 == cmd.compare("MODE"))
+	{
+		// Only a query if no modes are being set.
+		if (2 != words.size()) return nullptr;
+		const std::string& tgt = words[1];
+		specs = strchr("#&+!", tgt[0]) ? chan_mode_specs : user_mode_specs;
+		keys.emplace_back(tgt);
+	}
+	else
+		return nullptr;
+
+	if (0 == keys.size()) return nullptr;
+
+	QueryPtr q(std::make_shared<Query>());
+	q->list.reset(filt);
+	q->closed = false;
+	q->out = createItemStream();
+	for (size_t i = 0; i < words.size(); i++)
+	{
+		if (0 < i) q->cmd += ' ';
+		q->cmd += words[i];
+	}
+	q->deadline = std::chrono::steady_clock::now() + _timeout;
+	q->open = keys.size();
+
+	std::lock_guard<std::mutex> lck(_mtx);
+	for (const std::string& key : keys)
+		_pending.push_back({specs, casefold(key), q});
+
+	return q->out;
+}
+
+bool QueryTracker::deliver(const char* numeric, const char* params)
+{
+	int num = atoi(numeric);
+	if (0 == num or nullptr == params) return false;
+
+	// Split the params; a leading colon marks the last one, which
+	// may contain blanks.
+	std::vector<std::string> args;
+	const char* p = params;
+	while (*p)
+	{
+		while (' ' == *p) p++;
+		if (0 == *p) break;
+		if (':' == *p)
+		{
+			args.emplace_back(p+1);
+			break;
+		}
+		const char* e = strchr(p, ' ');
+		if (nullptr == e) e = p + strlen(p);
+		args.emplace_back(p, e-p);
+		p = e;
+	}
+
+	std::lock_guard<std::mutex> lck(_mtx);
+	for (auto it = _pending.begin(); it != _pending.end(); it++)
+	{
+		const ReplySpec* spec = it->specs;
+		while (spec->numeric and spec->numeric != num) spec++;
+		if (0 == spec->numeric) continue;
+
+		if (0 <= spec->keyarg and not it->key.empty())
+		{
+			if ((int) args.size() <= spec->keyarg) continue;
+			if (casefold(args[spec->keyarg]) != it->key) continue;
+		}
+
+		// The timeout is for silence, not for the whole reply;
+		// a LIST of a big network can take minutes.
+		Query& q = *it->query;
+		q.deadline = std::chrono::steady_clock::now() + _timeout;
+
+		if (q.list)
+			list_reply(q, num, args);
+		else if (not q.closed)
+		{
+			// Drop our own nick; keep the numeric.
+			std::vector<std::string> item;
+			item.emplace_back(numeric);
+			if (1 < args.size())
+				item.insert(item.end(), args.begin()+1, args.end());
+			q.out->add(createStringValue(std::move(item)));
+		}
+
+		if (spec->end)
+		{
+			QueryPtr qp(it->query);
+			_pending.erase(it);
+			if (0 == --qp->open and not qp->closed) qp->out->close();
+		}
+		return true;
+	}
+	return false;
+}
+
+/// Filter one line of a LIST reply, and, if it passes, turn it into
+/// a (channel, users, topic) triple. Called with the lock held.
+void QueryTracker::list_reply(Query& q, int num,
+                              const std::vector<std::string>& args)
+{
+	if (q.closed) return;
+
+	// Anything other than the start and the channels is an error,
+	// e.g. 416, output too large. Pass it on as is.
+	if (322 != num)
+	{
+		if (321 == num or 323 == num) return;
+		std::vector<std::string> item;
+		item.emplace_back(std::to_string(num));
+		if (1 < args.size())
+			item.insert(item.end(), args.begin()+1, args.end());
+		q.out->add(createStringValue(std::move(item)));
+		return;
+	}
+
+	// me #channel users :topic
+	if (3 > args.size()) return;
+	const ListFilter& f = *q.list;
+	size_t users = strtoul(args[2].c_str(), nullptr, 10);
+	if (users < f.min_users or f.max_users < users) return;
+
+	static const std::string empty;
+	const std::string& topic = (4 > args.size()) ? empty : args[3];
+	if (not f.match.empty() and
+	    fnmatch(f.match.c_str(), args[1].c_str(), FNM_CASEFOLD))
+		return;
+	if (not f.topic.empty() and
+	    fnmatch(f.topic.c_str(), topic.c_str(), FNM_CASEFOLD))
+		return;
+
+	q.out->add(createLinkValue(ValueSeq({
+		createStringValue(args[1]),
+		createFloatValue((double) users),
+		createStringValue(topic)})));
+
+	if (f.limit and f.limit <= ++q.list->count)
+	{
+		q.out->close();
+		q.closed = true;
+	}
+}
+
+// Must be called with the lock held.
+void QueryTracker::finish(const QueryPtr& q, const ValuePtr& why)
+{
+	if (not q->closed)
+	{
+		q->out->add(why);
+		q->out->close();
+	}
+	for (auto it = _pending.begin(); it != _pending.end(); )
+	{
+		if (it->query == q) it = _pending.erase(it);
+		else it++;
+	}
+}
+
+void QueryTracker::expire(void)
+{
+	TimePoint now = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lck(_mtx);
+	auto it = _pending.begin();
+	while (it != _pending.end())
+	{
+		if (now < it->query->deadline) { it++; continue; }
+
+		QueryPtr q(it->query);
+		SENSORY_DEBUG("IRC query timed out: %s", q->cmd.c_str());
+		finish(q, createStringValue(
+			std::vector<std::string>({"TIMEOUT", q->cmd})));
+
+		// The list may have lost several entries; start over.
+		it = _pending.begin();
+	}
+}
+
+void QueryTracker::cancel_all(const std::string& why)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	while (not _pending.empty())
+	{
+		QueryPtr q(_pending.front().query);
+		finish(q, createStringValue(
+			std::vector<std::string>({why, q->cmd})));
+	}
+}
+
+bool QueryTracker::empty(void)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	return _pending.empty();
+}
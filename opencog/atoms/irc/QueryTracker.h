@@ -0,0 +1,148 @@
+/*
+ * opencog/atoms/irc/QueryTracker.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_QUERY_TRACKER_H
+#define _OPENCOG_QUERY_TRACKER_H
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencog/atoms/sensory/ItemStream.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * Match IRC query commands (WHOIS, NAMES, LIST and MODE) to the
+ * numeric replies that answer them.
+ *
+ * IRC replies carry no request id. They do name the nick or channel
+ * they are about, and the server answers commands in the order they
+ * were sent. So each query is filed under the kind of query and the
+ * nick or channel, and a reply goes to the oldest query that it fits.
+ * Queries naming several targets, e.g. `WHOIS alice,bob`, are filed
+ * once per target, and finish when all of them are done.
+ *
+ * Each query gets an ItemStream. Each numeric reply is added to it,
+ * as a StringValue holding the numeric and its arguments, and the
+ * stream is closed when the end-of-reply numeric arrives. A query
+ * that gets no reply for too long gets a ("TIMEOUT" command) item, and
+ * is closed.
+ *
+ * LIST replies are structured instead: each channel is a LinkValue of
+ * (StringValue channel, FloatValue users, StringValue topic). They may
+ * be filtered, on the I/O thread, before any Values are made for them;
+ * see track().
+ */
+class QueryTracker
+{
+public:
+	struct ReplySpec;
+
+private:
+	typedef std::chrono::steady_clock::time_point TimePoint;
+
+	struct ListFilter
+	{
+		size_t min_users;
+		size_t max_users;
+		std::string match; // Glob on the channel name
+		std::string topic; // Glob on the topic
+		size_t limit;      // Zero for no limit.
+		size_t count;
+	};
+
+	struct Query
+	{
+		ItemStreamPtr out;
+		std::string cmd;
+		TimePoint deadline;
+		size_t open;       // Targets not yet done.
+		bool closed;       // Closed early, e.g. when a limit is reached.
+		std::unique_ptr<ListFilter> list;
+	};
+	typedef std::shared_ptr<Query> QueryPtr;
+
+	struct Pending
+	{
+		const ReplySpec* specs;
+		std::string key;   // Casefolded nick or channel; empty for any.
+		QueryPtr query;
+	};
+
+	std::mutex _mtx;
+	std::list<Pending> _pending;
+	std::chrono::milliseconds _timeout;
+
+	void finish(const QueryPtr&, const ValuePtr&);
+	void list_reply(Query&, int, const std::vector<std::string>&);
+	static ListFilter* list_filter(std::vector<std::string>&);
+
+public:
+	QueryTracker(void);
+
+	void set_timeout(int ms);
+
+	/// If `words` (the command, split on blanks) is a query, start
+	/// tracking it, and return the stream that will hold the replies.
+	/// Otherwise, return nullptr. Must be called before the command
+	/// is sent, so that no reply can arrive ahead of it.
+	///
+	/// LIST takes filter options, which are removed from `words`:
+	///    LIST min 20 max 500 match *linux* topic *kernel* limit 100
+	/// `match` and `topic` are case-insensitive globs. After `limit`
+	/// channels, the stream is closed; the rest of the listing is
+	/// read and dropped.
+	ItemStreamPtr track(std::vector<std::string>& words);
+
+	/// Offer a numeric reply; `params` is everything after the
+	/// numeric. Returns false if no query claims it.
+	bool deliver(const char* numeric, const char* params);
+
+	/// Time out the queries that have waited too long.
+	void expire(void);
+
+	/// Close all queries; e.g. when the connection is lost.
+	void cancel_all(const std::string& why);
+
+	bool empty(void);
+
+	/// Nicks and channel names, folded to compare case-insensitively.
+	static std::string casefold(const std::string&);
+
+	/// The numerics that may answer a query, as a null-terminated list.
+	/// Hook these ahead of other hooks for the same numerics.
+	static const char** numerics(void);
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_QUERY_TRACKER_H
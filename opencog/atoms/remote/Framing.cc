@@ -0,0 +1,426 @@
+/*
+ * opencog/atoms/remote/Framing.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <endian.h>
+#include <errno.h>
+#include <netdb.h>
+#include <string.h> // for strerror()
+#include <unistd.h>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/base/Link.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+
+#include "Framing.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Encoding.
+
+static void put_varint(std::string& out, uint64_t n)
+{
+	while (0x80 <= n)
+	{
+		out.push_back((char) (0x80 | (n & 0x7f)));
+		n >>= 7;
+	}
+	out.push_back((char) n);
+}
+
+static void put_string(std::string& out, const std::string& str)
+{
+	put_varint(out, str.size());
+	out.append(str);
+}
+
+static void put_value(std::string& out, const ValuePtr& vp)
+{
+	Type t = vp->get_type();
+	if (nameserver().isA(t, STRING_VALUE))
+	{
+		const std::vector<std::string>& strs = StringValueCast(vp)->value();
+		out.push_back('s');
+		put_varint(out, strs.size());
+		for (const std::string& s : strs)
+			put_string(out, s);
+		return;
+	}
+	if (nameserver().isA(t, FLOAT_VALUE))
+	{
+		const std::vector<double>& dbls = FloatValueCast(vp)->value();
+		out.push_back('f');
+		put_varint(out, dbls.size());
+		for (double d : dbls)
+		{
+			uint64_t u;
+			memcpy(&u, &d, sizeof(u));
+			u = htole64(u);
+			out.append((const char*) &u, sizeof(u));
+		}
+		return;
+	}
+	if (nameserver().isA(t, LINK_VALUE))
+	{
+		const ValueSeq& vals = LinkValueCast(vp)->value();
+		out.push_back('l');
+		put_varint(out, vals.size());
+		for (const ValuePtr& v : vals)
+			put_value(out, v);
+		return;
+	}
+	if (vp->is_node())
+	{
+		out.push_back('n');
+		put_string(out, nameserver().getTypeName(t));
+		put_string(out, HandleCast(vp)->get_name());
+		return;
+	}
+	if (vp->is_link())
+	{
+		const HandleSeq& oset = HandleCast(vp)->getOutgoingSet();
+		out.push_back('k');
+		put_string(out, nameserver().getTypeName(t));
+		put_varint(out, oset.size());
+		for (const Handle& h : oset)
+			put_value(out, h);
+		return;
+	}
+
+	// Anything else goes as text.
+	out.push_back('s');
+	put_varint(out, 1);
+	put_string(out, vp->to_short_string());
+}
+
+void Framing::put_frame(std::string& out, Kind kind, const std::string& body)
+{
+	uint32_t len = htobe32(body.size() + 1);
+	out.append((const char*) &len, sizeof(len));
+	out.push_back((char) kind);
+	out.append(body);
+}
+
+void Framing::put_items(std::string& out, const ValueSeq& vals)
+{
+	// Reserve the header, and fill in the length when done;
+	// this avoids copying the body.
+	size_t start = out.size();
+	out.append(HEADER, '\0');
+	out[start + 4] = (char) ITEMS;
+	put_varint(out, vals.size());
+	for (const ValuePtr& v : vals)
+		put_value(out, v);
+
+	uint32_t len = htobe32(out.size() - start - 4);
+	memcpy(&out[start], &len, sizeof(len));
+}
+
+// ==============================================================
+// Decoding.
+
+namespace {
+
+struct Reader
+{
+	const char* p;
+	const char* end;
+
+	void need(size_t n)
+	{
+		if ((size_t) (end - p) < n)
+			throw RuntimeException(TRACE_INFO, "Truncated frame\n");
+	}
+
+	uint64_t varint(void)
+	{
+		uint64_t n = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			need(1);
+			uint8_t c = *p++;
+			n |= ((uint64_t) (c & 0x7f)) << shift;
+			if (0 == (c & 0x80)) return n;
+		}
+		throw RuntimeException(TRACE_INFO, "Bad varint in frame\n");
+	}
+
+	/// A count of things, each at least `each` bytes long. The count
+	/// is checked against what is left, before it is used to size
+	/// anything, and without multiplying, which could overflow.
+	size_t count(size_t each = 1)
+	{
+		uint64_t n = varint();
+		if ((size_t) (end - p) / each < n)
+			throw RuntimeException(TRACE_INFO, "Truncated frame\n");
+		return n;
+	}
+
+	std::string string(void)
+	{
+		size_t n = count();
+		std::string s(p, n);
+		p += n;
+		return s;
+	}
+
+	Type type(void)
+	{
+		std::string tname = string();
+		Type t = nameserver().getType(tname);
+		if (NOTYPE == t)
+			throw RuntimeException(TRACE_INFO,
+				"Unknown type \"%s\" in frame\n", tname.c_str());
+		return t;
+	}
+
+	ValuePtr value(int depth)
+	{
+		if (256 < depth)
+			throw RuntimeException(TRACE_INFO, "Frame nested too deep\n");
+
+		need(1);
+		char tag = *p++;
+		if ('s' == tag)
+		{
+			size_t n = count();
+			std::vector<std::string> strs;
+			strs.reserve(n);
+			for (size_t i = 0; i < n; i++)
+				strs.emplace_back(string());
+			return createStringValue(std::move(strs));
+		}
+		if ('f' == tag)
+		{
+			size_t n = count(sizeof(uint64_t));
+			std::vector<double> dbls(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				uint64_t u;
+				memcpy(&u, p, sizeof(u));
+				p += sizeof(u);
+				u = le64toh(u);
+				memcpy(&dbls[i], &u, sizeof(u));
+			}
+			return createFloatValue(std::move(dbls));
+		}
+		if ('l' == tag)
+		{
+			size_t n = count();
+			ValueSeq vals;
+			vals.reserve(n);
+			for (size_t i = 0; i < n; i++)
+				vals.emplace_back(value(depth + 1));
+			return createLinkValue(std::move(vals));
+		}
+		if ('n' == tag)
+		{
+			Type t = type();
+			return createNode(t, string());
+		}
+		if ('k' == tag)
+		{
+			Type t = type();
+			size_t n = count();
+			HandleSeq oset;
+			oset.reserve(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				Handle h(HandleCast(value(depth + 1)));
+				if (nullptr == h)
+					throw RuntimeException(TRACE_INFO,
+						"Expecting an Atom in a Link, in frame\n");
+				oset.emplace_back(h);
+			}
+			return createLink(std::move(oset), t);
+		}
+		throw RuntimeException(TRACE_INFO,
+			"Unknown tag 0x%x in frame\n", (unsigned char) tag);
+	}
+};
+
+} // anonymous namespace
+
+size_t Framing::get_frame(const char* buf, size_t len, Kind& kind)
+{
+	if (len < HEADER) return 0;
+
+	uint32_t flen;
+	memcpy(&flen, buf, sizeof(flen));
+	flen = be32toh(flen);
+	if (0 == flen or MAX_FRAME < flen)
+		throw RuntimeException(TRACE_INFO,
+			"Bad frame length %u\n", flen);
+
+	if (len < flen + 4) return 0;
+	kind = (Kind) buf[4];
+	return flen + 4;
+}
+
+ValueSeq Framing::get_items(const char* body, size_t len)
+{
+	Reader rd{body, body + len};
+	size_t n = rd.count();
+	ValueSeq vals;
+	vals.reserve(n);
+	for (size_t i = 0; i < n; i++)
+		vals.emplace_back(rd.value(0));
+	return vals;
+}
+
+// ==============================================================
+// Transport.
+
+int Framing::open_socket(const std::string& urlq, bool listen)
+{
+	std::string url = urlq.substr(0, urlq.find('?'));
+
+	int fd = -1;
+	if (0 == url.compare(0, 7, "unix://"))
+	{
+		std::string path = url.substr(7);
+		struct sockaddr_un sun;
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		if (path.empty() or sizeof(sun.sun_path) <= path.size())
+			throw RuntimeException(TRACE_INFO,
+				"Bad socket path in \"%s\"\n", urlq.c_str());
+		strcpy(sun.sun_path, path.c_str());
+
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (0 > fd)
+			throw RuntimeException(TRACE_INFO,
+				"Can't open socket: %s\n", strerror(errno));
+
+		// A socket left behind by a server that died is in the way.
+		// One that a live server is listening on is not removed.
+		struct stat st;
+		if (listen and 0 == lstat(path.c_str(), &st) and S_ISSOCK(st.st_mode))
+		{
+			int pfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			bool live = 0 <= pfd and
+				0 == connect(pfd, (struct sockaddr*) &sun, sizeof(sun));
+			if (0 <= pfd) ::close(pfd);
+			if (live)
+			{
+				::close(fd);
+				throw RuntimeException(TRACE_INFO,
+					"Can't bind \"%s\": %s\n",
+					path.c_str(), strerror(EADDRINUSE));
+			}
+			unlink(path.c_str());
+		}
+
+		int rc = listen ?
+			bind(fd, (struct sockaddr*) &sun, sizeof(sun)) :
+			connect(fd, (struct sockaddr*) &sun, sizeof(sun));
+
+		// Only this user may connect. Nothing can connect until the
+		// listen() below, so there is no window in which others can.
+		bool bound = 0 == rc and listen;
+		if (bound)
+			rc = chmod(path.c_str(), S_IRUSR | S_IWUSR);
+		if (0 != rc)
+		{
+			int err = errno;
+			::close(fd);
+			if (bound) unlink(path.c_str());
+			throw RuntimeException(TRACE_INFO,
+				"Can't %s \"%s\": %s\n", listen ? "bind" : "connect to",
+				path.c_str(), strerror(err));
+		}
+	}
+	else if (0 == url.compare(0, 6, "tcp://"))
+	{
+		size_t col = url.rfind(':');
+		if (col < 6 or std::string::npos == col)
+			throw RuntimeException(TRACE_INFO,
+				"Invalid URL \"%s\" expecting tcp://host:port\n",
+				urlq.c_str());
+		std::string host = url.substr(6, col - 6);
+		if (2 <= host.size() and '[' == host.front() and ']' == host.back())
+			host = host.substr(1, host.size() - 2);
+		std::string port = url.substr(col + 1);
+		size_t sls = port.find('/');
+		if (std::string::npos != sls) port.resize(sls);
+
+		struct addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		if (listen) hints.ai_flags = AI_PASSIVE;
+		struct addrinfo* res = nullptr;
+		int rc = getaddrinfo(host.empty() ? nullptr : host.c_str(),
+		                     port.c_str(), &hints, &res);
+		if (0 != rc)
+			throw RuntimeException(TRACE_INFO,
+				"Can't resolve \"%s\": %s\n", urlq.c_str(), gai_strerror(rc));
+
+		int err = 0;
+		for (struct addrinfo* ai = res; ai; ai = ai->ai_next)
+		{
+			fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+			            ai->ai_protocol);
+			if (0 > fd) { err = errno; continue; }
+
+			int one = 1;
+			if (listen)
+				setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			else
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+			rc = listen ?
+				bind(fd, ai->ai_addr, ai->ai_addrlen) :
+				connect(fd, ai->ai_addr, ai->ai_addrlen);
+			if (0 == rc) break;
+			err = errno;
+			::close(fd);
+			fd = -1;
+		}
+		freeaddrinfo(res);
+		if (0 > fd)
+			throw RuntimeException(TRACE_INFO,
+				"Can't %s \"%s\": %s\n", listen ? "bind" : "connect to",
+				urlq.c_str(), strerror(err));
+	}
+	else
+		throw RuntimeException(TRACE_INFO,
+			"Unsupported URL \"%s\"\n", urlq.c_str());
+
+	if (listen and 0 != ::listen(fd, 64))
+	{
+		int err = errno;
+		::close(fd);
+		throw RuntimeException(TRACE_INFO,
+			"Can't listen on \"%s\": %s\n", urlq.c_str(), strerror(err));
+	}
+	return fd;
+}
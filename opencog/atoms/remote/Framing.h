@@ -0,0 +1,95 @@
+/*
+ * opencog/atoms/remote/Framing.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_FRAMING_H
+#define _OPENCOG_FRAMING_H
+
+#include <stdint.h>
+#include <string>
+#include <opencog/atoms/value/Value.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * The wire format spoken between the StreamServer and RemoteStreams.
+ *
+ * Each frame is a four-byte big-endian length, a one-byte kind, and
+ * then the body; the length counts the kind and the body. A client
+ * sends one SUBSCRIBE, naming a stream; the server answers with OK or
+ * ERROR, and then sends ITEMS frames, each holding a batch of Values,
+ * until the stream ENDs.
+ *
+ * Values are a one-byte tag and then the contents. Counts and lengths
+ * are LEB128 varints; floats are eight bytes, little-endian.
+ *    's' StringValue: count, then (length, bytes) for each string
+ *    'f' FloatValue:  count, then the doubles
+ *    'l' LinkValue:   count, then the Values
+ *    'n' Node:        type name, then name, as (length, bytes)
+ *    'k' Link:        type name, count, then the outgoing Atoms
+ * Values of any other type are sent as a StringValue holding their
+ * printed form.
+ */
+class Framing
+{
+public:
+	enum Kind : uint8_t
+	{
+		SUBSCRIBE = 1,
+		OK = 2,
+		ERROR = 3,
+		ITEMS = 4,
+		END = 5,
+	};
+
+	/// Frames larger than this are refused, as garbage.
+	static constexpr size_t MAX_FRAME = 64 * 1024 * 1024;
+	static constexpr size_t HEADER = 5;
+
+	/// Append a frame holding `body` to `out`.
+	static void put_frame(std::string& out, Kind, const std::string& body);
+
+	/// Append an ITEMS frame holding the Values to `out`.
+	static void put_items(std::string& out, const ValueSeq&);
+
+	/// If `buf` starts with a complete frame, return its total size,
+	/// and set `kind`; the body follows the header. Zero if more
+	/// bytes are needed. Throws on garbage.
+	static size_t get_frame(const char* buf, size_t len, Kind& kind);
+
+	/// Decode the body of an ITEMS frame. Throws on garbage.
+	static ValueSeq get_items(const char* body, size_t len);
+
+	/// Open a socket for `unix:///path` or `tcp://host:port`; any
+	/// query part of the URL is ignored. With `listen`, bind it and
+	/// listen on it, else connect it. Throws on failure.
+	static int open_socket(const std::string& url, bool listen);
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_FRAMING_H
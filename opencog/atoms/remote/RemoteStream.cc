@@ -0,0 +1,284 @@
+/*
+ * opencog/atoms/remote/RemoteStream.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h> // for strerror()
+#include <unistd.h>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/ValueFactory.h>
+
+#include <opencog/atoms/sensory-types/sensory_types.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include <opencog/atoms/sensory/SensoryNode.h>
+#include "Framing.h"
+#include "RemoteStream.h"
+
+using namespace opencog;
+
+RemoteStream::RemoteStream(const std::string& str)
+	: OutputStream(REMOTE_STREAM)
+{
+	init(str);
+}
+
+RemoteStream::RemoteStream(const Handle& senso)
+	: OutputStream(REMOTE_STREAM)
+{
+	if (SENSORY_NODE != senso->get_type())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting SensoryNode, got %s\n", senso->to_string().c_str());
+
+	init(senso->get_name());
+}
+
+RemoteStream::~RemoteStream()
+{
+	if (nullptr == _loop) return;
+
+	// Wakes up the reader, whether it waits for room or for data.
+	{
+		std::lock_guard<std::mutex> lck(_room_mtx);
+		_quit = true;
+	}
+	_room.notify_all();
+	shutdown(_fd, SHUT_RDWR);
+	_loop->join();
+	delete _loop;
+	::close(_fd);
+}
+
+/// The URL is that of the StreamServer, and the name of the stream:
+///    unix:///tmp/cog.sock?stream=irc
+///    tcp://127.0.0.1:7722?stream=irc&queue=1000
+void RemoteStream::init(const std::string& urlq)
+{
+	_loop = nullptr;
+	_fd = -1;
+	_uri = urlq;
+	_max_queue = 10000;
+	_quit = false;
+
+	std::map<std::string, std::string> params;
+	std::string url = SensoryNode::split_query(urlq, params);
+	for (const auto& pr : params)
+	{
+		if (0 == pr.first.compare("stream"))
+			_name = pr.second;
+		else if (0 == pr.first.compare("queue"))
+		{
+			char* end;
+			_max_queue = strtoul(pr.second.c_str(), &end, 10);
+			if (pr.second.empty() or *end or 0 == _max_queue)
+				throw RuntimeException(TRACE_INFO,
+					"Expecting a positive number for \"queue\" in \"%s\"\n",
+					urlq.c_str());
+		}
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown URL parameter \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+	}
+	if (_name.empty())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting ?stream=name in \"%s\"\n", urlq.c_str());
+
+	_fd = Framing::open_socket(url, false);
+	try
+	{
+		subscribe();
+	}
+	catch (...)
+	{
+		::close(_fd);
+		throw;
+	}
+
+	_loop = new std::thread(&RemoteStream::looper, this);
+}
+
+/// Ask for the stream, and wait for the answer.
+void RemoteStream::subscribe(void)
+{
+	std::string req;
+	Framing::put_frame(req, Framing::SUBSCRIBE, _name);
+	for (size_t off = 0; off < req.size(); )
+	{
+		ssize_t rc = send(_fd, req.data() + off, req.size() - off,
+		                  MSG_NOSIGNAL);
+		if (0 > rc and EINTR == errno) continue;
+		if (0 > rc)
+			throw RuntimeException(TRACE_INFO,
+				"Can't subscribe to \"%s\": %s\n",
+				_uri.c_str(), strerror(errno));
+		off += rc;
+	}
+
+	// Don't hang forever on a server that doesn't answer.
+	struct timeval tv = {10, 0};
+	setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	char buf[4096];
+	Framing::Kind kind;
+	size_t flen;
+	while (0 == (flen = Framing::get_frame(_inbuf.data(), _inbuf.size(), kind)))
+	{
+		ssize_t rc = recv(_fd, buf, sizeof(buf), 0);
+		if (0 > rc and EINTR == errno) continue;
+		if (0 >= rc)
+			throw RuntimeException(TRACE_INFO,
+				"No answer from \"%s\": %s\n", _uri.c_str(),
+				rc ? strerror(errno) : "connection closed");
+		_inbuf.append(buf, rc);
+	}
+
+	tv.tv_sec = 0;
+	setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	std::string body = _inbuf.substr(Framing::HEADER, flen - Framing::HEADER);
+	_inbuf.erase(0, flen);
+	if (Framing::OK == kind) return;
+
+	throw RuntimeException(TRACE_INFO,
+		"Can't subscribe to \"%s\": %s\n", _uri.c_str(),
+		Framing::ERROR == kind ? body.c_str() : "unexpected reply");
+}
+
+// ==============================================================
+
+/// Queue up the items in the frames that have arrived. Return false
+/// when the stream is over.
+bool RemoteStream::got_frames(void)
+{
+	size_t off = 0;
+	bool more = true;
+	while (more)
+	{
+		Framing::Kind kind;
+		size_t flen = Framing::get_frame(_inbuf.data() + off,
+			_inbuf.size() - off, kind);
+		if (0 == flen) break;
+
+		const char* body = _inbuf.data() + off + Framing::HEADER;
+		size_t blen = flen - Framing::HEADER;
+		off += flen;
+
+		if (Framing::ITEMS == kind)
+		{
+			for (ValuePtr& vp : Framing::get_items(body, blen))
+				push(std::move(vp));
+		}
+		else if (Framing::END == kind)
+			more = false;
+		else if (Framing::ERROR == kind)
+		{
+			SENSORY_WARN("RemoteStream: %s: %s", _uri.c_str(),
+				std::string(body, blen).c_str());
+			more = false;
+		}
+	}
+	_inbuf.erase(0, off);
+	return more;
+}
+
+void RemoteStream::looper(void)
+{
+	char buf[65536];
+	try
+	{
+		while (got_frames())
+		{
+			// Stop reading while the reader is behind. The server
+			// holds what comes next, up to its limit.
+			{
+				std::unique_lock<std::mutex> lck(_room_mtx);
+				_room.wait(lck, [this]
+					{ return _quit or
+						concurrent_queue<ValuePtr>::size() < _max_queue; });
+				if (_quit) break;
+			}
+
+			ssize_t rc = recv(_fd, buf, sizeof(buf), 0);
+			if (0 > rc and EINTR == errno) continue;
+			if (0 >= rc) break;
+			_inbuf.append(buf, rc);
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		SENSORY_ERROR("RemoteStream: %s: %s", _uri.c_str(), ex.what());
+	}
+
+	// Readers get what is left, and then an empty value.
+	concurrent_queue<ValuePtr>::close();
+}
+
+// ==============================================================
+
+/// Block until there is something to read, then return all of it.
+void RemoteStream::update() const
+{
+	try
+	{
+		std::deque<ValuePtr> vals =
+			const_cast<RemoteStream*>(this) -> wait_and_take_all();
+
+		// The looper checks for room with _room_mtx held; taking it
+		// here means the wakeup can't fall between check and wait.
+		{
+			std::lock_guard<std::mutex> lck(_room_mtx);
+		}
+		_room.notify_one();
+		_value.assign(vals.begin(), vals.end());
+		return;
+	}
+	catch (typename concurrent_queue<ValuePtr>::Canceled& e)
+	{}
+
+	// If we are here, the stream is over, and the queue is empty.
+	_value.clear();
+}
+
+ValuePtr RemoteStream::describe(AtomSpace* as, bool silent)
+{
+	throw RuntimeException(TRACE_INFO, "Not implemeneted");
+	return Handle::UNDEFINED;
+}
+
+ValuePtr RemoteStream::write_out(AtomSpace* as, bool silent,
+                                 const Handle& cref)
+{
+	throw RuntimeException(TRACE_INFO,
+		"RemoteStream is read-only: \"%s\"\n", _uri.c_str());
+	return Handle::UNDEFINED;
+}
+
+// ==============================================================
+
+// Adds factory when library is loaded.
+DEFINE_VALUE_FACTORY(REMOTE_STREAM, createRemoteStream, std::string)
+DEFINE_VALUE_FACTORY(REMOTE_STREAM, createRemoteStream, Handle)
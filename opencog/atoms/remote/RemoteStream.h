@@ -0,0 +1,99 @@
+/*
+ * opencog/atoms/remote/RemoteStream.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_REMOTE_STREAM_H
+#define _OPENCOG_REMOTE_STREAM_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <opencog/util/concurrent_queue.h>
+#include <opencog/atoms/sensory/OutputStream.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * RemoteStreams read a stream that a StreamServer, possibly in another
+ * process, is publishing. The URL names the server and the stream:
+ *    unix:///tmp/cog.sock?stream=irc
+ *    tcp://127.0.0.1:7722?stream=irc
+ * Opening fails if the stream is not being published. Reading blocks
+ * until something arrives, and then gives everything that has arrived.
+ * Once `?queue=N` items (default 10000) are waiting to be read, no
+ * more are read from the socket until they are; a server that is
+ * kept waiting too long drops the subscription.
+ * When the stream ends, is unpublished, or the server goes away, the
+ * rest is read out, followed by an empty value.
+ *
+ * RemoteStreams are read-only.
+ */
+class RemoteStream
+	: public OutputStream, protected concurrent_queue<ValuePtr>
+{
+private:
+	std::string _uri;
+	std::string _name;
+	int _fd;
+	std::string _inbuf;
+	std::thread* _loop;
+
+	// The looper waits for room here, when the queue is full.
+	size_t _max_queue;
+	bool _quit;
+	mutable std::mutex _room_mtx;
+	mutable std::condition_variable _room;
+
+	void init(const std::string&);
+	void subscribe(void);
+	bool got_frames(void);
+	void looper(void);
+
+protected:
+	virtual void update() const;
+
+public:
+	RemoteStream(const Handle&);
+	RemoteStream(const std::string&);
+	virtual ~RemoteStream();
+
+	virtual ValuePtr describe(AtomSpace*, bool);
+	virtual ValuePtr write_out(AtomSpace*, bool, const Handle&);
+};
+
+typedef std::shared_ptr<RemoteStream> RemoteStreamPtr;
+static inline RemoteStreamPtr RemoteStreamCast(ValuePtr& a)
+	{ return std::dynamic_pointer_cast<RemoteStream>(a); }
+
+template<typename ... Type>
+static inline std::shared_ptr<RemoteStream> createRemoteStream(Type&&... args) {
+   return std::make_shared<RemoteStream>(std::forward<Type>(args)...);
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_REMOTE_STREAM_H
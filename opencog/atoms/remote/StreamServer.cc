@@ -0,0 +1,604 @@
+/*
+ * opencog/atoms/remote/StreamServer.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h> // for strerror()
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/oc_assert.h>
+#include <opencog/atoms/base/Link.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+#include <opencog/atoms/value/ValueFactory.h>
+
+#include <opencog/atoms/sensory-types/sensory_types.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include <opencog/atoms/sensory/SensoryNode.h>
+#include "Framing.h"
+#include "StreamServer.h"
+
+using namespace opencog;
+
+namespace {
+
+/// A stream that is being served.
+struct Publication
+{
+	std::string name;
+	ValuePtr source;
+	std::atomic<bool> stop;
+	bool ended;
+	size_t items;
+	size_t frames;
+	size_t bytes;
+};
+typedef std::shared_ptr<Publication> PublicationPtr;
+
+/// A connection from a RemoteStream.
+struct Subscriber
+{
+	std::string name;     // Empty, until it subscribes.
+	std::string inbuf;
+	std::string outbuf;
+	size_t outpos;        // How much of outbuf was sent.
+	bool closing;         // Close, once outbuf is sent.
+};
+
+} // anonymous namespace
+
+/// State shared by the server, its I/O thread, and the threads that
+/// read the published streams. The latter block in the streams that
+/// they read, and cannot be woken; they hold on to the Hub, and exit
+/// when they next get something, and see that they are not wanted.
+struct StreamServer::Hub
+{
+	std::mutex mtx;
+	std::map<int, Subscriber> clients;
+	std::map<std::string, PublicationPtr> pubs;
+	int wake_fd;
+	size_t max_queue;
+	bool stop;
+
+	Hub(void) : max_queue(16*1024*1024), stop(false)
+	{
+		wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (0 > wake_fd)
+			throw RuntimeException(TRACE_INFO,
+				"Can't create eventfd: %s\n", strerror(errno));
+	}
+	~Hub() { close(wake_fd); }
+
+	void wake(void)
+	{
+		uint64_t one = 1;
+		if (write(wake_fd, &one, sizeof(one))) {}
+	}
+
+	void broadcast(const PublicationPtr&, const std::string&, size_t, bool);
+};
+
+/// Queue a frame for every subscriber of the publication. The I/O
+/// thread is woken only if it had nothing to send; otherwise it is
+/// busy sending already, and will pick this up in the same write.
+void StreamServer::Hub::broadcast(const PublicationPtr& pub,
+                                  const std::string& frame,
+                                  size_t nitems, bool end)
+{
+	bool poke = false;
+	{
+		std::lock_guard<std::mutex> lck(mtx);
+		pub->items += nitems;
+		pub->frames ++;
+		pub->bytes += frame.size();
+		if (end) pub->ended = true;
+
+		for (auto& pr : clients)
+		{
+			Subscriber& sub = pr.second;
+			if (sub.closing or sub.name != pub->name) continue;
+
+			size_t pending = sub.outbuf.size() - sub.outpos;
+			if (max_queue < pending)
+			{
+				SENSORY_WARN("StreamServer: dropping subscriber fd=%d to "
+					"\"%s\"; %zu bytes behind", pr.first,
+					pub->name.c_str(), pending);
+
+				// The frame that is partly sent has to be finished, or
+				// the reader would take the ERROR as the rest of it.
+				// The frames in outbuf start at zero.
+				size_t keep = 0;
+				while (keep < sub.outpos)
+				{
+					Framing::Kind kind;
+					keep += Framing::get_frame(sub.outbuf.data() + keep,
+						sub.outbuf.size() - keep, kind);
+				}
+				sub.outbuf.erase(keep);
+				Framing::put_frame(sub.outbuf, Framing::ERROR, "Too slow");
+				sub.closing = true;
+				poke = true;
+				continue;
+			}
+			if (0 == pending) poke = true;
+			sub.outbuf.append(frame);
+			if (end) sub.closing = true;
+		}
+	}
+	if (poke) wake();
+}
+
+/// Read the published stream, until it ends, or is unpublished.
+/// Each batch that the stream gives is encoded once, for everyone.
+static void pump(std::shared_ptr<StreamServer::Hub> hub, PublicationPtr pub)
+{
+	LinkValuePtr lvp(LinkValueCast(pub->source));
+	std::string frame;
+	while (not pub->stop)
+	{
+		ValueSeq vals;
+		try
+		{
+			vals = lvp->value();
+		}
+		catch (const std::exception& ex)
+		{
+			SENSORY_ERROR("StreamServer: reading \"%s\": %s",
+				pub->name.c_str(), ex.what());
+			break;
+		}
+		if (pub->stop) return;
+
+		// Same rules as OutputStream::write_content(): an empty
+		// list, or a list of empty lists, means the stream is done.
+		ValueSeq items;
+		items.reserve(vals.size());
+		for (const ValuePtr& v : vals)
+		{
+			if (v->is_type(LINK_VALUE) and 0 == v->size()) continue;
+			items.emplace_back(v);
+		}
+		if (0 == items.size()) break;
+
+		frame.clear();
+		Framing::put_items(frame, items);
+		hub->broadcast(pub, frame, items.size(), false);
+	}
+	if (pub->stop) return;
+
+	SENSORY_INFO("StreamServer: stream \"%s\" ended", pub->name.c_str());
+	frame.clear();
+	Framing::put_frame(frame, Framing::END, "");
+	hub->broadcast(pub, frame, 0, true);
+}
+
+// ==============================================================
+
+StreamServer::StreamServer(const std::string& str)
+	: OutputStream(STREAM_SERVER)
+{
+	init(str);
+}
+
+StreamServer::StreamServer(const Handle& senso)
+	: OutputStream(STREAM_SERVER)
+{
+	if (SENSORY_NODE != senso->get_type())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting SensoryNode, got %s\n", senso->to_string().c_str());
+
+	init(senso->get_name());
+}
+
+StreamServer::~StreamServer()
+{
+	if (nullptr == _loop) return;
+	{
+		std::lock_guard<std::mutex> lck(_hub->mtx);
+		_hub->stop = true;
+		for (auto& pr : _hub->pubs)
+			pr.second->stop = true;
+	}
+	_hub->wake();
+	_loop->join();
+	delete _loop;
+
+	for (auto& pr : _hub->clients)
+		close(pr.first);
+	_hub->clients.clear();
+	close(_listen);
+	if (not _path.empty())
+		unlink(_path.c_str());
+}
+
+/// The URL is one of
+///    unix:///path/to/socket
+///    tcp://127.0.0.1:port
+/// A TCP server accepts connections from anywhere that can reach the
+/// given address, so use a loopback address, unless you mean it.
+/// `?queue=16` sets how many megabytes may pile up for a subscriber
+/// that is not reading, before it is disconnected.
+void StreamServer::init(const std::string& urlq)
+{
+	_loop = nullptr;
+	_listen = -1;
+	_uri = urlq;
+	_hub = std::make_shared<Hub>();
+
+	std::map<std::string, std::string> params;
+	std::string url = SensoryNode::split_query(urlq, params);
+	for (const auto& pr : params)
+	{
+		char* end;
+		double num = strtod(pr.second.c_str(), &end);
+		if (pr.second.empty() or *end or num <= 0.0)
+			throw RuntimeException(TRACE_INFO,
+				"Expecting a number for \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+
+		if (0 == pr.first.compare("queue"))
+			_hub->max_queue = (size_t) (num * 1024.0 * 1024.0);
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown URL parameter \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+	}
+
+	_listen = Framing::open_socket(url, true);
+	fcntl(_listen, F_SETFL, fcntl(_listen, F_GETFL) | O_NONBLOCK);
+	if (0 == url.compare(0, 7, "unix://"))
+		_path = url.substr(7);
+
+	SENSORY_INFO("StreamServer: listening on %s", url.c_str());
+	_loop = new std::thread(&StreamServer::looper, this);
+}
+
+// ==============================================================
+
+/// Send what can be sent without blocking. Return false if the
+/// connection is done with, one way or another.
+static bool flush(int fd, Subscriber& sub)
+{
+	while (sub.outpos < sub.outbuf.size())
+	{
+		ssize_t rc = send(fd, sub.outbuf.data() + sub.outpos,
+			sub.outbuf.size() - sub.outpos, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (0 > rc)
+		{
+			if (EINTR == errno) continue;
+			if (EAGAIN == errno or EWOULDBLOCK == errno) return true;
+			return false;
+		}
+		sub.outpos += rc;
+	}
+	sub.outbuf.clear();
+	sub.outpos = 0;
+	return not sub.closing;
+}
+
+/// Handle the frames that a client sent. Return false if it should
+/// be dropped.
+static bool got_input(int fd, Subscriber& sub,
+                      const std::map<std::string, PublicationPtr>& pubs)
+{
+	while (true)
+	{
+		Framing::Kind kind;
+		size_t flen;
+		try
+		{
+			flen = Framing::get_frame(sub.inbuf.data(), sub.inbuf.size(), kind);
+		}
+		catch (const std::exception& ex)
+		{
+			SENSORY_WARN("StreamServer: garbage from fd=%d", fd);
+			return false;
+		}
+
+		// Subscription requests are short.
+		if (0 == flen) return sub.inbuf.size() < 4096;
+
+		std::string body = sub.inbuf.substr(Framing::HEADER,
+			flen - Framing::HEADER);
+		sub.inbuf.erase(0, flen);
+
+		if (Framing::SUBSCRIBE != kind) continue;
+		if (not sub.name.empty())
+		{
+			Framing::put_frame(sub.outbuf, Framing::ERROR, "Already subscribed");
+			sub.closing = true;
+			return true;
+		}
+
+		auto it = pubs.find(body);
+		if (pubs.end() == it or it->second->ended)
+		{
+			Framing::put_frame(sub.outbuf, Framing::ERROR,
+				"No such stream: " + body);
+			sub.closing = true;
+			return true;
+		}
+		sub.name = body;
+		Framing::put_frame(sub.outbuf, Framing::OK, "");
+		SENSORY_INFO("StreamServer: fd=%d subscribed to \"%s\"",
+			fd, body.c_str());
+	}
+}
+
+void StreamServer::looper(void)
+{
+	std::vector<struct pollfd> pfds;
+	char buf[65536];
+
+	while (true)
+	{
+		pfds.clear();
+		pfds.push_back({_listen, POLLIN, 0});
+		pfds.push_back({_hub->wake_fd, POLLIN, 0});
+		{
+			std::lock_guard<std::mutex> lck(_hub->mtx);
+			if (_hub->stop) return;
+
+			// Send whatever has been queued, and drop the
+			// connections that are done.
+			for (auto it = _hub->clients.begin(); it != _hub->clients.end(); )
+			{
+				if (flush(it->first, it->second))
+				{
+					short ev = POLLIN;
+					if (it->second.outpos < it->second.outbuf.size())
+						ev |= POLLOUT;
+					pfds.push_back({it->first, ev, 0});
+					it++;
+					continue;
+				}
+				close(it->first);
+				it = _hub->clients.erase(it);
+			}
+		}
+
+		int rc = poll(pfds.data(), pfds.size(), -1);
+		if (0 > rc)
+		{
+			if (EINTR == errno) continue;
+			SENSORY_ERROR("StreamServer: poll(): %s", strerror(errno));
+			return;
+		}
+
+		if (pfds[1].revents)
+		{
+			uint64_t cnt;
+			if (read(_hub->wake_fd, &cnt, sizeof(cnt))) {}
+		}
+
+		std::lock_guard<std::mutex> lck(_hub->mtx);
+		if (pfds[0].revents)
+		{
+			while (true)
+			{
+				int fd = accept4(_listen, nullptr, nullptr,
+				                 SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (0 > fd) break;
+				Subscriber& sub = _hub->clients[fd];
+				sub.outpos = 0;
+				sub.closing = false;
+			}
+		}
+
+		for (size_t i = 2; i < pfds.size(); i++)
+		{
+			if (0 == (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+
+			int fd = pfds[i].fd;
+			auto it = _hub->clients.find(fd);
+			if (_hub->clients.end() == it) continue;
+
+			ssize_t len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+			if (0 > len and (EINTR == errno or EAGAIN == errno))
+				continue;
+
+			bool keep = 0 < len;
+			if (keep)
+			{
+				it->second.inbuf.append(buf, len);
+				keep = got_input(fd, it->second, _hub->pubs);
+			}
+			if (not keep)
+			{
+				close(fd);
+				_hub->clients.erase(it);
+			}
+		}
+	}
+}
+
+// ==============================================================
+
+void StreamServer::publish(const std::string& name, const ValuePtr& src)
+{
+	if (nullptr == src or not src->is_type(LINK_STREAM_VALUE))
+		throw RuntimeException(TRACE_INFO,
+			"Expecting a stream to publish as \"%s\", got %s\n",
+			name.c_str(), src ? src->to_string().c_str() : "nothing");
+
+	PublicationPtr pub(std::make_shared<Publication>());
+	pub->name = name;
+	pub->source = src;
+	pub->stop = false;
+	pub->ended = false;
+	pub->items = 0;
+	pub->frames = 0;
+	pub->bytes = 0;
+	{
+		std::lock_guard<std::mutex> lck(_hub->mtx);
+		auto it = _hub->pubs.find(name);
+		if (_hub->pubs.end() != it and not it->second->ended)
+			throw RuntimeException(TRACE_INFO,
+				"Already publishing \"%s\"\n", name.c_str());
+		_hub->pubs[name] = pub;
+	}
+
+	std::thread(pump, _hub, pub).detach();
+	SENSORY_INFO("StreamServer: publishing \"%s\"", name.c_str());
+}
+
+void StreamServer::unpublish(const std::string& name)
+{
+	std::string frame;
+	Framing::put_frame(frame, Framing::END, "");
+	{
+		std::lock_guard<std::mutex> lck(_hub->mtx);
+		auto it = _hub->pubs.find(name);
+		if (_hub->pubs.end() == it) return;
+		it->second->stop = true;
+		_hub->pubs.erase(it);
+
+		for (auto& pr : _hub->clients)
+		{
+			Subscriber& sub = pr.second;
+			if (sub.closing or sub.name != name) continue;
+			sub.outbuf.append(frame);
+			sub.closing = true;
+		}
+	}
+	_hub->wake();
+	SENSORY_INFO("StreamServer: unpublished \"%s\"", name.c_str());
+}
+
+// ==============================================================
+
+/// Report on the published streams. This does not block.
+void StreamServer::update() const
+{
+	std::lock_guard<std::mutex> lck(_hub->mtx);
+	_value.clear();
+	for (const auto& pr : _hub->pubs)
+	{
+		const PublicationPtr& pub = pr.second;
+		size_t nsubs = 0;
+		for (const auto& cl : _hub->clients)
+			if (not cl.second.closing and cl.second.name == pub->name)
+				nsubs ++;
+
+		_value.emplace_back(createLinkValue(ValueSeq({
+			createStringValue(pub->name),
+			createFloatValue(std::vector<double>({
+				(double) nsubs, (double) pub->items, (double) pub->frames,
+				(double) pub->bytes, pub->ended ? 1.0 : 0.0}))})));
+	}
+}
+
+ValuePtr StreamServer::describe(AtomSpace* as, bool silent)
+{
+	throw RuntimeException(TRACE_INFO, "Not implemeneted");
+	return Handle::UNDEFINED;
+}
+
+static std::string get_word(const ValuePtr& vp)
+{
+	if (vp->is_node()) return HandleCast(vp)->get_name();
+	if (vp->is_type(STRING_VALUE))
+	{
+		const std::vector<std::string>& strs = StringValueCast(vp)->value();
+		if (1 == strs.size()) return strs[0];
+	}
+	return "";
+}
+
+/// Commands are (publish name stream) and (unpublish name). The
+/// members of the List are executed, so that the stream can be given
+/// by any expression that yields one.
+ValuePtr StreamServer::write_out(AtomSpace* as, bool silent,
+                                 const Handle& cref)
+{
+	ValueSeq args;
+	if (LIST_LINK == cref->get_type())
+	{
+		for (const Handle& h : cref->getOutgoingSet())
+		{
+			if (not h->is_executable())
+			{
+				args.emplace_back(h);
+				continue;
+			}
+			ValuePtr vp = h->execute(as, silent);
+			if (nullptr == vp)
+				throw RuntimeException(TRACE_INFO,
+					"Expecting something from %s\n", h->to_string().c_str());
+			args.emplace_back(vp);
+		}
+	}
+	else if (cref->is_executable())
+	{
+		ValuePtr content = cref->execute(as, silent);
+		if (content and content->is_type(LINK_VALUE) and
+		    not content->is_type(LINK_STREAM_VALUE))
+			args = LinkValueCast(content)->value();
+	}
+
+	std::string cmd = 0 < args.size() ? get_word(args[0]) : "";
+	std::string name = 1 < args.size() ? get_word(args[1]) : "";
+
+	if (0 == cmd.compare("publish") and 3 == args.size() and
+	    not name.empty())
+	{
+		publish(name, args[2]);
+		return args[2];
+	}
+	if (0 == cmd.compare("unpublish") and 2 == args.size() and
+	    not name.empty())
+	{
+		unpublish(name);
+		return cref;
+	}
+
+	throw RuntimeException(TRACE_INFO,
+		"Expecting (publish name stream) or (unpublish name), got %s\n",
+		cref->to_string().c_str());
+}
+
+// ==============================================================
+
+// Adds factory when library is loaded.
+DEFINE_VALUE_FACTORY(STREAM_SERVER, createStreamServer, std::string)
+DEFINE_VALUE_FACTORY(STREAM_SERVER, createStreamServer, Handle)
+
+// ====================================================================
+
+void opencog_sensory_remote_init(void)
+{
+	// Force shared lib ctors to run
+};
@@ -0,0 +1,105 @@
+/*
+ * opencog/atoms/remote/StreamServer.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_STREAM_SERVER_H
+#define _OPENCOG_STREAM_SERVER_H
+
+#include <memory>
+#include <thread>
+#include <opencog/atoms/sensory/OutputStream.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * StreamServers let other processes read local streams. A stream is
+ * published under a name, by writing
+ *    (List (Item "publish") (Item "irc") <something giving a stream>)
+ * to the server; the server then becomes the only reader of that
+ * stream, and sends whatever it reads to every RemoteStream that has
+ * subscribed to "irc". Thus one upstream connection (to IRC, to a log
+ * file) can feed many processes. `(List (Item "unpublish") (Item "irc"))`
+ * stops serving it.
+ *
+ * Subscribers get the items that arrive after they subscribe. Each
+ * batch read from the stream is encoded once, and sent to all of them;
+ * batches that pile up for a subscriber go out in a single write. A
+ * subscriber that falls too far behind is disconnected.
+ *
+ * Reading the server gives, for each published stream, its name and
+ * (FloatValue subscribers items frames bytes ended).
+ *
+ * See Framing.h for the wire format.
+ */
+class StreamServer
+	: public OutputStream
+{
+public:
+	struct Hub;
+
+private:
+	std::shared_ptr<Hub> _hub;
+	std::thread* _loop;
+	std::string _uri;
+	std::string _path;
+	int _listen;
+
+	void init(const std::string&);
+	void looper(void);
+
+protected:
+	virtual void update() const;
+
+public:
+	StreamServer(const Handle&);
+	StreamServer(const std::string&);
+	virtual ~StreamServer();
+
+	virtual ValuePtr describe(AtomSpace*, bool);
+	virtual ValuePtr write_out(AtomSpace*, bool, const Handle&);
+
+	/// C++ API, same as writing the commands.
+	void publish(const std::string&, const ValuePtr&);
+	void unpublish(const std::string&);
+};
+
+typedef std::shared_ptr<StreamServer> StreamServerPtr;
+static inline StreamServerPtr StreamServerCast(ValuePtr& a)
+	{ return std::dynamic_pointer_cast<StreamServer>(a); }
+
+template<typename ... Type>
+static inline std::shared_ptr<StreamServer> createStreamServer(Type&&... args) {
+   return std::make_shared<StreamServer>(std::forward<Type>(args)...);
+}
+
+/** @}*/
+} // namespace opencog
+
+extern "C" {
+void opencog_sensory_remote_init(void);
+};
+
+#endif // _OPENCOG_STREAM_SERVER_H
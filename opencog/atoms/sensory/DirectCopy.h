@@ -0,0 +1,91 @@
+/*
+ * opencog/atoms/sensory/DirectCopy.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_DIRECT_COPY_H
+#define _OPENCOG_DIRECT_COPY_H
+
+#include <opencog/atoms/sensory/OutputStream.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * Copy loop for writing one stream into another of the same C++ class.
+ * OutputStream::write_content() reads the source through the virtual
+ * update(), and writes each item through the virtual prt_value() and
+ * do_write(). When both ends are known to be exactly a `Stream`, the
+ * calls can be qualified instead, so that they are neither virtual nor
+ * opaque to the compiler. Devices can go further, by specializing
+ * `loop()`; the TextFileStream does, and copies lines without making
+ * ItemNodes for them.
+ *
+ * A `Stream` using this must befriend `DirectCopy<Stream>`, and must
+ * not be derived from by other streams that give the same type; the
+ * Atomese type is what is checked.
+ */
+template<class Stream>
+class DirectCopy
+{
+	static void loop(Stream* sink, const Stream* src);
+
+public:
+	/// Copy `content` into `sink`, if both are exactly of type `t`.
+	/// Returns false, having done nothing, if they are not; the
+	/// caller should then use OutputStream::write_content().
+	static bool copy(Stream* sink, const ValuePtr& content, Type t)
+	{
+		if (t != sink->get_type() or t != content->get_type())
+			return false;
+		loop(sink, static_cast<const Stream*>(content.get()));
+		return true;
+	}
+};
+
+/// Same as the loop in OutputStream::write_content()
+template<class Stream>
+void DirectCopy<Stream>::loop(Stream* sink, const Stream* src)
+{
+	while (true)
+	{
+		src->Stream::update();
+		const ValueSeq& vals = src->_value;
+		if (0 == vals.size()) break;
+
+		size_t nprinted = 0;
+		for (const ValuePtr& v : vals)
+		{
+			if (v->is_type(LINK_VALUE) and 0 == v->size()) continue;
+			sink->Stream::prt_value(v);
+			nprinted ++;
+		}
+		if (0 == nprinted) break;
+	}
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_DIRECT_COPY_H
@@ -0,0 +1,89 @@
+/*
+ * opencog/atoms/sensory/ItemStream.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/oc_assert.h>
+#include <opencog/atoms/value/ValueFactory.h>
+
+#include <opencog/atoms/sensory-types/sensory_types.h>
+#include "ItemStream.h"
+
+using namespace opencog;
+
+ItemStream::ItemStream(void)
+	: LinkStreamValue(ITEM_STREAM)
+{
+}
+
+ItemStream::~ItemStream()
+{
+}
+
+// ==============================================================
+
+void ItemStream::add(const ValuePtr& vp)
+{
+	push(vp);
+}
+
+void ItemStream::add(ValuePtr&& vp)
+{
+	push(std::move(vp));
+}
+
+/// No more items will be added. Readers drain whatever is left,
+/// and then get an empty value.
+void ItemStream::close(void)
+{
+	concurrent_queue<ValuePtr>::close();
+}
+
+// ==============================================================
+
+/// Block until there is something to read, then return all of it.
+void ItemStream::update() const
+{
+	try
+	{
+		std::deque<ValuePtr> vals =
+			const_cast<ItemStream*>(this) -> wait_and_take_all();
+		_value.assign(vals.begin(), vals.end());
+		return;
+	}
+	catch (typename concurrent_queue<ValuePtr>::Canceled& e)
+	{}
+
+	// If we are here, the producer is done, and the queue is empty.
+	_value.clear();
+}
+
+// ==============================================================
+
+bool ItemStream::operator==(const Value& other) const
+{
+	// Streams are equal only to themselves.
+	return this == &other;
+}
+
+// ==============================================================
+
+// Adds factory when library is loaded.
+DEFINE_VALUE_FACTORY(ITEM_STREAM, createItemStream)
@@ -0,0 +1,73 @@
+/*
+ * opencog/atoms/sensory/ItemStream.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_ITEM_STREAM_H
+#define _OPENCOG_ITEM_STREAM_H
+
+#include <opencog/util/concurrent_queue.h>
+#include <opencog/atoms/value/LinkStreamValue.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * ItemStreams deliver items that are produced by some other thread,
+ * e.g. the results of a long-running command. Readers block until
+ * something is available, and then get everything that is available.
+ * An empty value means that the producer closed the stream, and
+ * that everything has been read.
+ */
+class ItemStream
+	: public LinkStreamValue, protected concurrent_queue<ValuePtr>
+{
+protected:
+	virtual void update() const;
+
+public:
+	ItemStream(void);
+	virtual ~ItemStream();
+
+	/// Producer API.
+	void add(const ValuePtr&);
+	void add(ValuePtr&&);
+	void close(void);
+
+	virtual bool operator==(const Value&) const;
+};
+
+typedef std::shared_ptr<ItemStream> ItemStreamPtr;
+static inline ItemStreamPtr ItemStreamCast(ValuePtr& a)
+	{ return std::dynamic_pointer_cast<ItemStream>(a); }
+
+template<typename ... Type>
+static inline std::shared_ptr<ItemStream> createItemStream(Type&&... args) {
+   return std::make_shared<ItemStream>(std::forward<Type>(args)...);
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_ITEM_STREAM_H
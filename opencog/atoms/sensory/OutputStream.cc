@@ -29,6 +29,7 @@
 #include <opencog/atoms/value/StringValue.h>
 
 #include <opencog/atoms/sensory-types/sensory_types.h>
+#include "SensoryLog.h"
 #include "OutputStream.h"
 
 using namespace opencog;
@@ -42,7 +43,7 @@ OutputStream::OutputStream(Type t)
 
 OutputStream::~OutputStream()
 {
-	printf ("OutputStream dtor\n");
+	SENSORY_TRACE("OutputStream dtor");
 }
 
 // ==============================================================
@@ -98,16 +99,27 @@ void OutputStream::prt_value(const ValuePtr& content)
 ValuePtr OutputStream::do_write_out(AtomSpace* as, bool silent,
                                     const Handle& cref)
 {
-	ValuePtr content = cref;
-	if (cref->is_executable())
-	{
-		content = cref->execute(as, silent);
-		if (nullptr == content)
-			throw RuntimeException(TRACE_INFO,
-				"Expecting something to write from %s\n",
-				cref->to_string().c_str());
-	}
+	return write_content(get_content(as, silent, cref));
+}
+
+/// Get the content to write: the result of executing cref, if it
+/// is executable, else cref itself.
+ValuePtr OutputStream::get_content(AtomSpace* as, bool silent,
+                                   const Handle& cref)
+{
+	if (not cref->is_executable()) return cref;
 
+	ValuePtr content = cref->execute(as, silent);
+	if (nullptr == content)
+		throw RuntimeException(TRACE_INFO,
+			"Expecting something to write from %s\n",
+			cref->to_string().c_str());
+	return content;
+}
+
+/// Write out content that has already been executed.
+ValuePtr OutputStream::write_content(const ValuePtr& content)
+{
 	// If it is not a stream, then just print and return.
 	if (not content->is_type(LINK_STREAM_VALUE))
 	{
@@ -28,6 +28,8 @@
 namespace opencog
 {
 
+template<class> class DirectCopy;
+
 /** \addtogroup grp_atomspace
  *  @{
  */
@@ -46,6 +48,8 @@ protected:
 	virtual void do_write(const std::string&);
 	virtual void prt_value(const ValuePtr&);
 	virtual ValuePtr do_write_out(AtomSpace*, bool, const Handle&);
+	ValuePtr get_content(AtomSpace*, bool, const Handle&);
+	ValuePtr write_content(const ValuePtr&);
 
 public:
 	virtual ~OutputStream();
@@ -0,0 +1,292 @@
+/*
+ * opencog/atoms/sensory/SensoryLog.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "SensoryLog.h"
+
+using namespace opencog;
+
+// ==============================================================
+// The ring. This is a bounded multi-producer queue, in the style of
+// Dmitry Vyukov: each slot carries a sequence number that says whose
+// turn it is, so producers claim slots with one compare-and-swap, and
+// never wait on each other. There is only one consumer.
+
+#define RING_SLOTS 2048          // Must be a power of two.
+#define SLOT_CHARS 500
+
+namespace {
+
+struct Slot
+{
+	std::atomic<size_t> seq;
+	int level;
+	struct timespec ts;
+	char msg[SLOT_CHARS];
+};
+
+struct Ring
+{
+	Slot slots[RING_SLOTS];
+	alignas(64) std::atomic<size_t> head;   // Next slot to claim.
+	alignas(64) size_t tail;                // Next slot to write out.
+	std::atomic<size_t> dropped;
+
+	Ring(void) : head(0), tail(0), dropped(0)
+	{
+		for (size_t i = 0; i < RING_SLOTS; i++)
+			slots[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	Slot* claim(void)
+	{
+		size_t pos = head.load(std::memory_order_relaxed);
+		while (true)
+		{
+			Slot* s = &slots[pos & (RING_SLOTS - 1)];
+			size_t seq = s->seq.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+			if (0 == dif)
+			{
+				if (head.compare_exchange_weak(pos, pos + 1,
+				                               std::memory_order_relaxed))
+					return s;
+			}
+			else if (dif < 0)
+				return nullptr;  // Full.
+			else
+				pos = head.load(std::memory_order_relaxed);
+		}
+	}
+
+	void publish(Slot* s)
+	{
+		size_t pos = s->seq.load(std::memory_order_relaxed);
+		s->seq.store(pos + 1, std::memory_order_release);
+	}
+
+	Slot* peek(void)
+	{
+		Slot* s = &slots[tail & (RING_SLOTS - 1)];
+		if (s->seq.load(std::memory_order_acquire) != tail + 1)
+			return nullptr;
+		return s;
+	}
+
+	void release(Slot* s)
+	{
+		s->seq.store(tail + RING_SLOTS, std::memory_order_release);
+		tail++;
+	}
+};
+
+// ==============================================================
+
+class Writer
+{
+	Ring _ring;
+	std::mutex _mtx;          // Guards the output file, not the ring.
+	FILE* _out;
+	bool _own;
+	std::atomic<bool> _stop;
+	std::atomic<size_t> _written;
+	std::thread _thr;
+
+	void drain(void);
+	void loop(void);
+
+public:
+	Writer(void);
+	~Writer();
+	void put(int, const char*, va_list);
+	void set_path(const std::string&);
+	void flush(void);
+};
+
+static const char* _lvl_name[] = { "ERROR", "WARN", "INFO", "DEBUG", "TRACE" };
+
+Writer::Writer(void) :
+	_out(stderr), _own(false), _stop(false), _written(0)
+{
+	const char* path = getenv("SENSORY_LOG_FILE");
+	if (path and *path) set_path(path);
+	_thr = std::thread(&Writer::loop, this);
+}
+
+Writer::~Writer()
+{
+	_stop = true;
+	_thr.join();
+	drain();
+	if (_own) fclose(_out);
+}
+
+void Writer::set_path(const std::string& path)
+{
+	FILE* fh = stderr;
+	if (not path.empty())
+	{
+		fh = fopen(path.c_str(), "a");
+		if (nullptr == fh) return;
+	}
+
+	std::lock_guard<std::mutex> lck(_mtx);
+	if (_own) fclose(_out);
+	_out = fh;
+	_own = (stderr != fh);
+}
+
+void Writer::put(int lvl, const char* fmt, va_list ap)
+{
+	Slot* s = _ring.claim();
+	if (nullptr == s)
+	{
+		_ring.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	s->level = lvl;
+	clock_gettime(CLOCK_REALTIME, &s->ts);
+	vsnprintf(s->msg, SLOT_CHARS, fmt, ap);
+	_ring.publish(s);
+}
+
+/// Write out everything in the ring. Only the writer thread calls
+/// this, except at shutdown, after the writer thread is gone.
+void Writer::drain(void)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	size_t n = 0;
+	Slot* s;
+	while ((s = _ring.peek()))
+	{
+		struct tm tmv;
+		localtime_r(&s->ts.tv_sec, &tmv);
+		char stamp[32];
+		strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tmv);
+
+		// Don't double up on newlines.
+		size_t len = strnlen(s->msg, SLOT_CHARS);
+		while (0 < len and '\n' == s->msg[len-1]) len--;
+
+		int lvl = (0 <= s->level and s->level <= SENSORY_LOG_TRACE) ?
+			s->level : SENSORY_LOG_TRACE;
+		fprintf(_out, "[%s.%03ld] [%s] %.*s\n", stamp,
+			s->ts.tv_nsec / 1000000, _lvl_name[lvl], (int) len, s->msg);
+		_ring.release(s);
+		n++;
+	}
+
+	size_t lost = _ring.dropped.exchange(0);
+	if (lost)
+		fprintf(_out, "[sensory log: %zu messages dropped]\n", lost);
+
+	if (n or lost) fflush(_out);
+	_written.fetch_add(n, std::memory_order_release);
+}
+
+void Writer::loop(void)
+{
+	// Poll, backing off when idle. Producers never signal us; that
+	// would need a lock or a system call on their side.
+	int naps = 1;
+	while (not _stop)
+	{
+		if (_ring.peek())
+		{
+			drain();
+			naps = 1;
+			continue;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(naps));
+		if (naps < 50) naps *= 2;
+	}
+}
+
+void Writer::flush(void)
+{
+	size_t target = _ring.head.load();
+	while (_written.load(std::memory_order_acquire) < target and not _stop)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+// Created on first use, so that logging from static constructors
+// works.
+static Writer& writer(void)
+{
+	static Writer w;
+	return w;
+}
+
+} // anonymous namespace
+
+// ==============================================================
+
+static int initial_level(void)
+{
+	int lvl = SENSORY_LOG_LEVEL;
+	const char* env = getenv("SENSORY_LOG_LEVEL");
+	if (nullptr == env or 0 == *env) return lvl;
+
+	for (int i = 0; i <= SENSORY_LOG_TRACE; i++)
+		if (0 == strcasecmp(env, _lvl_name[i]))
+			return std::min(i, lvl);
+	if ('0' <= env[0] and env[0] <= '9')
+		return std::min(atoi(env), lvl);
+	return lvl;
+}
+
+std::atomic<int> SensoryLog::_level(initial_level());
+
+void SensoryLog::log(int lvl, const char* fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	writer().put(lvl, fmt, ap);
+	va_end(ap);
+}
+
+void SensoryLog::set_level(int lvl)
+{
+	// Anything above the compile-time level isn't there to be enabled.
+	_level = std::min(lvl, SENSORY_LOG_LEVEL);
+}
+
+void SensoryLog::set_path(const std::string& path)
+{
+	writer().set_path(path);
+}
+
+void SensoryLog::flush(void)
+{
+	writer().flush();
+}
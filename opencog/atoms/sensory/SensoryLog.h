@@ -0,0 +1,125 @@
+/*
+ * opencog/atoms/sensory/SensoryLog.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SENSORY_LOG_H
+#define _OPENCOG_SENSORY_LOG_H
+
+#include <atomic>
+#include <string>
+
+/**
+ * Leveled logging for the sensory modules.
+ *
+ * Messages above the compile-time level SENSORY_LOG_LEVEL are compiled
+ * out entirely; the arguments are not even evaluated. Messages at or
+ * below it are also checked against a run-time level, which defaults
+ * to the compile-time level, and can be lowered (but not raised).
+ *
+ * Logging never blocks and never does I/O on the calling thread. The
+ * message is formatted into a slot of a fixed-size, lock-free ring,
+ * and a background thread writes the slots out. If the ring is full,
+ * the message is dropped, and counted; the count of dropped messages
+ * is written out when there is room again.
+ *
+ * The destination is stderr, unless the environment variable
+ * SENSORY_LOG_FILE names a file, or SensoryLog::set_path() is called.
+ * SENSORY_LOG_LEVEL in the environment sets the run-time level, by
+ * name ("error", "warn", "info", "debug", "trace") or number.
+ */
+
+#define SENSORY_LOG_ERROR 0
+#define SENSORY_LOG_WARN  1
+#define SENSORY_LOG_INFO  2
+#define SENSORY_LOG_DEBUG 3
+#define SENSORY_LOG_TRACE 4
+
+#ifndef SENSORY_LOG_LEVEL
+#define SENSORY_LOG_LEVEL SENSORY_LOG_INFO
+#endif
+
+#define SENSORY_LOG_AT(LVL, ...) \
+	do { if (opencog::SensoryLog::enabled(LVL)) \
+		opencog::SensoryLog::log(LVL, __VA_ARGS__); } while (0)
+
+#define SENSORY_ERROR(...) SENSORY_LOG_AT(SENSORY_LOG_ERROR, __VA_ARGS__)
+
+#if SENSORY_LOG_LEVEL >= SENSORY_LOG_WARN
+#define SENSORY_WARN(...) SENSORY_LOG_AT(SENSORY_LOG_WARN, __VA_ARGS__)
+#else
+#define SENSORY_WARN(...) do {} while (0)
+#endif
+
+#if SENSORY_LOG_LEVEL >= SENSORY_LOG_INFO
+#define SENSORY_INFO(...) SENSORY_LOG_AT(SENSORY_LOG_INFO, __VA_ARGS__)
+#else
+#define SENSORY_INFO(...) do {} while (0)
+#endif
+
+#if SENSORY_LOG_LEVEL >= SENSORY_LOG_DEBUG
+#define SENSORY_DEBUG(...) SENSORY_LOG_AT(SENSORY_LOG_DEBUG, __VA_ARGS__)
+#else
+#define SENSORY_DEBUG(...) do {} while (0)
+#endif
+
+#if SENSORY_LOG_LEVEL >= SENSORY_LOG_TRACE
+#define SENSORY_TRACE(...) SENSORY_LOG_AT(SENSORY_LOG_TRACE, __VA_ARGS__)
+#else
+#define SENSORY_TRACE(...) do {} while (0)
+#endif
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+class SensoryLog
+{
+private:
+	static std::atomic<int> _level;
+
+public:
+	static bool enabled(int lvl)
+	{
+		return lvl <= _level.load(std::memory_order_relaxed);
+	}
+
+	/// printf-style. Messages longer than a ring slot are truncated.
+	static void log(int lvl, const char* fmt, ...)
+		__attribute__((format(printf, 2, 3)));
+
+	static void set_level(int);
+	static int get_level(void) { return _level.load(); }
+
+	/// Send output to the named file (appending), or to stderr if
+	/// the path is empty. Takes effect for messages not yet written.
+	static void set_path(const std::string&);
+
+	/// Wait until everything logged so far has been written out.
+	static void flush(void);
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_SENSORY_LOG_H
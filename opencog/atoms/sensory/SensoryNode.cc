@@ -48,6 +48,59 @@ std::string SensoryNode::monitor(void)
 
 // ====================================================================
 
+static int hexval(char c)
+{
+	if ('0' <= c and c <= '9') return c - '0';
+	if ('a' <= c and c <= 'f') return c - 'a' + 10;
+	if ('A' <= c and c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static std::string percent_decode(const std::string& str)
+{
+	std::string out;
+	out.reserve(str.size());
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		if ('%' == str[i] and i + 2 < str.size() and
+		    0 <= hexval(str[i+1]) and 0 <= hexval(str[i+2]))
+		{
+			out.push_back((char) (16 * hexval(str[i+1]) + hexval(str[i+2])));
+			i += 2;
+		}
+		else
+			out.push_back(str[i]);
+	}
+	return out;
+}
+
+std::string SensoryNode::split_query(const std::string& url,
+                                     std::map<std::string, std::string>& params)
+{
+	size_t qm = url.find('?');
+	if (std::string::npos == qm) return url;
+
+	size_t pos = qm + 1;
+	while (pos < url.size())
+	{
+		size_t amp = url.find('&', pos);
+		if (std::string::npos == amp) amp = url.size();
+		std::string kv = url.substr(pos, amp - pos);
+		pos = amp + 1;
+		if (kv.empty()) continue;
+
+		size_t eq = kv.find('=');
+		if (std::string::npos == eq)
+			params[percent_decode(kv)] = "";
+		else
+			params[percent_decode(kv.substr(0, eq))] =
+				percent_decode(kv.substr(eq + 1));
+	}
+	return url.substr(0, qm);
+}
+
+// ====================================================================
+
 void opencog_sensory_init(void)
 {
    // Force shared lib ctors to run
@@ -23,6 +23,8 @@
 #ifndef _OPENCOG_SENSORY_NODE_H
 #define _OPENCOG_SENSORY_NODE_H
 
+#include <map>
+#include <string>
 #include <opencog/atoms/base/Node.h>
 #include <opencog/atoms/sensory-types/sensory_types.h>
 
@@ -43,6 +45,16 @@ public:
 	 * Return debug diagnostics and/or performance monitoring stats.
 	 */
 	virtual std::string monitor(void);
+
+	/**
+	 * Split off the query string of a URL, such as the `?tail=100`
+	 * in `file:///var/log/syslog?tail=100`. Returns the URL without
+	 * the query; the parameters are placed in `params`. Keys without
+	 * a value (e.g. `?reverse`) map to the empty string. Values are
+	 * percent-decoded, so that `?delim=%00` is a NUL byte.
+	 */
+	static std::string split_query(const std::string& url,
+	                               std::map<std::string, std::string>& params);
 };
 
 NODE_PTR_DECL(SensoryNode)
@@ -0,0 +1,128 @@
+/*
+ * opencog/atoms/sensory/Spawn.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h> // for strerror()
+#include <time.h>
+#include <unistd.h>
+
+#include <opencog/util/exceptions.h>
+
+#include "Spawn.h"
+
+using namespace opencog;
+
+// Since glibc 2.34; older ones leave the fds that are not
+// close-on-exec open in the child.
+#if defined(__GLIBC__) && \
+    (2 < __GLIBC__ || (2 == __GLIBC__ && 34 <= __GLIBC_MINOR__))
+#define HAVE_ADDCLOSEFROM 1
+#endif
+
+pid_t opencog::spawn_process(const std::vector<std::string>& argv,
+                             const SpawnFdMap& fds)
+{
+	if (argv.empty())
+		throw RuntimeException(TRACE_INFO, "Nothing to spawn\n");
+
+	int high = 2;
+	for (const auto& pr : fds) if (high < pr.second) high = pr.second;
+
+	posix_spawn_file_actions_t acts;
+	posix_spawn_file_actions_init(&acts);
+
+	// Move the fds out of the way, first, in case some of them sit
+	// where others are to go. The copies are close-on-exec.
+	std::vector<int> tmp;
+	int err = 0;
+	for (const auto& pr : fds)
+	{
+		int t = fcntl(pr.first, F_DUPFD_CLOEXEC, high + 1);
+		if (0 > t) { err = errno; break; }
+		tmp.push_back(t);
+		posix_spawn_file_actions_adddup2(&acts, t, pr.second);
+	}
+
+	// Close everything else that is not close-on-exec.
+	for (int fd = 3; fd <= high; fd++)
+	{
+		bool target = false;
+		for (const auto& pr : fds) if (fd == pr.second) target = true;
+		if (not target) posix_spawn_file_actions_addclose(&acts, fd);
+	}
+#ifdef HAVE_ADDCLOSEFROM
+	posix_spawn_file_actions_addclosefrom_np(&acts, high + 1);
+#endif
+
+	// Start with a clean slate: SIG_IGN and the signal mask would
+	// otherwise be inherited across exec.
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t none, all;
+	sigemptyset(&none);
+	sigfillset(&all);
+	posix_spawnattr_setsigmask(&attr, &none);
+	posix_spawnattr_setsigdefault(&attr, &all);
+	posix_spawnattr_setflags(&attr,
+		POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	std::vector<char*> args;
+	for (const std::string& arg : argv)
+		args.push_back(const_cast<char*>(arg.c_str()));
+	args.push_back(nullptr);
+
+	pid_t pid = 0;
+	if (0 == err)
+		err = posix_spawnp(&pid, args[0], &acts, &attr, args.data(), environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&acts);
+	for (int t : tmp) close(t);
+
+	if (err)
+		throw RuntimeException(TRACE_INFO,
+			"Can't start %s: %s\n", argv[0].c_str(), strerror(err));
+	return pid;
+}
+
+int opencog::reap_process(pid_t pid, int timeout_ms)
+{
+	int status = 0;
+	if (0 >= pid) return status;
+
+	struct timespec tick = { 0, 10*1000*1000 };
+	for (int waited = 0; waited < timeout_ms; waited += 10)
+	{
+		pid_t rc = waitpid(pid, &status, WNOHANG);
+		if (pid == rc or (0 > rc and EINTR != errno)) return status;
+		nanosleep(&tick, nullptr);
+	}
+
+	// Not yet reaped, so the pid is still ours.
+	kill(pid, SIGKILL);
+	while (0 > waitpid(pid, &status, 0) and EINTR == errno) {}
+	return status;
+}
@@ -0,0 +1,74 @@
+/*
+ * opencog/atoms/sensory/Spawn.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SPAWN_H
+#define _OPENCOG_SPAWN_H
+
+#include <sys/types.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/// Pairs of (our fd, the fd number it is to have in the child).
+typedef std::vector<std::pair<int, int>> SpawnFdMap;
+
+/**
+ * Start a process running `argv` (xterms, helpers), without forking
+ * the AtomSpace.
+ *
+ * Forking a process with a heap of many gigabytes is slow, as all of
+ * its page tables are copied, and memory use spikes until the child
+ * gets around to calling exec(). glibc's posix_spawn() does not copy
+ * them (it uses CLONE_VM), and so costs the same, no matter how big
+ * the heap.
+ *
+ * argv[0] is looked up on the PATH. The new process gets the given
+ * file descriptors, and stdin, stdout and stderr, unless these are
+ * given; it has no others. Signal dispositions and the signal mask are
+ * reset to the defaults. Returns the pid. Throws if it could not be
+ * started.
+ *
+ * The process is our child, and must be reaped with reap_process().
+ * Until then, its pid can't be reused, so it is always safe to signal.
+ */
+pid_t spawn_process(const std::vector<std::string>& argv,
+                    const SpawnFdMap& fds = SpawnFdMap());
+
+/**
+ * Wait up to `timeout_ms` milliseconds for a process started with
+ * spawn_process() to exit, then kill it with SIGKILL, if it has not,
+ * and reap it. With a zero timeout, it is killed at once. Returns
+ * the wait status.
+ */
+int reap_process(pid_t, int timeout_ms = 0);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_SPAWN_H
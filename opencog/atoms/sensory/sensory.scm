@@ -15,14 +15,30 @@
 	(string-append opencog-ext-path-sensory "libsensory")
 	"opencog_sensory_init")
 
+(load-extension
+	(string-append opencog-ext-path-sensory "libsensory-bus")
+	"opencog_sensory_bus_init")
+
 (load-extension
 	(string-append opencog-ext-path-sensory "libsensory-filedir")
 	"opencog_sensory_filedir_init")
 
+(load-extension
+	(string-append opencog-ext-path-sensory "libsensory-http")
+	"opencog_sensory_http_init")
+
 (load-extension
 	(string-append opencog-ext-path-sensory "libsensory-irc")
 	"opencog_sensory_irc_init")
 
+(load-extension
+	(string-append opencog-ext-path-sensory "libsensory-remote")
+	"opencog_sensory_remote_init")
+
+(load-extension
+	(string-append opencog-ext-path-sensory "libsensory-sqlite")
+	"opencog_sensory_sqlite_init")
+
 (load-extension
 	(string-append opencog-ext-path-sensory "libsensory-terminal")
 	"opencog_sensory_terminal_init")
@@ -0,0 +1,459 @@
+/*
+ * opencog/atoms/sqlite/SqliteStream.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#ifdef HAVE_SQLITE3
+#include <sqlite3.h>
+#endif
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+#include <opencog/atoms/value/ValueFactory.h>
+
+#include <opencog/atoms/sensory-types/sensory_types.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include <opencog/atoms/sensory/SensoryNode.h>
+#include "SqliteStream.h"
+
+using namespace opencog;
+
+SqliteStream::SqliteStream(const std::string& str)
+	: OutputStream(SQLITE_STREAM)
+{
+	init(str);
+}
+
+SqliteStream::SqliteStream(const Handle& senso)
+	: OutputStream(SQLITE_STREAM)
+{
+	if (SENSORY_NODE != senso->get_type())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting SensoryNode, got %s\n", senso->to_string().c_str());
+
+	init(senso->get_name());
+}
+
+#ifndef HAVE_SQLITE3
+
+// ==============================================================
+// Built without SQLite.
+
+SqliteStream::~SqliteStream() {}
+
+void SqliteStream::init(const std::string& url)
+{
+	_db = nullptr;
+	_cursor = nullptr;
+	throw RuntimeException(TRACE_INFO,
+		"Built without SQLite; cannot open \"%s\"\n", url.c_str());
+}
+
+void SqliteStream::update() const { _value.clear(); }
+
+ValuePtr SqliteStream::query(const std::string&, const ValueSeq&)
+{
+	return nullptr;
+}
+
+#else // HAVE_SQLITE3
+
+SqliteStream::~SqliteStream()
+{
+	for (const Entry& ent : _lru)
+		sqlite3_finalize(ent.second);
+	sqlite3_close(_db);
+}
+
+/// The URL is the path to the database file:
+///    sqlite:///var/lib/facts.db?readonly&batch=500
+void SqliteStream::init(const std::string& urlq)
+{
+	_db = nullptr;
+	_cursor = nullptr;
+	_fresh = false;
+	_batch = 1000;
+	_cache_size = 64;
+	_names = false;
+
+	if (0 != urlq.compare(0, 10, "sqlite:///"))
+		throw RuntimeException(TRACE_INFO,
+			"Unsupported URL \"%s\"\n", urlq.c_str());
+	_uri = urlq;
+
+	int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX;
+	std::map<std::string, std::string> params;
+	std::string url = SensoryNode::split_query(urlq, params);
+	for (const auto& pr : params)
+	{
+		if (0 == pr.first.compare("readonly") and pr.second.empty())
+			flags = (flags & ~SQLITE_OPEN_READWRITE) | SQLITE_OPEN_READONLY;
+		else if (0 == pr.first.compare("create") and pr.second.empty())
+			flags |= SQLITE_OPEN_CREATE;
+		else if (0 == pr.first.compare("names") and pr.second.empty())
+			_names = true;
+		else if (0 == pr.first.compare("batch") or
+		         0 == pr.first.compare("cache"))
+		{
+			char* end;
+			size_t num = strtoul(pr.second.c_str(), &end, 10);
+			if (pr.second.empty() or *end or 0 == num)
+				throw RuntimeException(TRACE_INFO,
+					"Expecting a number for \"%s\" in \"%s\"\n",
+					pr.first.c_str(), urlq.c_str());
+			if ('b' == pr.first[0]) _batch = num;
+			else _cache_size = num;
+		}
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown URL parameter \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+	}
+	if ((flags & SQLITE_OPEN_READONLY) and (flags & SQLITE_OPEN_CREATE))
+		throw RuntimeException(TRACE_INFO,
+			"Can't both create and be read-only: \"%s\"\n", urlq.c_str());
+
+	// Ignore the first 9 chars "sqlite://"
+	std::string path = url.substr(9);
+	int rc = sqlite3_open_v2(path.c_str(), &_db, flags, nullptr);
+	if (SQLITE_OK != rc)
+	{
+		std::string err = _db ? sqlite3_errmsg(_db) : sqlite3_errstr(rc);
+		sqlite3_close(_db);
+		throw RuntimeException(TRACE_INFO,
+			"Can't open \"%s\": %s\n", path.c_str(), err.c_str());
+	}
+
+	// Wait a while for other writers, instead of failing at once.
+	sqlite3_busy_timeout(_db, 5000);
+}
+
+// ==============================================================
+
+/// Get the prepared statement for the SQL, from the cache if it's
+/// there. The caller holds the lock.
+sqlite3_stmt* SqliteStream::prepare(const std::string& sql)
+{
+	auto it = _cache.find(sql);
+	if (_cache.end() != it)
+	{
+		_lru.splice(_lru.begin(), _lru, it->second);
+		sqlite3_stmt* stmt = it->second->second;
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+		return stmt;
+	}
+
+	sqlite3_stmt* stmt = nullptr;
+	const char* tail = nullptr;
+	int rc = sqlite3_prepare_v3(_db, sql.c_str(), sql.size() + 1,
+		SQLITE_PREPARE_PERSISTENT, &stmt, &tail);
+	if (SQLITE_OK != rc)
+		throw RuntimeException(TRACE_INFO,
+			"Bad SQL \"%s\": %s\n", sql.c_str(), sqlite3_errmsg(_db));
+	if (nullptr == stmt)
+		throw RuntimeException(TRACE_INFO,
+			"Expecting an SQL statement, got \"%s\"\n", sql.c_str());
+
+	while (tail and (' ' == *tail or '\t' == *tail or '\n' == *tail or
+	                 '\r' == *tail or ';' == *tail))
+		tail++;
+	if (tail and *tail)
+	{
+		sqlite3_finalize(stmt);
+		throw RuntimeException(TRACE_INFO,
+			"Expecting one SQL statement at a time, got \"%s\"\n",
+			sql.c_str());
+	}
+
+	_lru.emplace_front(sql, stmt);
+	_cache[sql] = _lru.begin();
+	while (_cache_size < _lru.size())
+	{
+		// The open cursor is always the most recently used, so this
+		// never finalizes it.
+		_cache.erase(_lru.back().first);
+		sqlite3_finalize(_lru.back().second);
+		_lru.pop_back();
+	}
+	return stmt;
+}
+
+/// Bind the Values, starting at `start`, to the `?` parameters.
+void SqliteStream::bind(sqlite3_stmt* stmt, const ValueSeq& args,
+                        size_t start)
+{
+	int nparams = sqlite3_bind_parameter_count(stmt);
+	if (args.size() - start != (size_t) nparams)
+		throw RuntimeException(TRACE_INFO,
+			"Expecting %d parameters, got %zu\n",
+			nparams, args.size() - start);
+
+	for (size_t i = start; i < args.size(); i++)
+	{
+		const ValuePtr& vp = args[i];
+		int idx = i - start + 1;
+		int rc;
+
+		double num = NAN;
+		if (NUMBER_NODE == vp->get_type())
+			num = strtod(HandleCast(vp)->get_name().c_str(), nullptr);
+		else if (vp->is_type(FLOAT_VALUE) and 1 == vp->size())
+			num = FloatValueCast(vp)->value()[0];
+
+		if (not isnan(num))
+		{
+			if (num == floor(num) and fabs(num) < 9.0e15)
+				rc = sqlite3_bind_int64(stmt, idx, (sqlite3_int64) num);
+			else
+				rc = sqlite3_bind_double(stmt, idx, num);
+		}
+		else if (vp->is_node())
+		{
+			const std::string& str = HandleCast(vp)->get_name();
+			rc = sqlite3_bind_text(stmt, idx, str.data(), str.size(),
+			                       SQLITE_TRANSIENT);
+		}
+		else if (vp->is_type(STRING_VALUE) and 1 == vp->size())
+		{
+			const std::string& str = StringValueCast(vp)->value()[0];
+			rc = sqlite3_bind_text(stmt, idx, str.data(), str.size(),
+			                       SQLITE_TRANSIENT);
+		}
+		else if (vp->is_type(LINK_VALUE) and 0 == vp->size())
+			rc = sqlite3_bind_null(stmt, idx);
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Can't use %s as an SQL parameter\n", vp->to_string().c_str());
+
+		if (SQLITE_OK != rc)
+			throw RuntimeException(TRACE_INFO,
+				"Can't bind parameter %d: %s\n", idx, sqlite3_errmsg(_db));
+	}
+}
+
+ValuePtr SqliteStream::query(const std::string& sql, const ValueSeq& args)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+
+	// Abandon the old cursor; a cached statement may be reused now.
+	if (_cursor) sqlite3_reset(_cursor);
+	_cursor = nullptr;
+
+	sqlite3_stmt* stmt = prepare(sql);
+	try
+	{
+		bind(stmt, args, 0);
+	}
+	catch (...)
+	{
+		sqlite3_clear_bindings(stmt);
+		throw;
+	}
+
+	// Queries are stepped by the reader.
+	if (0 < sqlite3_column_count(stmt))
+	{
+		_cursor = stmt;
+		_fresh = true;
+		return shared_from_this();
+	}
+
+	int rc;
+	while (SQLITE_ROW == (rc = sqlite3_step(stmt))) {}
+	sqlite3_reset(stmt);
+	if (SQLITE_DONE != rc)
+		throw RuntimeException(TRACE_INFO,
+			"Failed \"%s\": %s\n", sql.c_str(), sqlite3_errmsg(_db));
+
+	return createLinkValue(ValueSeq({
+		int_value(sqlite3_changes(_db)),
+		int_value(sqlite3_last_insert_rowid(_db))}));
+}
+
+// ==============================================================
+
+/// Doubles hold integers exactly only up to 2^53; past that, the
+/// digits are given as text, so that nothing is lost. SQLite turns
+/// them back into integers when they are compared with, or stored in,
+/// an INTEGER column.
+ValuePtr SqliteStream::int_value(int64_t num)
+{
+	static const int64_t EXACT = 1LL << 53;
+	if (-EXACT <= num and num <= EXACT)
+		return createFloatValue((double) num);
+	return createStringValue(std::to_string(num));
+}
+
+ValuePtr SqliteStream::row(sqlite3_stmt* stmt) const
+{
+	int ncols = sqlite3_column_count(stmt);
+	ValueSeq cols;
+	cols.reserve(ncols);
+	for (int i = 0; i < ncols; i++)
+	{
+		switch (sqlite3_column_type(stmt, i))
+		{
+			case SQLITE_INTEGER:
+				cols.emplace_back(int_value(sqlite3_column_int64(stmt, i)));
+				break;
+			case SQLITE_FLOAT:
+				cols.emplace_back(createFloatValue(
+					sqlite3_column_double(stmt, i)));
+				break;
+			case SQLITE_NULL:
+				cols.emplace_back(createLinkValue(ValueSeq()));
+				break;
+			default:
+			{
+				// Text and blobs. Ask for the bytes first; the size
+				// is only right after that.
+				const char* p = (const char*) sqlite3_column_blob(stmt, i);
+				int len = sqlite3_column_bytes(stmt, i);
+				cols.emplace_back(createStringValue(
+					std::string(p ? p : "", len)));
+			}
+		}
+	}
+	return createLinkValue(std::move(cols));
+}
+
+/// Step the cursor, and give the next batch of rows. Empty when
+/// there are no more rows, or no query.
+void SqliteStream::update() const
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	_value.clear();
+	if (nullptr == _cursor) return;
+
+	if (_fresh)
+	{
+		_fresh = false;
+		if (_names)
+		{
+			std::vector<std::string> names;
+			int ncols = sqlite3_column_count(_cursor);
+			for (int i = 0; i < ncols; i++)
+				names.emplace_back(sqlite3_column_name(_cursor, i));
+			_value.emplace_back(createStringValue(std::move(names)));
+		}
+	}
+
+	_value.reserve(_batch);
+	while (_value.size() < _batch)
+	{
+		int rc = sqlite3_step(_cursor);
+		if (SQLITE_ROW == rc)
+		{
+			_value.emplace_back(row(_cursor));
+			continue;
+		}
+
+		sqlite3_stmt* stmt = _cursor;
+		_cursor = nullptr;
+		sqlite3_reset(stmt);
+		if (SQLITE_DONE == rc) break;
+
+		_value.clear();
+		throw RuntimeException(TRACE_INFO,
+			"Failed reading \"%s\": %s\n", _uri.c_str(), sqlite3_errmsg(_db));
+	}
+}
+
+#endif // HAVE_SQLITE3
+
+// ==============================================================
+
+ValuePtr SqliteStream::describe(AtomSpace* as, bool silent)
+{
+	throw RuntimeException(TRACE_INFO, "Not implemeneted");
+	return Handle::UNDEFINED;
+}
+
+static std::string get_sql(const ValuePtr& vp)
+{
+	if (vp->is_node()) return HandleCast(vp)->get_name();
+	if (vp->is_type(STRING_VALUE) and 1 == vp->size())
+		return StringValueCast(vp)->value()[0];
+	throw RuntimeException(TRACE_INFO,
+		"Expecting SQL, got %s\n", vp->to_string().c_str());
+}
+
+/// Either the SQL alone, or a List of the SQL and the parameters.
+/// The members of the List are executed first.
+ValuePtr SqliteStream::write_out(AtomSpace* as, bool silent,
+                                 const Handle& cref)
+{
+	ValueSeq args;
+	if (LIST_LINK == cref->get_type())
+	{
+		for (const Handle& h : cref->getOutgoingSet())
+		{
+			if (not h->is_executable())
+			{
+				args.emplace_back(h);
+				continue;
+			}
+			ValuePtr vp = h->execute(as, silent);
+			if (nullptr == vp)
+				throw RuntimeException(TRACE_INFO,
+					"Expecting something from %s\n", h->to_string().c_str());
+			args.emplace_back(vp);
+		}
+	}
+	else if (cref->is_executable())
+	{
+		ValuePtr content = cref->execute(as, silent);
+		if (content and content->is_type(LINK_VALUE) and
+		    not content->is_type(LINK_STREAM_VALUE))
+			args = LinkValueCast(content)->value();
+		else if (content)
+			args.emplace_back(content);
+	}
+	else
+		args.emplace_back(cref);
+
+	if (args.empty())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting SQL, got %s\n", cref->to_string().c_str());
+
+	std::string sql = get_sql(args[0]);
+	args.erase(args.begin());
+	return query(sql, args);
+}
+
+// ==============================================================
+
+// Adds factory when library is loaded.
+DEFINE_VALUE_FACTORY(SQLITE_STREAM, createSqliteStream, std::string)
+DEFINE_VALUE_FACTORY(SQLITE_STREAM, createSqliteStream, Handle)
+
+// ====================================================================
+
+void opencog_sensory_sqlite_init(void)
+{
+	// Force shared lib ctors to run
+};
@@ -0,0 +1,134 @@
+/*
+ * opencog/atoms/sqlite/SqliteStream.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SQLITE_STREAM_H
+#define _OPENCOG_SQLITE_STREAM_H
+
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <opencog/atoms/sensory/OutputStream.h>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * SqliteStreams are cursors on an SQLite database file:
+ *    sqlite:///var/lib/facts.db
+ *    sqlite:///var/lib/facts.db?readonly&batch=500
+ * A query is given by writing the SQL, and any values for its `?`
+ * parameters:
+ *    (Item "SELECT name, age FROM people")
+ *    (List (Item "SELECT * FROM facts WHERE subj = ?") (Item "cat"))
+ * Reading then steps the cursor, and gives the next `batch` rows. Each
+ * row is a LinkValue holding one Value per column: a FloatValue for
+ * numbers, a StringValue for text and blobs, and an empty LinkValue
+ * for NULL. Integers too big for a double to hold exactly (beyond
+ * 2^53) are StringValues of their digits. An empty value means that
+ * all the rows have been read. Rows are not read ahead; a large result
+ * set is never held in memory.
+ *
+ * Statements that give no rows (INSERT, UPDATE, CREATE...) are run
+ * when written, and return a row of (changes, last_rowid). Writing a
+ * new query abandons the rest of the previous one.
+ *
+ * A query that has been partly read keeps its read transaction open,
+ * and so holds up checkpoints of the WAL, and, in rollback mode, any
+ * writer. The cursor is let go when the last row is read, or when the
+ * next statement is written.
+ *
+ * Prepared statements are kept, by SQL text, and reused when the same
+ * SQL is written again; the `cache` least recently used are kept.
+ *
+ * URL parameters:
+ *    ?batch=N     Rows per read; default 1000.
+ *    ?cache=N     Prepared statements kept; default 64.
+ *    ?readonly    Open read-only.
+ *    ?create      Create the file, if missing.
+ *    ?names       Begin each query with a StringValue of column names.
+ */
+class SqliteStream
+	: public OutputStream
+{
+private:
+	std::string _uri;
+	sqlite3* _db;
+	size_t _batch;
+	size_t _cache_size;
+	bool _names;
+
+	// Statement cache, most recently used first.
+	typedef std::pair<std::string, sqlite3_stmt*> Entry;
+	std::list<Entry> _lru;
+	std::unordered_map<std::string, std::list<Entry>::iterator> _cache;
+
+	// The open cursor, if any, and whether its header is still due.
+	mutable std::mutex _mtx;
+	mutable sqlite3_stmt* _cursor;
+	mutable bool _fresh;
+
+	void init(const std::string&);
+	sqlite3_stmt* prepare(const std::string&);
+	void bind(sqlite3_stmt*, const ValueSeq&, size_t);
+	ValuePtr row(sqlite3_stmt*) const;
+	static ValuePtr int_value(int64_t);
+
+protected:
+	virtual void update() const;
+
+public:
+	SqliteStream(const Handle&);
+	SqliteStream(const std::string&);
+	virtual ~SqliteStream();
+
+	virtual ValuePtr describe(AtomSpace*, bool);
+	virtual ValuePtr write_out(AtomSpace*, bool, const Handle&);
+
+	/// C++ API, same as writing the SQL, and then the parameters.
+	ValuePtr query(const std::string&, const ValueSeq& = ValueSeq());
+};
+
+typedef std::shared_ptr<SqliteStream> SqliteStreamPtr;
+static inline SqliteStreamPtr SqliteStreamCast(ValuePtr& a)
+	{ return std::dynamic_pointer_cast<SqliteStream>(a); }
+
+template<typename ... Type>
+static inline std::shared_ptr<SqliteStream> createSqliteStream(Type&&... args) {
+   return std::make_shared<SqliteStream>(std::forward<Type>(args)...);
+}
+
+/** @}*/
+} // namespace opencog
+
+extern "C" {
+void opencog_sensory_sqlite_init(void);
+};
+
+#endif // _OPENCOG_SQLITE_STREAM_H
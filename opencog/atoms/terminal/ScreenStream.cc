@@ -0,0 +1,678 @@
+/*
+ * opencog/atoms/terminal/ScreenStream.cc
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <sys/ioctl.h>
+
+#include <algorithm>
+#include <map>
+
+#include <errno.h>
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h> // for strerror()
+#include <unistd.h>
+#include <wchar.h>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/base/Link.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+#include <opencog/atoms/value/ValueFactory.h>
+
+#include <opencog/atoms/sensory-types/sensory_types.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include <opencog/atoms/sensory/SensoryNode.h>
+#include "ScreenStream.h"
+
+using namespace opencog;
+
+ScreenStream::ScreenStream(void)
+	: TerminalStream(SCREEN_STREAM, "")
+{
+	init_screen(0, 0, 20.0);
+}
+
+/// The size of the screen, and the frame rate, may be given as a
+/// FloatValue of (rows cols frames-per-second).
+ScreenStream::ScreenStream(const ValueSeq& seq)
+	: TerminalStream(SCREEN_STREAM, "")
+{
+	std::vector<double> dims({0, 0, 20.0});
+	if (0 < seq.size())
+	{
+		if (1 != seq.size() or not seq[0]->is_type(FLOAT_VALUE))
+			throw RuntimeException(TRACE_INFO,
+				"Expecting FloatValue of (rows cols fps), got %s\n",
+				seq[0]->to_string().c_str());
+
+		const std::vector<double>& fv(FloatValueCast(seq[0])->value());
+		for (size_t i = 0; i < fv.size() and i < 3; i++)
+			dims[i] = fv[i];
+	}
+	init_screen((size_t) dims[0], (size_t) dims[1], dims[2]);
+}
+
+/// Or, as a URL: screen://?rows=24&cols=80&fps=10
+ScreenStream::ScreenStream(const Handle& senso)
+	: TerminalStream(SCREEN_STREAM, "")
+{
+	if (SENSORY_NODE != senso->get_type())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting SensoryNode, got %s\n", senso->to_string().c_str());
+
+	const std::string& urlq = senso->get_name();
+	if (0 != urlq.compare(0, 9, "screen://"))
+		throw RuntimeException(TRACE_INFO,
+			"Unsupported URL \"%s\"\n", urlq.c_str());
+
+	double rows = 0;
+	double cols = 0;
+	double fps = 20.0;
+	std::map<std::string, std::string> params;
+	SensoryNode::split_query(urlq, params);
+	for (const auto& pr : params)
+	{
+		char* end;
+		double val = strtod(pr.second.c_str(), &end);
+		if (pr.second.empty() or *end or val < 0.0)
+			throw RuntimeException(TRACE_INFO,
+				"Expecting a number for \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+
+		if (0 == pr.first.compare("rows"))
+			rows = val;
+		else if (0 == pr.first.compare("cols"))
+			cols = val;
+		else if (0 == pr.first.compare("fps"))
+			fps = val;
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown URL parameter \"%s\" in \"%s\"\n",
+				pr.first.c_str(), urlq.c_str());
+	}
+	init_screen((size_t) rows, (size_t) cols, fps);
+}
+
+ScreenStream::~ScreenStream()
+{
+	stop_flusher();
+}
+
+/// Rows or cols of zero means to follow the size of the xterm window.
+void ScreenStream::init_screen(size_t rows, size_t cols, double fps)
+{
+	_rows = 0;
+	_cols = 0;
+	_fixed_size = (0 < rows and 0 < cols);
+	_trow = 0;
+	_tcol = 0;
+	_crow = 0;
+	_ccol = 0;
+	_dirty = false;
+	_repaint = true;
+	_stop = false;
+	_flusher = nullptr;
+
+	if (not (0.0 < fps)) fps = 20.0;
+	_frame = std::chrono::duration_cast<Clock::duration>(
+		std::chrono::duration<double>(1.0 / fps));
+	_last_frame = Clock::now() - _frame;
+
+	if (_fixed_size)
+		resize(rows, cols);
+	else if (not check_size())
+		resize(24, 80);
+
+	_flusher = new std::thread(&ScreenStream::flusher, this);
+}
+
+/// Stop the background thread. This must happen before the xterm
+/// file is closed, as that thread writes to it.
+void ScreenStream::stop_flusher(void) const
+{
+	ScreenStream* that = const_cast<ScreenStream*>(this);
+	std::lock_guard<std::mutex> slck(_stop_mtx);
+	if (nullptr == _flusher) return;
+	{
+		std::lock_guard<std::mutex> lck(that->_mtx);
+		that->_stop = true;
+	}
+	that->_cv.notify_all();
+	_flusher->join();
+	delete _flusher;
+	that->_flusher = nullptr;
+}
+
+void ScreenStream::halt(void) const
+{
+	stop_flusher();
+	TerminalStream::halt();
+}
+
+// ==============================================================
+// The screen buffer. All of these must be called with _mtx held.
+
+/// Change the size of the buffer, keeping what fits. The xterm is
+/// repainted in full at the next frame.
+void ScreenStream::resize(size_t rows, size_t cols)
+{
+	std::vector<Cell> cells(rows * cols, U" ");
+	for (size_t r = 0; r < std::min(rows, _rows); r++)
+	{
+		for (size_t c = 0; c < std::min(cols, _cols); c++)
+			cells[r * cols + c] = _cells[r * _cols + c];
+
+		// A wide character cut in half by the new right edge.
+		if (cols < _cols and _cells[r * _cols + cols].empty())
+			cells[r * cols + cols - 1] = U" ";
+	}
+
+	_cells.swap(cells);
+	_shown.assign(rows * cols, U" ");
+	_rows = rows;
+	_cols = cols;
+	if (_trow >= _rows) _trow = _rows - 1;
+	if (_tcol >= _cols) _tcol = 0;
+	_repaint = true;
+	_dirty = true;
+}
+
+/// Follow the size of the xterm window, unless a size was given.
+/// Returns false if the size is not known.
+bool ScreenStream::check_size(void)
+{
+	if (_fixed_size) return true;
+	if (nullptr == _fh) return false;
+
+	struct winsize ws;
+	if (ioctl(fileno(_fh), TIOCGWINSZ, &ws) or 0 == ws.ws_row or 0 == ws.ws_col)
+		return false;
+	if (ws.ws_row != _rows or ws.ws_col != _cols)
+		resize(ws.ws_row, ws.ws_col);
+	return true;
+}
+
+/// Decode UTF-8; bytes that don't decode become U+FFFD.
+static std::u32string decode(const std::string& str)
+{
+	std::u32string out;
+	size_t i = 0;
+	while (i < str.size())
+	{
+		unsigned char b = str[i];
+		size_t len = (b < 0x80) ? 1 : (0xC0 == (b & 0xE0)) ? 2 :
+			(0xE0 == (b & 0xF0)) ? 3 : (0xF0 == (b & 0xF8)) ? 4 : 0;
+		if (0 == len or i + len > str.size())
+		{
+			out.push_back(0xFFFD);
+			i++;
+			continue;
+		}
+		char32_t cp = (1 == len) ? b : (b & (0x7F >> len));
+		size_t k = 1;
+		for (; k < len and 0x80 == (str[i+k] & 0xC0); k++)
+			cp = (cp << 6) | (str[i+k] & 0x3F);
+		if (k < len)
+		{
+			out.push_back(0xFFFD);
+			i++;
+			continue;
+		}
+		out.push_back(cp);
+		i += len;
+	}
+	return out;
+}
+
+static void encode(char32_t cp, std::string& out)
+{
+	if (cp < 0x80)
+		out += (char) cp;
+	else if (cp < 0x800)
+	{
+		out += (char) (0xC0 | (cp >> 6));
+		out += (char) (0x80 | (cp & 0x3F));
+	}
+	else if (cp < 0x10000)
+	{
+		out += (char) (0xE0 | (cp >> 12));
+		out += (char) (0x80 | ((cp >> 6) & 0x3F));
+		out += (char) (0x80 | (cp & 0x3F));
+	}
+	else
+	{
+		out += (char) (0xF0 | (cp >> 18));
+		out += (char) (0x80 | ((cp >> 12) & 0x3F));
+		out += (char) (0x80 | ((cp >> 6) & 0x3F));
+		out += (char) (0x80 | (cp & 0x3F));
+	}
+}
+
+/// Control characters would move the xterm's cursor behind our back.
+static inline char32_t printable(char32_t cp)
+{
+	return (cp < 0x20 or (0x7F <= cp and cp < 0xA0)) ? U' ' : cp;
+}
+
+/// The number of columns the xterm gives a character: 0 for combining
+/// marks, 2 for wide (CJK, most emoji) and 1 otherwise. wcwidth()
+/// follows the locale, and the process may well be in the "C" locale,
+/// which knows nothing of these; so it is asked in a UTF-8 one.
+static size_t char_width(char32_t cp)
+{
+	cp = printable(cp);
+	if (cp < 0x300) return 1;
+	static locale_t utf8 = newlocale(LC_CTYPE_MASK, "C.UTF-8", (locale_t) 0);
+	if ((locale_t) 0 == utf8) return 1;
+	locale_t prev = uselocale(utf8);
+	int w = wcwidth((wchar_t) cp);
+	uselocale(prev);
+	return (w < 0) ? 1 : w;
+}
+
+// Combining marks past this many, on one cell, are dropped.
+#define MAX_MARKS 8
+
+/// Before a cell is written, blank the other half of the wide
+/// character it is part of, if any; the xterm would erase it anyway.
+void ScreenStream::take_cell(size_t r, size_t c)
+{
+	Cell* row = &_cells[r * _cols];
+	if (row[c].empty())
+		row[c-1] = U" ";
+	else if (c + 1 < _cols and row[c+1].empty())
+		row[c+1] = U" ";
+}
+
+void ScreenStream::blank(size_t r, size_t c)
+{
+	take_cell(r, c);
+	_cells[r * _cols + c] = U" ";
+}
+
+/// Write a character at a cell on the screen. A combining mark goes
+/// into the cell before; a wide character fills two cells, and is
+/// not written if the second one is off the screen. Returns the
+/// width of the character.
+size_t ScreenStream::put_char(size_t r, size_t c, char32_t cp)
+{
+	cp = printable(cp);
+	size_t w = char_width(cp);
+	Cell* row = &_cells[r * _cols];
+	if (0 == w)
+	{
+		if (0 == c or _cols < c) return 0;
+		size_t b = row[c-1].empty() ? c - 2 : c - 1;
+		if (row[b].size() <= MAX_MARKS) row[b].push_back(cp);
+		return 0;
+	}
+	if (_cols < c + w) return w;
+
+	take_cell(r, c);
+	row[c] = cp;
+	if (2 == w)
+	{
+		take_cell(r, c+1);
+		row[c+1].clear();
+	}
+	return w;
+}
+
+/// Place text at the given cell. It is cut off at the right edge;
+/// a newline continues at the same column, on the next row.
+void ScreenStream::put(size_t row, size_t col, const std::string& text)
+{
+	size_t r = row;
+	size_t c = col;
+	for (char32_t cp : decode(text))
+	{
+		if (U'\n' == cp) { r++; c = col; continue; }
+		if (r < _rows)
+			c += put_char(r, c, cp);
+		else
+			c += char_width(cp);
+	}
+	_dirty = true;
+}
+
+/// Fill a rectangle with text, wrapping at its right edge, and at
+/// newlines. Whatever is left of the rectangle is blanked, so that
+/// rewriting a region with shorter text leaves nothing behind.
+void ScreenStream::region(size_t row, size_t col,
+                          size_t height, size_t width,
+                          const std::string& text)
+{
+	if (0 == width or 0 == height) return;
+	std::u32string cps(decode(text));
+	size_t i = 0;
+	for (size_t r = row; r < row + height and r < _rows; r++)
+	{
+		size_t c = col;
+		for (; i < cps.size(); i++)
+		{
+			if (U'\n' == cps[i]) break;
+			size_t w = char_width(cps[i]);
+			if (width < w or (0 == w and c == col)) continue;
+			if (col + width < c + w) break;
+			if (c < _cols)
+				put_char(r, c, cps[i]);
+			c += w;
+		}
+		if (i < cps.size() and U'\n' == cps[i]) i++;
+		for (; c < col + width and c < _cols; c++)
+			blank(r, c);
+	}
+	_dirty = true;
+}
+
+void ScreenStream::clear(size_t row, size_t col, size_t height, size_t width)
+{
+	for (size_t r = row; r < row + height and r < _rows; r++)
+		for (size_t c = col; c < col + width and c < _cols; c++)
+			blank(r, c);
+	_dirty = true;
+}
+
+/// Print at the text cursor, as a terminal would: wrap at the right
+/// edge, and scroll up at the bottom.
+void ScreenStream::print(const std::string& text)
+{
+	for (char32_t cp : decode(text))
+	{
+		if (U'\r' == cp) { _tcol = 0; continue; }
+		size_t w = (U'\t' == cp) ? 1 : char_width(cp);
+		if (U'\n' != cp and _tcol + w <= _cols)
+		{
+			if (U'\t' == cp)
+			{
+				size_t stop = std::min(_cols, (_tcol + 8) & ~7UL);
+				while (_tcol < stop) blank(_trow, _tcol++);
+				continue;
+			}
+			_tcol += put_char(_trow, _tcol, cp);
+			continue;
+		}
+
+		// Newline, or a character that doesn't fit.
+		_tcol = 0;
+		if (_trow + 1 < _rows)
+			_trow++;
+		else
+		{
+			std::move(_cells.begin() + _cols, _cells.end(), _cells.begin());
+			std::fill(_cells.end() - _cols, _cells.end(), U" ");
+		}
+		if (U'\n' != cp and w <= _cols)
+			_tcol += put_char(_trow, _tcol, cp);
+	}
+	_dirty = true;
+}
+
+// ==============================================================
+// Rendering
+
+/// Build the escape sequences that bring the xterm from what it shows
+/// to what the buffer holds. Changed cells that are close together
+/// are sent as one run, rewriting the few unchanged cells between
+/// them, as that is shorter than moving the cursor.
+std::string ScreenStream::render(void)
+{
+	std::string out;
+	if (_repaint)
+	{
+		// Hide the cursor, and start from a blank screen.
+		out += "\033[?25l\033[H\033[2J";
+		std::fill(_shown.begin(), _shown.end(), U" ");
+		_crow = 0;
+		_ccol = 0;
+		_repaint = false;
+	}
+
+	static const size_t max_gap = 4;
+	for (size_t r = 0; r < _rows; r++)
+	{
+		const Cell* want = &_cells[r * _cols];
+		Cell* have = &_shown[r * _cols];
+		size_t c = 0;
+		while (c < _cols)
+		{
+			if (want[c] == have[c]) { c++; continue; }
+
+			// Find the end of the run.
+			size_t end = c + 1;
+			size_t last = c;
+			while (end < _cols and end - last <= max_gap)
+			{
+				if (want[end] != have[end]) last = end;
+				end++;
+			}
+
+			// Runs start and end on whole wide characters.
+			if (want[c].empty()) c--;
+			if (last + 1 < _cols and want[last+1].empty()) last++;
+
+			if (_crow != r or _ccol != c)
+				out += "\033[" + std::to_string(r+1) + ";" +
+					std::to_string(c+1) + "H";
+			for (size_t k = c; k <= last; k++)
+			{
+				for (char32_t cp : want[k])
+					encode(cp, out);
+				have[k] = want[k];
+			}
+
+			// At the right edge, the xterm cursor waits to wrap, and
+			// its position is not to be trusted.
+			_crow = r;
+			_ccol = (last + 1 < _cols) ? last + 1 : _cols;
+			c = last + 1;
+		}
+	}
+	return out;
+}
+
+/// Send a frame whenever something has changed, but no more often
+/// than the frame rate. Changes made while waiting go into the same
+/// frame; so a burst of updates costs one frame. When idle, the size
+/// of the xterm window is checked every SIZE_POLL, and the screen is
+/// repainted when it changes. (SIGWINCH can't be used for this: it is
+/// only sent for a controlling terminal, and the xterm's PTY is not
+/// ours.)
+#define SIZE_POLL std::chrono::milliseconds(250)
+
+void ScreenStream::flusher(void)
+{
+	std::unique_lock<std::mutex> lck(_mtx);
+	while (true)
+	{
+		if (not _cv.wait_for(lck, SIZE_POLL,
+		                     [this]{ return _stop or _dirty; }))
+		{
+			check_size();
+			if (not _dirty) continue;
+		}
+		if (_stop) break;
+
+		Clock::time_point next = _last_frame + _frame;
+		if (Clock::now() < next and
+		    _cv.wait_until(lck, next, [this]{ return _stop; }))
+			break;
+
+		check_size();
+		std::string out(render());
+		_dirty = false;
+		_last_frame = Clock::now();
+		if (out.empty() or nullptr == _fh) continue;
+
+		// Write around stdio, which the reader holds.
+		int fd = fileno(_fh);
+		lck.unlock();
+		const char* p = out.data();
+		size_t left = out.size();
+		while (left)
+		{
+			ssize_t rc = write(fd, p, left);
+			if (0 > rc)
+			{
+				if (EINTR == errno) continue;
+				SENSORY_ERROR("ScreenStream: write(): %s", strerror(errno));
+				break;
+			}
+			p += rc;
+			left -= rc;
+		}
+		SENSORY_TRACE("ScreenStream: sent %zu bytes", out.size());
+		lck.lock();
+	}
+}
+
+// ==============================================================
+// Writing
+
+/// Plain text goes to the text cursor.
+void ScreenStream::do_write(const std::string& str)
+{
+	if (nullptr == _fh)
+		throw RuntimeException(TRACE_INFO,
+			"Screen stream not open\n");
+
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		print(str);
+	}
+	_cv.notify_one();
+}
+
+/// Flatten a command into strings; numbers are printed.
+static void flatten(const ValuePtr& vp, std::vector<std::string>& out)
+{
+	if (vp->is_type(STRING_VALUE))
+	{
+		for (const std::string& str : StringValueCast(vp)->value())
+			out.push_back(str);
+	}
+	else if (vp->is_type(FLOAT_VALUE))
+	{
+		for (double d : FloatValueCast(vp)->value())
+			out.push_back(std::to_string(d));
+	}
+	else if (vp->is_node())
+		out.push_back(HandleCast(vp)->get_name());
+	else if (vp->is_type(LINK_VALUE))
+	{
+		for (const ValuePtr& v : LinkValueCast(vp)->value())
+			flatten(v, out);
+	}
+	else if (vp->is_link())
+	{
+		for (const Handle& h : HandleCast(vp)->getOutgoingSet())
+			flatten(h, out);
+	}
+}
+
+static size_t get_num(const std::vector<std::string>& args, size_t i)
+{
+	char* end;
+	double d = strtod(args[i].c_str(), &end);
+	if (args[i].empty() or *end or d < 0.0)
+		throw RuntimeException(TRACE_INFO,
+			"Expecting a number for %s, got \"%s\"\n",
+			args[0].c_str(), args[i].c_str());
+	return (size_t) d;
+}
+
+/// The drawing commands:
+///    put row col text
+///    region row col height width text
+///    clear [row col height width]
+/// Returns false if this is not one of them.
+bool ScreenStream::run_cmd(const std::vector<std::string>& args)
+{
+	if (0 == args.size()) return false;
+	const std::string& cmd = args[0];
+
+	std::lock_guard<std::mutex> lck(_mtx);
+	if (0 == cmd.compare("put"))
+	{
+		if (args.size() < 3)
+			throw RuntimeException(TRACE_INFO,
+				"Expecting put row col text\n");
+		std::string text;
+		for (size_t i = 3; i < args.size(); i++) text += args[i];
+		put(get_num(args, 1), get_num(args, 2), text);
+	}
+	else if (0 == cmd.compare("region"))
+	{
+		if (args.size() < 5)
+			throw RuntimeException(TRACE_INFO,
+				"Expecting region row col height width text\n");
+		std::string text;
+		for (size_t i = 5; i < args.size(); i++) text += args[i];
+		region(get_num(args, 1), get_num(args, 2),
+		       get_num(args, 3), get_num(args, 4), text);
+	}
+	else if (0 == cmd.compare("clear"))
+	{
+		if (1 == args.size())
+		{
+			clear(0, 0, _rows, _cols);
+			_trow = 0;
+			_tcol = 0;
+		}
+		else if (5 == args.size())
+			clear(get_num(args, 1), get_num(args, 2),
+			      get_num(args, 3), get_num(args, 4));
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Expecting clear [row col height width]\n");
+	}
+	else
+		return false;
+
+	_cv.notify_one();
+	return true;
+}
+
+void ScreenStream::prt_value(const ValuePtr& content)
+{
+	if (nullptr == _fh)
+		throw RuntimeException(TRACE_INFO,
+			"Screen stream not open\n");
+
+	// Only lists can be commands; a lone (Item "clear") is text.
+	if (content->is_type(LINK_VALUE) or LIST_LINK == content->get_type())
+	{
+		std::vector<std::string> args;
+		flatten(content, args);
+		if (run_cmd(args)) return;
+	}
+	TerminalStream::prt_value(content);
+}
+
+// ==============================================================
+
+// Adds factory when library is loaded.
+DEFINE_VALUE_FACTORY(SCREEN_STREAM, createScreenStream)
+DEFINE_VALUE_FACTORY(SCREEN_STREAM, createScreenStream, ValueSeq)
+DEFINE_VALUE_FACTORY(SCREEN_STREAM, createScreenStream, Handle)
@@ -0,0 +1,131 @@
+/*
+ * opencog/atoms/terminal/ScreenStream.h
+ *
+ * Copyright (C) 2024 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SCREEN_STREAM_H
+#define _OPENCOG_SCREEN_STREAM_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TerminalStream.h"
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * ScreenStreams are TerminalStreams that keep a copy of the screen,
+ * one character per cell. Writes change the copy; a background thread
+ * brings the xterm up to date, no more than a fixed number of times a
+ * second, sending only the cells that changed since the last frame.
+ * A status display that is rewritten in full on every update thus
+ * costs only as much as what actually changed.
+ *
+ * Writing a (List (Item "put") (Number row) (Number col) (Item text))
+ * places text at a given cell; "region" and "clear" fill and blank
+ * rectangles. Anything else is printed at a text cursor, as on a
+ * plain terminal. Rows and columns count from zero. Wide characters
+ * take two cells, and combining marks go into the cell before them,
+ * as wcwidth() says.
+ */
+class ScreenStream
+	: public TerminalStream
+{
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// What the screen should look like, and what the xterm is
+	// believed to be showing. A cell holds a code point, and any
+	// combining marks after it. The cell to the right of a wide
+	// character is empty.
+	typedef std::u32string Cell;
+	std::mutex _mtx;
+	std::vector<Cell> _cells;
+	std::vector<Cell> _shown;
+	size_t _rows;
+	size_t _cols;
+	bool _fixed_size;
+
+	// Text cursor, for plain writes.
+	size_t _trow;
+	size_t _tcol;
+
+	// Where the xterm cursor is, or _cols if not known.
+	size_t _crow;
+	size_t _ccol;
+
+	bool _dirty;
+	bool _repaint;
+	bool _stop;
+	std::condition_variable _cv;
+	Clock::duration _frame;
+	Clock::time_point _last_frame;
+	std::thread* _flusher;
+	mutable std::mutex _stop_mtx;
+
+	void init_screen(size_t, size_t, double);
+	void stop_flusher(void) const;
+	void flusher(void);
+	void resize(size_t, size_t);
+	bool check_size(void);
+	std::string render(void);
+
+	void take_cell(size_t, size_t);
+	void blank(size_t, size_t);
+	size_t put_char(size_t, size_t, char32_t);
+	void put(size_t, size_t, const std::string&);
+	void region(size_t, size_t, size_t, size_t, const std::string&);
+	void clear(size_t, size_t, size_t, size_t);
+	void print(const std::string&);
+	bool run_cmd(const std::vector<std::string>&);
+
+protected:
+	virtual void halt(void) const;
+	virtual void do_write(const std::string&);
+	virtual void prt_value(const ValuePtr&);
+
+public:
+	ScreenStream(void);
+	ScreenStream(const ValueSeq&);
+	ScreenStream(const Handle&);
+	virtual ~ScreenStream();
+};
+
+typedef std::shared_ptr<ScreenStream> ScreenStreamPtr;
+static inline ScreenStreamPtr ScreenStreamCast(ValuePtr& a)
+	{ return std::dynamic_pointer_cast<ScreenStream>(a); }
+
+template<typename ... Type>
+static inline std::shared_ptr<ScreenStream> createScreenStream(Type&&... args) {
+   return std::make_shared<ScreenStream>(std::forward<Type>(args)...);
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_SCREEN_STREAM_H
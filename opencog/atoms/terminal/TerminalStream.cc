@@ -39,6 +39,8 @@
 #include <opencog/atoms/value/ValueFactory.h>
 
 #include <opencog/atoms/sensory-types/sensory_types.h>
+#include <opencog/atoms/sensory/SensoryLog.h>
+#include <opencog/atoms/sensory/Spawn.h>
 #include "TerminalStream.h"
 
 using namespace opencog;
@@ -78,8 +80,10 @@ void TerminalStream::halt(void) const
 		fclose (_fh);
 	_fh = nullptr;
 
+	// The xterm is our child, so its pid can't have been reused,
+	// even if it has exited already.
 	if (_xterm_pid)
-		kill (_xterm_pid, SIGKILL);
+		reap_process(_xterm_pid);
 	_xterm_pid= 0;
 
 	_value.clear();
@@ -113,23 +117,17 @@ void TerminalStream::init(void)
 		throw RuntimeException(TRACE_INFO, "Can't get PTY name %d %s",
 			errno, strerror(errno));
 
-	printf("Opened %s\n", my_ptsname);
+	SENSORY_INFO("Opened %s", my_ptsname);
 
-	// Build arguments for xterm
+	// Build arguments for xterm. It gets the PTY as fd 3.
 	std::string ccn = "-S";
 	ccn += my_ptsname;
-	ccn += "/" + std::to_string(fd);
+	ccn += "/3";
 
-	// Insane old-school hackery
-	_xterm_pid = fork();
-	if (-1 == _xterm_pid)
-		throw RuntimeException(TRACE_INFO, "Failed to fork %d %s",
-			errno, strerror(errno));
-
-	if (0 == _xterm_pid)
-		execl("/usr/bin/xterm", "xterm", ccn.c_str(), (char *) NULL);
+	// posix_spawn(), instead of forking the entire AtomSpace.
+	_xterm_pid = spawn_process({"/usr/bin/xterm", ccn}, {{fd, 3}});
 
-	printf("Created xterm pid=%d\n", _xterm_pid);
+	SENSORY_INFO("Created xterm pid=%d", _xterm_pid);
 
 	// Hmm. Seems like the right thing to do is to close the terminal
 	// created by open_pt() above, and open another, as a slave.
@@ -45,7 +45,7 @@ class TerminalStream
 protected:
 	TerminalStream(Type t, const std::string&);
 	void init(void);
-	void halt(void) const;
+	virtual void halt(void) const;
 	virtual void update() const;
 
 	Handle _description;